@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Shared helpers for the audio-capture-bench scenarios.
+class BenchTimer {
+public:
+    BenchTimer() : m_start(std::chrono::steady_clock::now()) {}
+
+    double elapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+inline int64_t benchNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// One result row: scenario name plus flat key/value fields.
+class BenchRecord {
+public:
+    explicit BenchRecord(const std::string& scenario) : m_scenario(scenario) {}
+
+    BenchRecord& set(const std::string& key, const std::string& value);
+    BenchRecord& set(const std::string& key, const char* value) { return set(key, std::string(value)); }
+    BenchRecord& set(const std::string& key, double value);
+    BenchRecord& set(const std::string& key, int64_t value);
+    BenchRecord& set(const std::string& key, uint64_t value) { return set(key, static_cast<int64_t>(value)); }
+    BenchRecord& set(const std::string& key, int value) { return set(key, static_cast<int64_t>(value)); }
+    BenchRecord& set(const std::string& key, bool value);
+
+    std::string toJson() const;
+    std::string toText() const;
+    // True when a pass/fail field (ok, bit_exact, length_ok) is false.
+    bool failed() const;
+
+private:
+    std::string m_scenario;
+    // Values are stored pre-encoded as JSON.
+    std::vector<std::pair<std::string, std::string>> m_fields;
+};
+
+struct BenchOptions {
+    // Shorter runs for CI smoke checks.
+    bool quick = false;
+    // Scratch directory for the files the writer benchmarks produce.
+    std::string workDir;
+};
+
+class BenchReport {
+public:
+    void add(const BenchRecord& record);
+    std::string toJson() const;
+    // The records that failed their checks, in the order added.
+    std::vector<const BenchRecord*> failures() const;
+
+private:
+    std::vector<BenchRecord> m_records;
+};
+
+// Latency samples (ns) reduced to the percentiles we track.
+struct LatencySummary {
+    size_t count = 0;
+    double p50Us = 0;
+    double p90Us = 0;
+    double p99Us = 0;
+    double p999Us = 0;
+    double maxUs = 0;
+
+    static LatencySummary fromSamples(std::vector<int64_t>& samplesNs);
+    void addTo(BenchRecord& record) const;
+};
+
+void runConversionBench(BenchReport& report, const BenchOptions& options);
+void runResamplerBench(BenchReport& report, const BenchOptions& options);
+void runWriterBench(BenchReport& report, const BenchOptions& options);
+void runCaptureLoopBench(BenchReport& report, const BenchOptions& options);
+void runLatencyBench(BenchReport& report, const BenchOptions& options);
+void runScalingBench(BenchReport& report, const BenchOptions& options);
+void runLoggingBench(BenchReport& report, const BenchOptions& options);
+void runBufferPoolBench(BenchReport& report, const BenchOptions& options);
+void runRealtimeBench(BenchReport& report, const BenchOptions& options);
+void runClockDriftBench(BenchReport& report, const BenchOptions& options);
+void runSilenceBench(BenchReport& report, const BenchOptions& options);
+void runFlacBench(BenchReport& report, const BenchOptions& options);
+void runCodecBench(BenchReport& report, const BenchOptions& options);
+void runVadBench(BenchReport& report, const BenchOptions& options);
+void runSegmentBench(BenchReport& report, const BenchOptions& options);
+void runFanoutBench(BenchReport& report, const BenchOptions& options);
+void runSharedMemoryBench(BenchReport& report, const BenchOptions& options);
+void runStreamBench(BenchReport& report, const BenchOptions& options);
+void runMultichannelBench(BenchReport& report, const BenchOptions& options);
+void runTypedPipelineBench(BenchReport& report, const BenchOptions& options);
@@ -0,0 +1,130 @@
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+static std::string quote(const std::string &text) {
+  std::string out = "\"";
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    default:
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+BenchRecord &BenchRecord::set(const std::string &key,
+                              const std::string &value) {
+  m_fields.emplace_back(key, quote(value));
+  return *this;
+}
+
+BenchRecord &BenchRecord::set(const std::string &key, double value) {
+  char buffer[64];
+  if (std::isfinite(value))
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+  else
+    snprintf(buffer, sizeof(buffer), "null");
+  m_fields.emplace_back(key, buffer);
+  return *this;
+}
+
+BenchRecord &BenchRecord::set(const std::string &key, int64_t value) {
+  m_fields.emplace_back(key, std::to_string(value));
+  return *this;
+}
+
+BenchRecord &BenchRecord::set(const std::string &key, bool value) {
+  m_fields.emplace_back(key, value ? "true" : "false");
+  return *this;
+}
+
+std::string BenchRecord::toJson() const {
+  std::string out = "{\"scenario\": " + quote(m_scenario);
+  for (const auto &field : m_fields)
+    out += ", " + quote(field.first) + ": " + field.second;
+  return out + "}";
+}
+
+std::string BenchRecord::toText() const {
+  std::string out = m_scenario;
+  for (const auto &field : m_fields)
+    out += " " + field.first + "=" + field.second;
+  return out;
+}
+
+bool BenchRecord::failed() const {
+  for (const auto &field : m_fields) {
+    if ((field.first == "ok" || field.first == "bit_exact" ||
+         field.first == "length_ok") &&
+        field.second == "false")
+      return true;
+  }
+  return false;
+}
+
+void BenchReport::add(const BenchRecord &record) {
+  m_records.push_back(record);
+  std::cerr << "  " << record.toText() << std::endl;
+}
+
+std::vector<const BenchRecord *> BenchReport::failures() const {
+  std::vector<const BenchRecord *> failed;
+  for (const BenchRecord &record : m_records) {
+    if (record.failed())
+      failed.push_back(&record);
+  }
+  return failed;
+}
+
+std::string BenchReport::toJson() const {
+  std::string out = "{\n  \"benchmark\": \"audio-capture-bench\",\n";
+  out += "  \"schema_version\": 1,\n";
+  out += "  \"timestamp\": " + std::to_string(static_cast<int64_t>(time(nullptr))) + ",\n";
+  out += "  \"results\": [\n";
+  for (size_t i = 0; i < m_records.size(); ++i) {
+    out += "    " + m_records[i].toJson();
+    out += i + 1 < m_records.size() ? ",\n" : "\n";
+  }
+  return out + "  ]\n}\n";
+}
+
+LatencySummary LatencySummary::fromSamples(std::vector<int64_t> &samplesNs) {
+  LatencySummary summary;
+  summary.count = samplesNs.size();
+  if (samplesNs.empty())
+    return summary;
+
+  std::sort(samplesNs.begin(), samplesNs.end());
+  auto at = [&](double quantile) {
+    size_t index = static_cast<size_t>(quantile * (samplesNs.size() - 1));
+    return samplesNs[index] / 1000.0;
+  };
+  summary.p50Us = at(0.50);
+  summary.p90Us = at(0.90);
+  summary.p99Us = at(0.99);
+  summary.p999Us = at(0.999);
+  summary.maxUs = samplesNs.back() / 1000.0;
+  return summary;
+}
+
+void LatencySummary::addTo(BenchRecord &record) const {
+  record.set("latency_samples", static_cast<int64_t>(count))
+      .set("latency_p50_us", p50Us)
+      .set("latency_p90_us", p90Us)
+      .set("latency_p99_us", p99Us)
+      .set("latency_p999_us", p999Us)
+      .set("latency_max_us", maxUs);
+}
@@ -0,0 +1,139 @@
+#include "AudioSink.h"
+#include "Bench.h"
+#include "DiskWriter.h"
+#include "Metrics.h"
+#include "SyntheticSource.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// A real-time synthetic stream whose sink stalls periodically, as a disk
+// does under contention, followed by a calm phase. Shows how many packets a
+// fixed pool drops and how the auto-tuner grows through the stalls and gives
+// the memory back afterwards.
+static constexpr uint32_t FRAMES_PER_PACKET = 480;
+static constexpr size_t MAX_BATCH_PACKETS = 8;
+static constexpr int READY_TIMEOUT_MS = 100;
+static constexpr int STALL_MS = 150;
+static constexpr int STALL_PERIOD_MS = 1000;
+static constexpr double PHASE_SECONDS = 3.0;
+static constexpr double QUICK_PHASE_SECONDS = 2.0;
+
+// Discards audio; while |stalling| is set, blocks for STALL_MS once every
+// STALL_PERIOD_MS.
+class StallingSink : public AudioSink {
+public:
+  explicit StallingSink(const std::atomic<bool> &stalling)
+      : m_stalling(stalling), m_nextStall(benchNowNs()) {}
+
+  bool initialize() override { return true; }
+  bool flush() override { return true; }
+  bool finalize() override { return true; }
+
+  void write(const uint8_t *, uint32_t) override {
+    int64_t now = benchNowNs();
+    if (!m_stalling.load(std::memory_order_relaxed) || now < m_nextStall)
+      return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(STALL_MS));
+    m_nextStall = now + int64_t(STALL_PERIOD_MS) * 1000000;
+    ++m_stalls;
+  }
+
+  uint64_t stalls() const { return m_stalls; }
+
+private:
+  const std::atomic<bool> &m_stalling;
+  int64_t m_nextStall;
+  uint64_t m_stalls = 0;
+};
+
+static void runCase(BenchReport &report, const char *name,
+                    const BufferPoolConfig &poolConfig, double phaseSeconds) {
+  SyntheticSourceConfig config;
+  config.signal = SyntheticSourceConfig::Signal::Noise;
+  config.framesPerPacket = FRAMES_PER_PACKET;
+  SyntheticSource source(config);
+
+  std::atomic<bool> stalling{true};
+  StallingSink sink(stalling);
+  StreamMetrics metrics;
+  DiskWriter writer(&sink, poolConfig);
+  writer.setMetrics(&metrics);
+  writer.start();
+  if (!source.open())
+    return;
+
+  // Same loop as AudioCapture::audioThread().
+  std::atomic<bool> stop{false};
+  std::thread capture([&]() {
+    std::vector<uint8_t> scratch(source.maxPacketBytes() * MAX_BATCH_PACKETS);
+    while (!stop.load(std::memory_order_relaxed)) {
+      if (source.waitReady(READY_TIMEOUT_MS))
+        writer.readFrom(source, scratch.data(), scratch.size());
+    }
+  });
+
+  size_t peakBlocks = writer.pool().blockCount();
+  auto sample = [&](double seconds) {
+    BenchTimer timer;
+    while (timer.elapsedSeconds() < seconds) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      peakBlocks = std::max(peakBlocks, writer.pool().blockCount());
+    }
+  };
+  // The first stall starts with the first write; later ones show whether
+  // the pool adapted to it.
+  sample(0.9 * STALL_PERIOD_MS / 1000.0);
+  uint64_t firstStallOverruns = writer.overruns();
+  sample(phaseSeconds - 0.9 * STALL_PERIOD_MS / 1000.0);
+  stalling = false;
+  size_t stallBlocks = writer.pool().blockCount();
+  sample(phaseSeconds);
+
+  stop = true;
+  capture.join();
+  writer.stop();
+  source.close();
+
+  const LatencyHistogram &latency = metrics.captureToDiskLatency();
+  BenchRecord record("buffer_pool");
+  record.set("pool", name)
+      .set("block_bytes", static_cast<int64_t>(poolConfig.blockSize))
+      .set("blocks_start", static_cast<int64_t>(poolConfig.blockCount))
+      .set("blocks_peak", static_cast<int64_t>(peakBlocks))
+      .set("blocks_after_stalls", static_cast<int64_t>(stallBlocks))
+      .set("blocks_end", static_cast<int64_t>(writer.pool().blockCount()))
+      .set("locked", writer.pool().locked())
+      .set("stalls", sink.stalls())
+      .set("first_stall_overruns", firstStallOverruns)
+      .set("later_overruns", writer.overruns() - firstStallOverruns)
+      .set("dropped_bytes", writer.droppedBytes())
+      .set("high_water_bytes", static_cast<int64_t>(writer.highWaterMark()))
+      .set("grows", writer.poolGrows())
+      .set("shrinks", writer.poolShrinks())
+      .set("latency_p50_us", latency.quantileNs(0.50) / 1000.0)
+      .set("latency_p99_us", latency.quantileNs(0.99) / 1000.0)
+      .set("latency_max_us", latency.maxNs() / 1000.0);
+  report.add(record);
+}
+
+void runBufferPoolBench(BenchReport &report, const BenchOptions &options) {
+  double phaseSeconds = options.quick ? QUICK_PHASE_SECONDS : PHASE_SECONDS;
+
+  // One 10 ms packet per 4 KiB block.
+  BufferPoolConfig small;
+  small.blockCount = 4;
+  small.blockSize = 4096;
+  runCase(report, "fixed_small", small, phaseSeconds);
+
+  BufferPoolConfig large = small;
+  large.blockCount = 64;
+  runCase(report, "fixed_large", large, phaseSeconds);
+
+  BufferPoolConfig tuned = small;
+  tuned.autoTune = true;
+  tuned.tuneIntervalMs = 100;
+  tuned.stableIntervals = 10;
+  runCase(report, "auto_tuned", tuned, phaseSeconds);
+}
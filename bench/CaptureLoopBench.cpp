@@ -0,0 +1,76 @@
+#include "Bench.h"
+#include "SyntheticSource.h"
+#include <ctime>
+#include <thread>
+#include <vector>
+
+// Compares the old fixed-interval polling capture loop against sleeping on
+// the source's readiness. Latency is measured from the capture time of the
+// newest frame a read() returned to the moment the loop had it in hand.
+static constexpr uint32_t FRAMES_PER_PACKET = 480;
+static constexpr int POLL_INTERVAL_MS = 5;
+static constexpr int READY_TIMEOUT_MS = 100;
+static constexpr size_t MAX_BATCH_PACKETS = 8;
+static constexpr double RUN_SECONDS = 3.0;
+static constexpr double QUICK_RUN_SECONDS = 1.0;
+
+enum class LoopKind { SleepPoll, Event };
+
+static void runLoop(BenchReport &report, LoopKind kind, double seconds) {
+  SyntheticSourceConfig config;
+  config.framesPerPacket = FRAMES_PER_PACKET;
+  SyntheticSource source(config);
+  if (!source.open())
+    return;
+
+  std::vector<uint8_t> buffer(source.maxPacketBytes() * MAX_BATCH_PACKETS);
+  std::vector<int64_t> latencies;
+  latencies.reserve(static_cast<size_t>(
+      seconds * config.format.sampleRate / FRAMES_PER_PACKET + 16));
+  uint64_t wakeups = 0;
+  uint64_t reads = 0;
+
+  auto handle = [&]() {
+    source.read(buffer.data(), buffer.size());
+    auto ready = source.frameTime(source.framesGenerated());
+    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            PacketTimer::Clock::now() - ready)
+                            .count());
+    ++reads;
+  };
+
+  std::clock_t cpuStart = std::clock();
+  BenchTimer timer;
+  while (timer.elapsedSeconds() < seconds) {
+    ++wakeups;
+    if (kind == LoopKind::SleepPoll) {
+      while (source.waitReady(0))
+        handle();
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    } else if (source.waitReady(READY_TIMEOUT_MS)) {
+      handle();
+    }
+  }
+  double elapsed = timer.elapsedSeconds();
+  double cpuPercent =
+      100.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC / elapsed;
+  uint64_t frames = source.framesGenerated();
+  source.close();
+
+  BenchRecord record("capture_loop_wakeups");
+  record.set("loop", kind == LoopKind::SleepPoll ? "sleep_poll_5ms" : "event")
+      .set("seconds", elapsed)
+      .set("wakeups", wakeups)
+      .set("wakeups_per_s", wakeups / elapsed)
+      .set("reads", reads)
+      .set("frames_per_read", reads ? double(frames) / reads : 0.0)
+      .set("cpu_percent", cpuPercent);
+  LatencySummary::fromSamples(latencies).addTo(record);
+  report.add(record);
+}
+
+void runCaptureLoopBench(BenchReport &report, const BenchOptions &options) {
+  double seconds = options.quick ? QUICK_RUN_SECONDS : RUN_SECONDS;
+  runLoop(report, LoopKind::SleepPoll, seconds);
+  runLoop(report, LoopKind::Event, seconds);
+}
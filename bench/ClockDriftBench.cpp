@@ -0,0 +1,148 @@
+#include "Bench.h"
+#include "ClockTracker.h"
+#include "SyntheticSource.h"
+#include "WavWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Long recordings from two devices whose clocks disagree: a 48 kHz float
+// "speaker" stream and a 44.1 kHz int16 "mic" stream, each with an injected
+// skew against the host clock. The sources stamp packets from a virtual host
+// clock, so an hour of drift replays in seconds. The mic is written at 48 kHz
+// with and without drift correction against the speaker clock; aligned files
+// end with the same number of frames.
+static constexpr double FULL_SECONDS = 3600.0;
+static constexpr double QUICK_SECONDS = 300.0;
+static constexpr double SPEAKER_SKEW_PPM = -50.0;
+static constexpr double MIC_SKEW_PPM = 250.0;
+static constexpr uint32_t OUTPUT_RATE = 48000;
+// Timestamps scatter uniformly by this much either way, as scheduling noise
+// would.
+static constexpr int64_t JITTER_NS = 200000;
+// Until the clock fits lock (ClockTracker::LOCK_SPAN_S) the drift goes
+// unseen; the error found then is steered out within this time.
+static constexpr double SETTLE_SECONDS = 10.0;
+
+namespace {
+
+struct Stream {
+  SyntheticSource source;
+  ClockTracker clock;
+  std::vector<uint8_t> packet;
+  size_t size = 0;
+  BlockTimestamp time;
+  uint64_t frames = 0;
+
+  explicit Stream(const SyntheticSourceConfig &config)
+      : source(config), clock(config.format.sampleRate),
+        packet(source.maxPacketBytes()) {}
+
+  // Reads the next packet; false at end of stream.
+  bool next(uint32_t &noise) {
+    size = source.read(packet.data(), packet.size());
+    time = source.lastTimestamp();
+    noise = noise * 1664525u + 1013904223u;
+    time.hostTimeNs += int64_t(noise >> 8) % (2 * JITTER_NS + 1) - JITTER_NS;
+    return size > 0;
+  }
+};
+
+SyntheticSourceConfig streamConfig(uint32_t rate, uint16_t channels,
+                                   SampleFormat format, double skewPpm,
+                                   double seconds) {
+  SyntheticSourceConfig config;
+  config.format.sampleRate = rate;
+  config.format.channels = channels;
+  config.format.sampleFormat = format;
+  config.framesPerPacket = rate / 100;
+  config.realTime = false;
+  config.clockSkewPpm = skewPpm;
+  config.totalFrames =
+      static_cast<uint64_t>(seconds * rate * (1 + skewPpm * 1e-6));
+  return config;
+}
+
+} // namespace
+
+void runClockDriftBench(BenchReport &report, const BenchOptions &options) {
+  const double seconds = options.quick ? QUICK_SECONDS : FULL_SECONDS;
+  const std::string path = options.workDir + "/clock-drift-bench.wav";
+
+  for (bool correct : {false, true}) {
+    Stream speaker(streamConfig(48000, 2, SampleFormat::Float32,
+                                SPEAKER_SKEW_PPM, seconds));
+    Stream mic(
+        streamConfig(44100, 1, SampleFormat::Int16, MIC_SKEW_PPM, seconds));
+    if (!speaker.source.open() || !mic.source.open())
+      continue;
+
+    WavWriterOptions writerOptions;
+    writerOptions.sampleRate = OUTPUT_RATE;
+    if (correct) {
+      writerOptions.clock = &mic.clock;
+      writerOptions.referenceClock = &speaker.clock;
+    }
+    WavWriter writer(path, 44100, 1, SampleFormat::Int16, writerOptions);
+    if (!writer.initialize())
+      continue;
+
+    // Replay both streams in host-time order, feeding each clock as its
+    // DiskWriter would before the sink sees the packet.
+    uint32_t noise = 1;
+    bool speakerLive = speaker.next(noise);
+    bool micLive = mic.next(noise);
+    double transient = 0.0;
+    double settled = 0.0;
+    BenchTimer timer;
+    while (speakerLive || micLive) {
+      if (speakerLive &&
+          (!micLive || speaker.time.hostTimeNs <= mic.time.hostTimeNs)) {
+        speaker.clock.update(speaker.time.position, speaker.time.hostTimeNs);
+        speaker.frames += speaker.size / (2 * sizeof(float));
+        speakerLive = speaker.next(noise);
+      } else {
+        mic.clock.update(mic.time.position, mic.time.hostTimeNs);
+        writer.writeTimed(mic.packet.data(), static_cast<uint32_t>(mic.size),
+                          mic.time);
+        double error = std::fabs(writer.driftError());
+        if (mic.time.position < SETTLE_SECONDS * 44100)
+          transient = std::max(transient, error);
+        else
+          settled = std::max(settled, error);
+        micLive = mic.next(noise);
+      }
+    }
+    bool ok = writer.finalize();
+    double elapsed = timer.elapsedSeconds();
+
+    // The speaker is written at its own 48 kHz, so aligned files match in
+    // length.
+    int64_t micFrames = int64_t(writer.bytesWritten() / sizeof(int16_t));
+    double actualPpm =
+        ((1 + MIC_SKEW_PPM * 1e-6) / (1 + SPEAKER_SKEW_PPM * 1e-6) - 1) * 1e6;
+    double measuredPpm =
+        (mic.clock.rateRatio() / speaker.clock.rateRatio() - 1) * 1e6;
+
+    BenchRecord record("clock_drift");
+    record.set("correction", correct)
+        .set("seconds", seconds)
+        .set("speaker_skew_ppm", SPEAKER_SKEW_PPM)
+        .set("mic_skew_ppm", MIC_SKEW_PPM)
+        .set("jitter_us", JITTER_NS / 1000.0)
+        .set("relative_ppm", actualPpm)
+        .set("measured_relative_ppm", measuredPpm)
+        .set("speaker_frames", speaker.frames)
+        .set("mic_frames", micFrames)
+        .set("end_offset_frames", micFrames - int64_t(speaker.frames))
+        .set("x_realtime", seconds / elapsed)
+        .set("ok", ok);
+    if (correct) {
+      record.set("startup_drift_frames", transient)
+          .set("max_drift_frames", settled);
+    }
+    report.add(record);
+  }
+  std::remove(path.c_str());
+}
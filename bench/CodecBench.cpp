@@ -0,0 +1,189 @@
+#include "Bench.h"
+#include "WavCodec.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// G.711 kernels against the scalar tables and memcpy, then WavWriter in
+// every encoding: write throughput, file size against PCM, and the signal
+// to noise ratio of what WavReader decodes back.
+static constexpr size_t KERNEL_SAMPLES = 48000 * 2 * 10;
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+static constexpr double WRITER_SECONDS = 300.0;
+static constexpr double WRITER_QUICK_SECONDS = 30.0;
+static constexpr uint32_t RATE = 48000;
+static constexpr uint16_t CHANNELS = 2;
+static constexpr uint32_t PACKET_FRAMES = 480;
+// The signal loops after this long; a whole number of packets.
+static constexpr uint32_t LOOP_FRAMES = 10 * RATE;
+
+namespace {
+
+// Speech-like material: a gliding voiced harmonic series under a syllable
+// envelope, with pauses and a little noise.
+std::vector<int16_t> makeSignal() {
+  const double pi = std::acos(-1.0);
+  std::vector<int16_t> signal(size_t(LOOP_FRAMES) * CHANNELS);
+  uint32_t noise = 1;
+  double phase = 0.0;
+  for (uint32_t i = 0; i < LOOP_FRAMES; ++i) {
+    double t = double(i) / RATE;
+    double pitch = 140.0 + 30.0 * std::sin(2 * pi * 0.3 * t);
+    phase += 2 * pi * pitch / RATE;
+    double syllable = std::max(0.0, std::sin(2 * pi * 3.0 * t));
+    double envelope = std::fmod(t, 2.5) < 2.0 ? syllable : 0.0;
+    double voiced = 0.0;
+    for (int h = 1; h <= 8; ++h)
+      voiced += std::sin(h * phase) / h;
+    for (uint16_t c = 0; c < CHANNELS; ++c) {
+      noise = noise * 1664525u + 1013904223u;
+      double value = 0.25 * envelope * voiced +
+                     0.002 * (double(noise >> 8) / double(1 << 24) - 0.5);
+      signal[size_t(i) * CHANNELS + c] =
+          static_cast<int16_t>(std::lround(value * 32767.0));
+    }
+  }
+  return signal;
+}
+
+void runKernels(BenchReport &report, const BenchOptions &options) {
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+  std::vector<int16_t> input(KERNEL_SAMPLES);
+  for (size_t i = 0; i < input.size(); ++i)
+    input[i] = static_cast<int16_t>(i * 40503u);
+  const uint8_t *pcm = reinterpret_cast<const uint8_t *>(input.data());
+  std::vector<uint8_t> output(KERNEL_SAMPLES * 2);
+
+  size_t passes = 0;
+  BenchTimer copyTimer;
+  do {
+    memcpy(output.data(), pcm, KERNEL_SAMPLES * 2);
+    ++passes;
+  } while (copyTimer.elapsedSeconds() < minSeconds);
+  double copyRate = passes * KERNEL_SAMPLES / copyTimer.elapsedSeconds() / 1e6;
+  report.add(BenchRecord("codec")
+                 .set("stage", "kernel")
+                 .set("encoding", "memcpy")
+                 .set("msamples_per_s", copyRate));
+
+  // Every 16-bit value, so bit exactness covers the whole domain.
+  std::vector<int16_t> all(65536);
+  for (int i = 0; i < 65536; ++i)
+    all[i] = static_cast<int16_t>(i);
+  const uint8_t *allPcm = reinterpret_cast<const uint8_t *>(all.data());
+  std::vector<uint8_t> reference(all.size());
+  std::vector<uint8_t> codes(all.size());
+
+  SimdLevel best = SampleConverter::detectSimdLevel();
+  for (WavEncoding law : {WavEncoding::MuLaw, WavEncoding::ALaw}) {
+    G711Codec scalar(law, SimdLevel::Scalar);
+    scalar.encode(allPcm, all.size(), reference.data());
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+      G711Codec codec(law, static_cast<SimdLevel>(level));
+      if (level > 0 && codec.simdLevel() != static_cast<SimdLevel>(level))
+        continue;
+      // Offset by one byte so the kernels see unaligned input.
+      std::vector<uint8_t> shifted(all.size() * 2 + 1);
+      memcpy(shifted.data() + 1, allPcm, all.size() * 2);
+      codec.encode(shifted.data() + 1, all.size(), codes.data());
+      bool exact = reference == codes;
+
+      passes = 0;
+      BenchTimer timer;
+      do {
+        codec.encode(pcm, KERNEL_SAMPLES, output.data());
+        ++passes;
+      } while (timer.elapsedSeconds() < minSeconds);
+      double rate = passes * KERNEL_SAMPLES / timer.elapsedSeconds() / 1e6;
+      report.add(BenchRecord("codec")
+                     .set("stage", "kernel")
+                     .set("encoding", encodingName(law))
+                     .set("kernel", SampleConverter::simdLevelName(
+                                        codec.simdLevel()))
+                     .set("msamples_per_s", rate)
+                     .set("vs_memcpy", rate / copyRate)
+                     .set("bit_exact", exact));
+    }
+  }
+}
+
+} // namespace
+
+void runCodecBench(BenchReport &report, const BenchOptions &options) {
+  runKernels(report, options);
+
+  const double seconds = options.quick ? WRITER_QUICK_SECONDS : WRITER_SECONDS;
+  const uint64_t totalFrames = static_cast<uint64_t>(seconds * RATE);
+  const size_t frameBytes = CHANNELS * 2;
+  const std::string path = options.workDir + "/codec-bench.wav";
+  const std::vector<int16_t> signal = makeSignal();
+  const uint8_t *signalBytes = reinterpret_cast<const uint8_t *>(signal.data());
+
+  uint64_t pcmFileBytes = 0;
+  for (WavEncoding encoding : {WavEncoding::Pcm, WavEncoding::MuLaw,
+                               WavEncoding::ALaw, WavEncoding::ImaAdpcm}) {
+    WavWriterOptions writerOptions;
+    writerOptions.encoding = encoding;
+    WavWriter writer(path, RATE, CHANNELS, SampleFormat::Int16, writerOptions);
+    if (!writer.initialize())
+      continue;
+
+    BenchTimer timer;
+    for (uint64_t frame = 0; frame < totalFrames; frame += PACKET_FRAMES) {
+      uint32_t frames =
+          uint32_t(std::min<uint64_t>(PACKET_FRAMES, totalFrames - frame));
+      writer.write(signalBytes + (frame % LOOP_FRAMES) * frameBytes,
+                   uint32_t(frames * frameBytes));
+    }
+    bool ok = writer.finalize();
+    double elapsed = timer.elapsedSeconds();
+    uint64_t fileBytes = writer.bytesWritten();
+    if (encoding == WavEncoding::Pcm)
+      pcmFileBytes = fileBytes;
+
+    // Decode and measure the coding noise against the looped input.
+    WavReader reader(path);
+    bool lengthOk = reader.open() && reader.encoding() == encoding &&
+                    reader.frames() == totalFrames;
+    std::vector<int16_t> chunk(size_t(PACKET_FRAMES) * CHANNELS);
+    uint64_t decoded = 0;
+    double signalPower = 0.0, noisePower = 0.0;
+    size_t got;
+    while (lengthOk &&
+           (got = reader.read(reinterpret_cast<uint8_t *>(chunk.data()),
+                              chunk.size() * 2)) > 0) {
+      const int16_t *expected =
+          signal.data() + (decoded % LOOP_FRAMES) * CHANNELS;
+      for (size_t i = 0; i < got / 2; ++i) {
+        double s = expected[i], e = double(chunk[i]) - expected[i];
+        signalPower += s * s;
+        noisePower += e * e;
+      }
+      decoded += got / frameBytes;
+    }
+    reader.close();
+    lengthOk = lengthOk && decoded == totalFrames;
+    double snr = noisePower > 0 ? 10 * std::log10(signalPower / noisePower)
+                                : 999.0;
+
+    double pcmBytes = double(totalFrames) * frameBytes;
+    report.add(BenchRecord("codec")
+                   .set("stage", "writer")
+                   .set("encoding", encodingName(encoding))
+                   .set("seconds", seconds)
+                   .set("input_mb_per_s", pcmBytes / elapsed / 1e6)
+                   .set("file_bytes", fileBytes)
+                   .set("size_vs_pcm",
+                        pcmFileBytes ? double(fileBytes) / pcmFileBytes : 1.0)
+                   .set("snr_db", snr)
+                   .set("length_ok", lengthOk)
+                   .set("ok", ok && lengthOk));
+    std::remove(path.c_str());
+  }
+}
@@ -0,0 +1,94 @@
+#include "Bench.h"
+#include "SampleConverter.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Ten seconds of 48 kHz stereo per pass.
+static constexpr size_t SAMPLES = 48000 * 2 * 10;
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+// A 44.1 kHz stereo device delivers 441-frame packets; an odd call size
+// leaves the dither phase off lane 0 for the next call.
+static constexpr size_t ODD_CALL = 441 * 2 + 1;
+// With dither, odd-sized calls must keep most of the aligned throughput:
+// only up to DITHER_LANES - 1 samples per call may go through the scalar
+// kernel before the vector loop picks up.
+static constexpr double MIN_ODD_CALL_RATIO = 0.5;
+
+// Converts |samples| in calls of ODD_CALL samples.
+static void convertInOddCalls(SampleConverter &converter, const float *src,
+                              size_t samples, uint8_t *dst) {
+  size_t bytes = 0;
+  for (size_t done = 0; done < samples; done += ODD_CALL) {
+    bytes += converter.convert(src + done, std::min(ODD_CALL, samples - done),
+                               dst + bytes);
+  }
+}
+
+void runConversionBench(BenchReport &report, const BenchOptions &options) {
+  std::vector<float> input(SAMPLES);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.1f, 1.1f);
+  for (float &sample : input)
+    sample = dist(rng);
+
+  const SampleFormat formats[] = {SampleFormat::Int16, SampleFormat::Int24,
+                                  SampleFormat::Int32};
+  const char *formatNames[] = {"int16", "int24", "int32"};
+  SimdLevel best = SampleConverter::detectSimdLevel();
+
+  std::vector<uint8_t> reference(SAMPLES * 4);
+  std::vector<uint8_t> output(SAMPLES * 4);
+
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+  for (int f = 0; f < 3; ++f) {
+    for (int dither = 0; dither < 2; ++dither) {
+      SampleConverter scalar(formats[f], dither != 0, SimdLevel::Scalar);
+      size_t bytes = scalar.convert(input.data(), SAMPLES, reference.data());
+
+      for (int level = 0; level <= static_cast<int>(best); ++level) {
+        SampleConverter converter(formats[f], dither != 0,
+                                  static_cast<SimdLevel>(level));
+        converter.convert(input.data(), SAMPLES, output.data());
+        bool exact = memcmp(reference.data(), output.data(), bytes) == 0;
+
+        size_t passes = 0;
+        BenchTimer timer;
+        do {
+          converter.convert(input.data(), SAMPLES, output.data());
+          ++passes;
+        } while (timer.elapsedSeconds() < minSeconds);
+        double rate = passes * SAMPLES / timer.elapsedSeconds() / 1e6;
+
+        BenchRecord record("conversion");
+        record.set("format", formatNames[f])
+            .set("dither", dither ? "tpdf" : "none")
+            .set("kernel",
+                 SampleConverter::simdLevelName(converter.simdLevel()))
+            .set("msamples_per_s", rate);
+        if (dither) {
+          // The dither stream continues across calls, so the result must
+          // still match the scalar kernel's single call.
+          SampleConverter chunked(formats[f], true,
+                                  static_cast<SimdLevel>(level));
+          convertInOddCalls(chunked, input.data(), SAMPLES, output.data());
+          exact = exact && memcmp(reference.data(), output.data(), bytes) == 0;
+
+          passes = 0;
+          BenchTimer oddTimer;
+          do {
+            convertInOddCalls(chunked, input.data(), SAMPLES, output.data());
+            ++passes;
+          } while (oddTimer.elapsedSeconds() < minSeconds);
+          double oddRate = passes * SAMPLES / oddTimer.elapsedSeconds() / 1e6;
+          record.set("odd_call_msamples_per_s", oddRate)
+              .set("ok", converter.simdLevel() == SimdLevel::Scalar ||
+                             oddRate >= rate * MIN_ODD_CALL_RATIO);
+        }
+        report.add(record.set("bit_exact", exact));
+      }
+    }
+  }
+}
@@ -0,0 +1,263 @@
+#include "AudioSink.h"
+#include "Bench.h"
+#include "BlockSubscriber.h"
+#include "DiskWriter.h"
+#include "RingBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// One stream read by 1..16 live consumers besides the sink. Zero-copy hands
+// every consumer a reference to the writer's block; the copying baseline
+// is a sink that copies each block into a ring per consumer. Then a paced
+// stream with one fast consumer and two that stall, one dropping blocks
+// and one detached: capture must not lose a byte and the fast consumer
+// must see the whole stream.
+static constexpr uint32_t BLOCK_BYTES = 16 << 10;
+static constexpr size_t QUEUED_BLOCKS = 64;
+static constexpr uint64_t TOTAL_BYTES = 512ull << 20;
+static constexpr uint64_t QUICK_TOTAL_BYTES = 64ull << 20;
+// 48 kHz stereo Int16 in 10 ms packets, at 20x real time.
+static constexpr uint32_t PACED_PACKET_BYTES = 480 * 4;
+static constexpr int PACED_PACKET_US = 500;
+static constexpr double PACED_SECONDS = 4.0;
+static constexpr double QUICK_PACED_SECONDS = 2.0;
+static constexpr int SLOW_BLOCK_MS = 5;
+
+namespace {
+
+class NullSink : public AudioSink {
+public:
+  bool initialize() override { return true; }
+  void write(const uint8_t *, uint32_t) override {}
+  bool flush() override { return true; }
+  bool finalize() override { return true; }
+};
+
+// The copying baseline: each block is copied into every consumer's ring,
+// waiting for room rather than dropping.
+class CopyingSink : public NullSink {
+public:
+  explicit CopyingSink(std::vector<std::unique_ptr<SpscRingBuffer>> &rings)
+      : m_rings(rings) {}
+
+  void write(const uint8_t *data, uint32_t size) override {
+    for (auto &ring : m_rings) {
+      while (ring->capacity() - ring->readAvailable() < size)
+        std::this_thread::yield();
+      ring->push(data, size);
+    }
+  }
+
+private:
+  std::vector<std::unique_ptr<SpscRingBuffer>> &m_rings;
+};
+
+// What a consumer does with the audio: touch every cache line.
+uint64_t touch(const uint8_t *data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; i += 64)
+    sum += data[i];
+  return sum;
+}
+
+// Pushes |total| bytes as fast as the pool lets it.
+void produce(DiskWriter &writer, const std::vector<uint8_t> &block,
+             uint64_t total) {
+  for (uint64_t sent = 0; sent < total; sent += block.size()) {
+    while (!writer.push(block.data(), static_cast<uint32_t>(block.size())))
+      std::this_thread::yield();
+  }
+}
+
+void runThroughput(BenchReport &report, bool zeroCopy, unsigned consumers,
+                   uint64_t total) {
+  std::vector<uint8_t> block(BLOCK_BYTES);
+  for (size_t i = 0; i < block.size(); ++i)
+    block[i] = static_cast<uint8_t>(i * 31);
+
+  BufferPoolConfig poolConfig;
+  poolConfig.blockSize = BLOCK_BYTES;
+  poolConfig.blockCount = QUEUED_BLOCKS;
+  poolConfig.maxBlocks = QUEUED_BLOCKS * 2;
+  poolConfig.lockPages = false;
+
+  std::vector<std::unique_ptr<SpscRingBuffer>> rings;
+  std::unique_ptr<AudioSink> sink;
+  if (zeroCopy) {
+    sink.reset(new NullSink);
+  } else {
+    for (unsigned i = 0; i < consumers; ++i)
+      rings.emplace_back(new SpscRingBuffer(QUEUED_BLOCKS * BLOCK_BYTES));
+    sink.reset(new CopyingSink(rings));
+  }
+  DiskWriter writer(sink.get(), poolConfig);
+
+  std::vector<std::shared_ptr<BlockSubscriber>> subscribers;
+  if (zeroCopy) {
+    // Queues that can hold the whole pool never drop: a lagging reader
+    // holds the producer back through the pool instead, as the rings do.
+    SubscriberOptions options;
+    options.maxQueuedBlocks = poolConfig.maxBlocks;
+    for (unsigned i = 0; i < consumers; ++i) {
+      subscribers.emplace_back(new BlockSubscriber(options));
+      writer.addSubscriber(subscribers.back());
+    }
+  }
+
+  std::vector<uint64_t> received(consumers, 0);
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> checksum{0};
+  std::vector<std::thread> readers;
+  for (unsigned i = 0; i < consumers; ++i) {
+    readers.emplace_back([&, i] {
+      uint64_t sum = 0;
+      if (zeroCopy) {
+        BlockSubscriber &subscriber = *subscribers[i];
+        while (!subscriber.ended()) {
+          const BufferPool::Block *block = subscriber.poll();
+          if (!block) {
+            std::this_thread::yield();
+            continue;
+          }
+          sum += touch(block->data, block->size);
+          received[i] += block->size;
+          subscriber.release(block);
+        }
+      } else {
+        SpscRingBuffer &ring = *rings[i];
+        for (;;) {
+          const uint8_t *data;
+          size_t size = ring.peek(&data);
+          if (size == 0) {
+            if (stopping.load(std::memory_order_acquire) &&
+                ring.readAvailable() == 0)
+              break;
+            std::this_thread::yield();
+            continue;
+          }
+          sum += touch(data, size);
+          received[i] += size;
+          ring.consume(size);
+        }
+      }
+      checksum.fetch_add(sum, std::memory_order_relaxed);
+    });
+  }
+
+  writer.start();
+  BenchTimer timer;
+  produce(writer, block, total);
+  writer.stop();
+  stopping.store(true, std::memory_order_release);
+  for (auto &reader : readers)
+    reader.join();
+  double seconds = timer.elapsedSeconds();
+
+  uint64_t delivered = 0;
+  bool complete = true;
+  for (uint64_t bytes : received) {
+    delivered += bytes;
+    complete = complete && bytes == total;
+  }
+  uint64_t dropped = 0;
+  for (const auto &subscriber : subscribers)
+    dropped += subscriber->droppedBlocks();
+  report.add(BenchRecord("fanout")
+                 .set("mode", zeroCopy ? "zero_copy" : "copy")
+                 .set("consumers", uint64_t(consumers))
+                 .set("stream_mb_per_s", total / seconds / 1e6)
+                 .set("delivered_mb_per_s", delivered / seconds / 1e6)
+                 .set("dropped_blocks", dropped)
+                 .set("ok", complete));
+}
+
+void runSlowConsumer(BenchReport &report, double seconds) {
+  NullSink sink;
+  BufferPoolConfig poolConfig;
+  poolConfig.blockSize = PACED_PACKET_BYTES;
+  poolConfig.lockPages = false;
+  DiskWriter writer(&sink, poolConfig);
+
+  SubscriberOptions fastOptions;
+  SubscriberOptions dropOptions;
+  dropOptions.maxQueuedBlocks = 16;
+  SubscriberOptions detachOptions = dropOptions;
+  detachOptions.policy = SlowSubscriberPolicy::Detach;
+  std::shared_ptr<BlockSubscriber> fast(new BlockSubscriber(fastOptions));
+  std::shared_ptr<BlockSubscriber> dropping(new BlockSubscriber(dropOptions));
+  std::shared_ptr<BlockSubscriber> detaching(
+      new BlockSubscriber(detachOptions));
+  writer.addSubscriber(fast);
+  writer.addSubscriber(dropping);
+  writer.addSubscriber(detaching);
+
+  // The fast consumer checks that block offsets run on without a gap.
+  uint64_t fastBytes = 0;
+  bool contiguous = true;
+  std::thread fastReader([&] {
+    while (!fast->ended()) {
+      const BufferPool::Block *block = fast->wait(10);
+      if (!block)
+        continue;
+      contiguous = contiguous && block->offset == fastBytes;
+      fastBytes += block->size;
+      fast->release(block);
+    }
+  });
+  auto slowReader = [](BlockSubscriber &subscriber) {
+    while (!subscriber.ended()) {
+      const BufferPool::Block *block = subscriber.wait(10);
+      if (!block)
+        continue;
+      std::this_thread::sleep_for(std::chrono::milliseconds(SLOW_BLOCK_MS));
+      subscriber.release(block);
+    }
+  };
+  std::thread dropReader(slowReader, std::ref(*dropping));
+  std::thread detachReader(slowReader, std::ref(*detaching));
+
+  std::vector<uint8_t> packet(PACED_PACKET_BYTES, 0x5a);
+  writer.start();
+  const uint64_t packets =
+      static_cast<uint64_t>(seconds * 1e6 / PACED_PACKET_US);
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < packets; ++i) {
+    std::this_thread::sleep_until(
+        start + std::chrono::microseconds(i * PACED_PACKET_US));
+    writer.push(packet.data(), PACED_PACKET_BYTES);
+  }
+  writer.stop();
+  fastReader.join();
+  dropReader.join();
+  detachReader.join();
+
+  const uint64_t total = packets * PACED_PACKET_BYTES;
+  bool ok = writer.overruns() == 0 && fastBytes == total && contiguous &&
+            fast->droppedBlocks() == 0 && dropping->droppedBlocks() > 0 &&
+            !dropping->detached() && detaching->detached();
+  report.add(BenchRecord("fanout_slow_consumer")
+                 .set("seconds", seconds)
+                 .set("packets", packets)
+                 .set("capture_overruns", writer.overruns())
+                 .set("fast_bytes", fastBytes)
+                 .set("fast_contiguous", contiguous)
+                 .set("dropping_received", dropping->receivedBlocks())
+                 .set("dropping_dropped", dropping->droppedBlocks())
+                 .set("detaching_received", detaching->receivedBlocks())
+                 .set("detached", detaching->detached())
+                 .set("ok", ok));
+}
+
+} // namespace
+
+void runFanoutBench(BenchReport &report, const BenchOptions &options) {
+  const uint64_t total = options.quick ? QUICK_TOTAL_BYTES : TOTAL_BYTES;
+  for (unsigned consumers : {1u, 4u, 16u}) {
+    runThroughput(report, true, consumers, total);
+    runThroughput(report, false, consumers, total);
+  }
+  runSlowConsumer(report, options.quick ? QUICK_PACED_SECONDS : PACED_SECONDS);
+}
@@ -0,0 +1,129 @@
+#include "Bench.h"
+#include "FlacReader.h"
+#include "FlacWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FlacWriter encode throughput by encoder thread count, fed 10 ms packets as
+// fast as write() accepts them, and a round trip through FlacReader that
+// must return every byte that went in.
+static constexpr double SECONDS = 600.0;
+static constexpr double QUICK_SECONDS = 60.0;
+static constexpr uint32_t RATE = 48000;
+static constexpr uint16_t CHANNELS = 2;
+static constexpr uint32_t PACKET_FRAMES = 480;
+// The signal loops after this long; a whole number of packets.
+static constexpr uint32_t LOOP_FRAMES = 20 * RATE;
+
+namespace {
+
+// A chord of three partials under a slow tremolo plus independent noise
+// about 60 dB down per channel, so blocks compress like program material
+// rather than a pure tone.
+std::vector<uint8_t> makeSignal(SampleFormat format) {
+  const uint16_t bytes = bytesPerSample(format);
+  const double scale = format == SampleFormat::Int16 ? 32767.0 : 8388607.0;
+  const double pi = std::acos(-1.0);
+  std::vector<uint8_t> signal(size_t(LOOP_FRAMES) * CHANNELS * bytes);
+  uint32_t noise = 1;
+  uint8_t *out = signal.data();
+  for (uint32_t i = 0; i < LOOP_FRAMES; ++i) {
+    double t = double(i) / RATE;
+    double envelope = 0.5 + 0.4 * std::sin(2 * pi * 0.7 * t);
+    for (uint16_t c = 0; c < CHANNELS; ++c) {
+      noise = noise * 1664525u + 1013904223u;
+      double value =
+          envelope * (0.3 * std::sin(2 * pi * 220.0 * t) +
+                      0.2 * std::sin(2 * pi * 277.2 * t + c) +
+                      0.15 * std::sin(2 * pi * 329.6 * t + 2 * c)) +
+          0.001 * (double(noise >> 8) / double(1 << 24) - 0.5);
+      int32_t sample = int32_t(std::lround(value * scale));
+      for (uint16_t b = 0; b < bytes; ++b)
+        *out++ = uint8_t(uint32_t(sample) >> (8 * b));
+    }
+  }
+  return signal;
+}
+
+} // namespace
+
+void runFlacBench(BenchReport &report, const BenchOptions &options) {
+  const double seconds = options.quick ? QUICK_SECONDS : SECONDS;
+  const uint64_t totalFrames = static_cast<uint64_t>(seconds * RATE);
+  const std::string path = options.workDir + "/flac-bench.flac";
+
+  std::vector<unsigned> threadCounts = {1, 2, 4};
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores > 4)
+    threadCounts.push_back(cores);
+
+  for (SampleFormat format : {SampleFormat::Int16, SampleFormat::Int24}) {
+    const std::vector<uint8_t> signal = makeSignal(format);
+    const size_t frameBytes = size_t(CHANNELS) * bytesPerSample(format);
+
+    for (unsigned threads : threadCounts) {
+      FlacWriterOptions writerOptions;
+      writerOptions.threads = threads;
+      FlacWriter writer(path, RATE, CHANNELS, format, writerOptions);
+      if (!writer.initialize())
+        continue;
+
+      double maxWriteUs = 0.0;
+      BenchTimer timer;
+      for (uint64_t frame = 0; frame < totalFrames; frame += PACKET_FRAMES) {
+        uint32_t frames =
+            uint32_t(std::min<uint64_t>(PACKET_FRAMES, totalFrames - frame));
+        const uint8_t *packet =
+            signal.data() + (frame % LOOP_FRAMES) * frameBytes;
+        int64_t start = benchNowNs();
+        writer.write(packet, uint32_t(frames * frameBytes));
+        maxWriteUs = std::max(maxWriteUs, (benchNowNs() - start) / 1000.0);
+      }
+      uint64_t stalls = writer.stalls();
+      bool ok = writer.finalize();
+      double elapsed = timer.elapsedSeconds();
+      uint64_t fileBytes = writer.bytesWritten();
+
+      // Decode and compare against the looped input.
+      FlacReader reader(path);
+      bool exact = reader.open() && reader.frames() == totalFrames &&
+                   reader.sampleFormat() == format;
+      BenchTimer decodeTimer;
+      uint64_t decoded = 0;
+      std::vector<uint8_t> chunk(size_t(PACKET_FRAMES) * frameBytes);
+      size_t got;
+      while (exact && (got = reader.read(chunk.data(), chunk.size())) > 0) {
+        // Chunks are whole packets, so none straddles the loop point.
+        const uint8_t *expected =
+            signal.data() + (decoded % LOOP_FRAMES) * frameBytes;
+        exact = got % frameBytes == 0 && memcmp(chunk.data(), expected, got) == 0;
+        decoded += got / frameBytes;
+      }
+      double decodeElapsed = decodeTimer.elapsedSeconds();
+      exact = exact && decoded == totalFrames && !reader.failed();
+      reader.close();
+
+      double pcmBytes = double(totalFrames) * frameBytes;
+      report.add(BenchRecord("flac")
+                     .set("format", format == SampleFormat::Int16 ? "int16"
+                                                                  : "int24")
+                     .set("threads", int(threads))
+                     .set("seconds", seconds)
+                     .set("x_realtime", seconds / elapsed)
+                     .set("x_realtime_per_thread", seconds / elapsed / threads)
+                     .set("input_mb_per_s", pcmBytes / elapsed / 1e6)
+                     .set("compression", double(fileBytes) / pcmBytes)
+                     .set("stalls", stalls)
+                     .set("max_write_us", maxWriteUs)
+                     .set("decode_x_realtime", seconds / decodeElapsed)
+                     .set("bit_exact", exact)
+                     .set("ok", ok && exact));
+      std::remove(path.c_str());
+    }
+  }
+}
@@ -0,0 +1,69 @@
+#include "Bench.h"
+#include "Logger.h"
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+// Per-call cost of a typical status line, written synchronously through an
+// ostream with std::endl (the old pattern) and through the async Logger.
+// Lines are logged in bursts, like start-up or a device error, with the
+// output drained between bursts.
+static constexpr size_t BURST_LINES = 256;
+static constexpr size_t BURSTS = 200;
+static constexpr size_t QUICK_BURSTS = 40;
+
+static void addRecord(BenchReport &report, const char *sink,
+                      std::vector<int64_t> &latencies, uint64_t dropped) {
+  BenchRecord record("logging");
+  record.set("sink", sink)
+      .set("lines", static_cast<int64_t>(latencies.size()))
+      .set("dropped", dropped);
+  LatencySummary::fromSamples(latencies).addTo(record);
+  report.add(record);
+}
+
+void runLoggingBench(BenchReport &report, const BenchOptions &options) {
+  const size_t bursts = options.quick ? QUICK_BURSTS : BURSTS;
+  const std::string path = options.workDir + "/logging-bench.log";
+  std::vector<int64_t> latencies;
+  latencies.reserve(bursts * BURST_LINES);
+
+  {
+    std::ofstream out(path);
+    for (size_t burst = 0; burst < bursts; ++burst) {
+      for (size_t i = 0; i < BURST_LINES; ++i) {
+        int64_t start = benchNowNs();
+        out << "[DiskWriter] Ring high-water mark: " << i << " / "
+            << 1048576 << " bytes" << std::endl;
+        latencies.push_back(benchNowNs() - start);
+      }
+    }
+    addRecord(report, "ostream_endl", latencies, 0);
+  }
+
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (!file)
+    return;
+  Logger &logger = Logger::instance();
+  logger.flush();
+  logger.prepareThread();
+  logger.setOutput(file, file);
+  uint64_t droppedBefore = logger.dropped();
+  latencies.clear();
+
+  for (size_t burst = 0; burst < bursts; ++burst) {
+    for (size_t i = 0; i < BURST_LINES; ++i) {
+      int64_t start = benchNowNs();
+      LOG_INFO << "[DiskWriter] Ring high-water mark: " << i << " / "
+               << 1048576 << " bytes";
+      latencies.push_back(benchNowNs() - start);
+    }
+    logger.flush();
+  }
+
+  logger.setOutput(stderr, stderr);
+  std::fclose(file);
+  std::remove(path.c_str());
+  addRecord(report, "async_logger", latencies,
+            logger.dropped() - droppedBefore);
+}
@@ -0,0 +1,271 @@
+#include "Bench.h"
+#include "ChannelInterleaver.h"
+#include "MultichannelWavWriter.h"
+#include "WavReader.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Interleave kernels for the layouts a mic + loopback file uses, each level
+// against the scalar kernel. End to end: a 48 kHz float stereo "speaker" and
+// a 44.1 kHz int16 mono "mic" that starts 250 ms later, loses 10 ms of
+// frames halfway and runs on skewed clocks, fed in timestamp order into one
+// combined file. Both carry an impulse at the same host time every two
+// seconds; the file is read back and, once the clock fits settle, the
+// impulses must line up.
+static constexpr size_t KERNEL_FRAMES = 4096;
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+static constexpr uint32_t FILE_RATE = 48000;
+static constexpr uint32_t SPEAKER_RATE = 48000;
+static constexpr uint32_t MIC_RATE = 44100;
+static constexpr double SPEAKER_SKEW_PPM = -50.0;
+static constexpr double MIC_SKEW_PPM = 300.0;
+static constexpr double MIC_DELAY_S = 0.25;
+static constexpr double GAP_AT_S = 5.0;
+static constexpr double GAP_S = 0.01;
+static constexpr double IMPULSE_PERIOD_S = 2.0;
+static constexpr double FULL_SECONDS = 60.0;
+static constexpr double QUICK_SECONDS_E2E = 12.0;
+static constexpr int64_t ORIGIN_NS = 1000000000;
+// Impulses within this of a packet edge still land in one packet.
+static constexpr double PACKET_S = 0.01;
+// Until the mic's clock fit locks (ClockTracker::LOCK_SPAN_S) its skew
+// goes unseen, and the error found then takes a few seconds to steer out;
+// after this, alignment must hold to within a quarter millisecond.
+static constexpr double SETTLE_SECONDS = 5.0;
+static constexpr double MAX_ERROR_MS = 0.25;
+
+namespace {
+
+// One stream: packets of PACKET_S whose device position maps to host time
+// through a skewed clock, with an impulse every IMPULSE_PERIOD_S of host
+// time.
+struct Stream {
+  uint32_t rate;
+  uint16_t channels;
+  SampleFormat format;
+  double startS;
+  double skewPpm;
+  uint64_t position = 0;
+  bool gapDone = false;
+
+  double hostSeconds(uint64_t frame) const {
+    return startS + double(frame) / (rate * (1.0 + skewPpm * 1e-6));
+  }
+  // Next packet and its timestamp; false once past |endS|.
+  bool next(double endS, std::vector<uint8_t> &packet, BlockTimestamp &time) {
+    if (!gapDone && hostSeconds(position) >= GAP_AT_S && skewPpm > 0) {
+      position += uint64_t(GAP_S * rate);
+      gapDone = true;
+    }
+    if (hostSeconds(position) >= endS)
+      return false;
+    const size_t frames = size_t(PACKET_S * rate);
+    const size_t sampleBytes = bytesPerSample(format);
+    packet.assign(frames * channels * sampleBytes, 0);
+    for (size_t f = 0; f < frames; ++f) {
+      double t = hostSeconds(position + f);
+      double phase = std::fmod(t, IMPULSE_PERIOD_S);
+      double step = 1.0 / (rate * (1.0 + skewPpm * 1e-6));
+      if (t < 1.0 || phase >= step)
+        continue;
+      for (uint16_t c = 0; c < channels; ++c) {
+        uint8_t *out = packet.data() + (f * channels + c) * sampleBytes;
+        if (format == SampleFormat::Float32) {
+          float value = 0.9f;
+          memcpy(out, &value, 4);
+        } else {
+          int16_t value = 29000;
+          memcpy(out, &value, 2);
+        }
+      }
+    }
+    time.position = position;
+    time.hostTimeNs =
+        ORIGIN_NS + int64_t(std::llround(hostSeconds(position) * 1e9));
+    position += frames;
+    return true;
+  }
+};
+
+// Frame of the largest |sample| of channel |channel| within |radius| of
+// |center|.
+int64_t peakNear(const std::vector<int16_t> &samples, uint16_t channels,
+                 uint16_t channel, int64_t center, int64_t radius) {
+  int64_t frames = int64_t(samples.size() / channels);
+  int64_t best = -1;
+  int peak = 0;
+  for (int64_t f = std::max<int64_t>(center - radius, 0);
+       f < std::min(center + radius, frames); ++f) {
+    int value = std::abs(int(samples[f * channels + channel]));
+    if (value > peak) {
+      peak = value;
+      best = f;
+    }
+  }
+  return peak > 8000 ? best : -1;
+}
+
+void runKernels(BenchReport &report, const BenchOptions &options) {
+  struct Layout {
+    const char *name;
+    std::vector<uint16_t> groups;
+  };
+  const Layout layouts[] = {{"2+2", {2, 2}}, {"2+1", {2, 1}},
+                            {"1+1", {1, 1}}, {"2+1+1", {2, 1, 1}}};
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  SimdLevel best = SampleConverter::detectSimdLevel();
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+
+  for (const Layout &layout : layouts) {
+    std::vector<std::vector<float>> data;
+    std::vector<const float *> groups;
+    size_t width = 0;
+    for (uint16_t channels : layout.groups) {
+      data.emplace_back(KERNEL_FRAMES * channels);
+      for (float &sample : data.back())
+        sample = dist(rng);
+      groups.push_back(data.back().data());
+      width += channels;
+    }
+    std::vector<float> reference(KERNEL_FRAMES * width);
+    std::vector<float> output(KERNEL_FRAMES * width);
+    ChannelInterleaver(layout.groups, SimdLevel::Scalar)
+        .interleave(groups.data(), KERNEL_FRAMES, reference.data());
+
+    SimdLevel previous = SimdLevel::Avx512;
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+      ChannelInterleaver interleaver(layout.groups,
+                                     static_cast<SimdLevel>(level));
+      // Levels without a kernel of their own fall back to the one below.
+      if (interleaver.simdLevel() == previous)
+        continue;
+      previous = interleaver.simdLevel();
+      // An odd frame count exercises the scalar tail too.
+      std::fill(output.begin(), output.end(), 0.0f);
+      interleaver.interleave(groups.data(), KERNEL_FRAMES - 3, output.data());
+      bool exact = memcmp(reference.data(), output.data(),
+                          (KERNEL_FRAMES - 3) * width * sizeof(float)) == 0;
+
+      size_t passes = 0;
+      BenchTimer timer;
+      do {
+        interleaver.interleave(groups.data(), KERNEL_FRAMES, output.data());
+        ++passes;
+      } while (timer.elapsedSeconds() < minSeconds);
+      double rate = passes * KERNEL_FRAMES / timer.elapsedSeconds() / 1e6;
+      report.add(BenchRecord("multichannel_interleave")
+                     .set("layout", layout.name)
+                     .set("kernel", SampleConverter::simdLevelName(
+                                        interleaver.simdLevel()))
+                     .set("mframes_per_s", rate)
+                     .set("bit_exact", exact));
+    }
+  }
+}
+
+} // namespace
+
+void runMultichannelBench(BenchReport &report, const BenchOptions &options) {
+  runKernels(report, options);
+
+  const double seconds = options.quick ? QUICK_SECONDS_E2E : FULL_SECONDS;
+  const std::string path = options.workDir + "/multichannel.wav";
+  auto writer = std::make_shared<MultichannelWavWriter>(path, FILE_RATE);
+  size_t speakerGroup = writer->addGroup(
+      "speaker", 2, WAV_SPEAKER_FRONT_LEFT | WAV_SPEAKER_FRONT_RIGHT);
+  size_t micGroup = writer->addGroup("mic", 1, WAV_SPEAKER_FRONT_CENTER);
+  Stream speaker{SPEAKER_RATE, 2, SampleFormat::Float32, 0.0,
+                 SPEAKER_SKEW_PPM};
+  Stream mic{MIC_RATE, 1, SampleFormat::Int16, MIC_DELAY_S, MIC_SKEW_PPM};
+  std::unique_ptr<AudioSink> speakerInput = writer->createInput(
+      speakerGroup, SPEAKER_RATE, 2, SampleFormat::Float32);
+  std::unique_ptr<AudioSink> micInput =
+      writer->createInput(micGroup, MIC_RATE, 1, SampleFormat::Int16);
+  bool ready = speakerInput->initialize() && micInput->initialize();
+
+  std::vector<uint8_t> speakerPacket;
+  std::vector<uint8_t> micPacket;
+  BlockTimestamp speakerTime;
+  BlockTimestamp micTime;
+  bool speakerMore = speaker.next(seconds, speakerPacket, speakerTime);
+  bool micMore = mic.next(seconds, micPacket, micTime);
+  BenchTimer timer;
+  while (speakerMore || micMore) {
+    if (speakerMore &&
+        (!micMore || speakerTime.hostTimeNs <= micTime.hostTimeNs)) {
+      speakerInput->writeTimed(speakerPacket.data(),
+                               uint32_t(speakerPacket.size()), speakerTime);
+      speakerMore = speaker.next(seconds, speakerPacket, speakerTime);
+    } else {
+      micInput->writeTimed(micPacket.data(), uint32_t(micPacket.size()),
+                           micTime);
+      micMore = mic.next(seconds, micPacket, micTime);
+    }
+  }
+  bool finalized = speakerInput->finalize() && micInput->finalize();
+  double elapsed = timer.elapsedSeconds();
+
+  WavReader reader(path);
+  bool opened = reader.open();
+  std::vector<int16_t> samples;
+  if (opened && reader.sampleFormat() == SampleFormat::Int16) {
+    samples.resize(reader.frames() * reader.channels());
+    reader.read(reinterpret_cast<uint8_t *>(samples.data()),
+                samples.size() * sizeof(int16_t));
+  }
+  const uint16_t channels = opened ? reader.channels() : 0;
+  const uint32_t mask = opened ? reader.channelMask() : 0;
+
+  // The file starts at the speaker's first frame.
+  int impulses = 0;
+  int found = 0;
+  double settleErrorMs = 0.0;
+  double maxErrorMs = 0.0;
+  for (double t = 2.0; channels == 3 && t < seconds - 0.5;
+       t += IMPULSE_PERIOD_S) {
+    int64_t center = int64_t(std::llround(t * FILE_RATE));
+    int64_t left = peakNear(samples, channels, 0, center, FILE_RATE / 20);
+    int64_t right = peakNear(samples, channels, 1, center, FILE_RATE / 20);
+    int64_t centre = peakNear(samples, channels, 2, center, FILE_RATE / 20);
+    ++impulses;
+    if (left < 0 || centre < 0 || left != right)
+      continue;
+    ++found;
+    double errorMs = std::abs(double(centre - left)) * 1e3 / FILE_RATE;
+    if (t < SETTLE_SECONDS)
+      settleErrorMs = std::max(settleErrorMs, errorMs);
+    else
+      maxErrorMs = std::max(maxErrorMs, errorMs);
+  }
+  const double micSilentMs =
+      writer->silentFrames(micGroup) * 1e3 / FILE_RATE;
+  std::remove(path.c_str());
+
+  // The mic's silence: its late start, the lost frames, and the speaker's
+  // run past its end.
+  bool ok = ready && finalized && opened && channels == 3 &&
+            mask == writer->channelMask() && found == impulses &&
+            impulses > 0 && maxErrorMs <= MAX_ERROR_MS &&
+            micSilentMs >= (MIC_DELAY_S + GAP_S) * 1e3 - 5.0;
+  report.add(BenchRecord("multichannel_alignment")
+                 .set("seconds", seconds)
+                 .set("realtime_factor", seconds / elapsed)
+                 .set("channels", int(channels))
+                 .set("channel_mask", uint64_t(mask))
+                 .set("frames", writer->framesWritten())
+                 .set("impulses", impulses)
+                 .set("impulses_found", found)
+                 .set("settling_align_error_ms", settleErrorMs)
+                 .set("max_align_error_ms", maxErrorMs)
+                 .set("mic_silent_ms", micSilentMs)
+                 .set("mic_dropped_frames", writer->droppedFrames(micGroup))
+                 .set("speaker_silent_frames",
+                      writer->silentFrames(speakerGroup))
+                 .set("ok", ok));
+}
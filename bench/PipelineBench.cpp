@@ -0,0 +1,285 @@
+#include "AudioSink.h"
+#include "Bench.h"
+#include "CaptureScheduler.h"
+#include "DiskWriter.h"
+#include "Realtime.h"
+#include "SyntheticSource.h"
+#include "WavWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// 10 ms packets of 48 kHz stereo int16, paced like a real device.
+static constexpr uint32_t FRAMES_PER_PACKET = 480;
+static constexpr size_t MAX_BATCH_PACKETS = 8;
+static constexpr int READY_TIMEOUT_MS = 100;
+static constexpr double RUN_SECONDS = 5.0;
+static constexpr double QUICK_RUN_SECONDS = 1.0;
+// Busy threads per CPU competing with capture in the real-time scenario.
+static constexpr unsigned HOGS_PER_CPU = 2;
+
+// Sits between the DiskWriter and the real sink and records, per packet, the
+// time from its capture (the source clock's timestamp of its last frame) to
+// the moment the sink accepted its last byte.
+class LatencyProbeSink : public AudioSink {
+public:
+  LatencyProbeSink(AudioSink *inner, const SyntheticSource &source,
+                   uint32_t packetBytes, size_t maxPackets)
+      : m_inner(inner), m_source(source), m_packetBytes(packetBytes),
+        m_maxPackets(maxPackets), m_offset(0), m_completed(0) {
+    m_latencies.reserve(maxPackets);
+  }
+
+  bool initialize() override { return m_inner->initialize(); }
+  bool flush() override { return m_inner->flush(); }
+  bool finalize() override { return m_inner->finalize(); }
+
+  void write(const uint8_t *data, uint32_t size) override {
+    m_inner->write(data, size);
+    m_offset += size;
+
+    auto now = PacketTimer::Clock::now();
+    uint64_t completed = m_offset / m_packetBytes;
+    for (; m_completed < completed && m_completed < m_maxPackets;
+         ++m_completed) {
+      auto captured =
+          m_source.frameTime((m_completed + 1) * FRAMES_PER_PACKET);
+      m_latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now - captured)
+              .count());
+    }
+  }
+
+  std::vector<int64_t> &latencies() { return m_latencies; }
+
+private:
+  AudioSink *m_inner;
+  const SyntheticSource &m_source;
+  uint32_t m_packetBytes;
+  size_t m_maxPackets;
+  std::vector<int64_t> m_latencies;
+  uint64_t m_offset;
+  uint64_t m_completed;
+};
+
+struct PipelineStream {
+  std::unique_ptr<SyntheticSource> source;
+  std::unique_ptr<WavWriter> writer;
+  std::unique_ptr<LatencyProbeSink> probe;
+  std::unique_ptr<DiskWriter> diskWriter;
+  std::thread thread;
+  CaptureScheduler::StreamId id = 0;
+};
+
+struct PipelineResult {
+  double seconds = 0;
+  double cpuPercent = 0;
+  uint64_t frames = 0;
+  uint64_t overruns = 0;
+  uint64_t writerWakeups = 0;
+  uint64_t captureWakeups = 0;
+  std::vector<int64_t> latencies;
+};
+
+// Same loop as AudioCapture::audioThread().
+static void pumpStream(PipelineStream &stream, const std::atomic<bool> &stop) {
+  Realtime::prepareThread(ThreadRole::Capture);
+  std::vector<uint8_t> buffer(stream.source->maxPacketBytes() *
+                              MAX_BATCH_PACKETS);
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (!stream.source->waitReady(READY_TIMEOUT_MS))
+      continue;
+    size_t size = stream.source->read(buffer.data(), buffer.size());
+    if (size == 0)
+      break;
+    stream.diskWriter->push(buffer.data(), static_cast<uint32_t>(size));
+  }
+}
+
+// Runs |streamCount| real-time streams for |seconds|, each on its own
+// capture thread, or on |schedulerThreads| shared threads when non-zero.
+static PipelineResult runPipeline(size_t streamCount, WavWriteMode mode,
+                                  double seconds, unsigned schedulerThreads,
+                                  const BenchOptions &options) {
+  SyntheticSourceConfig config;
+  config.signal = SyntheticSourceConfig::Signal::Noise;
+  config.framesPerPacket = FRAMES_PER_PACKET;
+  const uint32_t packetBytes = FRAMES_PER_PACKET * config.format.blockAlign();
+  const size_t maxPackets = static_cast<size_t>(
+      seconds * 2 * config.format.sampleRate / FRAMES_PER_PACKET + 16);
+
+  std::vector<PipelineStream> streams(streamCount);
+  for (size_t i = 0; i < streamCount; ++i) {
+    PipelineStream &stream = streams[i];
+    config.seed = static_cast<uint32_t>(i + 1);
+    stream.source = std::make_unique<SyntheticSource>(config);
+
+    WavWriterOptions writerOptions;
+    writerOptions.mode = mode;
+    writerOptions.preallocateSize = 16ull << 20;
+    std::string path =
+        options.workDir + "/pipeline-" + std::to_string(i) + ".wav";
+    stream.writer = std::make_unique<WavWriter>(
+        path, config.format.sampleRate, config.format.channels,
+        config.format.sampleFormat, writerOptions);
+    stream.probe = std::make_unique<LatencyProbeSink>(
+        stream.writer.get(), *stream.source, packetBytes, maxPackets);
+    stream.diskWriter = std::make_unique<DiskWriter>(stream.probe.get());
+    stream.probe->initialize();
+    stream.diskWriter->start();
+  }
+
+  std::unique_ptr<CaptureScheduler> scheduler;
+  if (schedulerThreads > 0) {
+    scheduler = std::make_unique<CaptureScheduler>(schedulerThreads);
+    scheduler->start();
+  }
+
+  std::atomic<bool> stop{false};
+  std::clock_t cpuStart = std::clock();
+  BenchTimer timer;
+  for (PipelineStream &stream : streams) {
+    stream.source->open();
+    if (scheduler)
+      stream.id = scheduler->attach(stream.source.get(),
+                                    stream.diskWriter.get());
+    else
+      stream.thread =
+          std::thread(pumpStream, std::ref(stream), std::cref(stop));
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+
+  PipelineResult result;
+  for (PipelineStream &stream : streams) {
+    if (scheduler)
+      scheduler->detach(stream.id);
+    else
+      stream.thread.join();
+  }
+  for (PipelineStream &stream : streams)
+    stream.diskWriter->stop();
+  result.seconds = timer.elapsedSeconds();
+  result.cpuPercent = 100.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC /
+                      result.seconds;
+  if (scheduler) {
+    result.captureWakeups = scheduler->wakeups();
+    scheduler->stop();
+  }
+
+  for (size_t i = 0; i < streamCount; ++i) {
+    PipelineStream &stream = streams[i];
+    stream.probe->finalize();
+    if (!scheduler)
+      result.captureWakeups += stream.source->timer().wakeups();
+    stream.source->close();
+    result.frames += stream.source->framesGenerated();
+    result.overruns += stream.diskWriter->overruns();
+    result.writerWakeups += stream.diskWriter->wakeups();
+    auto &latencies = stream.probe->latencies();
+    result.latencies.insert(result.latencies.end(), latencies.begin(),
+                            latencies.end());
+    std::remove(
+        (options.workDir + "/pipeline-" + std::to_string(i) + ".wav").c_str());
+  }
+  return result;
+}
+
+// Capture-to-disk latency of a single real-time stream for each write mode.
+void runLatencyBench(BenchReport &report, const BenchOptions &options) {
+  const struct {
+    const char *name;
+    WavWriteMode mode;
+  } modes[] = {{"stdio", WavWriteMode::Stdio},
+               {"batched", WavWriteMode::Batched},
+               {"mapped", WavWriteMode::Mapped}};
+  double seconds = options.quick ? QUICK_RUN_SECONDS : RUN_SECONDS;
+
+  for (const auto &mode : modes) {
+    PipelineResult result = runPipeline(1, mode.mode, seconds, 0, options);
+    BenchRecord record("capture_to_disk_latency");
+    record.set("mode", mode.name)
+        .set("packet_frames", static_cast<int64_t>(FRAMES_PER_PACKET))
+        .set("frames", result.frames)
+        .set("overruns", result.overruns)
+        .set("capture_wakeups", result.captureWakeups)
+        .set("writer_wakeups", result.writerWakeups);
+    LatencySummary::fromSamples(result.latencies).addTo(record);
+    report.add(record);
+  }
+}
+
+// Concurrent real-time synthetic streams, each with its own DiskWriter,
+// captured either by one thread per stream or by a CaptureScheduler pool.
+void runScalingBench(BenchReport &report, const BenchOptions &options) {
+  const struct {
+    size_t streams;
+    unsigned schedulerThreads;
+  } cases[] = {{1, 0}, {8, 0}, {64, 0}, {64, 2}, {256, 2}};
+  double seconds = options.quick ? QUICK_RUN_SECONDS : RUN_SECONDS;
+
+  for (const auto &c : cases) {
+    PipelineResult result = runPipeline(c.streams, WavWriteMode::Stdio,
+                                        seconds, c.schedulerThreads, options);
+    size_t captureThreads = c.schedulerThreads ? c.schedulerThreads : c.streams;
+    BenchRecord record("stream_scaling");
+    record.set("streams", static_cast<int64_t>(c.streams))
+        .set("capture", c.schedulerThreads ? "scheduler" : "thread_per_stream")
+        .set("threads", static_cast<int64_t>(captureThreads + c.streams))
+        .set("seconds", result.seconds)
+        .set("frames", result.frames)
+        .set("overruns", result.overruns)
+        .set("cpu_percent", result.cpuPercent)
+        .set("capture_wakeups", result.captureWakeups);
+    LatencySummary::fromSamples(result.latencies).addTo(record);
+    report.add(record);
+  }
+}
+
+// Capture-to-disk latency tails of real-time streams competing with
+// normal-priority busy threads, with the real-time mode off and on.
+void runRealtimeBench(BenchReport &report, const BenchOptions &options) {
+  const size_t streams = 8;
+  double seconds = options.quick ? QUICK_RUN_SECONDS : RUN_SECONDS;
+  unsigned hogCount =
+      HOGS_PER_CPU * std::max(1u, std::thread::hardware_concurrency());
+
+  for (bool realtime : {false, true}) {
+    RealtimeConfig config;
+    config.enabled = realtime;
+    Realtime::configure(config);
+
+    std::atomic<bool> stopHogs{false};
+    std::vector<std::thread> hogs;
+    for (unsigned i = 0; i < hogCount; ++i) {
+      hogs.emplace_back([&stopHogs]() {
+        volatile uint64_t spin = 0;
+        while (!stopHogs.load(std::memory_order_relaxed))
+          spin = spin + 1;
+      });
+    }
+
+    PipelineResult result =
+        runPipeline(streams, WavWriteMode::Stdio, seconds, 0, options);
+    stopHogs = true;
+    for (std::thread &hog : hogs)
+      hog.join();
+
+    BenchRecord record("realtime_latency");
+    record.set("realtime", realtime)
+        .set("streams", static_cast<int64_t>(streams))
+        .set("busy_threads", static_cast<int64_t>(hogCount))
+        .set("refused_threads", Realtime::refusedThreads())
+        .set("frames", result.frames)
+        .set("overruns", result.overruns);
+    LatencySummary::fromSamples(result.latencies).addTo(record);
+    report.add(record);
+  }
+  Realtime::configure(RealtimeConfig());
+}
@@ -0,0 +1,165 @@
+#include "Bench.h"
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+static constexpr double PI = 3.14159265358979323846;
+// Odd packet size so blocks never line up with the filter phases.
+static constexpr size_t PACKET_FRAMES = 333;
+static constexpr double SIGNAL_SECONDS = 2.0;
+
+struct ResampleCase {
+  uint32_t inputRate;
+  uint32_t outputRate;
+  uint16_t channels;
+  bool mono;
+  // The drift-correcting mode, run at a neutral adjustment.
+  bool variableRate;
+};
+
+// Streams |input| through |resampler| in packets, as the writer would.
+static std::vector<float> resampleAll(Resampler &resampler,
+                                      const std::vector<float> &input,
+                                      uint16_t channels) {
+  size_t frames = input.size() / channels;
+  std::vector<float> output(
+      (resampler.maxOutputFrames(frames) + resampler.tapsPerPhase() + 2) *
+      resampler.outputChannels());
+  std::vector<float> block(resampler.maxOutputFrames(PACKET_FRAMES) *
+                           resampler.outputChannels());
+  size_t produced = 0;
+  for (size_t offset = 0; offset < frames; offset += PACKET_FRAMES) {
+    size_t count = std::min(PACKET_FRAMES, frames - offset);
+    size_t n =
+        resampler.process(input.data() + offset * channels, count, block.data());
+    std::copy(block.begin(), block.begin() + n * resampler.outputChannels(),
+              output.begin() + produced * resampler.outputChannels());
+    produced += n;
+  }
+  produced += resampler.drain(output.data() +
+                              produced * resampler.outputChannels());
+  output.resize(produced * resampler.outputChannels());
+  return output;
+}
+
+static std::vector<float> sine(double frequency, uint32_t rate,
+                               uint16_t channels, size_t frames) {
+  std::vector<float> samples(frames * channels);
+  for (size_t i = 0; i < frames; ++i) {
+    float value = static_cast<float>(0.5 * std::sin(2 * PI * frequency * i / rate));
+    for (uint16_t c = 0; c < channels; ++c)
+      samples[i * channels + c] = value;
+  }
+  return samples;
+}
+
+// Error against the ideal band-limited output, skipping the filter's
+// start-up and tail.
+static double snrDb(const std::vector<float> &output, uint16_t channels,
+                    double frequency, uint32_t rate, size_t skip) {
+  size_t frames = output.size() / channels;
+  double signal = 0.0;
+  double noise = 0.0;
+  for (size_t i = skip; i + skip < frames; ++i) {
+    double ideal = 0.5 * std::sin(2 * PI * frequency * i / rate);
+    for (uint16_t c = 0; c < channels; ++c) {
+      double error = output[i * channels + c] - ideal;
+      signal += ideal * ideal;
+      noise += error * error;
+    }
+  }
+  return noise > 0 ? 10 * std::log10(signal / noise) : 200.0;
+}
+
+static double rmsDb(const std::vector<float> &samples, size_t skip) {
+  double sum = 0.0;
+  size_t count = 0;
+  for (size_t i = skip; i + skip < samples.size(); ++i, ++count)
+    sum += double(samples[i]) * samples[i];
+  return count ? 10 * std::log10(sum / count + 1e-30) : 0.0;
+}
+
+void runResamplerBench(BenchReport &report, const BenchOptions &options) {
+  const ResampleCase cases[] = {
+      {48000, 16000, 2, true, false},  {44100, 16000, 2, true, false},
+      {44100, 48000, 2, false, false}, {16000, 48000, 1, false, false},
+      {44100, 48000, 2, false, true},  {48000, 48000, 2, false, true},
+  };
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+  SimdLevel best = SampleConverter::detectSimdLevel();
+
+  for (const ResampleCase &test : cases) {
+    ResamplerConfig config;
+    config.inputRate = test.inputRate;
+    config.outputRate = test.outputRate;
+    config.channels = test.channels;
+    config.mono = test.mono;
+    config.variableRate = test.variableRate;
+    const size_t frames = size_t(SIGNAL_SECONDS * test.inputRate);
+    const double tone = 1000.0;
+    std::vector<float> input = sine(tone, test.inputRate, test.channels, frames);
+
+    Resampler scalar(config, SimdLevel::Scalar);
+    std::vector<float> reference = resampleAll(scalar, input, test.channels);
+    size_t skip = scalar.tapsPerPhase() * scalar.upFactor() /
+                      scalar.downFactor() +
+                  1;
+    double snr = snrDb(reference, scalar.outputChannels(), tone,
+                       test.outputRate, skip);
+
+    // A tone between the two Nyquist rates must not alias into the output.
+    double rejection = 0.0;
+    bool downsampling = test.outputRate < test.inputRate;
+    if (downsampling) {
+      double above = 0.75 * test.outputRate;
+      Resampler aliasing(config, SimdLevel::Scalar);
+      std::vector<float> out = resampleAll(
+          aliasing, sine(above, test.inputRate, test.channels, frames),
+          test.channels);
+      rejection = rmsDb(out, skip) - rmsDb(input, skip);
+    }
+
+    std::string ratio = std::to_string(test.inputRate) + "->" +
+                        std::to_string(test.outputRate);
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+      Resampler resampler(config, static_cast<SimdLevel>(level));
+      std::vector<float> output = resampleAll(resampler, input, test.channels);
+      double maxDiff = output.size() == reference.size() ? 0.0 : 1.0;
+      for (size_t i = 0; i < std::min(output.size(), reference.size()); ++i)
+        maxDiff = std::max(maxDiff, double(std::fabs(output[i] - reference[i])));
+
+      size_t passes = 0;
+      BenchTimer timer;
+      do {
+        resampler.reset();
+        resampleAll(resampler, input, test.channels);
+        ++passes;
+      } while (timer.elapsedSeconds() < minSeconds);
+      double framesPerSecond = passes * frames / timer.elapsedSeconds();
+
+      BenchRecord record("resampler");
+      record.set("ratio", ratio)
+          .set("channels", int(test.channels))
+          .set("mono", test.mono)
+          .set("taps", int64_t(resampler.tapsPerPhase()))
+          .set("phases", int64_t(test.variableRate
+                                     ? Resampler::VARIABLE_PHASES
+                                     : resampler.upFactor()))
+          .set("variable_rate", test.variableRate)
+          .set("kernel", SampleConverter::simdLevelName(resampler.simdLevel()))
+          .set("mframes_per_s", framesPerSecond / 1e6)
+          .set("x_realtime", framesPerSecond / test.inputRate)
+          .set("snr_db", snr)
+          .set("max_diff_vs_scalar", maxDiff)
+          .set("output_frames", int64_t(output.size() /
+                                        resampler.outputChannels()));
+      if (downsampling)
+        record.set("alias_rejection_db", rejection);
+      report.add(record);
+    }
+  }
+}
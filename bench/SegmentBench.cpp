@@ -0,0 +1,190 @@
+#include "Bench.h"
+#include "SegmentedSink.h"
+#include "Utils.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A 48 kHz stereo stream, paced at 20x real time, recorded into short
+// segments: rotation on SegmentedSink's background thread against closing
+// and creating files inline on the writing thread. Reports the worst
+// write() stall around the cuts, and checks that the segments read back
+// join into the exact input, with silent packets as zeros.
+static constexpr uint32_t RATE = 48000;
+static constexpr uint16_t CHANNELS = 2;
+// Odd-sized, so packets straddle the cuts.
+static constexpr uint32_t PACKET_FRAMES = 441;
+static constexpr uint32_t SILENT_EVERY = 7;
+static constexpr double SPEEDUP = 20.0;
+static constexpr double SECONDS = 120.0;
+static constexpr double QUICK_SECONDS = 20.0;
+static constexpr double SEGMENT_SECONDS = 10.0;
+static constexpr double QUICK_SEGMENT_SECONDS = 2.0;
+
+namespace {
+
+// The obvious rotation: finalize, sync and create files on the writing
+// thread when a segment is full.
+class InlineRotatingSink : public AudioSink {
+public:
+  InlineRotatingSink(const std::string &path, uint64_t segmentBytes)
+      : m_path(path), m_segmentBytes(segmentBytes) {}
+
+  bool initialize() override { return open(); }
+  void write(const uint8_t *data, uint32_t size) override {
+    while (size > 0) {
+      if (m_written == m_segmentBytes) {
+        closeCurrent();
+        open();
+      }
+      uint32_t chunk = static_cast<uint32_t>(
+          std::min<uint64_t>(size, m_segmentBytes - m_written));
+      m_writer->write(data, chunk);
+      m_written += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+  }
+  bool finalize() override {
+    if (m_writer)
+      closeCurrent();
+    return true;
+  }
+  unsigned segments() const { return m_index; }
+
+private:
+  bool open() {
+    m_writer.reset(new WavWriter(SegmentedSink::segmentPath(m_path, ++m_index),
+                                 RATE, CHANNELS, SampleFormat::Int16));
+    m_written = 0;
+    return m_writer->initialize();
+  }
+  void closeCurrent() {
+    m_writer->finalize();
+    m_writer.reset();
+    Utils::syncFile(SegmentedSink::segmentPath(m_path, m_index));
+  }
+
+  std::string m_path;
+  uint64_t m_segmentBytes;
+  std::unique_ptr<WavWriter> m_writer;
+  unsigned m_index = 0;
+  uint64_t m_written = 0;
+};
+
+// Reads segments 1..|count| back to back.
+std::vector<int16_t> readSegments(const std::string &path, unsigned count) {
+  std::vector<int16_t> samples;
+  std::vector<int16_t> chunk(4096 * CHANNELS);
+  for (unsigned index = 1; index <= count; ++index) {
+    WavReader reader(SegmentedSink::segmentPath(path, index));
+    if (!reader.open())
+      break;
+    size_t got;
+    while ((got = reader.read(reinterpret_cast<uint8_t *>(chunk.data()),
+                              chunk.size() * 2)) > 0)
+      samples.insert(samples.end(), chunk.begin(), chunk.begin() + got / 2);
+  }
+  return samples;
+}
+
+} // namespace
+
+void runSegmentBench(BenchReport &report, const BenchOptions &options) {
+  const double seconds = options.quick ? QUICK_SECONDS : SECONDS;
+  const double segmentSeconds =
+      options.quick ? QUICK_SEGMENT_SECONDS : SEGMENT_SECONDS;
+  const uint64_t frames = static_cast<uint64_t>(seconds * RATE);
+  const uint32_t frameBytes = CHANNELS * 2;
+  const std::string path = options.workDir + "/segment-bench.wav";
+
+  // Every frame distinct; silent packets read back as zeros.
+  std::vector<int16_t> input(size_t(frames) * CHANNELS);
+  std::vector<int16_t> expected(input.size());
+  for (uint64_t i = 0; i < input.size(); ++i)
+    input[i] = static_cast<int16_t>((i * 2654435761u) >> 16);
+  for (uint64_t frame = 0, packet = 0; frame < frames;
+       frame += PACKET_FRAMES, ++packet) {
+    uint64_t count = std::min<uint64_t>(PACKET_FRAMES, frames - frame);
+    if (packet % SILENT_EVERY != SILENT_EVERY - 1)
+      memcpy(&expected[frame * CHANNELS], &input[frame * CHANNELS],
+             count * frameBytes);
+  }
+
+  for (bool background : {true, false}) {
+    std::unique_ptr<AudioSink> sink;
+    SegmentedSink *segmented = nullptr;
+    InlineRotatingSink *inlined = nullptr;
+    if (background) {
+      SegmentOptions segmentOptions;
+      segmentOptions.maxSeconds = segmentSeconds;
+      segmentOptions.preopenSeconds = segmentSeconds / 4;
+      WavWriterOptions writerOptions;
+      writerOptions.reserveSeconds = segmentSeconds;
+      segmented = new SegmentedSink(
+          path, RATE, frameBytes, segmentOptions,
+          [writerOptions](const std::string &segmentPath) {
+            return std::unique_ptr<AudioSink>(
+                new WavWriter(segmentPath, RATE, CHANNELS,
+                              SampleFormat::Int16, writerOptions));
+          });
+      sink.reset(segmented);
+    } else {
+      inlined = new InlineRotatingSink(
+          path, uint64_t(segmentSeconds * RATE) * frameBytes);
+      sink.reset(inlined);
+    }
+    bool ok = sink->initialize();
+
+    std::vector<int64_t> stalls;
+    const auto start = std::chrono::steady_clock::now();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(input.data());
+    for (uint64_t frame = 0, packet = 0; ok && frame < frames;
+         frame += PACKET_FRAMES, ++packet) {
+      std::this_thread::sleep_until(
+          start + std::chrono::nanoseconds(
+                      int64_t(frame * 1e9 / RATE / SPEEDUP)));
+      uint32_t size = static_cast<uint32_t>(
+          std::min<uint64_t>(PACKET_FRAMES, frames - frame) * frameBytes);
+      BlockTimestamp time;
+      time.position = frame;
+      time.hostTimeNs = benchNowNs();
+      int64_t before = benchNowNs();
+      if (packet % SILENT_EVERY == SILENT_EVERY - 1)
+        sink->writeSilence(size, time);
+      else
+        sink->writeTimed(bytes + frame * frameBytes, size, time);
+      stalls.push_back(benchNowNs() - before);
+    }
+    ok = sink->finalize() && ok;
+    unsigned segments = background ? segmented->segments() : inlined->segments();
+    uint64_t lateCuts = background ? segmented->lateCuts() : 0;
+    sink.reset();
+
+    std::vector<int16_t> readBack = readSegments(path, segments);
+    bool gapFree = readBack == expected;
+    for (unsigned index = 1; index <= segments + 1; ++index)
+      std::remove(SegmentedSink::segmentPath(path, index).c_str());
+
+    std::sort(stalls.begin(), stalls.end());
+    double p99 = stalls.empty() ? 0.0 : stalls[stalls.size() * 99 / 100] / 1e3;
+    double worst = stalls.empty() ? 0.0 : stalls.back() / 1e3;
+    report.add(BenchRecord("segments")
+                   .set("rotation", background ? "background" : "inline")
+                   .set("seconds", seconds)
+                   .set("segment_seconds", segmentSeconds)
+                   .set("segments", uint64_t(segments))
+                   .set("late_cuts", lateCuts)
+                   .set("write_p99_us", p99)
+                   .set("write_max_us", worst)
+                   .set("gap_free", gapFree)
+                   .set("ok", ok && gapFree));
+  }
+}
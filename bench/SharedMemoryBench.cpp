@@ -0,0 +1,233 @@
+#include "Bench.h"
+#include "SharedMemoryReader.h"
+#include "SharedMemorySink.h"
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// A SharedMemorySink in this process and a SharedMemoryReader in a forked
+// one. Latency: 1 ms packets of 48 kHz stereo at real time, each stamped
+// with its send time, read by a reader sleeping on the futex against one
+// polling every millisecond. Throughput: an unpaced stream of counting
+// words; the reader checks every byte it accepted and counts what it lost
+// by falling behind, while the writer never waits for it.
+static constexpr uint32_t RATE = 48000;
+static constexpr uint16_t CHANNELS = 2;
+static constexpr uint32_t PACKET_BYTES = 48 * CHANNELS * 2;
+static constexpr double SECONDS = 10.0;
+static constexpr double QUICK_SECONDS = 2.0;
+static constexpr uint32_t BLOCK_BYTES = 16 << 10;
+static constexpr uint64_t TOTAL_BYTES = 1ull << 30;
+static constexpr uint64_t QUICK_TOTAL_BYTES = 128ull << 20;
+static constexpr int POLL_INTERVAL_MS = 1;
+
+namespace {
+
+struct ReaderResult {
+  uint64_t bytes;
+  uint64_t lostBytes;
+  uint64_t overruns;
+  uint64_t mismatches;
+  uint64_t samples;
+};
+
+bool writeAll(int fd, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  while (size > 0) {
+    ssize_t done = ::write(fd, bytes, size);
+    if (done <= 0)
+      return false;
+    bytes += done;
+    size -= static_cast<size_t>(done);
+  }
+  return true;
+}
+
+bool readAll(int fd, void *data, size_t size) {
+  uint8_t *bytes = static_cast<uint8_t *>(data);
+  while (size > 0) {
+    ssize_t done = ::read(fd, bytes, size);
+    if (done <= 0)
+      return false;
+    bytes += done;
+    size -= static_cast<size_t>(done);
+  }
+  return true;
+}
+
+// The child's side. Everything it needs is allocated before the fork, so
+// it makes no allocations of its own.
+void readStream(SharedMemoryReader &reader, bool latency, bool poll,
+                std::vector<int64_t> &samples, int resultFd) {
+  ReaderResult result = {};
+  while (!reader.open())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  while (!reader.ended()) {
+    const uint8_t *data;
+    size_t size;
+    if (poll) {
+      size = reader.peek(&data);
+      if (size == 0) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(POLL_INTERVAL_MS));
+        continue;
+      }
+    } else {
+      size = reader.wait(&data, 100);
+      if (size == 0)
+        continue;
+    }
+    int64_t now = benchNowNs();
+    uint64_t start = reader.position();
+
+    uint64_t mismatches = 0;
+    const size_t kept = samples.size();
+    if (latency) {
+      // Every packet starts with its send time.
+      uint64_t first = (start + PACKET_BYTES - 1) / PACKET_BYTES * PACKET_BYTES;
+      for (uint64_t packet = first; packet + sizeof(int64_t) <= start + size &&
+                                    samples.size() < samples.capacity();
+           packet += PACKET_BYTES) {
+        int64_t sent;
+        memcpy(&sent, data + (packet - start), sizeof(sent));
+        samples.push_back(now - sent);
+      }
+    } else {
+      // Word n of the stream holds n.
+      const size_t words = size / 4;
+      for (size_t i = 0; i < words; ++i) {
+        uint32_t word;
+        memcpy(&word, data + i * 4, 4);
+        mismatches += word != static_cast<uint32_t>(start / 4 + i);
+      }
+      size = words * 4;
+    }
+    // Only bytes that were not overwritten while we read them count.
+    if (reader.consume(size)) {
+      result.bytes += size;
+      result.mismatches += mismatches;
+    } else {
+      samples.resize(kept);
+    }
+  }
+  result.lostBytes = reader.lostBytes();
+  result.overruns = reader.overruns();
+  result.samples = samples.size();
+  writeAll(resultFd, &result, sizeof(result));
+  writeAll(resultFd, samples.data(), samples.size() * sizeof(int64_t));
+}
+
+// Runs |produce| against a reader in a child process; false if the child
+// could not be run.
+template <typename Produce>
+bool runWithReader(const std::string &name, bool latency, bool poll,
+                   size_t maxSamples, Produce produce, ReaderResult &result,
+                   std::vector<int64_t> &samples) {
+  SharedStreamOptions options;
+  options.capacitySeconds = 1.0;
+  SharedMemorySink sink(name, RATE, CHANNELS, SampleFormat::Int16, options);
+  if (!sink.initialize() || !sink.live())
+    return false;
+
+  SharedMemoryReader reader(name);
+  samples.clear();
+  samples.reserve(maxSamples);
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+  pid_t child = fork();
+  if (child < 0)
+    return false;
+  if (child == 0) {
+    close(fds[0]);
+    readStream(reader, latency, poll, samples, fds[1]);
+    _exit(0);
+  }
+  close(fds[1]);
+
+  // Give the reader time to attach and go to sleep.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  produce(sink);
+  sink.finalize();
+
+  bool ok = readAll(fds[0], &result, sizeof(result));
+  if (ok) {
+    samples.resize(result.samples);
+    ok = readAll(fds[0], samples.data(), samples.size() * sizeof(int64_t));
+  }
+  close(fds[0]);
+  int status = 0;
+  waitpid(child, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+void runSharedMemoryBench(BenchReport &report, const BenchOptions &options) {
+  const std::string name = "/audio-capture-bench-" + std::to_string(getpid());
+  const double seconds = options.quick ? QUICK_SECONDS : SECONDS;
+  const uint64_t packets = static_cast<uint64_t>(seconds * 1000);
+
+  for (bool poll : {false, true}) {
+    std::vector<uint8_t> packet(PACKET_BYTES, 0);
+    ReaderResult result = {};
+    std::vector<int64_t> samples;
+    bool ran = runWithReader(
+        name, true, poll, packets,
+        [&](SharedMemorySink &sink) {
+          const auto start = std::chrono::steady_clock::now();
+          for (uint64_t i = 0; i < packets; ++i) {
+            std::this_thread::sleep_until(start + std::chrono::milliseconds(i));
+            BlockTimestamp time;
+            time.position = i * (PACKET_BYTES / (CHANNELS * 2));
+            time.hostTimeNs = benchNowNs();
+            memcpy(packet.data(), &time.hostTimeNs, sizeof(time.hostTimeNs));
+            sink.writeTimed(packet.data(), PACKET_BYTES, time);
+          }
+        },
+        result, samples);
+
+    BenchRecord record("shm_latency");
+    record.set("reader", poll ? "poll_1ms" : "futex")
+        .set("packets", packets)
+        .set("received_bytes", result.bytes)
+        .set("lost_bytes", result.lostBytes);
+    LatencySummary::fromSamples(samples).addTo(record);
+    record.set("ok", ran && result.bytes == packets * PACKET_BYTES &&
+                         result.lostBytes == 0);
+    report.add(record);
+  }
+
+  const uint64_t total = options.quick ? QUICK_TOTAL_BYTES : TOTAL_BYTES;
+  std::vector<uint32_t> block(BLOCK_BYTES / 4);
+  ReaderResult result = {};
+  std::vector<int64_t> samples;
+  double writeSeconds = 0.0;
+  bool ran = runWithReader(
+      name, false, false, 0,
+      [&](SharedMemorySink &sink) {
+        BenchTimer timer;
+        for (uint64_t offset = 0; offset < total; offset += BLOCK_BYTES) {
+          for (size_t i = 0; i < block.size(); ++i)
+            block[i] = static_cast<uint32_t>(offset / 4 + i);
+          sink.write(reinterpret_cast<const uint8_t *>(block.data()),
+                     BLOCK_BYTES);
+        }
+        writeSeconds = timer.elapsedSeconds();
+      },
+      result, samples);
+  report.add(BenchRecord("shm_throughput")
+                 .set("total_mb", total / 1e6)
+                 .set("write_mb_per_s", total / writeSeconds / 1e6)
+                 .set("read_bytes", result.bytes)
+                 .set("lost_bytes", result.lostBytes)
+                 .set("overruns", result.overruns)
+                 .set("mismatches", result.mismatches)
+                 .set("ok", ran && result.mismatches == 0 &&
+                                result.bytes + result.lostBytes == total));
+}
@@ -0,0 +1,131 @@
+#include "Bench.h"
+#include "DiskWriter.h"
+#include "SyntheticSource.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+#include <cstdio>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// A speaker-like stream (48 kHz stereo float, written as int16) that is idle
+// most of the time: one second of signal, then four seconds the device flags
+// silent. Silence is stored either as literal zeros or as holes, per write
+// mode, through the DiskWriter; the file must hold every frame either way.
+static constexpr double SECONDS = 600.0;
+static constexpr double QUICK_SECONDS = 60.0;
+static constexpr uint32_t FRAMES_PER_PACKET = 480;
+static constexpr uint32_t ACTIVE_PACKETS = 100;
+static constexpr uint32_t SILENT_PACKETS = 400;
+
+namespace {
+
+// Hides the silence flag, so the zeros are written like any other audio.
+class UnflaggedSource : public CaptureSource {
+public:
+  explicit UnflaggedSource(CaptureSource &inner) : m_inner(inner) {}
+
+  bool open() override { return m_inner.open(); }
+  void close() override { m_inner.close(); }
+  StreamFormat format() const override { return m_inner.format(); }
+  size_t maxPacketBytes() const override { return m_inner.maxPacketBytes(); }
+  size_t read(uint8_t *buffer, size_t capacity) override {
+    return m_inner.read(buffer, capacity);
+  }
+
+private:
+  CaptureSource &m_inner;
+};
+
+struct WriterMode {
+  const char *name;
+  WavWriteMode mode;
+};
+
+} // namespace
+
+void runSilenceBench(BenchReport &report, const BenchOptions &options) {
+  const WriterMode modes[] = {{"stdio", WavWriteMode::Stdio},
+                              {"batched", WavWriteMode::Batched},
+                              {"mapped", WavWriteMode::Mapped}};
+  const double seconds = options.quick ? QUICK_SECONDS : SECONDS;
+  const std::string path = options.workDir + "/silence-bench.wav";
+
+  for (const WriterMode &mode : modes) {
+    for (bool holes : {false, true}) {
+      SyntheticSourceConfig config;
+      config.format.sampleFormat = SampleFormat::Float32;
+      config.framesPerPacket = FRAMES_PER_PACKET;
+      config.realTime = false;
+      config.totalFrames = static_cast<uint64_t>(seconds * 48000);
+      config.activePackets = ACTIVE_PACKETS;
+      config.silentPackets = SILENT_PACKETS;
+      SyntheticSource synthetic(config);
+      UnflaggedSource unflagged(synthetic);
+      CaptureSource &source =
+          holes ? static_cast<CaptureSource &>(synthetic) : unflagged;
+      if (!source.open())
+        continue;
+
+      WavWriterOptions writerOptions;
+      writerOptions.mode = mode.mode;
+      writerOptions.outputFormat = SampleFormat::Int16;
+      WavWriter writer(path, 48000, 2, SampleFormat::Float32, writerOptions);
+      if (!writer.initialize())
+        continue;
+
+      BufferPoolConfig poolConfig;
+      poolConfig.blockCount = 64;
+      poolConfig.blockSize = static_cast<uint32_t>(source.maxPacketBytes());
+      DiskWriter diskWriter(&writer, poolConfig);
+      if (!diskWriter.start())
+        continue;
+      std::vector<uint8_t> scratch(source.maxPacketBytes());
+
+      // The source is unpaced, so wait for free blocks instead of counting
+      // overruns.
+      BenchTimer timer;
+      for (;;) {
+        while (diskWriter.pool().available() == 0)
+          std::this_thread::yield();
+        if (diskWriter.readFrom(source, scratch.data(), scratch.size()) == 0)
+          break;
+      }
+      diskWriter.stop();
+      bool ok = writer.finalize() && diskWriter.overruns() == 0;
+      double elapsed = timer.elapsedSeconds();
+
+      struct stat info = {};
+      stat(path.c_str(), &info);
+      // Every row must read back the same samples.
+      WavReader reader(path);
+      uint64_t frames = reader.open() ? reader.frames() : 0;
+      uint64_t hash = 14695981039346656037ull;
+      size_t got;
+      while ((got = reader.read(scratch.data(), scratch.size())) > 0) {
+        for (size_t i = 0; i < got; ++i)
+          hash = (hash ^ scratch[i]) * 1099511628211ull;
+      }
+      reader.close();
+
+      report.add(BenchRecord("silence")
+                     .set("mode", mode.name)
+                     .set("silence", holes ? "holes" : "zeros")
+                     .set("seconds", seconds)
+                     .set("silent_fraction",
+                          double(SILENT_PACKETS) /
+                              (ACTIVE_PACKETS + SILENT_PACKETS))
+                     .set("frames", frames)
+                     .set("timeline_exact", frames == config.totalFrames)
+                     .set("file_bytes", int64_t(info.st_size))
+                     .set("disk_bytes", int64_t(info.st_blocks) * 512)
+                     .set("data_hash", std::to_string(hash))
+                     .set("bytes_written",
+                          writer.bytesWritten() - writer.silenceBytes())
+                     .set("x_realtime", seconds / elapsed)
+                     .set("ok", ok));
+      std::remove(path.c_str());
+    }
+  }
+}
@@ -0,0 +1,285 @@
+#include "Bench.h"
+#include "StreamSink.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// A StreamSink feeding a reader thread in this process over a Unix socket
+// or a FIFO. The stream is 48 kHz 16-bit stereo whose frame n holds the
+// word n, so the reader can tell a dropped frame (a jump), a repeated or
+// reordered one (a step back) and a torn one (garbage) apart. Throughput:
+// unpaced 1 ms packets, batched against one send per packet. Slow reader:
+// a reader taking 16 KB every 2 ms under each overflow policy, with the
+// worst time a single write() took. Reconnect: WAV framing, a reader that
+// leaves after 100 ms and another that takes over.
+static constexpr uint32_t RATE = 48000;
+static constexpr uint16_t CHANNELS = 2;
+static constexpr uint32_t FRAME_BYTES = CHANNELS * 2;
+static constexpr uint32_t PACKET_BYTES = 48 * FRAME_BYTES;
+static constexpr uint64_t TOTAL_BYTES = 256ull << 20;
+static constexpr uint64_t QUICK_TOTAL_BYTES = 32ull << 20;
+static constexpr uint64_t SLOW_TOTAL_BYTES = 8ull << 20;
+static constexpr uint64_t QUICK_SLOW_TOTAL_BYTES = 2ull << 20;
+static constexpr uint32_t SLOW_PACKET_BYTES = 20 * 48 * FRAME_BYTES;
+static constexpr size_t SLOW_READ_BYTES = 16 << 10;
+static constexpr int SLOW_READ_INTERVAL_MS = 2;
+static constexpr uint32_t RECONNECT_PACKETS = 600;
+static constexpr size_t WAV_HEADER_BYTES = 44;
+
+namespace {
+
+struct ReadResult {
+  bool connected = false;
+  bool headerOk = true;
+  uint64_t bytes = 0;
+  uint64_t frames = 0;
+  uint64_t gaps = 0;
+  uint64_t backwards = 0;
+  uint32_t firstFrame = 0;
+  uint32_t lastFrame = 0;
+};
+
+int connectReader(const std::string &target) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    int fd;
+    if (target.compare(0, 5, "unix:") == 0) {
+      sockaddr_un address = {};
+      address.sun_family = AF_UNIX;
+      strncpy(address.sun_path, target.c_str() + 5,
+              sizeof(address.sun_path) - 1);
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address),
+                             sizeof(address)) == 0)
+        return fd;
+      if (fd >= 0)
+        close(fd);
+    } else {
+      // Blocks until the sink opens its end, as `cat FIFO` would: a
+      // reader that is already there reads end-of-file with no writer.
+      fd = open(target.c_str(), O_RDONLY);
+      if (fd >= 0)
+        return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return -1;
+}
+
+// Reads until end of stream or |maxBytes| of audio, checking every frame.
+void readStream(const std::string &target, bool wav, uint64_t maxBytes,
+                bool slow, ReadResult &result) {
+  int fd = connectReader(target);
+  if (fd < 0)
+    return;
+  result.connected = true;
+
+  std::vector<uint8_t> buffer(slow ? SLOW_READ_BYTES : 256 << 10);
+  uint8_t header[WAV_HEADER_BYTES];
+  size_t headerBytes = wav ? 0 : WAV_HEADER_BYTES;
+  uint8_t frame[FRAME_BYTES];
+  size_t frameFill = 0;
+  uint32_t expected = 0;
+  while (result.bytes < maxBytes) {
+    ssize_t done = ::read(fd, buffer.data(), buffer.size());
+    if (done <= 0)
+      break;
+    const uint8_t *data = buffer.data();
+    size_t size = static_cast<size_t>(done);
+    if (headerBytes < WAV_HEADER_BYTES) {
+      size_t take = std::min(size, WAV_HEADER_BYTES - headerBytes);
+      memcpy(header + headerBytes, data, take);
+      headerBytes += take;
+      data += take;
+      size -= take;
+      if (headerBytes == WAV_HEADER_BYTES) {
+        uint16_t channels;
+        memcpy(&channels, header + 22, 2);
+        result.headerOk = memcmp(header, "RIFF", 4) == 0 &&
+                          memcmp(header + 8, "WAVE", 4) == 0 &&
+                          memcmp(header + 36, "data", 4) == 0 &&
+                          channels == CHANNELS;
+      }
+    }
+    result.bytes += size;
+    while (size > 0) {
+      size_t take = std::min<size_t>(size, FRAME_BYTES - frameFill);
+      memcpy(frame + frameFill, data, take);
+      frameFill += take;
+      data += take;
+      size -= take;
+      if (frameFill < FRAME_BYTES)
+        continue;
+      frameFill = 0;
+      uint32_t index;
+      memcpy(&index, frame, 4);
+      if (result.frames == 0)
+        result.firstFrame = index;
+      else if (index < expected)
+        ++result.backwards;
+      else if (index > expected)
+        ++result.gaps;
+      expected = index + 1;
+      result.lastFrame = index;
+      ++result.frames;
+    }
+    if (slow)
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(SLOW_READ_INTERVAL_MS));
+  }
+  close(fd);
+}
+
+// Writes |total| bytes, a multiple of |packetBytes|, of counting frames in
+// packets, paced
+// at one per |intervalMs| if nonzero; returns the slowest write() in ns.
+int64_t produce(StreamSink &sink, uint64_t total, uint32_t packetBytes,
+                int intervalMs) {
+  std::vector<uint32_t> packet(packetBytes / 4);
+  int64_t maxWriteNs = 0;
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t count = 0;
+  for (uint64_t offset = 0; offset < total; offset += packetBytes, ++count) {
+    if (intervalMs > 0)
+      std::this_thread::sleep_until(
+          start + std::chrono::milliseconds(count * intervalMs));
+    for (size_t i = 0; i < packet.size(); ++i)
+      packet[i] = static_cast<uint32_t>(offset / FRAME_BYTES + i);
+    int64_t before = benchNowNs();
+    sink.write(reinterpret_cast<const uint8_t *>(packet.data()), packetBytes);
+    maxWriteNs = std::max(maxWriteNs, benchNowNs() - before);
+  }
+  return maxWriteNs;
+}
+
+const char *policyName(StreamOverflowPolicy policy) {
+  switch (policy) {
+  case StreamOverflowPolicy::Block:
+    return "block";
+  case StreamOverflowPolicy::DropOldest:
+    return "drop_oldest";
+  case StreamOverflowPolicy::DropNewest:
+    return "drop_newest";
+  }
+  return "";
+}
+
+} // namespace
+
+void runStreamBench(BenchReport &report, const BenchOptions &options) {
+  const std::string socketTarget =
+      "unix:" + options.workDir + "/stream-" + std::to_string(getpid()) +
+      ".sock";
+  const std::string fifoTarget =
+      options.workDir + "/stream-" + std::to_string(getpid()) + ".fifo";
+
+  const uint64_t total =
+      (options.quick ? QUICK_TOTAL_BYTES : TOTAL_BYTES) / PACKET_BYTES *
+      PACKET_BYTES;
+  for (const std::string &target : {socketTarget, fifoTarget}) {
+    for (bool batched : {true, false}) {
+      StreamSinkOptions streamOptions;
+      streamOptions.policy = StreamOverflowPolicy::Block;
+      if (!batched)
+        streamOptions.batchBytes = 0;
+      StreamSink sink(target, RATE, CHANNELS, SampleFormat::Int16,
+                      streamOptions);
+      bool ready = sink.initialize();
+      ReadResult result;
+      std::thread reader(readStream, target, false, UINT64_MAX, false,
+                         std::ref(result));
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      BenchTimer timer;
+      produce(sink, total, PACKET_BYTES, 0);
+      sink.finalize();
+      double seconds = timer.elapsedSeconds();
+      reader.join();
+      report.add(
+          BenchRecord("stream_throughput")
+              .set("transport", target == fifoTarget ? "fifo" : "unix_socket")
+              .set("sends", batched ? "batched" : "per_packet")
+              .set("total_mb", total / 1e6)
+              .set("mb_per_s", total / seconds / 1e6)
+              .set("send_calls", sink.sendCalls())
+              .set("send_calls_per_mb", sink.sendCalls() / (total / 1e6))
+              .set("received_bytes", result.bytes)
+              .set("gaps", result.gaps)
+              .set("ok", ready && result.bytes == total && result.gaps == 0 &&
+                             result.backwards == 0));
+    }
+  }
+  unlink(fifoTarget.c_str());
+
+  const uint64_t slowTotal =
+      (options.quick ? QUICK_SLOW_TOTAL_BYTES : SLOW_TOTAL_BYTES) /
+      SLOW_PACKET_BYTES * SLOW_PACKET_BYTES;
+  for (StreamOverflowPolicy policy :
+       {StreamOverflowPolicy::Block, StreamOverflowPolicy::DropOldest,
+        StreamOverflowPolicy::DropNewest}) {
+    StreamSinkOptions streamOptions;
+    streamOptions.policy = policy;
+    streamOptions.queueBytes = 256 << 10;
+    StreamSink sink(socketTarget, RATE, CHANNELS, SampleFormat::Int16,
+                    streamOptions);
+    bool ready = sink.initialize();
+    ReadResult result;
+    std::thread reader(readStream, socketTarget, false, UINT64_MAX, true,
+                       std::ref(result));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int64_t maxWriteNs = produce(sink, slowTotal, SLOW_PACKET_BYTES, 0);
+    sink.finalize();
+    reader.join();
+    bool accounted = result.bytes + sink.droppedBytes() +
+                         sink.unsentBytes() ==
+                     slowTotal;
+    bool ok = ready && accounted && result.backwards == 0;
+    if (policy == StreamOverflowPolicy::Block)
+      ok = ok && result.gaps == 0 && result.bytes == slowTotal;
+    report.add(BenchRecord("stream_slow_reader")
+                   .set("policy", policyName(policy))
+                   .set("total_mb", slowTotal / 1e6)
+                   .set("max_write_us", maxWriteNs / 1e3)
+                   .set("received_bytes", result.bytes)
+                   .set("dropped_bytes", sink.droppedBytes())
+                   .set("gaps", result.gaps)
+                   .set("backwards", result.backwards)
+                   .set("ok", ok));
+  }
+
+  // The first reader leaves after 100 ms of audio; the second must get a
+  // new header, then frames that carry on where the first one stopped.
+  StreamSinkOptions streamOptions;
+  streamOptions.framing = StreamFraming::Wav;
+  streamOptions.reconnectIntervalMs = 10;
+  StreamSink sink(socketTarget, RATE, CHANNELS, SampleFormat::Int16,
+                  streamOptions);
+  bool ready = sink.initialize();
+  ReadResult first;
+  ReadResult second;
+  std::thread reader([&] {
+    readStream(socketTarget, true, 100 * PACKET_BYTES, false, first);
+    readStream(socketTarget, true, UINT64_MAX, false, second);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  produce(sink, uint64_t(RECONNECT_PACKETS) * PACKET_BYTES, PACKET_BYTES, 1);
+  sink.finalize();
+  reader.join();
+  report.add(BenchRecord("stream_reconnect")
+                 .set("connections", sink.connections())
+                 .set("first_frames", first.frames)
+                 .set("second_first_frame", uint64_t(second.firstFrame))
+                 .set("second_frames", second.frames)
+                 .set("missed_bytes", sink.unsentBytes())
+                 .set("ok", ready && sink.connections() == 2 &&
+                                first.headerOk && second.headerOk &&
+                                second.frames > 0 &&
+                                second.firstFrame > first.lastFrame &&
+                                second.gaps == 0 && second.backwards == 0));
+}
@@ -0,0 +1,150 @@
+#include "Bench.h"
+#include "SampleBlock.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Mono mix, the per-frame work of voice activity detection, through the
+// kernel blockKernels() picks against the loop it replaced, which switched
+// on the format for every sample and on a run-time channel count for every
+// frame; the two must agree bit for bit. Decode throughput is reported for
+// the same layouts. Stereo and mono are fixed-channel instantiations, six
+// channels the run-time fallback.
+static constexpr size_t FRAMES = 48000;
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+
+namespace {
+
+void downmixSwitched(const uint8_t *data, size_t frames, SampleFormat format,
+                     uint16_t channels, float *dst) {
+  const uint16_t bytes = bytesPerSample(format);
+  const float scale =
+      format == SampleFormat::Int16   ? 1.0f / (32768.0f * channels)
+      : format == SampleFormat::Int24 ? 1.0f / (8388608.0f * channels)
+      : format == SampleFormat::Int32 ? 1.0f / (2147483648.0f * channels)
+                                      : 1.0f / channels;
+  for (size_t f = 0; f < frames; ++f) {
+    const uint8_t *frame = data + f * channels * bytes;
+    float sum = 0.0f;
+    for (uint16_t c = 0; c < channels; ++c) {
+      const uint8_t *p = frame + c * bytes;
+      switch (format) {
+      case SampleFormat::Int16: {
+        int16_t value;
+        memcpy(&value, p, 2);
+        sum += float(value);
+        break;
+      }
+      case SampleFormat::Int24:
+        sum += float(static_cast<int32_t>(uint32_t(p[0]) << 8 |
+                                          uint32_t(p[1]) << 16 |
+                                          uint32_t(p[2]) << 24) >>
+                     8);
+        break;
+      case SampleFormat::Int32: {
+        int32_t value;
+        memcpy(&value, p, 4);
+        sum += float(value);
+        break;
+      }
+      case SampleFormat::Float32: {
+        float value;
+        memcpy(&value, p, 4);
+        sum += value;
+        break;
+      }
+      }
+    }
+    dst[f] = sum * scale;
+  }
+}
+
+// Frames per second through |run|, repeated for at least |minSeconds|.
+template <typename Run> double measure(double minSeconds, Run run) {
+  size_t passes = 0;
+  BenchTimer timer;
+  do {
+    run();
+    ++passes;
+  } while (timer.elapsedSeconds() < minSeconds);
+  return passes * FRAMES / timer.elapsedSeconds();
+}
+
+const char *formatName(SampleFormat format) {
+  switch (format) {
+  case SampleFormat::Int16:
+    return "int16";
+  case SampleFormat::Int24:
+    return "int24";
+  case SampleFormat::Int32:
+    return "int32";
+  case SampleFormat::Float32:
+    break;
+  }
+  return "float32";
+}
+
+} // namespace
+
+void runTypedPipelineBench(BenchReport &report, const BenchOptions &options) {
+  struct Layout {
+    SampleFormat format;
+    uint16_t channels;
+  };
+  const Layout layouts[] = {
+      {SampleFormat::Int16, 2},   {SampleFormat::Float32, 2},
+      {SampleFormat::Int16, 1},   {SampleFormat::Int24, 2},
+      {SampleFormat::Int32, 2},   {SampleFormat::Int16, 6},
+      {SampleFormat::Float32, 6}};
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+  std::mt19937 rng(42);
+
+  for (const Layout &layout : layouts) {
+    const size_t samples = FRAMES * layout.channels;
+    std::vector<uint8_t> input(samples * bytesPerSample(layout.format));
+    if (layout.format == SampleFormat::Float32) {
+      std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+      for (size_t i = 0; i < samples; ++i) {
+        float value = dist(rng);
+        memcpy(input.data() + 4 * i, &value, 4);
+      }
+    } else {
+      for (uint8_t &byte : input)
+        byte = static_cast<uint8_t>(rng());
+    }
+    std::vector<float> reference(FRAMES);
+    std::vector<float> mono(FRAMES);
+    std::vector<float> decoded(samples);
+
+    const BlockKernels &kernels =
+        blockKernels(layout.format, layout.channels);
+    downmixSwitched(input.data(), FRAMES, layout.format, layout.channels,
+                    reference.data());
+    kernels.downmix(input.data(), FRAMES, layout.channels, mono.data());
+    bool exact =
+        memcmp(reference.data(), mono.data(), FRAMES * sizeof(float)) == 0;
+
+    double switched = measure(minSeconds, [&] {
+      downmixSwitched(input.data(), FRAMES, layout.format, layout.channels,
+                      mono.data());
+    });
+    double typed = measure(minSeconds, [&] {
+      kernels.downmix(input.data(), FRAMES, layout.channels, mono.data());
+    });
+    double decode = measure(minSeconds, [&] {
+      kernels.decode(input.data(), FRAMES, layout.channels, decoded.data());
+    });
+    report.add(BenchRecord("typed_pipeline")
+                   .set("format", formatName(layout.format))
+                   .set("channels", int(layout.channels))
+                   .set("kernel", kernels.channels == DYNAMIC_CHANNELS
+                                      ? "dynamic"
+                                      : "fixed")
+                   .set("downmix_switched_mframes_per_s", switched / 1e6)
+                   .set("downmix_typed_mframes_per_s", typed / 1e6)
+                   .set("speedup", typed / switched)
+                   .set("decode_mframes_per_s", decode / 1e6)
+                   .set("bit_exact", exact));
+  }
+}
@@ -0,0 +1,279 @@
+#include "Bench.h"
+#include "LevelMeter.h"
+#include "VoiceActivity.h"
+#include "VoiceActivitySink.h"
+#include "WavWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// LevelMeter kernels against the scalar one, then the detector on
+// synthetic speech bursts in white noise: frame precision/recall against
+// the known bursts, start/end error, and how much a gated WavWriter keeps.
+static constexpr size_t KERNEL_FRAMES = 48000 * 10;
+static constexpr uint16_t CHANNELS = 2;
+static constexpr double MIN_SECONDS = 0.5;
+static constexpr double QUICK_SECONDS = 0.1;
+static constexpr uint32_t RATE = 48000;
+static constexpr uint32_t PACKET_FRAMES = 480;
+static constexpr double SCENE_SECONDS = 120.0;
+static constexpr double SCENE_QUICK_SECONDS = 30.0;
+// Speech RMS in dBFS; the noise is set below it by the SNR.
+static constexpr double SPEECH_DBFS = -20.0;
+
+namespace {
+
+struct Burst {
+  uint64_t start;
+  uint64_t end;
+};
+
+uint32_t nextRandom(uint32_t &state) {
+  state = state * 1664525u + 1013904223u;
+  return state;
+}
+
+double uniform(uint32_t &state) {
+  return double(nextRandom(state) >> 8) / double(1 << 24);
+}
+
+// Voiced bursts of 0.5-3 s with a syllable envelope, separated by 0.5-2.5 s
+// pauses, in white noise |snrDb| below the speech (no speech when
+// |snrDb| is negative). Returns stereo Int16 and the true bursts.
+std::vector<int16_t> makeScene(uint64_t frames, double snrDb,
+                               std::vector<Burst> &bursts) {
+  const double pi = std::acos(-1.0);
+  std::vector<double> speech(frames, 0.0);
+  uint32_t random = 12345;
+  bursts.clear();
+  if (snrDb >= 0.0) {
+    uint64_t position = uint64_t((0.5 + 2.0 * uniform(random)) * RATE);
+    double phase = 0.0;
+    while (position < frames) {
+      uint64_t length = uint64_t((0.5 + 2.5 * uniform(random)) * RATE);
+      uint64_t end = std::min(frames, position + length);
+      double basePitch = 100.0 + 120.0 * uniform(random);
+      for (uint64_t i = position; i < end; ++i) {
+        double t = double(i - position) / RATE;
+        double pitch = basePitch * (1.0 + 0.1 * std::sin(2 * pi * 0.7 * t));
+        phase += 2 * pi * pitch / RATE;
+        double edge = std::min({1.0, t / 0.02, double(end - i) / RATE / 0.02});
+        double syllable = 0.3 + 0.7 * std::fabs(std::sin(2 * pi * 2.0 * t));
+        double voiced = 0.0;
+        for (int h = 1; h * pitch < 3500.0; ++h)
+          voiced += std::sin(h * phase) / h;
+        speech[i] = edge * syllable * voiced;
+      }
+      bursts.push_back({position, end});
+      position = end + uint64_t((0.5 + 2.0 * uniform(random)) * RATE);
+    }
+  }
+
+  // Scale the bursts to SPEECH_DBFS and the noise to the SNR below it.
+  double power = 0.0;
+  uint64_t speechFrames = 0;
+  for (const Burst &burst : bursts) {
+    for (uint64_t i = burst.start; i < burst.end; ++i)
+      power += speech[i] * speech[i];
+    speechFrames += burst.end - burst.start;
+  }
+  double speechRms = std::pow(10.0, SPEECH_DBFS / 20.0);
+  double gain = speechFrames ? speechRms / std::sqrt(power / speechFrames) : 0;
+  double noiseRms = speechRms * std::pow(10.0, -std::fabs(snrDb) / 20.0);
+  // Uniform noise has an RMS of its half-width over sqrt(3).
+  double noiseWidth = noiseRms * std::sqrt(3.0);
+
+  std::vector<int16_t> scene(size_t(frames) * CHANNELS);
+  for (uint64_t i = 0; i < frames; ++i) {
+    for (uint16_t c = 0; c < CHANNELS; ++c) {
+      double value = gain * speech[i] +
+                     noiseWidth * (2.0 * uniform(random) - 1.0);
+      scene[size_t(i) * CHANNELS + c] = static_cast<int16_t>(
+          std::lround(std::max(-1.0, std::min(1.0, value)) * 32767.0));
+    }
+  }
+  return scene;
+}
+
+bool sameSums(const LevelSums &a, const LevelSums &b, bool exact) {
+  if (a.peak != b.peak || a.zeroCrossings != b.zeroCrossings ||
+      a.samples != b.samples)
+    return false;
+  if (exact)
+    return a.sumSquares == b.sumSquares;
+  return std::fabs(a.sumSquares - b.sumSquares) <= 1e-9 * a.sumSquares;
+}
+
+void runKernels(BenchReport &report, const BenchOptions &options) {
+  const double minSeconds = options.quick ? QUICK_SECONDS : MIN_SECONDS;
+  const size_t samples = KERNEL_FRAMES * CHANNELS;
+  uint32_t random = 1;
+  std::vector<int16_t> pcm(samples);
+  std::vector<float> floats(samples);
+  for (size_t i = 0; i < samples; ++i) {
+    pcm[i] = static_cast<int16_t>(nextRandom(random) >> 16);
+    floats[i] = float(pcm[i]) / 32768.0f;
+  }
+
+  SimdLevel best = SampleConverter::detectSimdLevel();
+  for (SampleFormat format : {SampleFormat::Int16, SampleFormat::Float32}) {
+    const uint8_t *data =
+        format == SampleFormat::Int16
+            ? reinterpret_cast<const uint8_t *>(pcm.data())
+            : reinterpret_cast<const uint8_t *>(floats.data());
+    size_t bytes = samples * bytesPerSample(format);
+    // Offset by one byte so the kernels see unaligned input.
+    std::vector<uint8_t> shifted(bytes + 1);
+    memcpy(shifted.data() + 1, data, bytes);
+
+    LevelSums reference;
+    LevelMeter(format, CHANNELS, SimdLevel::Scalar)
+        .measure(data, KERNEL_FRAMES, reference);
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+      LevelMeter meter(format, CHANNELS, static_cast<SimdLevel>(level));
+      if (level > 0 && meter.simdLevel() != static_cast<SimdLevel>(level))
+        continue;
+      LevelSums sums;
+      meter.measure(shifted.data() + 1, KERNEL_FRAMES, sums);
+      bool matches =
+          sameSums(reference, sums, format == SampleFormat::Int16);
+
+      size_t passes = 0;
+      BenchTimer timer;
+      do {
+        LevelSums scratch;
+        meter.reset();
+        meter.measure(data, KERNEL_FRAMES, scratch);
+        ++passes;
+      } while (timer.elapsedSeconds() < minSeconds);
+      double rate = passes * samples / timer.elapsedSeconds() / 1e6;
+      report.add(BenchRecord("vad")
+                     .set("stage", "meter")
+                     .set("format", format == SampleFormat::Int16 ? "int16" : "float32")
+                     .set("kernel", SampleConverter::simdLevelName(
+                                        meter.simdLevel()))
+                     .set("msamples_per_s", rate)
+                     .set("matches_scalar", matches));
+    }
+  }
+}
+
+// Fraction of |a| covered by |b|.
+double coverage(const std::vector<Burst> &a, const std::vector<Burst> &b) {
+  uint64_t total = 0, covered = 0;
+  for (const Burst &x : a) {
+    total += x.end - x.start;
+    for (const Burst &y : b) {
+      uint64_t start = std::max(x.start, y.start);
+      uint64_t end = std::min(x.end, y.end);
+      if (end > start)
+        covered += end - start;
+    }
+  }
+  return total ? double(covered) / total : 1.0;
+}
+
+} // namespace
+
+void runVadBench(BenchReport &report, const BenchOptions &options) {
+  runKernels(report, options);
+
+  const double seconds = options.quick ? SCENE_QUICK_SECONDS : SCENE_SECONDS;
+  const uint64_t frames = static_cast<uint64_t>(seconds * RATE);
+  const size_t frameBytes = CHANNELS * 2;
+  const std::string path = options.workDir + "/vad-bench.wav";
+
+  // Negative: noise only, at the level of the 10 dB case.
+  for (double snrDb : {30.0, 20.0, 10.0, -10.0}) {
+    std::vector<Burst> truth;
+    std::vector<int16_t> scene = makeScene(frames, snrDb, truth);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(scene.data());
+
+    // Detector alone: accuracy and cost.
+    VoiceActivityDetector detector;
+    detector.reset(RATE, CHANNELS, SampleFormat::Int16);
+    std::vector<VoiceEvent> events;
+    BenchTimer timer;
+    for (uint64_t frame = 0; frame < frames; frame += PACKET_FRAMES) {
+      uint64_t count = std::min<uint64_t>(PACKET_FRAMES, frames - frame);
+      detector.process(bytes + frame * frameBytes, size_t(count * frameBytes),
+                       &events);
+    }
+    double elapsed = timer.elapsedSeconds();
+
+    std::vector<Burst> detected;
+    for (const VoiceEvent &event : events) {
+      if (event.type == VoiceEvent::Type::SpeechStart)
+        detected.push_back({event.frame, frames});
+      else if (!detected.empty())
+        detected.back().end = event.frame;
+    }
+    // Start and end errors against the true burst each detection overlaps
+    // most; ends include the hangover.
+    double startError = 0.0, endError = 0.0;
+    size_t matched = 0;
+    for (const Burst &burst : truth) {
+      for (const Burst &found : detected) {
+        if (found.start < burst.end && found.end > burst.start &&
+            found.start + RATE / 2 > burst.start) {
+          startError += std::fabs(double(found.start) - double(burst.start));
+          endError += double(found.end) - double(burst.end);
+          ++matched;
+          break;
+        }
+      }
+    }
+
+    // The gate in front of a WavWriter.
+    WavWriter *writer = new WavWriter(path, RATE, CHANNELS, SampleFormat::Int16);
+    VoiceActivityConfig gateConfig;
+    gateConfig.gate = true;
+    VoiceActivityDetector gateDetector(gateConfig);
+    gateDetector.reset(RATE, CHANNELS, SampleFormat::Int16);
+    VoiceActivitySink gate{std::unique_ptr<AudioSink>(writer), &gateDetector};
+    bool ok = gate.initialize();
+    for (uint64_t frame = 0; ok && frame < frames; frame += PACKET_FRAMES) {
+      uint64_t count = std::min<uint64_t>(PACKET_FRAMES, frames - frame);
+      BlockTimestamp time;
+      time.position = frame;
+      time.hostTimeNs = int64_t(frame) * 1000000000 / RATE + 1;
+      gate.writeTimed(bytes + frame * frameBytes, uint32_t(count * frameBytes),
+                      time);
+    }
+    ok = ok && gate.finalize();
+    bool lengthOk = writer->framesWritten() == frames;
+    uint64_t holeBytes = writer->silenceBytes();
+    std::remove(path.c_str());
+
+    double speechSeconds = 0.0;
+    for (const Burst &burst : truth)
+      speechSeconds += double(burst.end - burst.start) / RATE;
+    BenchRecord record("vad");
+    record.set("stage", "detector");
+    if (snrDb >= 0.0)
+      record.set("snr_db", snrDb);
+    else
+      record.set("noise_only", true);
+    record.set("seconds", seconds)
+        .set("x_realtime", seconds / elapsed)
+        .set("true_speech_s", speechSeconds)
+        .set("true_segments", uint64_t(truth.size()))
+        .set("segments", detector.speechSegments())
+        .set("recall", coverage(truth, detected))
+        .set("precision", detected.empty() ? 1.0 : coverage(detected, truth));
+    if (matched) {
+      record.set("start_error_ms", 1000.0 * startError / matched / RATE)
+          .set("end_overhang_ms", 1000.0 * endError / matched / RATE);
+    }
+    record.set("gated_kept", 1.0 - double(gate.gatedBytes()) /
+                                       double(frames * frameBytes))
+        .set("hole_bytes", holeBytes)
+        .set("length_ok", lengthOk)
+        .set("ok", ok && lengthOk);
+    report.add(record);
+  }
+}
@@ -0,0 +1,58 @@
+#include "Bench.h"
+#include "WavWriter.h"
+#include <cstdio>
+#include <vector>
+
+// WavWriter throughput per write mode and packet size. Each pass writes a
+// fixed payload of 48 kHz stereo int16 and includes finalize(), so deferred
+// I/O is counted.
+static constexpr uint64_t PAYLOAD_BYTES = 64ull << 20;
+static constexpr uint64_t QUICK_PAYLOAD_BYTES = 16ull << 20;
+
+struct WriterMode {
+  const char *name;
+  WavWriteMode mode;
+};
+
+void runWriterBench(BenchReport &report, const BenchOptions &options) {
+  const WriterMode modes[] = {{"stdio", WavWriteMode::Stdio},
+                              {"batched", WavWriteMode::Batched},
+                              {"mapped", WavWriteMode::Mapped}};
+  const uint32_t packetSizes[] = {256, 1024, 4096, 16384, 65536};
+  const uint64_t payload =
+      options.quick ? QUICK_PAYLOAD_BYTES : PAYLOAD_BYTES;
+
+  std::vector<uint8_t> packet(packetSizes[4]);
+  for (size_t i = 0; i < packet.size(); ++i)
+    packet[i] = static_cast<uint8_t>(i * 31);
+
+  const std::string path = options.workDir + "/writer-bench.wav";
+  for (const WriterMode &mode : modes) {
+    for (uint32_t packetSize : packetSizes) {
+      WavWriterOptions writerOptions;
+      writerOptions.mode = mode.mode;
+      writerOptions.preallocateSize = payload + (1 << 20);
+      WavWriter writer(path, 48000, 2, 16, writerOptions);
+      if (!writer.initialize())
+        continue;
+
+      const uint64_t packets = payload / packetSize;
+      BenchTimer timer;
+      for (uint64_t i = 0; i < packets; ++i)
+        writer.write(packet.data(), packetSize);
+      bool ok = writer.finalize();
+      double seconds = timer.elapsedSeconds();
+
+      report.add(BenchRecord("writer_throughput")
+                     .set("mode", mode.name)
+                     .set("packet_bytes", static_cast<int64_t>(packetSize))
+                     .set("bytes", packets * packetSize)
+                     .set("seconds", seconds)
+                     .set("mib_per_s", packets * packetSize / seconds /
+                                           (1024.0 * 1024.0))
+                     .set("ns_per_packet", seconds * 1e9 / packets)
+                     .set("ok", ok));
+    }
+  }
+  std::remove(path.c_str());
+}
@@ -0,0 +1,105 @@
+#include "Bench.h"
+#include "Logger.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+struct Scenario {
+    const char* name;
+    const char* title;
+    void (*run)(BenchReport&, const BenchOptions&);
+};
+
+static const Scenario SCENARIOS[] = {
+    {"conversion", "Sample format conversion (float32 -> PCM)", runConversionBench},
+    {"resampler", "Polyphase resampler throughput and quality per SIMD kernel", runResamplerBench},
+    {"writer", "WavWriter throughput by write mode and packet size", runWriterBench},
+    {"capture-loop", "Capture loop wakeups: sleep polling vs readiness events", runCaptureLoopBench},
+    {"latency", "Capture-to-disk latency, single stream", runLatencyBench},
+    {"scaling", "Concurrent synthetic streams (1/8/64)", runScalingBench},
+    {"realtime", "Latency tails under CPU load: default vs real-time threads", runRealtimeBench},
+    {"buffer-pool", "Buffer pool under disk stalls: fixed vs auto-tuned", runBufferPoolBench},
+    {"clock-drift", "Mic/speaker alignment over long runs with skewed clocks", runClockDriftBench},
+    {"silence", "Mostly idle stream: silence stored as zeros vs holes", runSilenceBench},
+    {"flac", "FLAC encoding throughput per encoder thread, with round trip", runFlacBench},
+    {"codec", "G.711 / IMA ADPCM kernels and compressed WAV writing, with round trip", runCodecBench},
+    {"vad", "Level meter kernels and voice-activity detection accuracy / gating", runVadBench},
+    {"segments", "Segment rotation: background vs inline close/create, gap-free check", runSegmentBench},
+    {"fanout", "Fan-out to live consumers: zero-copy vs copying, slow consumer", runFanoutBench},
+    {"shm", "Shared-memory live stream: wake latency and lossy reader check", runSharedMemoryBench},
+    {"stream", "Socket/FIFO streaming: batched sends, overflow policies, reconnects", runStreamBench},
+    {"multichannel", "Combined mic + loopback file: interleave kernels, group alignment", runMultichannelBench},
+    {"typed", "Typed sample blocks: per-layout kernels vs per-sample format switch", runTypedPipelineBench},
+    {"logging", "Log call cost: ostream with std::endl vs async logger", runLoggingBench},
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--quick] [--filter NAME] [--output FILE] [--dir DIR]" << std::endl;
+    std::cerr << "Scenarios:";
+    for (const Scenario& scenario : SCENARIOS) {
+        std::cerr << " " << scenario.name;
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::string filter;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.quick = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.workDir = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.workDir.empty()) {
+        options.workDir = std::filesystem::temp_directory_path().string();
+    }
+
+    // Keep stdout clean for the JSON report.
+    Logger::instance().setOutput(stderr, stderr);
+
+    BenchReport report;
+    for (const Scenario& scenario : SCENARIOS) {
+        if (!filter.empty() && filter != scenario.name) {
+            continue;
+        }
+        Logger::instance().flush();
+        std::cerr << "=== " << scenario.title << " ===" << std::endl;
+        scenario.run(report, options);
+    }
+    Logger::instance().flush();
+
+    std::string json = report.toJson();
+    if (outputPath.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream file(outputPath);
+        if (!file) {
+            std::cerr << "Failed to write " << outputPath << std::endl;
+            return 1;
+        }
+        file << json;
+        std::cerr << "Results written to " << outputPath << std::endl;
+    }
+
+    // Nonzero when any check failed, so CI catches it.
+    std::vector<const BenchRecord*> failures = report.failures();
+    for (const BenchRecord* record : failures) {
+        std::cerr << "FAILED: " << record->toText() << std::endl;
+    }
+    return failures.empty() ? 0 : 1;
+}
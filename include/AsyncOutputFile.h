@@ -0,0 +1,90 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "OutputFile.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
+
+struct AsyncOutputOptions {
+    // Rounded up to a multiple of the page size.
+    size_t blockSize = 1 << 20;
+    unsigned maxBlocksInFlight = 4;
+    bool directIo = false;
+    // Falls back to the pwritev thread when io_uring is unavailable.
+    bool useIoUring = true;
+};
+
+// Gathers appended data into large page-aligned blocks and writes them
+// asynchronously, keeping at most maxBlocksInFlight blocks outstanding.
+// Blocks are submitted through io_uring when the kernel allows it, otherwise
+// through pwritev() on a helper thread.
+class AsyncOutputFile : public OutputFile {
+public:
+    explicit AsyncOutputFile(const AsyncOutputOptions& options = AsyncOutputOptions());
+    ~AsyncOutputFile() override;
+
+    bool open(const std::string& path) override;
+    bool append(const uint8_t* data, size_t size) override;
+    // Long runs end the current block early and leave a hole before the
+    // next one; aligned for O_DIRECT.
+    bool appendZeros(uint64_t size) override;
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size) override;
+    // fallocate(FALLOC_FL_KEEP_SIZE); close() sets the length, which
+    // releases what was not used.
+    bool reserve(uint64_t size) override;
+    bool flush() override;
+    bool close() override;
+    uint64_t size() const override { return m_size; }
+
+    bool usingIoUring() const { return m_ring != nullptr; }
+    uint64_t blocksSubmitted() const { return m_blocksSubmitted; }
+
+private:
+    struct Block {
+        uint8_t* data = nullptr;
+        size_t used = 0;
+        uint64_t offset = 0;
+        iovec iov{};
+        bool inFlight = false;
+    };
+
+    struct IoUring;
+
+    int acquireBlock();
+    // append() body; |data| == nullptr appends zeros.
+    bool copyIn(const uint8_t* data, size_t size);
+    bool submit(int index, size_t length);
+    bool waitOne();
+    bool waitAll();
+    size_t alignUp(size_t value) const;
+
+    void workerLoop();
+
+    AsyncOutputOptions m_options;
+    std::string m_path;
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    uint64_t m_blocksSubmitted = 0;
+    bool m_failed = false;
+
+    std::vector<Block> m_blocks;
+    int m_current = -1;
+    unsigned m_inFlight = 0;
+
+    IoUring* m_ring = nullptr;
+
+    // pwritev fallback
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<int> m_pending;
+    std::deque<std::pair<int, bool>> m_completed;
+    bool m_stopWorker = false;
+};
+
+#endif
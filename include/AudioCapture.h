@@ -2,8 +2,23 @@
 
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <vector>
 #include "WavWriter.h"
-class WavWriter;
+#include "FlacWriter.h"
+#include "BlockSubscriber.h"
+#include "BufferPool.h"
+#include "CaptureSource.h"
+#include "ClockTracker.h"
+#include "Metrics.h"
+#include "MultichannelWavWriter.h"
+#include "SegmentedSink.h"
+#include "SharedMemorySink.h"
+#include "StreamSink.h"
+#include "VoiceActivity.h"
+class AudioSink;
+class DiskWriter;
+class CaptureScheduler;
 
 #ifdef _WIN32
     #include <windows.h>
@@ -17,7 +32,9 @@ class WavWriter;
     #include <atomic>
     #include <mutex>
     #include <condition_variable>
+    #ifndef PLATFORM_LINUX
     #define PLATFORM_LINUX
+    #endif
 #endif
 
 class AudioCapture {
@@ -29,12 +46,101 @@ public:
     virtual void stop() = 0;
     virtual bool isRunning() const;
 
+    // Options for the WavWriter created when capture starts.
+    void setWriterOptions(const WavWriterOptions& options);
+    // Record FLAC through a FlacWriter instead. Resampling, mono and drift
+    // correction are WavWriter features and do not apply. Set before
+    // start().
+    void setFlacOutput(const FlacWriterOptions& options);
+    // Pool of blocks queued between capture and the disk writer. Set before
+    // start().
+    void setBufferConfig(const BufferPoolConfig& config);
+#ifdef PLATFORM_WINDOWS
+    // waveIn buffers kept queued on the device: count and size trade latency
+    // against dropout risk. Set before start().
+    void setDeviceBufferConfig(const BufferPoolConfig& config);
+#endif
+
+    // Live counters for this stream, e.g. for a MetricsReporter.
+    const StreamMetrics& metrics() const { return m_metrics; }
+    // This stream's device clock, fitted from its block timestamps.
+    const ClockTracker& clock() const { return m_clock; }
+    // Resample the output to stay aligned with |reference| (nullptr: the
+    // host clock) rather than this device's clock. Set before start().
+    void setDriftCorrection(bool enabled, const ClockTracker* reference = nullptr);
+    // Meter levels and detect speech on the way to the writer, optionally
+    // gating non-speech to silence. Set before start(); the event queue
+    // keeps its default capacity.
+    void setVoiceActivity(const VoiceActivityConfig& config);
+    // Record numbered segments (mic-0001.wav, ...) instead of one file,
+    // cut by length or size without losing a frame. Set before start().
+    void setSegments(const SegmentOptions& options);
+    // Also publish every block written to |subscriber|, e.g. for live
+    // transcription; see BlockSubscriber. Set before start().
+    void addSubscriber(std::shared_ptr<BlockSubscriber> subscriber);
+    // Record into channel group |group| of a combined file shared with other
+    // captures instead of a file of its own; see MultichannelWavWriter.
+    // Format, drift correction and segment options do not apply. Set before
+    // start().
+    void setChannelGroup(std::shared_ptr<MultichannelWavWriter> writer, size_t group);
+    // Levels, speech totals and events; any thread once started.
+    VoiceActivityDetector& voiceActivity() { return m_voice; }
+
+#ifdef PLATFORM_LINUX
+    // Backend that supplies the audio. There is no hardware backend on
+    // Linux yet, so this is a synthetic or file-replay source.
+    void setSource(std::unique_ptr<CaptureSource> source);
+    // Services the source from |scheduler|'s thread pool instead of a
+    // dedicated capture thread. Must be set before start().
+    void setScheduler(CaptureScheduler* scheduler);
+    // Also publish the stream live, as captured, into the shared-memory
+    // ring |name| for SharedMemoryReaders in other processes. Set before
+    // start().
+    void setLiveStream(const std::string& name, const SharedStreamOptions& options = SharedStreamOptions());
+    // Also stream the audio as captured to a reader on stdout ("-"), a
+    // Unix socket ("unix:PATH") or a FIFO. Set before start().
+    void setStream(const std::string& target, const StreamSinkOptions& options = StreamSinkOptions());
+#endif
+
     protected:
     void cleanup();
+#ifdef PLATFORM_WINDOWS
     virtual void audioThread(){};
+#else
+    // Sleeps on the source's readiness and pushes every due period into the
+    // disk writer in one batch, until stopped or the source ends.
+    virtual void audioThread();
+    bool startSource();
+#endif
     void startInternal();
+    // m_writerOptions plus the drift correction settings.
+    WavWriterOptions writerOptions();
+    // The FLAC or WAV sink for the stream's format, behind the voice
+    // activity stage when enabled; not yet initialized.
+    AudioSink* createWriter(uint32_t sampleRate, uint16_t channels, SampleFormat format);
 
     std::string m_outputFile;
+    WavWriterOptions m_writerOptions;
+    bool m_flac = false;
+    FlacWriterOptions m_flacOptions;
+    BufferPoolConfig m_bufferConfig;
+    StreamMetrics m_metrics;
+    ClockTracker m_clock;
+    bool m_driftCorrection = false;
+    const ClockTracker* m_referenceClock = nullptr;
+    bool m_segmented = false;
+    SegmentOptions m_segmentOptions;
+    std::shared_ptr<MultichannelWavWriter> m_combined;
+    size_t m_combinedGroup = 0;
+    std::vector<std::shared_ptr<BlockSubscriber>> m_subscribers;
+    bool m_voiceActivity = false;
+    VoiceActivityDetector m_voice;
+#ifdef PLATFORM_LINUX
+    std::string m_liveStream;
+    SharedStreamOptions m_liveStreamOptions;
+    std::string m_stream;
+    StreamSinkOptions m_streamOptions;
+#endif
 
 #ifdef PLATFORM_WINDOWS
     bool initializeWaveIn();
@@ -45,16 +151,29 @@ public:
     
     static DWORD WINAPI audioThreadProc(LPVOID lpParam);
     static void CALLBACK waveInProc(HWAVEIN hwi, UINT uMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2);
-    static constexpr int BUFFER_COUNT = 4;
-    static constexpr int BUFFER_SIZE = 4096;
+    BufferPoolConfig m_deviceBufferConfig;
+    std::unique_ptr<BufferPool> m_deviceBuffers;
+    std::vector<WAVEHDR> m_headers;
+    // Frames delivered so far; waveIn reports no device position.
+    uint64_t m_devicePosition = 0;
 
-    WAVEHDR m_headers[BUFFER_COUNT];
-    BYTE m_buffers[BUFFER_COUNT][BUFFER_SIZE];
-
-    WavWriter *m_writer;
+    AudioSink *m_writer;
+    DiskWriter *m_diskWriter;
 #else
+    // Periods a single wakeup may drain.
+    static constexpr size_t MAX_BATCH_PACKETS = 8;
+    // Upper bound on how long stop() waits for an idle source.
+    static constexpr int READY_TIMEOUT_MS = 100;
+
     std::thread* m_pThread;
     std::atomic<bool> m_bRunning;
     static void audioThreadProc(AudioCapture* pThis);
+
+    std::unique_ptr<CaptureSource> m_source;
+    std::vector<uint8_t> m_packet;
+    CaptureScheduler* m_scheduler;
+    uint64_t m_streamId;
+    AudioSink *m_writer;
+    DiskWriter *m_diskWriter;
 #endif
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "ClockTracker.h"
+#include <algorithm>
+#include <cstdint>
+
+// Consumer of captured audio bytes. DiskWriter drains its ring into one of
+// these; WavWriter is the standard implementation.
+class AudioSink {
+public:
+    virtual ~AudioSink() = default;
+
+    virtual bool initialize() = 0;
+    virtual void write(const uint8_t* data, uint32_t size) = 0;
+    // write() for a block that starts a captured packet and knows where it
+    // was captured; sinks that do not track time just write it.
+    virtual void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) {
+        (void)time;
+        write(data, size);
+    }
+    // |size| bytes of digital silence in the stream's input format, e.g. a
+    // packet the device flagged silent; |time| as for writeTimed(). Sinks
+    // that can store silence without writing it override this; the default
+    // writes zeros.
+    virtual void writeSilence(uint32_t size, const BlockTimestamp& time) {
+        static const uint8_t zeros[4096] = {};
+        for (uint32_t offset = 0; offset < size; offset += sizeof(zeros)) {
+            uint32_t chunk = std::min<uint32_t>(size - offset, sizeof(zeros));
+            if (offset == 0) {
+                writeTimed(zeros, chunk, time);
+            } else {
+                write(zeros, chunk);
+            }
+        }
+    }
+    virtual bool flush() { return true; }
+    virtual bool finalize() = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "BufferPool.h"
+#include "RingBuffer.h"
+#include "WakeEvent.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class DiskWriter;
+
+enum class SlowSubscriberPolicy {
+    // Blocks that find the queue full are skipped; the reader sees a jump
+    // in Block::offset.
+    DropBlocks,
+    // The first block that finds the queue full detaches the subscriber:
+    // nothing more is published to it.
+    Detach,
+};
+
+struct SubscriberOptions {
+    // Blocks published but not yet polled; a reader this far behind is
+    // slow. The DiskWriter grows its pool by this much per subscriber.
+    size_t maxQueuedBlocks = 64;
+    SlowSubscriberPolicy policy = SlowSubscriberPolicy::DropBlocks;
+};
+
+// Reads a DiskWriter's stream on a thread of its own, e.g. a live ASR feed
+// or a meter alongside the file. Every captured block is published to each
+// subscriber by reference, never copied: blocks are reference counted and
+// go back to the pool once the sink and every subscriber have released
+// them. Each subscriber has its own queue and reads at its own pace; one
+// that falls behind loses blocks (or is detached) rather than ever holding
+// up capture or the writer.
+class BlockSubscriber {
+public:
+    explicit BlockSubscriber(const SubscriberOptions& options = SubscriberOptions());
+
+    BlockSubscriber(const BlockSubscriber&) = delete;
+    BlockSubscriber& operator=(const BlockSubscriber&) = delete;
+
+    // Reader thread. The next block, or nullptr if none is queued. Its
+    // contents stay valid and unchanged until release(), which must follow
+    // for every block. A silent block stands for |size| bytes of zeros.
+    const BufferPool::Block* poll();
+    // poll(), sleeping up to |timeoutMs| for a block to arrive.
+    const BufferPool::Block* wait(int timeoutMs);
+    void release(const BufferPool::Block* block);
+    // The stream has stopped and every block has been polled. Blocks must
+    // all be released before the DiskWriter is destroyed; its stop() waits
+    // for that.
+    bool ended() const;
+
+    // Any thread.
+    uint64_t receivedBlocks() const { return m_offered.load(std::memory_order_relaxed); }
+    uint64_t droppedBlocks() const { return m_droppedBlocks.load(std::memory_order_relaxed); }
+    uint64_t droppedBytes() const { return m_droppedBytes.load(std::memory_order_relaxed); }
+    bool detached() const { return m_detached.load(std::memory_order_relaxed); }
+
+private:
+    friend class DiskWriter;
+
+    // Writer thread.
+    void attach(DiskWriter* writer, size_t poolBlocks);
+    // Queues |block|, which already counts this subscriber in its refs;
+    // false if it was dropped instead.
+    bool offer(BufferPool::Block* block);
+    // Returns blocks whose last reference this subscriber dropped.
+    void reclaim(BufferPool& pool);
+    bool returning() const { return m_returned->size() > 0; }
+    bool idle() const;
+    void end();
+
+    SubscriberOptions m_options;
+    DiskWriter* m_writer = nullptr;
+    SpscQueue<BufferPool::Block*> m_queue;
+    // Reader to writer; sized for the whole pool when attached.
+    std::unique_ptr<SpscQueue<BufferPool::Block*>> m_returned;
+    WakeEvent m_wake;
+    std::atomic<bool> m_sleeping{false};
+    std::atomic<bool> m_ended{false};
+    std::atomic<bool> m_detached{false};
+    std::atomic<uint64_t> m_offered{0};
+    std::atomic<uint64_t> m_released{0};
+    std::atomic<uint64_t> m_droppedBlocks{0};
+    std::atomic<uint64_t> m_droppedBytes{0};
+};
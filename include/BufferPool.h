@@ -0,0 +1,107 @@
+#pragma once
+
+#include "ClockTracker.h"
+#include "RingBuffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct BufferPoolConfig {
+    // Blocks allocated up front.
+    size_t blockCount = 64;
+    // Usable bytes per block; each block occupies whole pages.
+    uint32_t blockSize = 16 << 10;
+    // Bounds for grow()/shrink() and the tuner. maxBlocks also sizes the
+    // free list, so a pool can never hold more blocks than this.
+    size_t minBlocks = 4;
+    size_t maxBlocks = 1024;
+    // Keep every block resident (mlock/VirtualLock) so capture never takes a
+    // page fault or waits on swap. Failure, e.g. a low RLIMIT_MEMLOCK, is
+    // logged and the pool runs unlocked.
+    bool lockPages = true;
+
+    // Let the consumer resize the pool: grow on overruns or low headroom,
+    // shrink once usage has stayed low for stableIntervals in a row.
+    bool autoTune = false;
+    uint32_t tuneIntervalMs = 500;
+    uint32_t stableIntervals = 20;
+};
+
+// Preallocated, page-aligned audio blocks handed from one producer thread
+// (capture) to one consumer thread (the writer) and back. acquire() never
+// blocks, allocates or takes a lock; allocation only happens in grow(), on
+// the consumer.
+class BufferPool {
+public:
+    struct Block {
+        uint8_t* data;
+        // Bytes filled by the producer.
+        uint32_t size;
+        // Where the block's first frame was captured, if the producer knows.
+        BlockTimestamp time;
+        // Stands for |size| bytes of silence; |data| is unused.
+        bool silent;
+        // Consumer side: stream position of the block's first byte, and
+        // the holders (writer plus subscribers) still reading a block that
+        // is fanned out to BlockSubscribers.
+        uint64_t offset;
+        mutable std::atomic<uint32_t> refs;
+    };
+
+    explicit BufferPool(const BufferPoolConfig& config);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Producer side. A free block, or nullptr when all are in use.
+    Block* acquire();
+    size_t available() const { return m_free.size(); }
+
+    // Consumer side. Returns |block| to the producer, or frees it while a
+    // shrink is pending.
+    void release(Block* block);
+    // Consumer side. Adds up to |count| blocks, bounded by maxBlocks; returns
+    // how many were added.
+    size_t grow(size_t count);
+    // Consumer side. Retires up to |count| blocks, bounded by minBlocks, as
+    // they are released.
+    void shrink(size_t count);
+
+    // Blocks currently allocated, whether free or in flight.
+    size_t blockCount() const { return m_blockCount.load(std::memory_order_relaxed); }
+    uint32_t blockSize() const { return m_config.blockSize; }
+    size_t capacityBytes() const { return blockCount() * m_config.blockSize; }
+    // True while every block is page-locked.
+    bool locked() const { return m_locked.load(std::memory_order_relaxed); }
+    const BufferPoolConfig& config() const { return m_config; }
+
+private:
+    Block* allocateBlock();
+    void freeBlock(Block* block);
+
+    BufferPoolConfig m_config;
+    size_t m_allocSize;
+    SpscQueue<Block*> m_free;
+    // Consumer-owned.
+    std::vector<Block*> m_blocks;
+    size_t m_retiring = 0;
+    std::atomic<size_t> m_blockCount{0};
+    std::atomic<bool> m_locked{true};
+};
+
+// Sizing policy for an auto-tuned pool, fed once per interval by the pool's
+// consumer with what it observed during that interval.
+class BufferPoolTuner {
+public:
+    explicit BufferPoolTuner(const BufferPoolConfig& config);
+
+    // Block count the pool should have, given its current size, the most
+    // blocks that were in use at once, and the overruns since the last call.
+    size_t update(size_t blocks, size_t peakInUse, uint64_t overruns);
+
+private:
+    BufferPoolConfig m_config;
+    uint32_t m_stable = 0;
+};
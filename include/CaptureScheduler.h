@@ -0,0 +1,88 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class CaptureSource;
+class DiskWriter;
+class StreamMetrics;
+
+// Services many capture streams from a small fixed pool of threads. Each
+// stream's readiness descriptor is registered one-shot in a shared epoll set;
+// a worker that picks it up reads one batch, pushes it to the stream's
+// DiskWriter and re-arms it, so a busy stream goes to the back of the ready
+// list instead of starving the others. Streams can be attached and detached
+// while the scheduler runs.
+class CaptureScheduler {
+public:
+    using StreamId = uint64_t;
+
+    static constexpr unsigned DEFAULT_THREADS = 2;
+    // Periods a stream may drain per turn.
+    static constexpr size_t MAX_BATCH_PACKETS = 8;
+
+    explicit CaptureScheduler(unsigned threadCount = DEFAULT_THREADS);
+    ~CaptureScheduler();
+
+    bool start();
+    void stop();
+
+    // |source| must already be open; |metrics| is optional. Returns 0 on
+    // failure.
+    StreamId attach(CaptureSource* source, DiskWriter* writer, StreamMetrics* metrics = nullptr);
+    // Returns once no worker is touching the stream any more, so the caller
+    // may close the source and stop the writer right after.
+    bool detach(StreamId id);
+
+    // False once the stream's source reported end of stream.
+    bool isActive(StreamId id) const;
+    size_t streamCount() const;
+    unsigned threadCount() const { return m_threadCount; }
+    // epoll_wait returns across all workers.
+    uint64_t wakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+    // Batches read across all streams.
+    uint64_t batches() const { return m_batches.load(std::memory_order_relaxed); }
+
+private:
+    struct Stream {
+        StreamId id;
+        CaptureSource* source;
+        DiskWriter* writer;
+        StreamMetrics* metrics;
+        uint16_t blockAlign;
+        // Source descriptor, or an always-readable eventfd for unpaced sources.
+        int fd;
+        bool ownsFd;
+        std::vector<uint8_t> buffer;
+        std::atomic<bool> busy{false};
+        std::atomic<bool> active{true};
+    };
+
+    void run();
+    std::shared_ptr<Stream> acquire(StreamId id);
+    void service(Stream& stream);
+    void rearm(Stream& stream);
+
+    unsigned m_threadCount;
+    int m_epollFd;
+    // Level-triggered and never drained: wakes every worker on stop().
+    int m_stopFd;
+    std::atomic<bool> m_running{false};
+    std::vector<std::thread> m_threads;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<StreamId, std::shared_ptr<Stream>> m_streams;
+    StreamId m_nextId;
+
+    std::atomic<uint64_t> m_wakeups{0};
+    std::atomic<uint64_t> m_batches{0};
+};
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "ClockTracker.h"
+#include "SampleFormat.h"
+#include <cstddef>
+#include <cstdint>
+
+struct StreamFormat {
+    uint32_t sampleRate = 48000;
+    uint16_t channels = 2;
+    SampleFormat sampleFormat = SampleFormat::Int16;
+
+    uint16_t blockAlign() const { return static_cast<uint16_t>(channels * bytesPerSample(sampleFormat)); }
+};
+
+// Produces interleaved audio packets for AudioCapture. Hardware backends and
+// the synthetic/file-replay sources used for load testing all implement this.
+class CaptureSource {
+public:
+    virtual ~CaptureSource() = default;
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+
+    virtual StreamFormat format() const = 0;
+    // Size of one device period. read() may return several periods at once
+    // when more are due and |capacity| allows.
+    virtual size_t maxPacketBytes() const = 0;
+
+    // Blocks until read() has at least one period to return without waiting.
+    // Returns false on timeout; a negative timeout waits forever. Unpaced
+    // sources are always ready.
+    virtual bool waitReady(int timeoutMs) {
+        (void)timeoutMs;
+        return true;
+    }
+
+#ifdef PLATFORM_LINUX
+    // Descriptor that polls readable while waitReady(0) would succeed, or -1
+    // if the source is always ready.
+    virtual int readyFd() const { return -1; }
+#endif
+
+    // Copies every period that is due (at least one, waiting for it when the
+    // source is paced) into |buffer|, up to |capacity|. Returns the number of
+    // bytes written, or 0 at the end of the stream.
+    virtual size_t read(uint8_t* buffer, size_t capacity) = 0;
+
+    // Device position and host capture time of the first frame returned by
+    // the last read(); invalid if the source has no clock.
+    virtual BlockTimestamp lastTimestamp() const { return BlockTimestamp(); }
+    // True if the last read() returned silence the device flagged as such,
+    // like AUDCLNT_BUFFERFLAGS_SILENT; the bytes are zeros and need not be
+    // stored.
+    virtual bool lastReadSilent() const { return false; }
+};
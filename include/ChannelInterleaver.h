@@ -0,0 +1,34 @@
+#pragma once
+
+#include "SampleConverter.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Merges channel groups, each interleaved float32 frames of its own width,
+// into one interleaved stream: output frame n is frame n of group 0, then
+// of group 1, and so on. Two stereo groups, two mono groups and stereo
+// followed by mono run on shuffle kernels picked from the best instruction
+// set the CPU supports; other layouts are scalar. It only moves samples, so
+// every kernel matches the scalar one bit for bit.
+class ChannelInterleaver {
+public:
+    using Kernel = void (*)(const float* const* groups, const uint16_t* channels, size_t groupCount, size_t frames,
+                            float* dst);
+
+    explicit ChannelInterleaver(const std::vector<uint16_t>& groupChannels,
+                                SimdLevel level = SampleConverter::detectSimdLevel());
+
+    // |groups| holds one pointer per group to |frames| frames; |dst| must
+    // hold |frames| * channels() samples. Nothing needs to be aligned.
+    void interleave(const float* const* groups, size_t frames, float* dst) const;
+
+    uint16_t channels() const { return m_channels; }
+    SimdLevel simdLevel() const { return m_level; }
+
+private:
+    std::vector<uint16_t> m_groupChannels;
+    uint16_t m_channels;
+    SimdLevel m_level;
+    Kernel m_kernel;
+};
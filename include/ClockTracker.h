@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Where a captured block sits on the device and host timelines.
+struct BlockTimestamp {
+    // Device frame position of the block's first frame.
+    uint64_t position = 0;
+    // Host capture time of that frame, steady_clock nanoseconds (QPC on
+    // Windows); 0 if unknown.
+    int64_t hostTimeNs = 0;
+
+    bool valid() const { return hostTimeNs != 0; }
+};
+
+// Estimates one stream's device clock against the host clock from block
+// timestamps: an exponentially weighted least-squares line through (host
+// time, device position), so timestamp jitter averages out over roughly
+// FIT_TIME_CONSTANT_S while a slowly wandering crystal is still followed.
+// update() has a single writer (the stream's DiskWriter); the fitted line is
+// published through a seqlock and may be read from any thread.
+class ClockTracker {
+public:
+    static constexpr double FIT_TIME_CONSTANT_S = 30.0;
+    // Points and span before the fitted rate replaces the nominal one.
+    static constexpr uint32_t LOCK_POINTS = 8;
+    static constexpr double LOCK_SPAN_S = 2.0;
+
+    explicit ClockTracker(uint32_t nominalRate = 48000);
+
+    // Forgets all points. Call before the stream starts.
+    void reset(uint32_t nominalRate);
+    void update(uint64_t position, int64_t hostTimeNs);
+
+    uint32_t nominalRate() const { return m_nominalRate.load(std::memory_order_relaxed); }
+    // True once any timestamp has been seen.
+    bool started() const;
+    // True once the rate comes from the fit rather than the nominal rate.
+    bool locked() const;
+    // Measured device rate over the nominal rate; 1 until locked.
+    double rateRatio() const;
+    // Device clock error against the host clock in parts per million.
+    double ppm() const { return (rateRatio() - 1.0) * 1e6; }
+
+    // Fitted device position at a host time, and the inverse. Before the
+    // first update the device is assumed to run on the host clock.
+    double positionAt(int64_t hostTimeNs) const;
+    int64_t hostTimeAt(double position) const;
+
+private:
+    struct Line {
+        int64_t originNs;
+        uint64_t originPosition;
+        // Weighted means relative to the origin, in seconds and frames.
+        double meanTime;
+        double meanPosition;
+        // Frames per second.
+        double slope;
+        bool started;
+        bool locked;
+    };
+
+    Line load() const;
+    void publish(const Line& line);
+
+    std::atomic<uint32_t> m_nominalRate;
+
+    // Writer-only fit state.
+    Line m_line;
+    double m_weight = 0.0;
+    double m_varTime = 0.0;
+    double m_covariance = 0.0;
+    double m_lastTime = 0.0;
+    uint32_t m_points = 0;
+
+    // Published copy of m_line.
+    std::atomic<uint32_t> m_sequence{0};
+    std::atomic<int64_t> m_originNs{0};
+    std::atomic<uint64_t> m_originPosition{0};
+    std::atomic<double> m_meanTime{0.0};
+    std::atomic<double> m_meanPosition{0.0};
+    std::atomic<double> m_slope{0.0};
+    std::atomic<uint8_t> m_state{0};
+};
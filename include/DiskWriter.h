@@ -0,0 +1,144 @@
+#pragma once
+
+#include "BlockSubscriber.h"
+#include "BufferPool.h"
+#include "RingBuffer.h"
+#include "WakeEvent.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class AudioSink;
+class CaptureSource;
+class StreamMetrics;
+
+// Decouples capture from disk I/O: the capture side fills blocks from a
+// preallocated BufferPool and queues them, and a dedicated thread writes them
+// to the sink (usually a WavWriter) and recycles them.
+class DiskWriter {
+public:
+    // The writer sleeps until push() wakes it; this only bounds how long a
+    // lost wakeup could go unnoticed.
+    static constexpr int IDLE_TIMEOUT_MS = 100;
+    static constexpr int SUBSCRIBER_STOP_TIMEOUT_MS = 2000;
+
+    explicit DiskWriter(AudioSink* sink, const BufferPoolConfig& poolConfig = BufferPoolConfig());
+    ~DiskWriter();
+
+    // Optional, set before start(). The writer thread then reports bytes
+    // written, overruns/pool usage and the latency from push() to the sink
+    // accepting each packet.
+    void setMetrics(StreamMetrics* metrics);
+    // Optional, set before start(). The writer thread feeds it the
+    // timestamp of every packet it writes.
+    void setClock(ClockTracker* clock);
+    // Optional, before start(). Every block is also published to
+    // |subscriber|, by reference, before the sink writes it; the pool grows
+    // by the blocks the subscriber may hold. Returns how many of those
+    // blocks the pool could not add (maxBlocks reached or allocation
+    // failed); the shortfall is logged and kept in subscriberShortfall().
+    size_t addSubscriber(std::shared_ptr<BlockSubscriber> subscriber);
+
+    bool start();
+    // Stops the writer thread after everything already pushed has been
+    // written, ends the subscribers' streams and waits, up to
+    // SUBSCRIBER_STOP_TIMEOUT_MS, for them to release their blocks.
+    void stop();
+
+    // Called from the capture thread/callback. Copies |data| into as many
+    // blocks as it needs, all or nothing; a packet that does not fit is
+    // counted as an overrun. Never blocks or allocates; the writer thread is
+    // only signaled when it is actually asleep. |time| stamps the packet's
+    // first block.
+    bool push(const uint8_t* data, uint32_t size, const BlockTimestamp& time = BlockTimestamp());
+    // Queues |size| bytes of silence as a single block without copying
+    // anything; the sink's writeSilence() gets it. Same thread as push().
+    bool pushSilence(uint32_t size, const BlockTimestamp& time = BlockTimestamp());
+
+    // Zero-copy alternative to push() for the same thread: fill a block from
+    // acquire() (nullptr when the pool is exhausted) and queue it with
+    // commit(), or hand it back unused with cancel().
+    BufferPool::Block* acquire();
+    void commit(BufferPool::Block* block, uint32_t size, const BlockTimestamp& time = BlockTimestamp());
+    void cancel(BufferPool::Block* block);
+
+#ifdef PLATFORM_LINUX
+    // Reads one batch of at most |scratchSize| bytes from |source| straight
+    // into a block, or via |scratch| and push() when blocks are smaller than
+    // a packet or none is free, stamped with the source's timestamp. Reads
+    // the source flags silent are queued as silence. Returns the bytes read;
+    // 0 is end of stream.
+    size_t readFrom(CaptureSource& source, uint8_t* scratch, size_t scratchSize);
+#endif
+
+    uint64_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+    uint64_t droppedBytes() const { return m_droppedBytes.load(std::memory_order_relaxed); }
+    // Most pool bytes queued for the writer at once.
+    size_t highWaterMark() const { return m_highWaterBlocks.load(std::memory_order_relaxed) * m_pool.blockSize(); }
+    size_t capacity() const { return m_pool.capacityBytes(); }
+    const BufferPool& pool() const { return m_pool; }
+    // Times the auto-tuner resized the pool.
+    uint64_t poolGrows() const { return m_grows.load(std::memory_order_relaxed); }
+    uint64_t poolShrinks() const { return m_shrinks.load(std::memory_order_relaxed); }
+    // Blocks subscribers may hold that the pool could not add; while they
+    // are held, capture has that much less headroom than configured.
+    size_t subscriberShortfall() const { return m_subscriberShortfall; }
+    // Times the writer thread went to sleep on an empty queue.
+    uint64_t wakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+
+private:
+    // End offset and push time of a packet, queued for the latency histogram.
+    struct PushMark {
+        uint64_t endOffset;
+        int64_t timeNs;
+    };
+    // Packets tracked in flight; pushes beyond that go unsampled.
+    static constexpr size_t MARK_CAPACITY = 1024;
+
+    void queued(uint32_t size, int64_t pushTime);
+    void run();
+    size_t drain();
+    void tune();
+    void recordLatencies();
+    // Wakes the writer if it is asleep; subscribers call it when they
+    // return a block.
+    friend class BlockSubscriber;
+    void wake();
+    // Hands |block| to the subscribers, counting a reference for each that
+    // takes it.
+    void publish(BufferPool::Block* block);
+    void reclaim();
+
+    AudioSink* m_sink;
+    BufferPool m_pool;
+    SpscQueue<BufferPool::Block*> m_ready;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    WakeEvent m_wake;
+    std::atomic<bool> m_sleeping{false};
+    std::atomic<uint64_t> m_wakeups{0};
+
+    StreamMetrics* m_metrics = nullptr;
+    ClockTracker* m_clock = nullptr;
+    std::vector<std::shared_ptr<BlockSubscriber>> m_subscribers;
+    size_t m_subscriberShortfall = 0;
+    std::unique_ptr<PushMark[]> m_marks;
+    // Producer side.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_markHead{0};
+    uint64_t m_pushedBytes = 0;
+    BufferPool::Block* m_spare = nullptr;
+    std::atomic<uint64_t> m_overruns{0};
+    std::atomic<uint64_t> m_droppedBytes{0};
+    // Writer side.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_markTail{0};
+    uint64_t m_writtenBytes = 0;
+    std::atomic<size_t> m_highWaterBlocks{0};
+    BufferPoolTuner m_tuner;
+    size_t m_intervalPeak = 0;
+    uint64_t m_tunedOverruns = 0;
+    int64_t m_nextTuneNs = 0;
+    std::atomic<uint64_t> m_grows{0};
+    std::atomic<uint64_t> m_shrinks{0};
+};
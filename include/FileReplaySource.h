@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CaptureSource.h"
+#include "PacketTimer.h"
+#include "WavReader.h"
+#include <string>
+
+// Replays the samples of a WAV file as capture packets, either paced at the
+// file's sample rate or as fast as they are read.
+class FileReplaySource : public CaptureSource {
+public:
+    FileReplaySource(const std::string& filename, uint32_t framesPerPacket = 480, bool realTime = true,
+                     bool loop = false);
+
+    bool open() override;
+    void close() override;
+    StreamFormat format() const override { return m_format; }
+    size_t maxPacketBytes() const override;
+    bool waitReady(int timeoutMs) override;
+#ifdef PLATFORM_LINUX
+    int readyFd() const override { return m_realTime ? m_timer.fd() : -1; }
+#endif
+    size_t read(uint8_t* buffer, size_t capacity) override;
+    // Paced replay is stamped from its timer, unpaced replay from a virtual
+    // clock at the file's rate starting at open().
+    BlockTimestamp lastTimestamp() const override { return m_lastTimestamp; }
+
+private:
+    WavReader m_reader;
+    StreamFormat m_format;
+    uint32_t m_framesPerPacket;
+    bool m_realTime;
+    bool m_loop;
+    uint64_t m_framesDelivered;
+    PacketTimer m_timer;
+    int64_t m_openTimeNs = 0;
+    BlockTimestamp m_lastTimestamp;
+};
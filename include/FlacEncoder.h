@@ -0,0 +1,77 @@
+#pragma once
+
+#include "FlacFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct FlacEncoderConfig {
+    uint32_t sampleRate = 48000;
+    uint16_t channels = 2;
+    // FLAC_MIN_BITS to FLAC_MAX_BITS.
+    uint16_t bitsPerSample = 16;
+    // Frames per FLAC frame; 4096 is the usual choice at 44.1/48 kHz.
+    uint32_t blockFrames = 4096;
+    // Highest LPC order; 0 uses the fixed predictors only. The subset allows
+    // 12 at rates up to 48 kHz.
+    uint32_t maxLpcOrder = 8;
+    // Highest Rice partition order searched.
+    uint32_t maxPartitionOrder = 6;
+    // Stereo: also try left/side, right/side and mid/side and keep the
+    // smallest.
+    bool stereoDecorrelation = true;
+};
+
+// Encodes interleaved integer PCM as FLAC frames. Every frame is independent
+// (fixed block size, numbered by the caller), so any number of encoders can
+// work on different blocks of one stream at once; one encoder is not
+// thread-safe. Each channel is coded with the cheapest of constant,
+// verbatim, the best fixed polynomial predictor and an LPC predictor whose
+// order is picked from the Levinson-Durbin error, all with partitioned Rice
+// residuals. Scratch is sized for blockFrames once; encodeFrame() never
+// allocates.
+class FlacEncoder {
+public:
+    explicit FlacEncoder(const FlacEncoderConfig& config);
+    ~FlacEncoder();
+
+    FlacEncoder(const FlacEncoder&) = delete;
+    FlacEncoder& operator=(const FlacEncoder&) = delete;
+
+    // False if the channel count, depth or block size is out of range.
+    bool valid() const { return m_valid; }
+    const FlacEncoderConfig& config() const { return m_config; }
+    // Upper bound on an encoded frame: never more than the verbatim frame.
+    size_t maxFrameBytes() const;
+
+    // Encodes |frames| interleaved samples (sign-extended to 32 bits) as
+    // frame |frameNumber| into |out|, which must hold maxFrameBytes().
+    // Only the last frame of a stream may be shorter than blockFrames.
+    // Returns the bytes written.
+    size_t encodeFrame(const int32_t* samples, uint32_t frames, uint64_t frameNumber, uint8_t* out);
+
+private:
+    struct Subframe;
+
+    void analyze(const int32_t* x, uint32_t frames, uint32_t bits, Subframe& best);
+    void tryFixed(const int32_t* x, uint32_t frames, uint32_t bits, Subframe& best);
+    void tryLpc(const int32_t* x, uint32_t frames, uint32_t bits, Subframe& best);
+    // Picks the partition order and Rice parameters for the residual in
+    // |sf|; returns its exact size in bits.
+    uint64_t chooseRice(Subframe& sf, uint32_t frames) const;
+    void buildWindow(uint32_t frames);
+
+    FlacEncoderConfig m_config;
+    bool m_valid;
+    uint32_t m_precision;
+    // Per coded channel: left, right, side, mid for stereo.
+    std::vector<std::vector<int32_t>> m_planar;
+    std::vector<Subframe> m_subframes;
+    // Candidate being evaluated; swapped with the best when it wins.
+    std::unique_ptr<Subframe> m_candidate;
+    std::vector<int64_t> m_accumulator;
+    std::vector<double> m_window;
+    std::vector<double> m_windowed;
+    uint32_t m_windowFrames;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Stream-level pieces of the FLAC format shared by FlacEncoder, FlacWriter
+// and FlacReader.
+
+// "fLaC", then metadata blocks, then frames.
+static constexpr uint8_t FLAC_STREAM_MARKER[4] = {'f', 'L', 'a', 'C'};
+static constexpr uint8_t FLAC_METADATA_STREAMINFO = 0;
+static constexpr uint32_t FLAC_STREAMINFO_SIZE = 34;
+// Offset of the STREAMINFO body: the marker plus one block header.
+static constexpr uint32_t FLAC_STREAMINFO_OFFSET = 8;
+
+static constexpr uint16_t FLAC_MAX_CHANNELS = 8;
+static constexpr uint32_t FLAC_MAX_BLOCK_FRAMES = 65535;
+static constexpr uint32_t FLAC_MAX_LPC_ORDER = 32;
+// The subset limit; the format allows 15.
+static constexpr uint32_t FLAC_MAX_PARTITION_ORDER = 8;
+// Sample depths the encoder and decoder handle; 32-bit needs 33-bit side
+// channels.
+static constexpr uint16_t FLAC_MIN_BITS = 4;
+static constexpr uint16_t FLAC_MAX_BITS = 24;
+
+// Frame header channel assignments above the independent ones (0-7).
+enum class FlacChannels : uint8_t {
+    LeftSide = 8,
+    RightSide = 9,
+    MidSide = 10,
+};
+
+struct FlacStreamInfo {
+    uint32_t minBlockFrames = 0;
+    uint32_t maxBlockFrames = 0;
+    // 0 when unknown.
+    uint32_t minFrameBytes = 0;
+    uint32_t maxFrameBytes = 0;
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint16_t bitsPerSample = 0;
+    // 0 when unknown.
+    uint64_t totalFrames = 0;
+    // MD5 of the decoded samples; all zero when not computed.
+    uint8_t md5[16] = {};
+
+    void serialize(uint8_t out[FLAC_STREAMINFO_SIZE]) const;
+    bool parse(const uint8_t in[FLAC_STREAMINFO_SIZE]);
+};
+
+// Frame header check (polynomial x^8 + x^2 + x + 1).
+uint8_t flacCrc8(const uint8_t* data, size_t size);
+// Whole-frame check (polynomial x^16 + x^15 + x^2 + 1).
+uint16_t flacCrc16(const uint8_t* data, size_t size);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "FlacFormat.h"
+#include "SampleFormat.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Decodes FLAC files of 4 to 24 bits per sample to interleaved little-endian
+// PCM: Int16 up to 16 bits, Int24 above, narrower samples shifted up to fill
+// the container as WAV stores them. Every frame header and frame CRC is
+// checked; decoding stops at the first frame that fails.
+class FlacReader {
+public:
+    explicit FlacReader(const std::string& filename);
+    ~FlacReader();
+
+    bool open();
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    uint32_t sampleRate() const { return m_info.sampleRate; }
+    uint16_t channels() const { return m_info.channels; }
+    uint16_t bitsPerSample() const { return m_info.bitsPerSample; }
+    SampleFormat sampleFormat() const { return m_sampleFormat; }
+    uint16_t blockAlign() const { return m_blockAlign; }
+    // From STREAMINFO; 0 if the encoder did not know the length.
+    uint64_t frames() const { return m_info.totalFrames; }
+    const FlacStreamInfo& streamInfo() const { return m_info; }
+
+    // Reads up to |size| bytes of decoded samples; returns the number read,
+    // 0 at the end of the stream or after a corrupt frame.
+    size_t read(uint8_t* data, size_t size);
+    // Seeks back to the first frame.
+    bool rewind();
+    // True once a frame failed to parse or its CRC did not match.
+    bool failed() const { return m_failed; }
+    // Frames decoded since the last rewind().
+    uint64_t framesDecoded() const { return m_framesDecoded; }
+
+private:
+    class BitReader;
+
+    bool decodeFrame();
+    bool decodeSubframe(BitReader& reader, uint32_t frames, uint32_t bits, int32_t* out);
+    bool decodeResidual(BitReader& reader, uint32_t frames, uint32_t order, int32_t* out);
+    // Makes at least |bytes| bytes available from the current position, if
+    // the file holds them; returns the number available.
+    size_t fill(size_t bytes);
+
+    std::string m_filename;
+    FILE* m_file;
+    FlacStreamInfo m_info;
+    SampleFormat m_sampleFormat;
+    uint16_t m_blockAlign;
+    uint64_t m_firstFrameOffset;
+    // Largest frame fill() must be able to hold.
+    size_t m_frameLimit;
+
+    // Undecoded bytes [m_begin, m_end); zero padded so bit reads may run a
+    // few bytes past the end.
+    std::vector<uint8_t> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    bool m_eof;
+
+    std::vector<std::vector<int32_t>> m_planar;
+    std::vector<uint8_t> m_decoded;
+    size_t m_decodedBegin;
+    size_t m_decodedEnd;
+    uint64_t m_framesDecoded;
+    bool m_failed;
+};
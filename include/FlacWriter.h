@@ -0,0 +1,124 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "FlacFormat.h"
+#include "SampleFormat.h"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FlacEncoder;
+class OutputFile;
+class SampleConverter;
+
+struct FlacWriterOptions {
+    // Format stored on disk: Int16 or Int24. Integer input is stored as is;
+    // Float32 input is converted, to Int16 unless set here, optionally with
+    // TPDF dither (the same conversion WavWriter applies).
+    std::optional<SampleFormat> outputFormat;
+    bool dither = false;
+    // Frames per FLAC frame, and so per unit of work for the encoders.
+    uint32_t blockFrames = 4096;
+    // See FlacEncoderConfig.
+    uint32_t maxLpcOrder = 8;
+    uint32_t maxPartitionOrder = 6;
+    // Encoder threads; 0 uses half the cores, at least one.
+    unsigned threads = 0;
+    // Blocks queued or being encoded before write() waits for an encoder;
+    // 0 allows four per thread.
+    unsigned maxBlocksInFlight = 0;
+};
+
+// Lossless FLAC sink. write() only converts samples and gathers them into
+// blocks; each full block is encoded as an independent frame by a pool of
+// worker threads, and the encoded frames are appended in order by the
+// thread calling write(), flush() or finalize(). The writing thread
+// therefore never spends its time encoding, and only waits when
+// maxBlocksInFlight blocks are already queued. STREAMINFO is patched with
+// the length and frame sizes at finalize; the MD5 signature is left unset.
+class FlacWriter : public AudioSink {
+public:
+    FlacWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, SampleFormat inputFormat,
+               const FlacWriterOptions& options = FlacWriterOptions());
+    ~FlacWriter() override;
+
+    // Fails for input FLAC cannot store losslessly (32-bit integer), more
+    // than FLAC_MAX_CHANNELS channels, or if the file cannot be created.
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    // Blocks until every full block written so far has reached the file. A
+    // partial block is held back: only the last frame may be short.
+    bool flush() override;
+    // Encodes the partial block, patches STREAMINFO and closes the file.
+    bool finalize() override;
+    bool isOpen() const { return m_isOpen; }
+
+    SampleFormat outputFormat() const { return m_outputFormat; }
+    unsigned threads() const { return static_cast<unsigned>(m_encoders.size()); }
+    // Sample frames encoded and appended so far.
+    uint64_t framesWritten() const { return m_framesWritten; }
+    // File size so far.
+    uint64_t bytesWritten() const { return m_bytesWritten; }
+    // Times write() found every block in flight and had to wait.
+    uint64_t stalls() const { return m_stalls; }
+
+private:
+    struct Job {
+        std::vector<int32_t> samples;
+        uint32_t frames = 0;
+        uint64_t number = 0;
+        std::vector<uint8_t> encoded;
+        size_t encodedSize = 0;
+        bool done = false;
+    };
+
+    void encodeLoop(FlacEncoder* encoder);
+    // Makes the next job free to fill, writing out finished ones.
+    Job& currentJob();
+    void submit();
+    // Appends the oldest submitted block if it is encoded, waiting for it if
+    // |wait|; false if nothing was appended.
+    bool writeNext(bool wait);
+    void appendFrames(const uint8_t* data, size_t frames);
+    void stopWorkers();
+
+    std::string m_filename;
+    FlacWriterOptions m_options;
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    SampleFormat m_inputFormat;
+    SampleFormat m_outputFormat;
+    std::unique_ptr<SampleConverter> m_converter;
+    std::unique_ptr<OutputFile> m_output;
+    uint16_t m_inputFrameBytes;
+    // Bytes of an input frame split across write() calls.
+    std::vector<uint8_t> m_frameCarry;
+    std::vector<float> m_floatScratch;
+    std::vector<uint8_t> m_pcmScratch;
+
+    std::vector<std::unique_ptr<FlacEncoder>> m_encoders;
+    std::vector<std::thread> m_workers;
+    // Ring of blocks; block n lives in m_jobs[n % size]. Blocks below
+    // m_written are free, m_written up to m_submitted are queued or being
+    // encoded (workers have taken those below m_taken), and m_submitted is
+    // the one write() is filling.
+    std::vector<Job> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::condition_variable m_encoded;
+    uint64_t m_submitted;
+    uint64_t m_taken;
+    uint64_t m_written;
+    bool m_stopping;
+
+    FlacStreamInfo m_info;
+    bool m_isOpen;
+    uint64_t m_framesWritten;
+    uint64_t m_bytesWritten;
+    uint64_t m_stalls;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "SampleConverter.h"
+#include "SampleFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Running sums over interleaved samples, scaled so full scale is 1.
+struct LevelSums {
+    double sumSquares = 0.0;
+    float peak = 0.0f;
+    // Sign changes between consecutive frames, summed over channels.
+    uint64_t zeroCrossings = 0;
+    uint64_t samples = 0;
+
+    double rms() const;
+};
+
+// Measures RMS, peak and zero crossings of interleaved PCM. Int16 and
+// Float32 run on a kernel picked from the best instruction set the CPU
+// supports (integer sums are exact, so every Int16 kernel matches the
+// scalar one bit for bit); Int24/Int32 are scalar.
+class LevelMeter {
+public:
+    using Kernel = void (*)(const uint8_t* data, size_t samples, uint16_t channels, LevelSums* sums);
+
+    LevelMeter(SampleFormat format, uint16_t channels, SimdLevel level = SampleConverter::detectSimdLevel());
+
+    // Adds |frames| whole frames to |sums|, counting crossings against the
+    // last frame of the previous call too. |data| need not be aligned.
+    void measure(const uint8_t* data, size_t frames, LevelSums& sums);
+    // Forgets the previous frame.
+    void reset() { m_haveLast = false; }
+
+    SimdLevel simdLevel() const { return m_level; }
+
+private:
+    SampleFormat m_format;
+    uint16_t m_channels;
+    uint16_t m_frameBytes;
+    SimdLevel m_level;
+    Kernel m_kernel;
+    std::vector<uint8_t> m_lastFrame;
+    bool m_haveLast;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "RingBuffer.h"
+#include "WakeEvent.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t { Debug, Info, Warning, Error, Off };
+
+// Asynchronous logger. Each thread appends finished lines to its own
+// preallocated lock-free ring; a background thread formats the batch in
+// timestamp order and writes it out (Info and below to stdout, warnings and
+// errors to stderr). Logging never allocates, locks or touches a stream on
+// the calling thread, so capture code can log freely. A full ring drops the
+// line and counts it.
+class Logger {
+public:
+    // Longest message; longer ones are truncated.
+    static constexpr size_t MAX_MESSAGE = 240;
+    static constexpr size_t THREAD_BUFFER_SIZE = 64 << 10;
+    // Lines are written at least this often. Producers only wake the writer
+    // early once their ring is half full, so logging costs no syscall.
+    static constexpr int FLUSH_INTERVAL_MS = 50;
+
+    static Logger& instance();
+
+    void setLevel(LogLevel level) { m_level.store(level, std::memory_order_relaxed); }
+    LogLevel level() const { return m_level.load(std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const { return level >= this->level(); }
+    // Streams for Debug/Info and for Warning/Error; default stdout/stderr.
+    void setOutput(FILE* info, FILE* error);
+
+    // Allocates the calling thread's ring up front. Capture threads call this
+    // at startup so their first log line does not allocate.
+    void prepareThread();
+    // Blocks until every line logged before the call has been written.
+    void flush();
+    // Lines lost to full rings.
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    void submit(LogLevel level, const char* text, size_t length);
+
+    // Per-thread ring; internal.
+    struct ThreadBuffer;
+
+private:
+    Logger();
+    ~Logger();
+
+    ThreadBuffer* threadBuffer();
+    void run();
+    size_t collect();
+    void write(size_t count);
+
+    std::atomic<LogLevel> m_level{LogLevel::Info};
+    std::atomic<FILE*> m_info;
+    std::atomic<FILE*> m_error;
+
+    std::mutex m_buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+
+    struct Pending {
+        int64_t timeNs;
+        LogLevel level;
+        std::string text;
+    };
+    // Background thread only.
+    std::vector<Pending> m_pending;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running{true};
+    WakeEvent m_wake;
+    std::atomic<bool> m_sleeping{false};
+    std::atomic<uint64_t> m_submitted{0};
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+// Lets one call site through at most once per interval; the number of
+// suppressed lines is appended to the next one that gets through.
+class LogRateLimiter {
+public:
+    bool allow(uint32_t intervalMs);
+    uint64_t takeSuppressed() { return m_suppressed.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> m_nextNs{0};
+    std::atomic<uint64_t> m_suppressed{0};
+};
+
+struct LogHex {
+    uint64_t value;
+};
+inline LogHex logHex(uint64_t value) { return LogHex{value}; }
+
+// One log line, formatted into a fixed stack buffer and submitted when it
+// goes out of scope. Use through the LOG_* macros.
+class LogLine {
+public:
+    explicit LogLine(LogLevel level, LogRateLimiter* limiter = nullptr)
+        : m_level(level), m_limiter(limiter), m_length(0) {}
+    ~LogLine();
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(const char* text);
+    LogLine& operator<<(const std::string& text) { return append(text.data(), text.size()); }
+    LogLine& operator<<(char c) { return append(&c, 1); }
+    LogLine& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+    LogLine& operator<<(int value) { return format("%d", value); }
+    LogLine& operator<<(unsigned value) { return format("%u", value); }
+    LogLine& operator<<(long value) { return format("%ld", value); }
+    LogLine& operator<<(unsigned long value) { return format("%lu", value); }
+    LogLine& operator<<(long long value) { return format("%lld", value); }
+    LogLine& operator<<(unsigned long long value) { return format("%llu", value); }
+    LogLine& operator<<(short value) { return format("%d", static_cast<int>(value)); }
+    LogLine& operator<<(unsigned short value) { return format("%u", static_cast<unsigned>(value)); }
+    LogLine& operator<<(double value) { return format("%g", value); }
+    LogLine& operator<<(LogHex hex) { return format("%llx", static_cast<unsigned long long>(hex.value)); }
+
+private:
+    LogLine& append(const char* text, size_t length);
+    template <typename T>
+    LogLine& format(const char* spec, T value) {
+        if (m_length < Logger::MAX_MESSAGE) {
+            int written = snprintf(m_text + m_length, Logger::MAX_MESSAGE - m_length + 1, spec, value);
+            if (written > 0) {
+                m_length += static_cast<size_t>(written);
+                if (m_length > Logger::MAX_MESSAGE) {
+                    m_length = Logger::MAX_MESSAGE;
+                }
+            }
+        }
+        return *this;
+    }
+
+    LogLevel m_level;
+    LogRateLimiter* m_limiter;
+    size_t m_length;
+    char m_text[Logger::MAX_MESSAGE + 1];
+};
+
+// A single statement, safe as the body of an unbraced if/else; the loop
+// runs once when |level| is enabled.
+#define LOG_AT(level)                                                                                                  \
+    for (bool logOnce_ = Logger::instance().enabled(level); logOnce_; logOnce_ = false)                                \
+    LogLine(level)
+#define LOG_DEBUG LOG_AT(LogLevel::Debug)
+#define LOG_INFO LOG_AT(LogLevel::Info)
+#define LOG_WARN LOG_AT(LogLevel::Warning)
+#define LOG_ERROR LOG_AT(LogLevel::Error)
+
+// Rate-limited variant for hot paths: at most one line per |intervalMs|
+// from this call site. The limiter is a static local of a lambda, which is
+// unique to the call site, so this too stays a single statement.
+#define LOG_EVERY_MS(level, intervalMs)                                                                                \
+    for (LogRateLimiter* logLimiter_ = Logger::instance().enabled(level)                                               \
+                                           ? [] { static LogRateLimiter limiter; return &limiter; }()                  \
+                                           : nullptr;                                                                  \
+         logLimiter_ && logLimiter_->allow(intervalMs); logLimiter_ = nullptr)                                         \
+    LogLine(level, logLimiter_)
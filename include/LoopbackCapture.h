@@ -4,8 +4,20 @@
 
 #include <string>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <mmdeviceapi.h>
 #include <audioclient.h>
+#include "BlockSubscriber.h"
+#include "BufferPool.h"
+#include "ClockTracker.h"
+#include "FlacWriter.h"
+#include "Metrics.h"
+#include "MultichannelWavWriter.h"
+#include "SampleFormat.h"
+#include "SegmentedSink.h"
+#include "WavCodec.h"
 
 class LoopbackCapture
 {
@@ -16,19 +28,87 @@ public:
     bool start();
     void stop();
 
+    // Format written to disk when the mix format is float. Float32 keeps the
+    // samples as captured (WAVE_FORMAT_IEEE_FLOAT).
+    void setOutputFormat(SampleFormat format, bool dither = false);
+    // Rate written to disk instead of the mix rate (0 keeps it), optionally
+    // downmixed to mono; resampling runs on the disk writer thread.
+    void setOutputRate(uint32_t sampleRate, bool mono = false);
+    // Compressed WAV encoding; the mix is quantized to 16 bits first.
+    void setEncoding(WavEncoding encoding) { m_encoding = encoding; }
+    // Record FLAC instead of WAV; float mixes are stored in the
+    // setOutputFormat() format. Resampling and drift correction do not
+    // apply. Set before start().
+    void setFlacOutput(const FlacWriterOptions& options);
+    // Pool of blocks queued between capture and the disk writer. Set before
+    // start().
+    void setBufferConfig(const BufferPoolConfig& config) { m_bufferConfig = config; }
+    // Record numbered segments instead of one file; see SegmentedSink. Set
+    // before start().
+    void setSegments(const SegmentOptions& options) {
+        m_segmented = true;
+        m_segmentOptions = options;
+    }
+    // Record into channel group |group| of a combined file instead; see
+    // MultichannelWavWriter. Format, encoding, FLAC, drift correction and
+    // segment options do not apply. Set before start().
+    void setChannelGroup(std::shared_ptr<MultichannelWavWriter> writer, size_t group) {
+        m_combined = std::move(writer);
+        m_combinedGroup = group;
+    }
+    // Also publish every block written to |subscriber|; see
+    // BlockSubscriber. Set before start().
+    void addSubscriber(std::shared_ptr<BlockSubscriber> subscriber) { m_subscribers.push_back(std::move(subscriber)); }
+
+    // Live counters for this stream, e.g. for a MetricsReporter.
+    const StreamMetrics& metrics() const { return m_metrics; }
+    // The render device's clock, fitted from GetBuffer's device and QPC
+    // positions.
+    const ClockTracker& clock() const { return m_clock; }
+    // Resample the output to stay aligned with |reference| (nullptr: the
+    // host clock) rather than the render clock. Set before start().
+    void setDriftCorrection(bool enabled, const ClockTracker* reference = nullptr);
+
 private:
     bool initialize();
     void captureLoop();
+    SampleFormat mixSampleFormat() const;
 
 private:
     std::string m_outputFile;
     std::atomic<bool> m_running{false};
+    // Runs captureLoop(); stop() joins it before releasing what it uses.
+    std::thread m_thread;
+    SampleFormat m_outputFormat = SampleFormat::Int16;
+    bool m_dither = false;
+    uint32_t m_outputRate = 0;
+    bool m_mono = false;
+    WavEncoding m_encoding = WavEncoding::Pcm;
+    bool m_flac = false;
+    FlacWriterOptions m_flacOptions;
+    BufferPoolConfig m_bufferConfig;
+    bool m_segmented = false;
+    SegmentOptions m_segmentOptions;
+    std::shared_ptr<MultichannelWavWriter> m_combined;
+    size_t m_combinedGroup = 0;
+    std::vector<std::shared_ptr<BlockSubscriber>> m_subscribers;
+    StreamMetrics m_metrics;
+    ClockTracker m_clock;
+    bool m_driftCorrection = false;
+    const ClockTracker* m_referenceClock = nullptr;
 
     IMMDevice *m_device = nullptr;
     IAudioClient *m_audioClient = nullptr;
     IAudioCaptureClient *m_captureClient = nullptr;
 
     WAVEFORMATEX *m_waveFormat = nullptr;
+
+    // Signaled by the audio engine each time a period is ready
+    // (AUDCLNT_STREAMFLAGS_EVENTCALLBACK).
+    HANDLE m_captureEvent = nullptr;
+    // Wait bound in case the engine stops signaling, e.g. loopback on
+    // Windows builds that do not support event-driven loopback.
+    DWORD m_waitTimeoutMs = 20;
 };
 
 #endif
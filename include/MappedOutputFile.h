@@ -0,0 +1,55 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "OutputFile.h"
+
+struct MappedOutputOptions {
+    // File space is reserved with posix_fallocate() in steps of this size.
+    uint64_t extentSize = 64ull << 20;
+    // Size of the sliding mapping the data is copied into.
+    size_t windowSize = 16 << 20;
+};
+
+// Copies appended data straight into a shared mapping of the file. Space is
+// reserved ahead in large extents, the mapping window slides forward as
+// recording progresses, and the first page stays mapped so the header can be
+// patched in place. close() truncates the file to the real length.
+class MappedOutputFile : public OutputFile {
+public:
+    explicit MappedOutputFile(const MappedOutputOptions& options = MappedOutputOptions());
+    ~MappedOutputFile() override;
+
+    bool open(const std::string& path) override;
+    bool append(const uint8_t* data, size_t size) override;
+    // Never touches the mapping: reserved space already reads as zeros. Long
+    // runs are punched out of the reservation and not reserved ahead.
+    bool appendZeros(uint64_t size) override;
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size) override;
+    // fallocate(FALLOC_FL_KEEP_SIZE) for the first |size| bytes, ahead of
+    // the window's own extents; the length is left alone and close() sets
+    // it, which releases what was not used.
+    bool reserve(uint64_t size) override;
+    bool flush() override;
+    bool close() override;
+    uint64_t size() const override { return m_size; }
+
+private:
+    // Backs the file up to |end|, rounded up to whole extents, so every
+    // mapped page has disk blocks; extends the file.
+    bool reserveTo(uint64_t end);
+    bool mapWindow(uint64_t offset);
+    void unmapWindow();
+
+    MappedOutputOptions m_options;
+    int m_fd = -1;
+    size_t m_pageSize = 4096;
+    uint64_t m_size = 0;
+    uint64_t m_reserved = 0;
+
+    uint8_t* m_headerPage = nullptr;
+    uint8_t* m_window = nullptr;
+    uint64_t m_windowOffset = 0;
+};
+
+#endif
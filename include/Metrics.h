@@ -0,0 +1,139 @@
+#pragma once
+
+#include "RingBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+inline int64_t metricsNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Counter with a single writer thread and any number of readers. Updates are
+// plain relaxed load/store pairs: no locked instructions on the hot path.
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void set(uint64_t value) { m_value.store(value, std::memory_order_relaxed); }
+    void raise(uint64_t value) {
+        if (value > m_value.load(std::memory_order_relaxed)) {
+            m_value.store(value, std::memory_order_relaxed);
+        }
+    }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+// Log-linear (HDR-style) histogram of nanosecond durations: 32 linear
+// sub-buckets per power of two, so any recorded value is reported within
+// ~3%, from 1 ns up to ~18 minutes. Single writer, lock-free readers;
+// readers see a slightly torn but never corrupt view.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 5;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_EXPONENT = 40;
+    static constexpr unsigned BUCKET_COUNT = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(int64_t valueNs);
+
+    uint64_t count() const { return m_count.value(); }
+    uint64_t maxNs() const { return m_max.value(); }
+    double meanNs() const;
+    // Upper bound of the bucket holding the given quantile (0..1).
+    uint64_t quantileNs(double quantile) const;
+
+    // {"count":..,"mean_us":..,"p50_us":..,...}
+    std::string toJson() const;
+
+private:
+    static unsigned bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(unsigned index);
+
+    MetricCounter m_buckets[BUCKET_COUNT];
+    MetricCounter m_count;
+    MetricCounter m_sum;
+    MetricCounter m_max;
+};
+
+// Runtime counters for one capture stream. The capture-side block is only
+// written by the thread delivering packets and the writer-side block only by
+// the stream's DiskWriter thread; each sits on its own cache line. Nothing
+// here locks, allocates or does I/O.
+class StreamMetrics {
+public:
+    // Capture side.
+    void recordPacket(uint32_t frames, uint32_t bytes, bool silent = false) {
+        m_frames.add(frames);
+        m_bytes.add(bytes);
+        m_packets.add();
+        if (silent) {
+            m_silentPackets.add();
+        }
+    }
+    void recordDiscontinuity() { m_discontinuities.add(); }
+    // Time spent handling one callback/wakeup.
+    void recordCallback(int64_t durationNs) { m_callback.record(durationNs); }
+
+    // Writer side.
+    void recordWrite(uint64_t bytes) { m_bytesWritten.add(bytes); }
+    void recordLatency(int64_t latencyNs) { m_captureToDisk.record(latencyNs); }
+    void updateRing(uint64_t overruns, uint64_t droppedBytes, size_t highWaterMark) {
+        m_overruns.set(overruns);
+        m_droppedBytes.set(droppedBytes);
+        m_ringHighWater.raise(highWaterMark);
+    }
+    // |shortfallBlocks|: blocks subscribers may hold that the pool could not
+    // add.
+    void updatePool(size_t blocks, size_t bytes, size_t shortfallBlocks = 0) {
+        m_poolBlocks.set(blocks);
+        m_poolBytes.set(bytes);
+        m_poolShortfall.set(shortfallBlocks);
+    }
+    // Once per analysis frame when a VoiceActivityDetector is attached.
+    void recordVoice(float rmsDb, float peakDb, bool speech, uint64_t speechFrames, uint64_t speechSegments) {
+        m_levelRmsDb.store(rmsDb, std::memory_order_relaxed);
+        m_levelPeakDb.store(peakDb, std::memory_order_relaxed);
+        m_speech.set(speech ? 1 : 0);
+        m_speechFrames.set(speechFrames);
+        m_speechSegments.set(speechSegments);
+        m_voiceFrames.add();
+    }
+
+    uint64_t frames() const { return m_frames.value(); }
+    uint64_t packets() const { return m_packets.value(); }
+    uint64_t overruns() const { return m_overruns.value(); }
+    const LatencyHistogram& callbackDuration() const { return m_callback; }
+    const LatencyHistogram& captureToDiskLatency() const { return m_captureToDisk; }
+
+    // Snapshot of every counter as a JSON object body, without braces.
+    std::string toJsonFields() const;
+
+private:
+    alignas(CACHE_LINE_SIZE) MetricCounter m_frames;
+    MetricCounter m_bytes;
+    MetricCounter m_packets;
+    MetricCounter m_silentPackets;
+    MetricCounter m_discontinuities;
+    LatencyHistogram m_callback;
+
+    alignas(CACHE_LINE_SIZE) MetricCounter m_bytesWritten;
+    MetricCounter m_overruns;
+    MetricCounter m_droppedBytes;
+    MetricCounter m_ringHighWater;
+    MetricCounter m_poolBlocks;
+    MetricCounter m_poolBytes;
+    MetricCounter m_poolShortfall;
+    std::atomic<float> m_levelRmsDb{-120.0f};
+    std::atomic<float> m_levelPeakDb{-120.0f};
+    MetricCounter m_speech;
+    MetricCounter m_speechFrames;
+    MetricCounter m_speechSegments;
+    MetricCounter m_voiceFrames;
+    LatencyHistogram m_captureToDisk;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "WakeEvent.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class StreamMetrics;
+
+struct MetricsReporterOptions {
+    // Snapshot rewritten every interval (atomically, via rename). Empty
+    // disables the file.
+    std::string filePath;
+    // Linux only: Unix stream socket that sends one snapshot to each client
+    // that connects, e.g. `socat - UNIX-CONNECT:<path>`. Empty disables it.
+    std::string socketPath;
+    uint32_t intervalMs = 1000;
+};
+
+// Background thread that publishes StreamMetrics snapshots as JSON. It only
+// reads the metrics' atomics, so capture and writer threads never wait on it.
+class MetricsReporter {
+public:
+    explicit MetricsReporter(const MetricsReporterOptions& options);
+    ~MetricsReporter();
+
+    // |metrics| must outlive its registration.
+    void add(const std::string& name, const StreamMetrics* metrics);
+    void remove(const StreamMetrics* metrics);
+
+    bool start();
+    // Publishes a final snapshot before returning.
+    void stop();
+
+    std::string snapshot() const;
+
+private:
+    void run();
+    void writeFile(const std::string& json) const;
+    bool openSocket();
+    void serveClients();
+
+    MetricsReporterOptions m_options;
+    mutable std::mutex m_mutex;
+    std::vector<std::pair<std::string, const StreamMetrics*>> m_streams;
+    int64_t m_startNs;
+
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    WakeEvent m_stop;
+    int m_listenFd;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "ChannelInterleaver.h"
+#include "RingBuffer.h"
+#include "SampleFormat.h"
+#include "WavWriter.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Speaker positions used by the default mic + loopback layout.
+static constexpr uint32_t WAV_SPEAKER_FRONT_LEFT = 0x1;
+static constexpr uint32_t WAV_SPEAKER_FRONT_RIGHT = 0x2;
+static constexpr uint32_t WAV_SPEAKER_FRONT_CENTER = 0x4;
+static constexpr uint32_t WAV_SPEAKER_BACK_LEFT = 0x10;
+static constexpr uint32_t WAV_SPEAKER_BACK_RIGHT = 0x20;
+
+struct MultichannelWavOptions {
+    // Format stored on disk; groups are combined as float and converted
+    // once, optionally with TPDF dither.
+    SampleFormat outputFormat = SampleFormat::Int16;
+    bool dither = false;
+    WavContainer container = WavContainer::Rf64Auto;
+    WavWriteMode mode = WavWriteMode::Stdio;
+    // How far one group may get ahead of another that has delivered
+    // nothing, e.g. a stalled or failed device, before the missing one is
+    // written as silence; its audio for that stretch is then discarded.
+    uint32_t maxSkewMs = 500;
+    // A group this far from where its timestamps place it, e.g. after the
+    // device skipped frames, is realigned at once by inserting silence or
+    // dropping audio. Smaller errors, clock drift among them, are steered
+    // out by resampling.
+    uint32_t resyncMs = 5;
+};
+
+// One WAVE_FORMAT_EXTENSIBLE file holding several captures side by side as
+// channel groups, e.g. loopback at front left/right and the microphone at
+// front center, aligned on the host clock. Each group is fed by its own
+// input sink (createInput()), normally on its own DiskWriter thread. An
+// input converts its stream to float at the file rate through a
+// variable-rate Resampler and places it on the shared timeline from its
+// block timestamps: the first block fixes where the group starts, the
+// device clock fitted by a ClockTracker steers the resampler to stay there,
+// and frames the device skipped become silence. Whichever input wrote last
+// interleaves the frames every group has into the file; a group that falls
+// maxSkewMs behind is filled with silence instead of holding the others
+// up. The file is finalized with the last input.
+class MultichannelWavWriter : public std::enable_shared_from_this<MultichannelWavWriter> {
+public:
+    MultichannelWavWriter(const std::string& filename, uint32_t sampleRate,
+                          const MultichannelWavOptions& options = MultichannelWavOptions());
+    ~MultichannelWavWriter();
+
+    // Declares the next channel group, |channels| wide, at the speaker
+    // positions in |channelMask| (0: the lowest free positions above the
+    // previous group). Groups are stored in the order added, and as
+    // WAVE_FORMAT_EXTENSIBLE orders channels by position, each group's
+    // positions must lie above the previous group's. Call before any input
+    // is created; returns the group's index.
+    size_t addGroup(const std::string& name, uint16_t channels, uint32_t channelMask = 0);
+    // Sink feeding |group| with a stream in the given format, to be
+    // initialized, written and finalized like any other sink. A mono group
+    // takes the average of a wider stream; other channel counts must
+    // match. The writer must be owned by a shared_ptr.
+    std::unique_ptr<AudioSink> createInput(size_t group, uint32_t sampleRate, uint16_t channels,
+                                           SampleFormat format);
+
+    uint32_t sampleRate() const { return m_sampleRate; }
+    size_t groupCount() const { return m_groups.size(); }
+    uint16_t channels() const;
+    // Positions of every group, as stored in the file.
+    uint32_t channelMask() const;
+    uint32_t groupMask(size_t group) const { return m_groups[group]->mask; }
+    const std::string& groupName(size_t group) const { return m_groups[group]->name; }
+    // Frames in the file.
+    uint64_t framesWritten() const { return m_framesWritten.load(std::memory_order_relaxed); }
+    // Frames of |group| stored as silence because it had nothing for them:
+    // a late start, skipped device frames, a stall or an early end.
+    uint64_t silentFrames(size_t group) const {
+        return m_groups[group]->silentFrames.load(std::memory_order_relaxed);
+    }
+    // Captured frames of |group| discarded because they arrived after their
+    // place in the file was written, or ahead of their time.
+    uint64_t droppedFrames(size_t group) const {
+        return m_groups[group]->droppedFrames.load(std::memory_order_relaxed);
+    }
+
+private:
+    class Input;
+    friend class Input;
+
+    struct Group {
+        std::string name;
+        uint16_t channels;
+        uint32_t mask;
+        // Float frames at the file rate, from the input to the mixer.
+        std::unique_ptr<SpscRingBuffer> ring;
+        // Host time of the group's first frame; 0 until it has one.
+        std::atomic<int64_t> startNs{0};
+        std::atomic<bool> ended{false};
+        std::atomic<uint64_t> silentFrames{0};
+        std::atomic<uint64_t> droppedFrames{0};
+
+        // Mixer state: timeline frame of the group's frame 0, once placed,
+        // and the group frames taken from the ring.
+        bool placed = false;
+        int64_t offset = 0;
+        uint64_t consumed = 0;
+        std::vector<float> chunk;
+    };
+
+    static constexpr size_t MIX_CHUNK_FRAMES = 4096;
+
+    // Opens the file for the groups declared so far; once, from the first
+    // input's initialize().
+    bool open();
+    // Called by inputs after every write: mixes unless another input is
+    // already doing it.
+    void pump();
+    // Writes the frames every group has, or, with |final|, until the last
+    // group runs out. Needs m_mutex.
+    void mix(bool final);
+    // Places groups that have started on the timeline; false while the
+    // origin is not known yet.
+    bool placeGroups(bool final);
+    // Frames of |group| the timeline could take, discarding what is late.
+    int64_t available(Group& group);
+    bool finishInput();
+
+    std::string m_filename;
+    uint32_t m_sampleRate;
+    MultichannelWavOptions m_options;
+    std::vector<std::unique_ptr<Group>> m_groups;
+    std::atomic<uint64_t> m_framesWritten{0};
+
+    // Guards everything below.
+    std::mutex m_mutex;
+    std::unique_ptr<WavWriter> m_file;
+    std::unique_ptr<ChannelInterleaver> m_interleaver;
+    bool m_opened = false;
+    bool m_failed = false;
+    size_t m_inputs = 0;
+    size_t m_finishedInputs = 0;
+    bool m_originSet = false;
+    int64_t m_originNs = 0;
+    // Timeline frame of the next frame written.
+    uint64_t m_position = 0;
+    std::vector<const float*> m_groupData;
+    std::vector<float> m_interleaved;
+};
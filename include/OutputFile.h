@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Byte sink used by WavWriter. Data is appended sequentially; writeAt() is
+// only used to patch bytes that were already appended (header fix-ups).
+class OutputFile {
+public:
+    // Zero runs shorter than this are written out: a hole saves nothing
+    // until it spans whole filesystem blocks.
+    static constexpr uint64_t MIN_HOLE_BYTES = 64 << 10;
+
+    virtual ~OutputFile() = default;
+
+    virtual bool open(const std::string& path) = 0;
+    virtual bool append(const uint8_t* data, size_t size) = 0;
+    // Appends |size| zero bytes. Files that support it leave long runs as a
+    // hole (sparse region) that costs neither disk space nor bandwidth; the
+    // default writes them from a shared zero block.
+    virtual bool appendZeros(uint64_t size);
+    virtual bool writeAt(uint64_t offset, const uint8_t* data, size_t size) = 0;
+    // Reserves disk space for the first |size| bytes ahead of the writes,
+    // without changing the file's length; close() releases what was not
+    // used. The default reserves nothing.
+    virtual bool reserve(uint64_t size) {
+        (void)size;
+        return true;
+    }
+    // Returns once everything appended so far has reached the file.
+    virtual bool flush() = 0;
+    // Completes all outstanding writes and closes the file.
+    virtual bool close() = 0;
+    virtual uint64_t size() const = 0;
+};
+
+// Plain buffered stdio output; the original WavWriter behaviour.
+class StdioOutputFile : public OutputFile {
+public:
+    StdioOutputFile() = default;
+    ~StdioOutputFile() override;
+
+    bool open(const std::string& path) override;
+    bool append(const uint8_t* data, size_t size) override;
+    // Long runs seek past the end; the file is marked sparse on Windows.
+    bool appendZeros(uint64_t size) override;
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size) override;
+    // fallocate(FALLOC_FL_KEEP_SIZE) / FileAllocationInfo.
+    bool reserve(uint64_t size) override;
+    bool flush() override;
+    bool close() override;
+    uint64_t size() const override { return m_size; }
+
+private:
+    FILE* m_file = nullptr;
+    uint64_t m_size = 0;
+    // The file ends in a hole, so its length must be set at close.
+    bool m_holeAtEnd = false;
+    // Space was reserved past the end; setting the length releases it.
+    bool m_reserved = false;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Device clock for paced sources: frame N is "captured" N / sampleRate
+// seconds after start(), as measured by the device clock. A skew makes that
+// clock run fast (positive ppm) or slow against the host clock, the way a
+// real sound card's crystal does. On Linux a timerfd is armed for the next deadline,
+// so waiting costs exactly one wakeup per period and the descriptor can be
+// handed to poll/epoll; elsewhere waits fall back to sleep_until.
+class PacketTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PacketTimer();
+    ~PacketTimer();
+
+    PacketTimer(const PacketTimer&) = delete;
+    PacketTimer& operator=(const PacketTimer&) = delete;
+
+    bool start(uint32_t sampleRate, double skewPpm = 0.0);
+    void stop();
+
+    // Capture time of the end of frame |frame|.
+    Clock::time_point frameTime(uint64_t frame) const;
+    // Frames whose capture time has passed.
+    uint64_t framesElapsed() const;
+
+    // Arms the timer so that fd() becomes readable once |frame| frames have
+    // elapsed.
+    void arm(uint64_t frame);
+    // Blocks until |frame| frames have elapsed. Returns false on timeout; a
+    // negative timeout waits forever.
+    bool waitFor(uint64_t frame, int timeoutMs);
+
+    // Blocking waits that actually slept.
+    uint64_t wakeups() const { return m_wakeups; }
+
+#ifdef PLATFORM_LINUX
+    int fd() const { return m_fd; }
+#endif
+
+private:
+    uint32_t m_sampleRate;
+    // Device seconds per host second.
+    double m_clockScale;
+    Clock::time_point m_startTime;
+    uint64_t m_wakeups;
+#ifdef PLATFORM_LINUX
+    int m_fd;
+    uint64_t m_armedFrame;
+#endif
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ThreadRole { Capture, Writer };
+
+struct RealtimeConfig {
+    // Everything below is ignored until this is set.
+    bool enabled = false;
+    // Linux: SCHED_RR instead of SCHED_FIFO.
+    bool roundRobin = false;
+    // Linux priorities (1-99). Capture outranks the writer so a slow disk
+    // never delays a device read.
+    int capturePriority = 80;
+    int writerPriority = 70;
+    // CPUs each role is pinned to; empty leaves the threads unpinned.
+    std::vector<int> captureCpus;
+    std::vector<int> writerCpus;
+    // Linux: mlockall() what is mapped now (rings, pools, code) and, when the
+    // memlock limit allows it, everything mapped later.
+    // Windows: raises the working-set minimum so pools can VirtualLock().
+    bool lockMemory = true;
+    // Windows: MMCSS task per role (HKLM\...\Multimedia\SystemProfile\Tasks).
+    std::string captureTask = "Pro Audio";
+    std::string writerTask = "Audio";
+};
+
+// Opt-in real-time mode for capture and writer threads. The configuration
+// is process-wide; each of those threads calls prepareThread() as it starts,
+// which does nothing while the mode is off. Missing privileges are reported,
+// not treated as errors, so capture always runs.
+class Realtime {
+public:
+    // Applies the process-wide part (memory locking) and logs which
+    // privileges are missing. Call before capture starts; threads that are
+    // already running keep their current settings.
+    static void configure(const RealtimeConfig& config);
+    static RealtimeConfig config();
+    static bool enabled();
+
+    // Scheduling class and affinity for the calling thread (MMCSS on
+    // Windows), and prefaults its stack. Returns false if any part was
+    // refused.
+    static bool prepareThread(ThreadRole role);
+
+    // One line per setting: what was requested and whether it was granted.
+    static std::string report();
+    // Threads whose real-time request was refused since configure().
+    static uint64_t refusedThreads();
+};
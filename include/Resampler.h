@@ -0,0 +1,133 @@
+#pragma once
+
+#include "SampleBlock.h"
+#include "SampleConverter.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct ResamplerConfig {
+    uint32_t inputRate = 48000;
+    uint32_t outputRate = 16000;
+    uint16_t channels = 2;
+    // Average all input channels into one before filtering.
+    bool mono = false;
+    // Filter taps per output sample when upsampling. Downsampling scales this
+    // by the decimation factor so the transition band keeps its width; the
+    // result is rounded up to a multiple of 16.
+    uint32_t taps = 32;
+    // Passband edge as a fraction of the lower of the two Nyquist rates.
+    double cutoff = 0.91;
+    // Kaiser window shape; 8 gives roughly 80 dB of stopband rejection.
+    double kaiserBeta = 8.0;
+    // Let setRateAdjust() trim the ratio while running, e.g. for clock drift
+    // correction. Uses VARIABLE_PHASES phases whatever the ratio and
+    // interpolates between neighbouring ones: two dot products per sample.
+    bool variableRate = false;
+};
+
+// Streaming polyphase sample-rate converter for interleaved float32 audio at
+// any rational ratio L/M (the reduced output/input rates). The windowed-sinc
+// prototype is split into L phases of tapsPerPhase() coefficients each, so an
+// output sample costs one dot product per channel. Filter banks are built
+// once per ratio and shared process-wide; process() never allocates and runs
+// in blocks of any size. The output timeline is aligned with the input:
+// output frame n is the input at time n * M / L (or the sum of the adjusted
+// steps in variable-rate mode).
+class Resampler {
+public:
+    // Largest L supported; bank size grows with L * tapsPerPhase().
+    static constexpr uint32_t MAX_PHASES = 16384;
+    static constexpr uint32_t VARIABLE_PHASES = 256;
+
+    explicit Resampler(const ResamplerConfig& config, SimdLevel level = SampleConverter::detectSimdLevel());
+    ~Resampler();
+
+    Resampler(const Resampler&) = delete;
+    Resampler& operator=(const Resampler&) = delete;
+
+    // False if the rates are zero or the reduced ratio needs more than
+    // MAX_PHASES phases; process() then outputs nothing.
+    bool valid() const { return m_bank != nullptr; }
+
+    // Converts |frames| input frames; |out| must hold maxOutputFrames(frames)
+    // frames of outputChannels(). Returns the frames written.
+    size_t process(const float* in, size_t frames, float* out);
+    // End of stream: emits the frames the filter delay still holds back, so
+    // the output covers exactly the input: ceil(input frames * L / M) frames
+    // at a fixed rate. |out| must hold maxOutputFrames(tapsPerPhase())
+    // frames.
+    size_t drain(float* out);
+    // Clears the filter history for a new stream.
+    void reset();
+    // Variable-rate mode: output frames per input frame become
+    // outputRate / inputRate * |factor|. Takes effect from the next output.
+    void setRateAdjust(double factor);
+    double rateAdjust() const { return m_adjust; }
+
+    size_t maxOutputFrames(size_t inputFrames) const;
+    uint16_t outputChannels() const { return m_outChannels; }
+    uint32_t outputRate() const { return m_config.outputRate; }
+    uint32_t upFactor() const { return m_up; }
+    uint32_t downFactor() const { return m_down; }
+    uint32_t tapsPerPhase() const { return m_taps; }
+    // Input frames process() holds back before the matching output appears.
+    uint32_t latencyFrames() const { return m_latency; }
+    uint64_t inputFrames() const { return m_inputFrames; }
+    uint64_t outputFrames() const { return m_outputFrames; }
+    // Input time, in input frames since the stream started, of the next
+    // output frame.
+    double outputPosition() const;
+    SimdLevel simdLevel() const { return m_level; }
+
+    using Kernel = float (*)(const float* coeffs, const float* samples, size_t taps);
+
+private:
+    struct FilterBank;
+    // Input frames deinterleaved per call; bounds the planar history buffers.
+    static constexpr size_t CHUNK_FRAMES = 1024;
+
+    // Shared, built on first use. |bandwidth| is the passband edge as a
+    // fraction of the input Nyquist rate. Holds |phases| + 1 phases; the last
+    // is phase 0 one frame later, for interpolation.
+    static std::shared_ptr<const FilterBank> bankFor(uint32_t phases, uint32_t taps, double bandwidth,
+                                                     double kaiserBeta);
+    // |in| == nullptr feeds zeros. Stops after |maxOut| output frames.
+    size_t processChunk(const float* in, size_t frames, float* out, size_t maxOut);
+    void deinterleave(const float* in, size_t frames);
+
+    ResamplerConfig m_config;
+    SimdLevel m_level;
+    Kernel m_kernel;
+    std::shared_ptr<const FilterBank> m_bank;
+    uint32_t m_up = 1;
+    uint32_t m_down = 1;
+    uint32_t m_taps = 0;
+    uint32_t m_latency = 0;
+    uint16_t m_outChannels;
+    // Fixed rate: per output sample the input advances by m_step whole
+    // frames plus m_stepPhase / m_up.
+    uint32_t m_step = 0;
+    uint32_t m_stepPhase = 0;
+
+    // One planar buffer per output channel: tapsPerPhase() - 1 frames of
+    // history followed by the current chunk.
+    std::vector<std::vector<float>> m_planar;
+    // Float mono mix for the input's channel count.
+    BlockKernels::Kernel m_downmix;
+    // Buffer index of the newest input frame the next output needs, and the
+    // filter phase it uses (variable rate: the fraction of a frame past it,
+    // as 0.32 fixed point).
+    size_t m_next = 0;
+    uint32_t m_phase = 0;
+    // Variable rate: input frames per output frame as 32.32 fixed point.
+    uint64_t m_stepFixed = 0;
+    double m_adjust = 1.0;
+    // Input frames shifted out of the planar buffers, and how far output 0
+    // lies behind the first input frame the filter needs for it.
+    uint64_t m_shifted = 0;
+    double m_delay = 0.0;
+    uint64_t m_inputFrames = 0;
+    uint64_t m_outputFrames = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Most x86/ARM cores use 64-byte lines; used to keep producer and consumer
+// indices from sharing a line.
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Lock-free single-producer/single-consumer byte ring. All storage is
+// allocated up front, so push() never allocates or blocks and is safe to call
+// from an audio callback. Capacity is rounded up to a power of two.
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity);
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Producer side. Writes all of |size| bytes or nothing; a rejected push
+    // is counted as an overrun.
+    bool push(const uint8_t* data, size_t size);
+
+    // Consumer side. Returns the largest contiguous readable region; call
+    // consume() once it has been processed.
+    size_t peek(const uint8_t** data) const;
+    void consume(size_t size);
+
+    size_t readAvailable() const;
+    size_t capacity() const { return m_capacity; }
+
+    uint64_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+    uint64_t droppedBytes() const { return m_droppedBytes.load(std::memory_order_relaxed); }
+    size_t highWaterMark() const { return m_highWaterMark.load(std::memory_order_relaxed); }
+
+private:
+    // Producer-owned line: write index plus a cached copy of the read index.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_writePos{0};
+    size_t m_cachedReadPos = 0;
+    std::atomic<uint64_t> m_overruns{0};
+    std::atomic<uint64_t> m_droppedBytes{0};
+
+    // Consumer-owned line.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_readPos{0};
+    mutable std::atomic<size_t> m_highWaterMark{0};
+
+    alignas(CACHE_LINE_SIZE) size_t m_capacity;
+    size_t m_mask;
+    std::vector<uint8_t> m_buffer;
+};
+
+// Lock-free single-producer/single-consumer queue of small trivially copyable
+// values, e.g. block pointers handed between two threads. Fixed capacity,
+// rounded up to a power of two; push() fails rather than allocating.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : m_capacity(1) {
+        while (m_capacity < capacity) {
+            m_capacity <<= 1;
+        }
+        m_mask = m_capacity - 1;
+        m_items.reset(new T[m_capacity]);
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side.
+    bool push(const T& value) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == m_capacity) {
+            return false;
+        }
+        m_items[head & m_mask] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool pop(T& value) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = m_items[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Exact from either side's point of view; approximate from elsewhere.
+    size_t size() const {
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return m_head.load(std::memory_order_acquire) - tail;
+    }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_tail{0};
+
+    alignas(CACHE_LINE_SIZE) size_t m_capacity;
+    size_t m_mask;
+    std::unique_ptr<T[]> m_items;
+};
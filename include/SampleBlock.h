@@ -0,0 +1,127 @@
+#pragma once
+
+#include "SampleFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Compile-time view of a sample format: bytes per sample, full scale and
+// how to load one sample as an unscaled float.
+template <SampleFormat Format>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<SampleFormat::Int16> {
+    static constexpr uint16_t BYTES = 2;
+    static constexpr float FULL_SCALE = 32768.0f;
+    static float load(const uint8_t* p) {
+        int16_t value;
+        memcpy(&value, p, 2);
+        return float(value);
+    }
+};
+
+template <>
+struct SampleTraits<SampleFormat::Int24> {
+    static constexpr uint16_t BYTES = 3;
+    static constexpr float FULL_SCALE = 8388608.0f;
+    static float load(const uint8_t* p) {
+        return float(static_cast<int32_t>(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24) >> 8);
+    }
+};
+
+template <>
+struct SampleTraits<SampleFormat::Int32> {
+    static constexpr uint16_t BYTES = 4;
+    static constexpr float FULL_SCALE = 2147483648.0f;
+    static float load(const uint8_t* p) {
+        int32_t value;
+        memcpy(&value, p, 4);
+        return float(value);
+    }
+};
+
+template <>
+struct SampleTraits<SampleFormat::Float32> {
+    static constexpr uint16_t BYTES = 4;
+    static constexpr float FULL_SCALE = 1.0f;
+    static float load(const uint8_t* p) {
+        float value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+};
+
+// Channel count only known at run time.
+static constexpr uint16_t DYNAMIC_CHANNELS = 0;
+
+// Interleaved frames of a sample format and channel count fixed at compile
+// time, over bytes owned elsewhere. Stages written against it compile to
+// loops with no per-sample format branch, and with Channels fixed the
+// per-frame channel loop unrolls; DYNAMIC_CHANNELS takes the count at run
+// time for unusual device layouts.
+template <SampleFormat Format, uint16_t Channels = DYNAMIC_CHANNELS>
+class SampleBlock {
+public:
+    using Traits = SampleTraits<Format>;
+
+    SampleBlock(const uint8_t* data, size_t frames, uint16_t channels = Channels)
+        : m_data(data), m_frames(frames), m_channels(Channels ? Channels : channels) {}
+
+    const uint8_t* data() const { return m_data; }
+    size_t frames() const { return m_frames; }
+    uint16_t channels() const { return Channels ? Channels : m_channels; }
+    size_t frameBytes() const { return size_t(channels()) * Traits::BYTES; }
+    // Unscaled, as stored.
+    float sample(size_t frame, uint16_t channel) const {
+        return Traits::load(m_data + (frame * channels() + channel) * Traits::BYTES);
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_frames;
+    uint16_t m_channels;
+};
+
+// Every sample scaled to [-1, 1), interleaved as stored.
+template <SampleFormat Format, uint16_t Channels>
+void decodeBlock(const SampleBlock<Format, Channels>& block, float* dst) {
+    const size_t count = block.frames() * block.channels();
+    if constexpr (Format == SampleFormat::Float32) {
+        memcpy(dst, block.data(), count * sizeof(float));
+    } else {
+        using Traits = SampleTraits<Format>;
+        const uint8_t* src = block.data();
+        for (size_t i = 0; i < count; ++i)
+            dst[i] = Traits::load(src + i * Traits::BYTES) * (1.0f / Traits::FULL_SCALE);
+    }
+}
+
+// The mean of each frame's channels, scaled to [-1, 1).
+template <SampleFormat Format, uint16_t Channels>
+void downmixBlock(const SampleBlock<Format, Channels>& block, float* dst) {
+    const uint16_t channels = block.channels();
+    const float scale = 1.0f / (SampleTraits<Format>::FULL_SCALE * channels);
+    for (size_t f = 0; f < block.frames(); ++f) {
+        float sum = 0.0f;
+        for (uint16_t c = 0; c < channels; ++c)
+            sum += block.sample(f, c);
+        dst[f] = sum * scale;
+    }
+}
+
+// The stages above for a format and channel count chosen at run time. Mono
+// and stereo of every format are instantiated with the count fixed; other
+// counts use the DYNAMIC_CHANNELS instantiation. Pick once per stream, not
+// per block.
+struct BlockKernels {
+    using Kernel = void (*)(const uint8_t* src, size_t frames, uint16_t channels, float* dst);
+
+    Kernel decode;
+    Kernel downmix;
+    // The count the kernels were built for; DYNAMIC_CHANNELS for the
+    // fallback.
+    uint16_t channels;
+};
+
+const BlockKernels& blockKernels(SampleFormat format, uint16_t channels);
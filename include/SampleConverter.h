@@ -0,0 +1,53 @@
+#pragma once
+
+#include "SampleFormat.h"
+#include <cstddef>
+#include <cstdint>
+
+enum class SimdLevel {
+    Scalar,
+    Sse2,
+    Avx2,
+    // AVX-512F + AVX-512BW
+    Avx512,
+};
+
+// Converts interleaved float32 samples to integer PCM with clipping and
+// optional TPDF dither. The kernel is picked once from the best instruction
+// set the CPU supports; the scalar kernel is the reference the vector kernels
+// must match bit for bit (dither included).
+class SampleConverter {
+public:
+    // Number of independent dither generators. Sample i of the stream always
+    // uses generator i % DITHER_LANES so every kernel draws the same noise.
+    static constexpr int DITHER_LANES = 16;
+
+    struct DitherState {
+        uint32_t lanes[DITHER_LANES];
+        unsigned phase;
+    };
+
+    using Kernel = void (*)(const float* src, size_t samples, uint8_t* dst, DitherState* dither);
+
+    SampleConverter(SampleFormat output, bool dither = false, SimdLevel level = detectSimdLevel());
+
+    // Returns the number of bytes written to dst.
+    size_t convert(const float* src, size_t samples, uint8_t* dst);
+
+    SampleFormat outputFormat() const { return m_output; }
+    SimdLevel simdLevel() const { return m_level; }
+    void resetDither(uint32_t seed = 1);
+
+    static SimdLevel detectSimdLevel();
+    static const char* simdLevelName(SimdLevel level);
+
+private:
+    SampleFormat m_output;
+    SimdLevel m_level;
+    bool m_dither;
+    Kernel m_kernel;
+    DitherState m_ditherState;
+};
+
+// Decodes |count| little-endian samples of |format| to float in [-1, 1).
+void decodeSamples(const uint8_t* src, SampleFormat format, size_t count, float* dst);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+enum class SampleFormat {
+    Int16,
+    // Packed little-endian 3-byte samples.
+    Int24,
+    Int32,
+    Float32,
+};
+
+inline uint16_t bytesPerSample(SampleFormat format) {
+    switch (format) {
+    case SampleFormat::Int16: return 2;
+    case SampleFormat::Int24: return 3;
+    case SampleFormat::Int32: return 4;
+    case SampleFormat::Float32: return 4;
+    }
+    return 0;
+}
+
+inline bool isFloatFormat(SampleFormat format) {
+    return format == SampleFormat::Float32;
+}
+
+// Integer PCM format for a bit depth as reported by waveIn/WASAPI.
+inline SampleFormat pcmFormatForBits(uint16_t bitsPerSample) {
+    switch (bitsPerSample) {
+    case 24: return SampleFormat::Int24;
+    case 32: return SampleFormat::Int32;
+    default: return SampleFormat::Int16;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "AudioSink.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct SegmentOptions {
+    // A segment is cut after this much audio or this many bytes of input,
+    // whichever comes first; 0 for no limit. Every segment but the last
+    // holds exactly the same number of input frames.
+    double maxSeconds = 0.0;
+    uint64_t maxBytes = 0;
+    // The next segment is created this long before the cut (at most half
+    // a segment), so the cut itself only swaps sinks.
+    double preopenSeconds = 10.0;
+    // Called on the rotation thread once a segment is finalized and synced
+    // to disk, e.g. to start its upload.
+    std::function<void(const std::string& path, uint64_t frames, bool ok)> onClosed;
+};
+
+// Records into numbered segment files (mic-0001.wav, mic-0002.wav, ...),
+// each written by its own sink from |factory|. Cuts fall on exact frame
+// boundaries and a block spanning a cut is split, so the segments join
+// back into the uninterrupted stream; the first block of each segment
+// carries the timestamp of its first frame. Creating the next segment and
+// finalizing and fsyncing the previous one happen on a rotation thread, so
+// the writing thread never waits on file creation or close.
+class SegmentedSink : public AudioSink {
+public:
+    using Factory = std::function<std::unique_ptr<AudioSink>(const std::string& path)>;
+
+    // |path| names the stream (output/mic.wav); |frameBytes| is the input
+    // frame size at |sampleRate|.
+    SegmentedSink(const std::string& path, uint32_t sampleRate, uint16_t frameBytes, const SegmentOptions& options,
+                  Factory factory);
+    ~SegmentedSink() override;
+
+    // Creates the first segment and starts the rotation thread.
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) override;
+    void writeSilence(uint32_t size, const BlockTimestamp& time) override;
+    bool flush() override;
+    // Finalizes the current segment, removes a next one created ahead but
+    // never used, and waits for the rotation thread to finish.
+    bool finalize() override;
+
+    // output/mic.wav, 3 -> output/mic-0003.wav
+    static std::string segmentPath(const std::string& path, unsigned index);
+
+    unsigned segments() const { return m_index; }
+    // Cuts that had to wait for the next segment to be created.
+    uint64_t lateCuts() const { return m_lateCuts; }
+
+private:
+    struct Job {
+        enum class Type {
+            Open,
+            Close,
+            Discard,
+        };
+        Type type;
+        unsigned index;
+        std::unique_ptr<AudioSink> sink;
+        uint64_t frames;
+    };
+
+    void append(const uint8_t* data, uint32_t size, const BlockTimestamp* time, bool silent);
+    void requestOpen();
+    bool cut();
+    void post(Job job);
+    void rotationThread();
+
+    std::string m_path;
+    uint32_t m_sampleRate;
+    uint16_t m_frameBytes;
+    SegmentOptions m_options;
+    Factory m_factory;
+    // Input bytes per segment (UINT64_MAX: unlimited), and how long before
+    // a cut the next segment is requested.
+    uint64_t m_segmentLimit;
+    uint64_t m_preopenBytes;
+
+    // Writing thread. The current segment is cut once it holds m_cutAt
+    // bytes; that moves on by a segment when the next could not be created.
+    std::unique_ptr<AudioSink> m_current;
+    unsigned m_index = 0;
+    uint64_t m_segmentBytes = 0;
+    uint64_t m_cutAt;
+    bool m_opening = false;
+    uint64_t m_lateCuts = 0;
+
+    // Shared with the rotation thread.
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs;
+    std::unique_ptr<AudioSink> m_next;
+    bool m_nextDone = false;
+    bool m_stop = false;
+    std::atomic<bool> m_failed{false};
+    std::thread m_thread;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "SampleFormat.h"
+#include "SharedStream.h"
+#include <cstdint>
+#include <string>
+
+// Reads a stream a SharedMemorySink publishes, typically in another
+// process, in place: peek() returns a pointer straight into the shared
+// ring, contiguous even where the ring wraps. The writer never waits for
+// readers, so reading is optimistic: consume() reports whether the writer
+// overwrote what was just read, and a reader that falls a whole ring
+// behind skips to the live edge and counts the loss. Not thread-safe; use
+// one reader per thread.
+class SharedMemoryReader {
+public:
+    explicit SharedMemoryReader(const std::string& name);
+    ~SharedMemoryReader();
+
+    SharedMemoryReader(const SharedMemoryReader&) = delete;
+    SharedMemoryReader& operator=(const SharedMemoryReader&) = delete;
+
+    // Attaches to the stream; false while it does not exist or is still
+    // being set up. Reading starts at the live edge, or with |fromOldest|
+    // at the oldest audio the ring still holds.
+    bool open(bool fromOldest = false);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+
+    uint32_t sampleRate() const { return m_header->sampleRate; }
+    uint16_t channels() const { return m_header->channels; }
+    SampleFormat format() const { return static_cast<SampleFormat>(m_header->sampleFormat); }
+    uint16_t frameBytes() const { return m_frameBytes; }
+    uint64_t capacity() const { return m_capacity; }
+    int writerPid() const { return m_header->writerPid; }
+
+    // Bytes ready at the stream position |position()|, with |*data|
+    // pointing at them; 0 when caught up.
+    size_t peek(const uint8_t** data);
+    // peek(), sleeping up to |timeoutMs| (negative: forever) for the writer
+    // to publish more; 0 on timeout or once the stream has ended.
+    size_t wait(const uint8_t** data, int timeoutMs);
+    // Moves on by |size| bytes after processing them in place. False if the
+    // writer overwrote any of them meanwhile: they may be torn and should
+    // be discarded; they count as lost.
+    bool consume(size_t size);
+
+    // Stream byte offset of the next peek().
+    uint64_t position() const { return m_position; }
+    // The writer has finalized and everything it published has been read.
+    bool ended() const;
+    // Bytes overwritten before they were read: skipped or torn.
+    uint64_t lostBytes() const { return m_lostBytes; }
+    uint64_t overruns() const { return m_overruns; }
+    // Timestamp of the newest timed block and the stream offset of its
+    // first byte; false before the first.
+    bool latestTime(uint64_t& offset, BlockTimestamp& time) const;
+
+private:
+    std::string m_name;
+    int m_fd = -1;
+    SharedStreamHeader* m_header = nullptr;
+    uint8_t* m_ring = nullptr;
+    uint64_t m_headerSize = 0;
+    uint64_t m_capacity = 0;
+    uint16_t m_frameBytes = 1;
+    uint64_t m_position = 0;
+    uint64_t m_lostBytes = 0;
+    uint64_t m_overruns = 0;
+};
+
+#endif // PLATFORM_LINUX
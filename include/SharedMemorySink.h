@@ -0,0 +1,69 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "AudioSink.h"
+#include "SampleFormat.h"
+#include "SharedStream.h"
+#include <memory>
+#include <string>
+
+struct SharedStreamOptions {
+    // Ring length; readers further behind than this lose audio. Rounded up
+    // to whole pages and frames.
+    double capacitySeconds = 2.0;
+    // Permissions of the shared-memory object.
+    unsigned mode = 0600;
+};
+
+// Publishes a stream live into a named POSIX shared-memory ring (see
+// SharedStream.h) for SharedMemoryReaders in other processes, then passes
+// it on to |inner|, if any, e.g. the WAV/FLAC sink. The writer never waits
+// for readers: a reader that falls a ring behind loses audio, and the
+// writer only makes a syscall to wake readers that are asleep. A stream
+// with the same name is replaced; finalize() marks the stream ended and
+// removes the name, while readers that are attached keep their mapping.
+class SharedMemorySink : public AudioSink {
+public:
+    SharedMemorySink(const std::string& name, uint32_t sampleRate, uint16_t channels, SampleFormat format,
+                     const SharedStreamOptions& options = SharedStreamOptions(),
+                     std::unique_ptr<AudioSink> inner = nullptr);
+    ~SharedMemorySink() override;
+
+    // Creates the shared-memory object, then initializes |inner|. Failing
+    // to create the stream is logged and recording goes on without it.
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) override;
+    void writeSilence(uint32_t size, const BlockTimestamp& time) override;
+    bool flush() override;
+    bool finalize() override;
+
+    bool live() const { return m_header != nullptr; }
+    uint64_t capacity() const { return m_capacity; }
+    // Bytes published so far.
+    uint64_t written() const { return m_written; }
+
+private:
+    bool create();
+    void close();
+    // Copies |size| bytes (zeros when |data| is null) into the ring and
+    // publishes them.
+    void publish(const uint8_t* data, uint32_t size, const BlockTimestamp* time);
+
+    std::string m_name;
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    SampleFormat m_format;
+    SharedStreamOptions m_options;
+    std::unique_ptr<AudioSink> m_inner;
+
+    int m_fd = -1;
+    SharedStreamHeader* m_header = nullptr;
+    uint8_t* m_ring = nullptr;
+    uint64_t m_headerSize = 0;
+    uint64_t m_capacity = 0;
+    uint64_t m_written = 0;
+};
+
+#endif // PLATFORM_LINUX
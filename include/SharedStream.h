@@ -0,0 +1,85 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "ClockTracker.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Layout of a live stream in a named POSIX shared-memory object, written by
+// SharedMemorySink and read by SharedMemoryReader in other processes:
+//
+//   [SharedStreamHeader, padded to headerSize][ring of capacity bytes]
+//
+// Both sides map the ring twice, back to back, so any span of up to
+// |capacity| bytes is contiguous in memory even where it wraps. Positions
+// are byte counts since the stream started and never wrap; stream byte p
+// lives at ring offset p % capacity.
+static constexpr uint32_t SHARED_STREAM_MAGIC = 0x4d534341; // "ACSM"
+static constexpr uint32_t SHARED_STREAM_VERSION = 1;
+
+enum class SharedStreamState : uint32_t {
+    Live = 0,
+    // The writer finalized; nothing more will be published.
+    Ended = 1,
+};
+
+struct SharedStreamHeader {
+    // Stored last, with release order, once everything else is valid.
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    // Bytes before the ring; a page multiple.
+    uint32_t headerSize;
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t bitsPerSample;
+    // SampleFormat of the interleaved frames in the ring.
+    uint32_t sampleFormat;
+    // Ring bytes; a multiple of both the page and the frame size.
+    uint64_t capacity;
+    int32_t writerPid;
+
+    // Writer line. |reserved| moves on before the writer copies into the
+    // ring and |written| once the copy is complete, so a reader can tell
+    // whether bytes it read in place were overwritten meanwhile.
+    alignas(64) std::atomic<uint64_t> reserved;
+    std::atomic<uint64_t> written;
+    std::atomic<uint32_t> state;
+
+    // Futex word, bumped on every publish; readers sleep on it, and the
+    // writer only makes the wake syscall while |waiters| is nonzero.
+    alignas(64) std::atomic<uint32_t> wakeSequence;
+    std::atomic<uint32_t> waiters;
+
+    // Seqlock: the timestamp of the newest timed block and the stream
+    // position of its first byte.
+    alignas(64) std::atomic<uint32_t> timeSequence;
+    std::atomic<uint64_t> timeOffset;
+    std::atomic<uint64_t> timePosition;
+    std::atomic<int64_t> timeHostNs;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "shared stream counters must be lock-free to work across processes");
+
+// "mic" -> "/mic": shm_open() names start with a single slash.
+std::string sharedStreamObjectName(const std::string& name);
+
+// Maps |capacity| bytes of |fd| at |offset| twice, back to back; nullptr on
+// failure. Release with sharedStreamUnmapRing().
+uint8_t* sharedStreamMapRing(int fd, uint64_t offset, uint64_t capacity, bool writable);
+void sharedStreamUnmapRing(uint8_t* ring, uint64_t capacity);
+
+// Futex on a word in the shared mapping. Sleeps while |*word| still equals
+// |expected|, up to |timeoutMs| (negative: forever); returns early on a
+// wake or a changed word.
+void sharedStreamWait(std::atomic<uint32_t>* word, uint32_t expected, int timeoutMs);
+void sharedStreamWakeAll(std::atomic<uint32_t>* word);
+
+// Seqlock read of the newest timestamp; false before the first timed block.
+bool sharedStreamLoadTime(const SharedStreamHeader& header, uint64_t& offset, BlockTimestamp& time);
+
+#endif // PLATFORM_LINUX
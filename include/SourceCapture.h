@@ -0,0 +1,21 @@
+#pragma once
+
+#include "AudioCapture.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <memory>
+#include <string>
+
+// Records any CaptureSource (synthetic generator, file replay, ...) through
+// the regular capture-to-disk path.
+class SourceCapture : public AudioCapture {
+public:
+    SourceCapture(const std::string& outputFile, std::unique_ptr<CaptureSource> source);
+    ~SourceCapture() override = default;
+
+    bool start() override;
+    void stop() override;
+};
+
+#endif
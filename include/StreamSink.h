@@ -0,0 +1,150 @@
+#pragma once
+
+#ifdef PLATFORM_LINUX
+
+#include "AudioSink.h"
+#include "SampleFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class StreamFraming {
+    // Interleaved samples in the capture format, nothing else.
+    Raw,
+    // A WAV header with open-ended sizes (0xFFFFFFFF) at the start of every
+    // connection, then the samples, as sox and ffmpeg read from a pipe.
+    Wav,
+};
+
+enum class StreamOverflowPolicy {
+    // Wait for the reader. Stalls the writer thread, and with it the file
+    // behind this sink, until the reader catches up; capture itself only
+    // stalls once the DiskWriter's pool runs out.
+    Block,
+    // Discard the oldest queued audio to make room: the reader stays close
+    // to live.
+    DropOldest,
+    // Discard audio that does not fit: the reader gets an unbroken stream
+    // up to the gap.
+    DropNewest,
+};
+
+struct StreamSinkOptions {
+    StreamFraming framing = StreamFraming::Raw;
+    StreamOverflowPolicy policy = StreamOverflowPolicy::DropOldest;
+    // Audio queued while the reader is slow.
+    size_t queueBytes = 1 << 20;
+    // Queued audio goes out in one writev() once there is this much of it,
+    // or once the oldest byte has waited maxDelayMs.
+    size_t batchBytes = 64 << 10;
+    uint32_t maxDelayMs = 20;
+    // How often to look for a new reader while there is none.
+    uint32_t reconnectIntervalMs = 200;
+};
+
+// Streams audio to a reader outside the process, then passes it on to
+// |inner|, if any, e.g. the WAV/FLAC sink. |target| is "-" for stdout,
+// "unix:PATH" for a Unix domain socket the sink listens on, or the path of
+// a FIFO, created if missing. Everything happens on the writing thread
+// with non-blocking I/O, and packets are batched so a stream costs a few
+// syscalls per second. Only whole frames are sent or dropped. Audio
+// arriving while no reader is connected is discarded; a new reader
+// (another connection, or the FIFO reopened) picks up at the next frame,
+// after a fresh header with WAV framing. stdout cannot reconnect.
+class StreamSink : public AudioSink {
+public:
+    StreamSink(const std::string& target, uint32_t sampleRate, uint16_t channels, SampleFormat format,
+               const StreamSinkOptions& options = StreamSinkOptions(), std::unique_ptr<AudioSink> inner = nullptr);
+    ~StreamSink() override;
+
+    // Creates the socket or FIFO, then initializes |inner|.
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    // The timestamp is passed on to |inner|, which may align or drift
+    // correct with it.
+    void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) override;
+    void writeSilence(uint32_t size, const BlockTimestamp& time) override;
+    // Sends whatever is queued without waiting, then flushes |inner|.
+    bool flush() override;
+    // Sends what is queued, waiting up to a second for the reader, and
+    // closes the stream.
+    bool finalize() override;
+
+    bool connected() const { return m_fd >= 0; }
+    // Audio bytes the reader was sent.
+    uint64_t sentBytes() const { return m_sentBytes; }
+    // Audio bytes the overflow policy discarded.
+    uint64_t droppedBytes() const { return m_droppedBytes; }
+    // Audio bytes that arrived while no reader was connected.
+    uint64_t unsentBytes() const { return m_unsentBytes; }
+    uint64_t connections() const { return m_connections; }
+    // writev()/sendmsg() calls.
+    uint64_t sendCalls() const { return m_sendCalls; }
+
+private:
+    enum class Kind {
+        Stdout,
+        Fifo,
+        Socket,
+    };
+
+    // Splits |size| bytes (zeros for null |data|) into whole frames.
+    void append(const uint8_t* data, size_t size);
+    // Queues whole frames under the overflow policy.
+    void enqueue(const uint8_t* data, size_t size);
+    void copyIn(const uint8_t* data, size_t size);
+    void dropOldest(size_t size);
+    // Looks for a reader, at most every reconnectIntervalMs.
+    bool connect();
+    void disconnect(const char* reason);
+    // One writev() of the header remainder and the queue; false once the
+    // reader is gone.
+    bool sendQueued();
+    // Waits up to |timeoutMs| for the reader to take more.
+    bool waitWritable(int timeoutMs);
+    void buildHeader();
+
+    std::string m_target;
+    Kind m_kind;
+    std::string m_path;
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    SampleFormat m_format;
+    uint16_t m_frameBytes;
+    StreamSinkOptions m_options;
+    std::unique_ptr<AudioSink> m_inner;
+
+    int m_listenFd = -1;
+    int m_fd = -1;
+    bool m_closed = false;
+    int64_t m_nextConnectNs = 0;
+    // Bytes of a frame split across write() calls; the policy only ever
+    // sees whole frames.
+    std::vector<uint8_t> m_partial;
+
+    // Header bytes still to send on this connection.
+    std::vector<uint8_t> m_header;
+    size_t m_headerSent = 0;
+    // Byte ring of queued frames.
+    std::vector<uint8_t> m_queue;
+    size_t m_queueHead = 0;
+    size_t m_queued = 0;
+    // Bytes queued since the last send, and since when they have waited.
+    // A reader that cannot keep up is retried once per batch, not once
+    // per write().
+    size_t m_unbatched = 0;
+    int64_t m_waitingSinceNs = 0;
+    // Audio bytes sent on this connection; a frame the reader got part of
+    // is always finished.
+    uint64_t m_connectionBytes = 0;
+
+    uint64_t m_sentBytes = 0;
+    uint64_t m_droppedBytes = 0;
+    uint64_t m_unsentBytes = 0;
+    uint64_t m_connections = 0;
+    uint64_t m_sendCalls = 0;
+};
+
+#endif // PLATFORM_LINUX
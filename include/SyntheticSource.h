@@ -0,0 +1,70 @@
+#pragma once
+
+#include "CaptureSource.h"
+#include "PacketTimer.h"
+#include "SampleConverter.h"
+#include <memory>
+#include <vector>
+
+struct SyntheticSourceConfig {
+    enum class Signal { Sine, Noise, Silence };
+
+    Signal signal = Signal::Sine;
+    StreamFormat format;
+    uint32_t framesPerPacket = 480;
+    double frequency = 440.0;
+    double amplitude = 0.5;
+    uint32_t seed = 1;
+    // Deliver packets at the rate a real device would; otherwise as fast as
+    // the consumer reads them.
+    bool realTime = true;
+    // 0 runs forever.
+    uint64_t totalFrames = 0;
+    // When both are set the signal is gated: activePackets of it, then
+    // silentPackets of zeros flagged silent, as from a render stream that
+    // keeps going idle. Signal::Silence is always flagged.
+    uint32_t activePackets = 0;
+    uint32_t silentPackets = 0;
+    // Device clock error against the host clock. Paced sources deliver at
+    // the skewed rate; unpaced ones stamp packets from a virtual host clock
+    // that starts at open(), so hours of drift can be replayed in seconds.
+    double clockSkewPpm = 0.0;
+};
+
+// Deterministic signal generator: the same config always yields the same
+// bytes, so runs can be compared.
+class SyntheticSource : public CaptureSource {
+public:
+    explicit SyntheticSource(const SyntheticSourceConfig& config = SyntheticSourceConfig());
+
+    bool open() override;
+    void close() override;
+    StreamFormat format() const override { return m_config.format; }
+    size_t maxPacketBytes() const override;
+    bool waitReady(int timeoutMs) override;
+#ifdef PLATFORM_LINUX
+    int readyFd() const override { return m_config.realTime ? m_timer.fd() : -1; }
+#endif
+    size_t read(uint8_t* buffer, size_t capacity) override;
+    BlockTimestamp lastTimestamp() const override { return m_lastTimestamp; }
+    bool lastReadSilent() const override { return m_lastSilent; }
+
+    uint64_t framesGenerated() const { return m_framesGenerated; }
+    // When frame |frame| was "recorded" (real-time mode only).
+    PacketTimer::Clock::time_point frameTime(uint64_t frame) const { return m_timer.frameTime(frame); }
+    const PacketTimer& timer() const { return m_timer; }
+
+private:
+    void generate(float* samples, uint32_t frames);
+
+    SyntheticSourceConfig m_config;
+    std::unique_ptr<SampleConverter> m_converter;
+    std::vector<float> m_samples;
+    double m_phase;
+    uint32_t m_noiseState;
+    uint64_t m_framesGenerated;
+    PacketTimer m_timer;
+    int64_t m_openTimeNs;
+    BlockTimestamp m_lastTimestamp;
+    bool m_lastSilent;
+};
@@ -9,4 +9,7 @@ public:
     static bool createDirectory(const std::string& path);
     static std::string getLastErrorString();
     static void sleep(uint32_t milliseconds);
+    // Forces a closed file's data and metadata to stable storage (fsync,
+    // plus its directory entry on POSIX; FlushFileBuffers on Windows).
+    static bool syncFile(const std::string& path);
 };
\ No newline at end of file
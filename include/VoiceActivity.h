@@ -0,0 +1,161 @@
+#pragma once
+
+#include "LevelMeter.h"
+#include "RingBuffer.h"
+#include "SampleBlock.h"
+#include "SampleFormat.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class StreamMetrics;
+
+struct VoiceActivityConfig {
+    // Levels and decisions are made per analysis frame.
+    uint32_t frameMs = 20;
+    // A frame is speech-like when its level is this far above the tracked
+    // noise floor and above |minLevelDb| (dBFS)...
+    float thresholdDb = 9.0f;
+    float minLevelDb = -55.0f;
+    // ...and its spectrum looks voiced: enough of the energy in the speech
+    // band (80-4000 Hz) and a peaky, not flat, spectrum there.
+    float minSpeechBandRatio = 0.5f;
+    float maxFlatness = 0.3f;
+    // Speech starts after |onsetMs| of consecutive speech-like frames, at
+    // the first of them, and ends once |hangoverMs| pass without one.
+    uint32_t onsetMs = 60;
+    uint32_t hangoverMs = 300;
+    // The noise floor follows quieter frames at once and rises at most this
+    // fast (a tenth of it during speech-like frames).
+    float noiseRiseDbPerSecond = 3.0f;
+    // VoiceActivitySink only: hand non-speech to the sink as silence, which
+    // a WavWriter stores as a hole and a FlacWriter as constant subframes,
+    // keeping |prerollMs| before each start. Delays the stream by the
+    // decision latency plus the preroll.
+    bool gate = false;
+    uint32_t prerollMs = 200;
+    // Events queued for pollEvent(); more are dropped and counted. Fixed
+    // when the detector is constructed.
+    size_t eventCapacity = 256;
+};
+
+struct VoiceEvent {
+    enum class Type {
+        SpeechStart,
+        SpeechEnd,
+    };
+    Type type = Type::SpeechStart;
+    // Stream position in sample frames from the first frame analyzed. An
+    // end is exclusive and includes the hangover.
+    uint64_t frame = 0;
+};
+
+// Features of the latest analysis frame.
+struct LevelSnapshot {
+    // Stream position just past the frame.
+    uint64_t frame = 0;
+    float rmsDb = -120.0f;
+    float peakDb = -120.0f;
+    // Sign changes per second, averaged over channels.
+    float zeroCrossingRate = 0.0f;
+    float noiseFloorDb = -120.0f;
+    float speechBandRatio = 0.0f;
+    float flatness = 1.0f;
+    bool speech = false;
+};
+
+// Energy/spectral voice-activity detector with hangover. process() runs on
+// a single thread (the stream's DiskWriter); levels() is published through
+// a seqlock and events through a lock-free queue, so any one other thread
+// can watch without ever blocking the writer.
+class VoiceActivityDetector {
+public:
+    explicit VoiceActivityDetector(const VoiceActivityConfig& config = VoiceActivityConfig());
+
+    const VoiceActivityConfig& config() const { return m_config; }
+    // Set before reset().
+    void setConfig(const VoiceActivityConfig& config) { m_config = config; }
+    // Optional, set before the stream starts: levels and speech totals go
+    // to the stream's metrics too.
+    void setMetrics(StreamMetrics* metrics) { m_metrics = metrics; }
+    // Starts over on a new stream. Call before the stream starts.
+    void reset(uint32_t sampleRate, uint16_t channels, SampleFormat format);
+
+    // Writer thread. Analyzes |size| bytes of interleaved samples, which may
+    // split frames; events decided on the way are also appended to
+    // |events| when given.
+    void process(const uint8_t* data, size_t size, std::vector<VoiceEvent>* events = nullptr);
+    // |size| bytes of digital silence.
+    void processSilence(size_t size, std::vector<VoiceEvent>* events = nullptr);
+    bool speech() const { return m_speech; }
+    // Frames analyzed so far.
+    uint64_t position() const { return m_position; }
+    // How far a decision lags the audio it is about, in frames: a start is
+    // reported once the onset is complete.
+    uint32_t decisionDelayFrames() const;
+    uint32_t sampleRate() const { return m_sampleRate; }
+    uint16_t frameBytes() const { return m_frameBytes; }
+
+    // Any thread.
+    LevelSnapshot levels() const;
+    uint64_t speechFrames() const { return m_speechFrames.load(std::memory_order_relaxed); }
+    uint64_t speechSegments() const { return m_segments.load(std::memory_order_relaxed); }
+    uint64_t droppedEvents() const { return m_droppedEvents.load(std::memory_order_relaxed); }
+    // One consumer thread.
+    bool pollEvent(VoiceEvent& event) { return m_events.pop(event); }
+
+private:
+    void analyzeFrames(const uint8_t* data, size_t frames, std::vector<VoiceEvent>* events);
+    void finishFrame(std::vector<VoiceEvent>* events);
+    void spectrum(float& speechBandRatio, float& flatness);
+    void emit(VoiceEvent::Type type, uint64_t frame, std::vector<VoiceEvent>* events);
+    void publish(const LevelSnapshot& snapshot);
+
+    VoiceActivityConfig m_config;
+    StreamMetrics* m_metrics = nullptr;
+    uint32_t m_sampleRate = 0;
+    uint16_t m_channels = 0;
+    SampleFormat m_format = SampleFormat::Int16;
+    uint16_t m_frameBytes = 0;
+    std::unique_ptr<LevelMeter> m_meter;
+    // Mono mix for the spectrum, for this stream's format and channels.
+    BlockKernels::Kernel m_downmix = nullptr;
+
+    // Writer-only analysis state.
+    uint32_t m_framesPerAnalysis = 0;
+    uint32_t m_filled = 0;
+    LevelSums m_sums;
+    // Mono mix of the analysis frame, zero-padded FFT buffers and window.
+    std::vector<float> m_mono;
+    std::vector<float> m_window;
+    std::vector<float> m_real;
+    std::vector<float> m_imag;
+    // cos/sin pairs for the FFT.
+    std::vector<float> m_twiddles;
+    std::vector<uint8_t> m_frameCarry;
+    uint64_t m_position = 0;
+    bool m_haveFloor = false;
+    float m_noiseFloorDb = -120.0f;
+    bool m_speech = false;
+    uint32_t m_run = 0;
+    uint64_t m_runStart = 0;
+    uint32_t m_quiet = 0;
+    uint32_t m_onsetFrames = 1;
+    uint32_t m_hangoverFrames = 1;
+
+    // Published.
+    std::atomic<uint32_t> m_sequence{0};
+    std::atomic<uint64_t> m_snapFrame{0};
+    std::atomic<float> m_snapRmsDb{-120.0f};
+    std::atomic<float> m_snapPeakDb{-120.0f};
+    std::atomic<float> m_snapZeroCrossingRate{0.0f};
+    std::atomic<float> m_snapNoiseFloorDb{-120.0f};
+    std::atomic<float> m_snapSpeechBandRatio{0.0f};
+    std::atomic<float> m_snapFlatness{1.0f};
+    std::atomic<bool> m_snapSpeech{false};
+    std::atomic<uint64_t> m_speechFrames{0};
+    std::atomic<uint64_t> m_segments{0};
+    std::atomic<uint64_t> m_droppedEvents{0};
+    SpscQueue<VoiceEvent> m_events;
+};
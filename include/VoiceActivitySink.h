@@ -0,0 +1,64 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "VoiceActivity.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Runs a VoiceActivityDetector over everything on its way to another sink.
+// Without the gate the audio passes straight through. With it, audio is
+// held back for the detector's decision delay plus the preroll, and what
+// falls outside speech (and its preroll) goes to the sink as silence, so
+// the file keeps its timeline but stores pauses as holes.
+class VoiceActivitySink : public AudioSink {
+public:
+    // |detector| is not owned and must already be reset() for the stream.
+    VoiceActivitySink(std::unique_ptr<AudioSink> inner, VoiceActivityDetector* detector);
+
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) override;
+    void writeSilence(uint32_t size, const BlockTimestamp& time) override;
+    bool flush() override;
+    bool finalize() override;
+
+    // Bytes handed on as silence instead of audio by the gate.
+    uint64_t gatedBytes() const { return m_gatedBytes; }
+
+private:
+    struct Region {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Gate only.
+    void append(const uint8_t* data, uint32_t size, const BlockTimestamp* time);
+    void track(const std::vector<VoiceEvent>& events);
+    // Hands on held bytes before stream offset |limit|; UINT64_MAX for
+    // all of them.
+    void release(uint64_t limit);
+    // Whether the byte at |offset| is kept, and up to where that holds.
+    bool kept(uint64_t offset, uint64_t& until) const;
+
+    std::unique_ptr<AudioSink> m_inner;
+    VoiceActivityDetector* m_detector;
+    bool m_gate;
+    uint16_t m_frameBytes;
+    uint64_t m_holdFrames;
+    uint64_t m_prerollFrames;
+
+    // Held bytes from m_heldStart on; the first is at stream byte offset
+    // m_heldOffset.
+    std::vector<uint8_t> m_held;
+    size_t m_heldStart = 0;
+    uint64_t m_heldOffset = 0;
+    // Timestamps of held packets, by stream byte offset.
+    std::deque<std::pair<uint64_t, BlockTimestamp>> m_marks;
+    // Speech plus preroll, in stream byte offsets; the last may be open.
+    std::deque<Region> m_regions;
+    std::vector<VoiceEvent> m_events;
+    uint64_t m_gatedBytes = 0;
+};
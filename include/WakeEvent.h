@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+// Auto-reset wakeup flag a consumer thread can sleep on. signal() never
+// blocks and is safe to call from a capture callback; several signals before
+// a wait() collapse into one wakeup. Backed by an eventfd on Linux and an
+// event object on Windows.
+class WakeEvent {
+public:
+    WakeEvent();
+    ~WakeEvent();
+
+    WakeEvent(const WakeEvent&) = delete;
+    WakeEvent& operator=(const WakeEvent&) = delete;
+
+    void signal();
+    // Returns true if signaled, false on timeout. A negative timeout waits
+    // forever.
+    bool wait(int timeoutMs);
+
+#ifdef PLATFORM_LINUX
+    // Readable while signaled, for use with poll/epoll.
+    int fd() const { return m_fd; }
+#endif
+
+private:
+#ifdef PLATFORM_LINUX
+    int m_fd;
+#else
+    void* m_handle;
+#endif
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "SampleConverter.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sample encodings a WAV file can carry besides plain PCM. The compressed
+// ones all take 16-bit samples.
+enum class WavEncoding {
+    Pcm,
+    // G.711 mu-law (WAVE_FORMAT_MULAW), 8 bits per sample.
+    MuLaw,
+    // G.711 A-law (WAVE_FORMAT_ALAW), 8 bits per sample.
+    ALaw,
+    // IMA/DVI ADPCM (WAVE_FORMAT_IMA_ADPCM), 4 bits per sample in blocks
+    // that each restart the predictor.
+    ImaAdpcm,
+};
+
+// WAVE format tag for |encoding|.
+uint16_t waveFormatTag(WavEncoding encoding);
+// Encoding for a WAVE format tag; false when it is none of the above.
+bool encodingForTag(uint16_t tag, WavEncoding& encoding);
+const char* encodingName(WavEncoding encoding);
+
+// G.711 companding of little-endian 16-bit samples. Encoding runs on a
+// kernel picked from the best instruction set the CPU supports; the scalar
+// kernel, a 64 KiB lookup table, is the reference the vector kernels match
+// bit for bit. Decoding is a 256-entry table.
+class G711Codec {
+public:
+    using Kernel = void (*)(const uint8_t* src, size_t samples, uint8_t* dst);
+
+    // |law| is MuLaw or ALaw.
+    explicit G711Codec(WavEncoding law, SimdLevel level = SampleConverter::detectSimdLevel());
+
+    // |src| need not be aligned.
+    void encode(const uint8_t* src, size_t samples, uint8_t* dst) const { m_kernel(src, samples, dst); }
+    void decode(const uint8_t* src, size_t samples, int16_t* dst) const;
+
+    WavEncoding law() const { return m_law; }
+    SimdLevel simdLevel() const { return m_level; }
+
+    // Reference single-sample conversions the tables are built from.
+    static uint8_t encodeMuLaw(int16_t sample);
+    static uint8_t encodeALaw(int16_t sample);
+    static int16_t decodeMuLaw(uint8_t code);
+    static int16_t decodeALaw(uint8_t code);
+
+private:
+    WavEncoding m_law;
+    SimdLevel m_level;
+    Kernel m_kernel;
+    const int16_t* m_decodeTable;
+};
+
+// IMA ADPCM block layout as written by Windows: per channel a 4-byte header
+// holding the first sample and the step index, then groups of 4 bytes
+// (8 samples) per channel, low nibble first.
+struct ImaAdpcmState {
+    int32_t predictor = 0;
+    int32_t index = 0;
+};
+
+// The usual block size: 256 bytes per channel, doubled with every doubling
+// of the rate above 11025 Hz.
+uint16_t imaAdpcmBlockAlign(uint32_t sampleRate, uint16_t channels);
+uint32_t imaAdpcmFramesPerBlock(uint16_t blockAlign, uint16_t channels);
+// Encodes one full block of interleaved frames; |states| holds one entry per
+// channel and carries the step index from block to block.
+void encodeImaAdpcmBlock(const int16_t* frames, uint16_t channels, uint32_t framesPerBlock, ImaAdpcmState* states,
+                         uint8_t* block);
+// Decodes a block of |size| bytes (the last block of a file may be short);
+// returns the number of frames written to |frames|, 0 if malformed.
+uint32_t decodeImaAdpcmBlock(const uint8_t* block, size_t size, uint16_t channels, int16_t* frames);
+
+// Streams little-endian 16-bit PCM, in arbitrary byte ranges, into one of
+// the compressed encodings.
+class WavEncoder {
+public:
+    WavEncoder(WavEncoding encoding, uint32_t sampleRate, uint16_t channels);
+
+    WavEncoding encoding() const { return m_encoding; }
+    uint16_t formatTag() const { return waveFormatTag(m_encoding); }
+    uint16_t bitsPerSample() const { return m_encoding == WavEncoding::ImaAdpcm ? 4 : 8; }
+    uint16_t blockAlign() const { return m_blockAlign; }
+    uint32_t framesPerBlock() const { return m_framesPerBlock; }
+    uint32_t byteRate() const;
+    // Upper bound on encode() output for |size| input bytes.
+    size_t maxOutputBytes(size_t size) const;
+    // Frames taken in so far, whole ones only.
+    uint64_t frames() const { return m_frames; }
+
+    // Returns the number of bytes written to |out|. Partial samples and,
+    // for ADPCM, partial blocks are held back for the next call.
+    size_t encode(const uint8_t* data, size_t size, uint8_t* out);
+    // Pads a held-back partial block with silence and encodes it; the
+    // padding is not counted in frames().
+    size_t finish(uint8_t* out);
+    void reset();
+
+private:
+    WavEncoding m_encoding;
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    uint16_t m_blockAlign;
+    uint32_t m_framesPerBlock;
+    G711Codec m_g711;
+    std::vector<ImaAdpcmState> m_states;
+    // Input bytes not yet encoded: one byte of a split sample for G.711, the
+    // block being filled for ADPCM.
+    std::vector<uint8_t> m_pending;
+    std::vector<int16_t> m_block;
+    size_t m_inputBytes;
+    uint64_t m_frames;
+
+    size_t encodeBlock(const uint8_t* pcm, uint8_t* out);
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "SampleFormat.h"
+#include "WavCodec.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reads the sample data of RIFF/WAVE, RF64 and Wave64 files with integer PCM
+// or IEEE float samples. G.711 and IMA ADPCM files are decoded to 16-bit
+// PCM on the fly; the accessors below then describe the decoded stream.
+class WavReader {
+public:
+    explicit WavReader(const std::string& filename);
+    ~WavReader();
+
+    bool open();
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    uint32_t sampleRate() const { return m_sampleRate; }
+    uint16_t channels() const { return m_channels; }
+    // Speaker positions from WAVE_FORMAT_EXTENSIBLE; 0 for other files.
+    uint32_t channelMask() const { return m_channelMask; }
+    SampleFormat sampleFormat() const { return m_sampleFormat; }
+    uint16_t blockAlign() const { return m_blockAlign; }
+    WavEncoding encoding() const { return m_encoding; }
+    uint64_t dataSize() const { return m_dataSize; }
+    uint64_t frames() const { return m_blockAlign ? m_dataSize / m_blockAlign : 0; }
+
+    // Reads up to |size| bytes of sample data; returns the number read.
+    // Decoded streams are read in whole samples.
+    size_t read(uint8_t* data, size_t size);
+    // Seeks back to the first sample.
+    bool rewind();
+
+private:
+    bool parseRiff(bool rf64);
+    bool parseWave64();
+    bool parseFmt(const uint8_t* fmt, size_t size);
+    void setData(uint64_t offset, uint64_t size, uint64_t factFrames);
+    size_t readDecoded(uint8_t* data, size_t size);
+
+    std::string m_filename;
+    FILE* m_file;
+    uint32_t m_sampleRate;
+    uint16_t m_channels;
+    uint32_t m_channelMask;
+    uint16_t m_blockAlign;
+    SampleFormat m_sampleFormat;
+    uint64_t m_dataOffset;
+    uint64_t m_dataSize;
+    uint64_t m_position;
+    // Compressed files: the encoding, the size of the data chunk and how
+    // much of it has been read, and for ADPCM the decoded block being
+    // served.
+    WavEncoding m_encoding;
+    uint16_t m_encodedBlockAlign;
+    uint32_t m_framesPerBlock;
+    uint64_t m_encodedSize;
+    uint64_t m_encodedPosition;
+    std::unique_ptr<G711Codec> m_g711;
+    std::vector<uint8_t> m_encoded;
+    std::vector<int16_t> m_decoded;
+    size_t m_decodedSize;
+    size_t m_decodedPosition;
+};
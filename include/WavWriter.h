@@ -2,40 +2,197 @@
 
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "AudioSink.h"
+#include "SampleFormat.h"
+#include "WavCodec.h"
 
-class WavWriter {
+class ClockTracker;
+class OutputFile;
+class Resampler;
+class SampleConverter;
+
+enum class WavWriteMode {
+    // One buffered fwrite per packet.
+    Stdio,
+    // Packets are gathered into large aligned blocks and written
+    // asynchronously (io_uring or a pwritev thread). Linux only; other
+    // platforms fall back to Stdio.
+    Batched,
+    // Space is preallocated in large extents and packets are copied into a
+    // sliding shared mapping of the file. Linux only; other platforms fall
+    // back to Stdio.
+    Mapped,
+};
+
+enum class WavContainer {
+    // RIFF/WAVE with a JUNK chunk reserved after the RIFF header. Files that
+    // outgrow the 32-bit size fields are promoted to RF64 at finalize by
+    // turning the JUNK chunk into a ds64 chunk; the payload is never moved.
+    Rf64Auto,
+    // Sony Wave64: GUID chunk ids with 64-bit sizes throughout.
+    Wave64,
+};
+
+struct WavWriterOptions {
+    WavContainer container = WavContainer::Rf64Auto;
+    // Rf64Auto: RIFF size above which finalize() promotes the file to RF64.
+    // The format's limit; lowered only to exercise the promotion in tests.
+    uint64_t rf64Threshold = 0xFFFFFFFF;
+    WavWriteMode mode = WavWriteMode::Stdio;
+
+    // Format stored on disk. Defaults to the input format; Float32 input may
+    // be converted to Int16/Int24/Int32 here, optionally with TPDF dither.
+    std::optional<SampleFormat> outputFormat;
+    bool dither = false;
+    // Compressed encodings store 16-bit samples as G.711 (8 bits) or IMA
+    // ADPCM (4 bits) with a fact chunk holding the frame count. Float input
+    // and resampled output are quantized to 16 bits first; other integer
+    // input is written as PCM.
+    WavEncoding encoding = WavEncoding::Pcm;
+    // Rate written to disk; 0 keeps the input rate. A different rate, or
+    // mono, runs every format through a polyphase Resampler on the writing
+    // thread.
+    uint32_t sampleRate = 0;
+    // Average all input channels into one.
+    bool mono = false;
+    // Drift correction: |clock| tracks this stream's device clock (its
+    // DiskWriter feeds it), and the output length is steered to follow
+    // |referenceClock| instead, or the host clock when that is nullptr. Runs
+    // the Resampler in variable-rate mode even at the input rate.
+    const ClockTracker* clock = nullptr;
+    const ClockTracker* referenceClock = nullptr;
+    // Speaker positions for WAVE_FORMAT_EXTENSIBLE; 0 picks the default
+    // layout for the channel count.
+    uint32_t channelMask = 0;
+    // Disk space for this much audio is reserved when the file is created,
+    // so a file of known length, e.g. a segment, neither fragments nor runs
+    // out of space halfway; the unused part is released at finalize.
+    double reserveSeconds = 0.0;
+    size_t blockSize = 1 << 20;
+    unsigned maxBlocksInFlight = 4;
+    bool directIo = false;
+
+    // Mapped mode
+    uint64_t preallocateSize = 64ull << 20;
+    size_t mapWindowSize = 16 << 20;
+};
+
+class WavWriter : public AudioSink {
 public:
-    WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample);
-    ~WavWriter();
+    // Integer PCM input of the given bit depth.
+    WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample,
+              const WavWriterOptions& options = WavWriterOptions());
+    WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, SampleFormat inputFormat,
+              const WavWriterOptions& options = WavWriterOptions());
+    ~WavWriter() override;
 
-    bool initialize();
-    void write(const uint8_t* data, uint32_t size);
-    void finalize();
+    bool initialize() override;
+    void write(const uint8_t* data, uint32_t size) override;
+    // Steers the drift correction from |time|, then writes.
+    void writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) override;
+    // Without resampling, consecutive silent packets are gathered into one
+    // zero run in the output file, left as a hole when long enough; the
+    // resampler and compressed encodings are fed zeros.
+    void writeSilence(uint32_t size, const BlockTimestamp& time) override;
+    // Blocks until all data written so far has reached the file.
+    bool flush() override;
+    // Completes outstanding writes, fixes up the header and closes the file.
+    bool finalize() override;
     bool isOpen() const;
 
+    // Bytes of sample data in the file, after any encoding.
+    uint64_t bytesWritten() const { return m_bytesWritten; }
+    // Sample frames in the file.
+    uint64_t framesWritten() const;
+    // Output bytes written as zero runs by writeSilence().
+    uint64_t silenceBytes() const { return m_silenceBytes; }
+    // True once the file has been finalized as RF64.
+    bool isRf64() const { return m_isRf64; }
+    // Drift correction: output frames ahead (+) or behind (-) the reference
+    // clock as of the last timed write. Writing thread only.
+    double driftError() const { return m_driftError; }
+
 private:
-    struct WavHeader {
-        char riff[4];
-        uint32_t fileSize;
-        char wave[4];
-        char fmt[4];
-        uint32_t fmtChunkSize;
+    struct Format {
         uint16_t audioFormat;
         uint16_t channels;
         uint32_t sampleRate;
         uint32_t byteRate;
         uint16_t blockAlign;
         uint16_t bitsPerSample;
-        char data[4];
-        uint32_t dataSize;
+        uint32_t channelMask;
+        bool extensible;
     };
 
     std::string m_filename;
-    WavHeader m_header;
-    FILE* m_file;
-    uint32_t m_bytesWritten;
+    WavWriterOptions m_options;
+    SampleFormat m_inputFormat;
+    SampleFormat m_outputFormat;
+    Format m_format;
+    std::unique_ptr<SampleConverter> m_converter;
+    std::unique_ptr<Resampler> m_resampler;
+    std::unique_ptr<WavEncoder> m_encoder;
+    std::vector<uint8_t> m_encoded;
+    // Resampling path: input decoded to float and the resampler's output,
+    // sized once for RESAMPLE_CHUNK_FRAMES input frames.
+    std::vector<float> m_floatInput;
+    std::vector<float> m_resampled;
+    uint16_t m_inputFrameBytes;
+    // Bytes of an input frame split across write() calls.
+    std::vector<uint8_t> m_frameCarry;
+    std::vector<uint8_t> m_scratch;
+    std::vector<float> m_alignedInput;
+    // Bytes of a float sample split across write() calls.
+    uint8_t m_carry[4];
+    size_t m_carrySize;
+    // Serialized header; its size is fixed once the file is opened so the
+    // data offset never changes.
+    std::vector<uint8_t> m_header;
+    std::unique_ptr<OutputFile> m_output;
+    uint64_t m_bytesWritten;
+    uint64_t m_silenceBytes;
+    // Output bytes of silence not yet appended to the file.
+    uint64_t m_pendingSilence;
     bool m_isOpen;
+    bool m_isRf64;
+    // Drift correction: device position of input frame 0 (its offset moves
+    // when the device skips frames), and the input frames skipped.
+    bool m_timed;
+    uint64_t m_startPosition;
+    int64_t m_positionOffset;
+    int64_t m_gapFrames;
+    // Reference time, in seconds, of input frame 0. Re-estimated until the
+    // clock fit has seen a full window past the start, then fixed: later
+    // fits would have to extrapolate back to it.
+    bool m_anchored;
+    double m_referenceStart;
+    double m_driftError;
+
+    static constexpr size_t RESAMPLE_CHUNK_FRAMES = 4096;
+    // Seconds over which a drift error is steered out.
+    static constexpr double DRIFT_CORRECTION_SECONDS = 2.0;
+    // Largest rate adjustment drift correction applies.
+    static constexpr double MAX_DRIFT_ADJUST = 0.002;
 
+    void setupFormat(uint32_t sampleRate, uint16_t channels);
+    void setupResampler(uint32_t sampleRate, uint16_t channels);
+    void writeResampled(const uint8_t* data, uint32_t size);
+    void resampleFrames(const uint8_t* data, size_t frames);
+    void appendFloat(const float* samples, size_t count);
+    // Appends output-format samples, through the encoder if there is one.
+    void appendPcm(const uint8_t* data, size_t size);
+    void steerDrift(const BlockTimestamp& time);
+    void flushSilence();
+    bool needsFactChunk() const;
+    // Zeros finalize() appends after the data: RIFF chunks are padded to an
+    // even length, Wave64 chunks to a multiple of 8.
+    uint64_t dataPadding() const;
+    void buildFmtPayload(std::vector<uint8_t>& payload) const;
+    void buildRiffHeader(bool rf64);
+    void buildWave64Header();
     void writeHeader();
     void updateHeader();
-};
\ No newline at end of file
+};
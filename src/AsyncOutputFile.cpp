@@ -0,0 +1,504 @@
+#include "AsyncOutputFile.h"
+#include "Logger.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Minimal io_uring wrapper on the raw syscalls so the build does not depend
+// on liburing. Only what the writer needs: WRITEV submissions and blocking
+// completion reaping.
+struct AsyncOutputFile::IoUring {
+  int fd = -1;
+  void *sqRing = MAP_FAILED;
+  void *cqRing = MAP_FAILED;
+  size_t sqRingSize = 0;
+  size_t cqRingSize = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  size_t sqesSize = 0;
+
+  unsigned *sqTail = nullptr;
+  unsigned *sqMask = nullptr;
+  unsigned *sqArray = nullptr;
+  unsigned *cqHead = nullptr;
+  unsigned *cqTail = nullptr;
+  unsigned *cqMask = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  bool setup(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+      return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+      return false;
+
+    cqRing = singleMmap ? sqRing
+                        : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+      return false;
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize,
+                                            PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, fd,
+                                            IORING_OFF_SQES));
+    if (sqes == MAP_FAILED)
+      return false;
+
+    uint8_t *sq = static_cast<uint8_t *>(sqRing);
+    uint8_t *cq = static_cast<uint8_t *>(cqRing);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void teardown() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+      munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED)
+      munmap(sqRing, sqRingSize);
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  bool submitWritev(int fileFd, const iovec *iov, uint64_t offset,
+                    uint64_t userData) {
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fileFd;
+    sqe->addr = reinterpret_cast<uint64_t>(iov);
+    sqe->len = 1;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+      ret = static_cast<int>(
+          syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0));
+    } while (ret < 0 && errno == EINTR);
+    return ret == 1;
+  }
+
+  bool waitCompletion(uint64_t *userData, int *result) {
+    for (;;) {
+      unsigned head = *cqHead;
+      if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        const io_uring_cqe &cqe = cqes[head & *cqMask];
+        *userData = cqe.user_data;
+        *result = cqe.res;
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+
+      int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, 0, 1,
+                                         IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (ret < 0 && errno != EINTR)
+        return false;
+    }
+  }
+};
+
+static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+AsyncOutputFile::AsyncOutputFile(const AsyncOutputOptions &options)
+    : m_options(options) {
+  if (m_options.maxBlocksInFlight == 0)
+    m_options.maxBlocksInFlight = 1;
+  m_options.blockSize = alignUp(std::max<size_t>(m_options.blockSize, 1));
+}
+
+AsyncOutputFile::~AsyncOutputFile() { close(); }
+
+size_t AsyncOutputFile::alignUp(size_t value) const {
+  return (value + DIRECT_IO_ALIGNMENT - 1) & ~(DIRECT_IO_ALIGNMENT - 1);
+}
+
+bool AsyncOutputFile::open(const std::string &path) {
+  m_path = path;
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (m_options.directIo) {
+    m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+    if (m_fd < 0 && errno == EINVAL) {
+      LOG_WARN << "[AsyncOutputFile] WARNING: O_DIRECT not supported for "
+               << path << ", using buffered I/O";
+      m_options.directIo = false;
+    }
+  }
+  if (m_fd < 0)
+    m_fd = ::open(path.c_str(), flags, 0644);
+  if (m_fd < 0)
+    return false;
+
+  // One block being filled, one spare for flush() snapshots, the rest in
+  // flight.
+  m_blocks.resize(m_options.maxBlocksInFlight + 2);
+  for (Block &block : m_blocks) {
+    void *memory = nullptr;
+    if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, m_options.blockSize) !=
+        0) {
+      LOG_ERROR << "[AsyncOutputFile] ERROR: cannot allocate "
+                << m_options.blockSize << "-byte blocks";
+      for (Block &allocated : m_blocks)
+        free(allocated.data);
+      m_blocks.clear();
+      ::close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+    block.data = static_cast<uint8_t *>(memory);
+    // Fault the pages in now rather than on the first write.
+    memset(block.data, 0, m_options.blockSize);
+  }
+
+  if (m_options.useIoUring) {
+    m_ring = new IoUring();
+    if (!m_ring->setup(m_options.maxBlocksInFlight)) {
+      LOG_WARN << "[AsyncOutputFile] WARNING: io_uring unavailable ("
+               << strerror(errno) << "), using pwritev thread";
+      m_ring->teardown();
+      delete m_ring;
+      m_ring = nullptr;
+    }
+  }
+
+  if (!m_ring) {
+    m_stopWorker = false;
+    m_worker = std::thread(&AsyncOutputFile::workerLoop, this);
+  }
+
+  m_size = 0;
+  m_failed = false;
+  return true;
+}
+
+int AsyncOutputFile::acquireBlock() {
+  for (;;) {
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+      if (!m_blocks[i].inFlight && static_cast<int>(i) != m_current)
+        return static_cast<int>(i);
+    }
+    if (!waitOne())
+      return -1;
+  }
+}
+
+bool AsyncOutputFile::append(const uint8_t *data, size_t size) {
+  if (m_fd < 0 || m_failed)
+    return false;
+  return copyIn(data, size);
+}
+
+bool AsyncOutputFile::appendZeros(uint64_t size) {
+  if (m_fd < 0 || m_failed)
+    return false;
+
+  uint64_t end = m_size + size;
+  uint64_t holeStart = alignUp(m_size);
+  uint64_t holeEnd = end & ~uint64_t(DIRECT_IO_ALIGNMENT - 1);
+  if (holeEnd < holeStart + MIN_HOLE_BYTES)
+    return copyIn(nullptr, static_cast<size_t>(size));
+
+  // Zero-fill up to an aligned boundary, write out what the current block
+  // holds, and start the next block past the hole.
+  if (!copyIn(nullptr, static_cast<size_t>(holeStart - m_size)))
+    return false;
+  if (m_current >= 0) {
+    int partial = m_current;
+    m_current = -1;
+    if (m_blocks[partial].used > 0 &&
+        !submit(partial, m_blocks[partial].used))
+      return false;
+  }
+  m_size = holeEnd;
+  return copyIn(nullptr, static_cast<size_t>(end - holeEnd));
+}
+
+bool AsyncOutputFile::copyIn(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    if (m_current < 0) {
+      m_current = acquireBlock();
+      if (m_current < 0)
+        return false;
+      m_blocks[m_current].used = 0;
+      m_blocks[m_current].offset = m_size;
+    }
+
+    Block &block = m_blocks[m_current];
+    size_t chunk = std::min(size, m_options.blockSize - block.used);
+    if (data) {
+      memcpy(block.data + block.used, data, chunk);
+      data += chunk;
+    } else {
+      memset(block.data + block.used, 0, chunk);
+    }
+    block.used += chunk;
+    m_size += chunk;
+    size -= chunk;
+
+    if (block.used == m_options.blockSize) {
+      int full = m_current;
+      m_current = -1;
+      if (!submit(full, m_options.blockSize))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool AsyncOutputFile::submit(int index, size_t length) {
+  while (m_inFlight >= m_options.maxBlocksInFlight) {
+    if (!waitOne())
+      return false;
+  }
+
+  Block &block = m_blocks[index];
+  block.iov.iov_base = block.data;
+  block.iov.iov_len = length;
+  block.inFlight = true;
+  ++m_inFlight;
+  ++m_blocksSubmitted;
+
+  if (m_ring) {
+    if (!m_ring->submitWritev(m_fd, &block.iov, block.offset, index)) {
+      block.inFlight = false;
+      --m_inFlight;
+      m_failed = true;
+      return false;
+    }
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.push_back(index);
+  }
+  m_cv.notify_all();
+  return true;
+}
+
+bool AsyncOutputFile::waitOne() {
+  if (m_inFlight == 0)
+    return false;
+
+  int index;
+  bool ok;
+  if (m_ring) {
+    uint64_t userData;
+    int result;
+    if (!m_ring->waitCompletion(&userData, &result))
+      return false;
+    index = static_cast<int>(userData);
+    Block &block = m_blocks[index];
+    ok = result == static_cast<int>(block.iov.iov_len);
+    if (result > 0 && !ok) {
+      // Short write: send the rest, as the pwritev worker does. The block
+      // stays in flight.
+      block.iov.iov_base = static_cast<uint8_t *>(block.iov.iov_base) + result;
+      block.iov.iov_len -= static_cast<size_t>(result);
+      uint64_t offset =
+          block.offset + (static_cast<uint8_t *>(block.iov.iov_base) -
+                          block.data);
+      if (m_ring->submitWritev(m_fd, &block.iov, offset, index))
+        return true;
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_completed.empty(); });
+    index = m_completed.front().first;
+    ok = m_completed.front().second;
+    m_completed.pop_front();
+  }
+
+  if (!ok) {
+    LOG_ERROR << "[AsyncOutputFile] ERROR: block write failed at offset "
+              << m_blocks[index].offset;
+    m_failed = true;
+  }
+  m_blocks[index].inFlight = false;
+  --m_inFlight;
+  return true;
+}
+
+bool AsyncOutputFile::waitAll() {
+  while (m_inFlight > 0) {
+    if (!waitOne())
+      return false;
+  }
+  return !m_failed;
+}
+
+bool AsyncOutputFile::writeAt(uint64_t offset, const uint8_t *data,
+                              size_t size) {
+  if (m_fd < 0 || offset + size > m_size)
+    return false;
+
+  // Bytes still sitting in the block being filled are patched in memory.
+  if (m_current >= 0) {
+    Block &block = m_blocks[m_current];
+    if (offset + size > block.offset) {
+      size_t skip = offset < block.offset ? block.offset - offset : 0;
+      memcpy(block.data + (offset + skip - block.offset), data + skip,
+             size - skip);
+      size = skip;
+    }
+  }
+  if (size == 0)
+    return true;
+
+  // Everything else is already on its way to the file; wait for it so the
+  // patch cannot be overwritten by an older block.
+  if (!waitAll())
+    return false;
+
+  int fd = m_fd;
+  if (m_options.directIo)
+    fd = ::open(m_path.c_str(), O_WRONLY);
+  if (fd < 0)
+    return false;
+  bool ok = pwrite(fd, data, size, static_cast<off_t>(offset)) ==
+            static_cast<ssize_t>(size);
+  if (fd != m_fd)
+    ::close(fd);
+  return ok;
+}
+
+bool AsyncOutputFile::flush() {
+  if (m_fd < 0)
+    return false;
+
+  if (m_current >= 0 && m_blocks[m_current].used > 0) {
+    // Write a snapshot of the partial block so the block itself can keep
+    // filling; it will be written again in full later.
+    int snapshot = acquireBlock();
+    if (snapshot < 0)
+      return false;
+    Block &source = m_blocks[m_current];
+    Block &copy = m_blocks[snapshot];
+    size_t length =
+        m_options.directIo ? alignUp(source.used) : source.used;
+    memcpy(copy.data, source.data, source.used);
+    memset(copy.data + source.used, 0, length - source.used);
+    copy.offset = source.offset;
+    copy.used = source.used;
+    if (!submit(snapshot, length))
+      return false;
+  }
+  return waitAll();
+}
+
+bool AsyncOutputFile::reserve(uint64_t size) {
+  return m_fd >= 0 &&
+         fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+}
+
+bool AsyncOutputFile::close() {
+  if (m_fd < 0)
+    return true;
+
+  if (m_current >= 0 && m_blocks[m_current].used > 0) {
+    Block &block = m_blocks[m_current];
+    size_t length = m_options.directIo ? alignUp(block.used) : block.used;
+    memset(block.data + block.used, 0, length - block.used);
+    int last = m_current;
+    m_current = -1;
+    submit(last, length);
+  }
+  m_current = -1;
+  bool ok = waitAll();
+
+  // O_DIRECT pads the tail block and a trailing hole writes nothing; set
+  // the real length either way.
+  if (ftruncate(m_fd, static_cast<off_t>(m_size)) != 0)
+    ok = false;
+
+  if (m_ring) {
+    m_ring->teardown();
+    delete m_ring;
+    m_ring = nullptr;
+  } else if (m_worker.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopWorker = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+  }
+
+  if (::close(m_fd) != 0)
+    ok = false;
+  m_fd = -1;
+
+  for (Block &block : m_blocks)
+    free(block.data);
+  m_blocks.clear();
+  return ok && !m_failed;
+}
+
+void AsyncOutputFile::workerLoop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_cv.wait(lock, [this] { return m_stopWorker || !m_pending.empty(); });
+    if (m_pending.empty())
+      return;
+
+    int index = m_pending.front();
+    m_pending.pop_front();
+    lock.unlock();
+
+    Block &block = m_blocks[index];
+    iovec iov = block.iov;
+    off_t offset = static_cast<off_t>(block.offset);
+    bool ok = true;
+    while (iov.iov_len > 0) {
+      ssize_t written = pwritev(m_fd, &iov, 1, offset);
+      if (written < 0 && errno == EINTR)
+        continue;
+      if (written <= 0) {
+        ok = false;
+        break;
+      }
+      iov.iov_base = static_cast<uint8_t *>(iov.iov_base) + written;
+      iov.iov_len -= static_cast<size_t>(written);
+      offset += written;
+    }
+
+    lock.lock();
+    m_completed.emplace_back(index, ok);
+    m_cv.notify_all();
+  }
+}
+
+#endif
@@ -1,16 +1,27 @@
 #include "AudioCapture.h"
+#include "CaptureScheduler.h"
+#include "DiskWriter.h"
+#include "Logger.h"
+#include "Realtime.h"
 #include "Utils.h"
-#include <iostream>
+#include "VoiceActivitySink.h"
+#include <algorithm>
 
 AudioCapture::AudioCapture()
 
 #ifdef PLATFORM_WINDOWS
     : m_hWaveIn(nullptr), m_hThread(nullptr), m_bRunning(false),
-      m_writer(nullptr)
+      m_writer(nullptr), m_diskWriter(nullptr)
 #else
-    : m_pThread(nullptr), m_bRunning(false)
+    : m_pThread(nullptr), m_bRunning(false), m_scheduler(nullptr),
+      m_streamId(0), m_writer(nullptr), m_diskWriter(nullptr)
 #endif
 {
+#ifdef PLATFORM_WINDOWS
+  // 4 x 4 KiB: about 23 ms per buffer at 44.1 kHz stereo 16-bit.
+  m_deviceBufferConfig.blockCount = 4;
+  m_deviceBufferConfig.blockSize = 4096;
+#endif
 }
 
 AudioCapture::~AudioCapture() { cleanup(); }
@@ -19,15 +30,138 @@ bool AudioCapture::isRunning() const {
 #ifdef PLATFORM_WINDOWS
   return m_bRunning;
 #else
+  if (m_streamId)
+    return m_bRunning.load() && m_scheduler->isActive(m_streamId);
   return m_bRunning.load();
 #endif
 }
 
+void AudioCapture::setWriterOptions(const WavWriterOptions &options) {
+  m_writerOptions = options;
+}
+
+void AudioCapture::setFlacOutput(const FlacWriterOptions &options) {
+  m_flac = true;
+  m_flacOptions = options;
+}
+
+void AudioCapture::setBufferConfig(const BufferPoolConfig &config) {
+  m_bufferConfig = config;
+}
+
+void AudioCapture::setDriftCorrection(bool enabled,
+                                      const ClockTracker *reference) {
+  m_driftCorrection = enabled;
+  m_referenceClock = reference;
+}
+
+WavWriterOptions AudioCapture::writerOptions() {
+  WavWriterOptions options = m_writerOptions;
+  if (m_driftCorrection) {
+    options.clock = &m_clock;
+    options.referenceClock = m_referenceClock;
+  }
+  return options;
+}
+
+void AudioCapture::setVoiceActivity(const VoiceActivityConfig &config) {
+  m_voiceActivity = true;
+  m_voice.setConfig(config);
+}
+
+void AudioCapture::setSegments(const SegmentOptions &options) {
+  m_segmented = true;
+  m_segmentOptions = options;
+}
+
+#ifdef PLATFORM_LINUX
+void AudioCapture::setLiveStream(const std::string &name,
+                                 const SharedStreamOptions &options) {
+  m_liveStream = name;
+  m_liveStreamOptions = options;
+}
+
+void AudioCapture::setStream(const std::string &target,
+                             const StreamSinkOptions &options) {
+  m_stream = target;
+  m_streamOptions = options;
+}
+#endif
+
+void AudioCapture::setChannelGroup(
+    std::shared_ptr<MultichannelWavWriter> writer, size_t group) {
+  m_combined = std::move(writer);
+  m_combinedGroup = group;
+}
+
+void AudioCapture::addSubscriber(std::shared_ptr<BlockSubscriber> subscriber) {
+  m_subscribers.push_back(std::move(subscriber));
+}
+
+AudioSink *AudioCapture::createWriter(uint32_t sampleRate, uint16_t channels,
+                                      SampleFormat format) {
+  const uint16_t frameBytes = channels * bytesPerSample(format);
+  WavWriterOptions wavOptions = writerOptions();
+  if (m_segmented) {
+    // Reserve a full segment up front.
+    double seconds = m_segmentOptions.maxSeconds;
+    if (m_segmentOptions.maxBytes > 0) {
+      double bySize =
+          double(m_segmentOptions.maxBytes) / (double(sampleRate) * frameBytes);
+      seconds = seconds > 0.0 ? std::min(seconds, bySize) : bySize;
+    }
+    wavOptions.reserveSeconds = seconds;
+  }
+  // Runs on the rotation thread for later segments, so it copies what it
+  // needs.
+  bool flac = m_flac;
+  FlacWriterOptions flacOptions = m_flacOptions;
+  auto open = [=](const std::string &path) -> std::unique_ptr<AudioSink> {
+    if (flac)
+      return std::unique_ptr<AudioSink>(
+          new FlacWriter(path, sampleRate, channels, format, flacOptions));
+    return std::unique_ptr<AudioSink>(
+        new WavWriter(path, sampleRate, channels, format, wavOptions));
+  };
+
+  std::unique_ptr<AudioSink> sink;
+  if (m_combined)
+    sink = m_combined->createInput(m_combinedGroup, sampleRate, channels,
+                                   format);
+  else if (m_segmented)
+    sink.reset(new SegmentedSink(m_outputFile, sampleRate, frameBytes,
+                                 m_segmentOptions, open));
+  else
+    sink = open(m_outputFile);
+  if (m_voiceActivity) {
+    m_voice.setMetrics(&m_metrics);
+    m_voice.reset(sampleRate, channels, format);
+    sink.reset(new VoiceActivitySink(std::move(sink), &m_voice));
+  }
+#ifdef PLATFORM_LINUX
+  // Ahead of the gate too, but on this thread's I/O; the shared-memory
+  // ring is cheaper still, so it goes first.
+  if (!m_stream.empty())
+    sink.reset(new StreamSink(m_stream, sampleRate, channels, format,
+                              m_streamOptions, std::move(sink)));
+  // Outermost, so readers get the audio as captured, ahead of the gate.
+  if (!m_liveStream.empty())
+    sink.reset(new SharedMemorySink(m_liveStream, sampleRate, channels, format,
+                                    m_liveStreamOptions, std::move(sink)));
+#endif
+  return sink.release();
+}
+
+#ifdef PLATFORM_WINDOWS
+void AudioCapture::setDeviceBufferConfig(const BufferPoolConfig &config) {
+  m_deviceBufferConfig = config;
+}
+#endif
+
 #ifdef PLATFORM_WINDOWS
 bool AudioCapture::initializeWaveIn() {
-  std::cout
-      << "[AudioCapture] Setting up audio format (PCM 16-bit stereo 44.1kHz)..."
-      << std::endl;
+  LOG_INFO << "[AudioCapture] Setting up audio format (PCM 16-bit stereo "
+              "44.1kHz)...";
 
   // PCM 16-bit stereo 44.1kHz
   m_waveFormat.wFormatTag = WAVE_FORMAT_PCM;
@@ -40,81 +174,94 @@ bool AudioCapture::initializeWaveIn() {
       m_waveFormat.nSamplesPerSec * m_waveFormat.nBlockAlign;
   m_waveFormat.cbSize = 0;
 
-  std::cout << "[AudioCapture] Format: " << m_waveFormat.nChannels
-            << " channels, " << m_waveFormat.nSamplesPerSec << " Hz, "
-            << m_waveFormat.wBitsPerSample << " bits" << std::endl;
+  LOG_INFO << "[AudioCapture] Format: " << m_waveFormat.nChannels
+           << " channels, " << m_waveFormat.nSamplesPerSec << " Hz, "
+           << m_waveFormat.wBitsPerSample << " bits";
 
-  std::cout << "[AudioCapture] Opening WaveIn device..." << std::endl;
+  LOG_INFO << "[AudioCapture] Opening WaveIn device...";
   MMRESULT res =
       waveInOpen(&m_hWaveIn, WAVE_MAPPER, &m_waveFormat, (DWORD_PTR)waveInProc,
                  (DWORD_PTR)this, CALLBACK_FUNCTION);
 
   if (res != MMSYSERR_NOERROR) {
-    std::cerr << "[AudioCapture] ERROR: waveInOpen failed with error code: "
-              << res << std::endl;
-    std::cerr << "[AudioCapture] Error codes: MMSYSERR_ALLOCATED="
-              << MMSYSERR_ALLOCATED
-              << ", MMSYSERR_BADDEVICEID=" << MMSYSERR_BADDEVICEID
-              << ", MMSYSERR_NODRIVER=" << MMSYSERR_NODRIVER
-              << ", MMSYSERR_NOMEM=" << MMSYSERR_NOMEM
-              << ", WAVERR_BADFORMAT=" << WAVERR_BADFORMAT << std::endl;
+    LOG_ERROR << "[AudioCapture] ERROR: waveInOpen failed with error code: "
+              << res;
+    LOG_ERROR << "[AudioCapture] Error codes: MMSYSERR_ALLOCATED="
+              << MMSYSERR_ALLOCATED << ", MMSYSERR_BADDEVICEID="
+              << MMSYSERR_BADDEVICEID << ", MMSYSERR_NODRIVER="
+              << MMSYSERR_NODRIVER << ", MMSYSERR_NOMEM=" << MMSYSERR_NOMEM
+              << ", WAVERR_BADFORMAT=" << WAVERR_BADFORMAT;
     return false;
   }
 
-  std::cout << "[AudioCapture] WaveIn device opened successfully" << std::endl;
-  std::cout << "[AudioCapture] Creating WAV writer for: " << m_outputFile
-            << std::endl;
+  LOG_INFO << "[AudioCapture] WaveIn device opened successfully";
+  LOG_INFO << "[AudioCapture] Creating " << (m_flac ? "FLAC" : "WAV")
+           << " writer for: " << m_outputFile;
 
-  m_writer = new WavWriter(m_outputFile, 44100, 2, 16);
+  m_clock.reset(m_waveFormat.nSamplesPerSec);
+  m_devicePosition = 0;
+  m_writer = createWriter(44100, 2, SampleFormat::Int16);
   if (!m_writer->initialize()) {
-    std::cerr << "[AudioCapture] ERROR: Failed to initialize WAV writer!"
-              << std::endl;
+    LOG_ERROR << "[AudioCapture] ERROR: Failed to initialize writer!";
     return false;
   }
 
-  std::cout << "[AudioCapture] WAV writer initialized successfully"
-            << std::endl;
-  std::cout << "[AudioCapture] Preparing " << BUFFER_COUNT
-            << " audio buffers..." << std::endl;
-
-  // Prepare buffers
-  for (int i = 0; i < BUFFER_COUNT; ++i) {
+  LOG_INFO << "[AudioCapture] Writer initialized successfully";
+
+  // The waveIn callback only copies into the ring; disk I/O happens on the
+  // DiskWriter thread.
+  m_diskWriter = new DiskWriter(m_writer, m_bufferConfig);
+  m_diskWriter->setMetrics(&m_metrics);
+  m_diskWriter->setClock(&m_clock);
+  for (const auto &subscriber : m_subscribers)
+    m_diskWriter->addSubscriber(subscriber);
+  if (!m_diskWriter->start()) {
+    LOG_ERROR << "[AudioCapture] ERROR: Failed to start disk writer thread!";
+    return false;
+  }
+  LOG_INFO << "[AudioCapture] Preparing " << m_deviceBufferConfig.blockCount
+           << " audio buffers of " << m_deviceBufferConfig.blockSize
+           << " bytes...";
+
+  // Every device buffer stays queued on the driver, so the pool is drained
+  // once here and the headers keep their blocks until stop().
+  m_deviceBuffers.reset(new BufferPool(m_deviceBufferConfig));
+  m_headers.assign(m_deviceBuffers->blockCount(), WAVEHDR());
+  for (size_t i = 0; i < m_headers.size(); ++i) {
     ZeroMemory(&m_headers[i], sizeof(WAVEHDR));
-    m_headers[i].lpData = (LPSTR)m_buffers[i];
-    m_headers[i].dwBufferLength = BUFFER_SIZE;
+    m_headers[i].lpData = (LPSTR)m_deviceBuffers->acquire()->data;
+    m_headers[i].dwBufferLength = m_deviceBuffers->blockSize();
 
     MMRESULT prepRes =
         waveInPrepareHeader(m_hWaveIn, &m_headers[i], sizeof(WAVEHDR));
     if (prepRes != MMSYSERR_NOERROR) {
-      std::cerr
-          << "[AudioCapture] ERROR: waveInPrepareHeader failed for buffer " << i
-          << " with error: " << prepRes << std::endl;
+      LOG_ERROR
+          << "[AudioCapture] ERROR: waveInPrepareHeader failed for buffer "
+          << i << " with error: " << prepRes;
       return false;
     }
 
     MMRESULT addRes =
         waveInAddBuffer(m_hWaveIn, &m_headers[i], sizeof(WAVEHDR));
     if (addRes != MMSYSERR_NOERROR) {
-      std::cerr << "[AudioCapture] ERROR: waveInAddBuffer failed for buffer "
-                << i << " with error: " << addRes << std::endl;
+      LOG_ERROR << "[AudioCapture] ERROR: waveInAddBuffer failed for buffer "
+                << i << " with error: " << addRes;
       return false;
     }
   }
 
-  std::cout << "[AudioCapture] All buffers prepared successfully" << std::endl;
+  LOG_INFO << "[AudioCapture] All buffers prepared successfully";
   return true;
 }
 
 void AudioCapture::startInternal() {
-  std::cout << "[AudioCapture] Starting WaveIn recording..." << std::endl;
+  LOG_INFO << "[AudioCapture] Starting WaveIn recording...";
   m_bRunning = true;
   MMRESULT res = waveInStart(m_hWaveIn);
   if (res != MMSYSERR_NOERROR) {
-    std::cerr << "[AudioCapture] ERROR: waveInStart failed with error: " << res
-              << std::endl;
+    LOG_ERROR << "[AudioCapture] ERROR: waveInStart failed with error: " << res;
   } else {
-    std::cout << "[AudioCapture] WaveIn recording started successfully"
-              << std::endl;
+    LOG_INFO << "[AudioCapture] WaveIn recording started successfully";
   }
 }
 
@@ -127,19 +274,20 @@ void AudioCapture::stop() {
   waveInStop(m_hWaveIn);
   waveInReset(m_hWaveIn);
 
-  // for (int i = 0; i < BUFFER_COUNT; ++i)
-  // {
-  //     waveInUnprepareHeader(m_hWaveIn, &m_headers[i], sizeof(WAVEHDR));
-  // }
-
   if (m_hWaveIn) {
-    for (int i = 0; i < BUFFER_COUNT; ++i) {
+    for (size_t i = 0; i < m_headers.size(); ++i) {
       if (m_headers[i].dwFlags & WHDR_PREPARED) {
         waveInUnprepareHeader(m_hWaveIn, &m_headers[i], sizeof(WAVEHDR));
       }
     }
   }
 
+  if (m_diskWriter) {
+    m_diskWriter->stop();
+    delete m_diskWriter;
+    m_diskWriter = nullptr;
+  }
+
   if (m_writer) {
     m_writer->finalize();
     delete m_writer;
@@ -175,31 +323,142 @@ void CALLBACK AudioCapture::waveInProc(HWAVEIN, UINT uMsg, DWORD_PTR dwInstance,
   auto *self = reinterpret_cast<AudioCapture *>(dwInstance);
   auto *hdr = reinterpret_cast<WAVEHDR *>(dwParam1);
 
-  if (!self->m_bRunning || !self->m_writer)
+  if (!self->m_bRunning || !self->m_diskWriter)
     return;
 
-  static int audioDataCount = 0;
-  if (audioDataCount % 100 == 0) { // Print every 100th buffer to avoid spam
-    std::cout << "[AudioCapture] Capturing audio data... (buffer #"
-              << audioDataCount << ", " << hdr->dwBytesRecorded << " bytes)"
-              << std::endl;
-  }
-  audioDataCount++;
+  int64_t callbackStart = metricsNowNs();
+
+  // The buffer completes as its last frame arrives, so its first frame was
+  // recorded one buffer length earlier.
+  uint32_t frames = hdr->dwBytesRecorded / self->m_waveFormat.nBlockAlign;
+  BlockTimestamp time;
+  time.position = self->m_devicePosition;
+  time.hostTimeNs =
+      callbackStart - int64_t(frames) * 1000000000 /
+                          int64_t(self->m_waveFormat.nSamplesPerSec);
+  self->m_devicePosition += frames;
 
   // 🔴 THIS IS REAL AUDIO
-  self->m_writer->write(reinterpret_cast<uint8_t *>(hdr->lpData),
-                        hdr->dwBytesRecorded);
+  self->m_diskWriter->push(reinterpret_cast<uint8_t *>(hdr->lpData),
+                           hdr->dwBytesRecorded, time);
+  self->m_metrics.recordPacket(frames, hdr->dwBytesRecorded);
 
   // Requeue buffer
   waveInAddBuffer(self->m_hWaveIn, hdr, sizeof(WAVEHDR));
+  self->m_metrics.recordCallback(metricsNowNs() - callbackStart);
 }
 #else
+void AudioCapture::setSource(std::unique_ptr<CaptureSource> source) {
+  m_source = std::move(source);
+}
+
+void AudioCapture::setScheduler(CaptureScheduler *scheduler) {
+  m_scheduler = scheduler;
+}
+
+bool AudioCapture::startSource() {
+  if (!m_source) {
+    LOG_ERROR << "[AudioCapture] ERROR: No capture source configured!";
+    return false;
+  }
+
+  if (!m_source->open()) {
+    LOG_ERROR << "[AudioCapture] ERROR: Failed to open capture source!";
+    return false;
+  }
+
+  StreamFormat format = m_source->format();
+  LOG_INFO << "[AudioCapture] Source format: " << format.channels
+           << " channels, " << format.sampleRate << " Hz, "
+           << bytesPerSample(format.sampleFormat) * 8 << " bits";
+
+  m_clock.reset(format.sampleRate);
+  m_writer =
+      createWriter(format.sampleRate, format.channels, format.sampleFormat);
+  if (!m_writer->initialize()) {
+    LOG_ERROR << "[AudioCapture] ERROR: Failed to initialize writer!";
+    cleanup();
+    return false;
+  }
+
+  m_diskWriter = new DiskWriter(m_writer, m_bufferConfig);
+  m_diskWriter->setMetrics(&m_metrics);
+  m_diskWriter->setClock(&m_clock);
+  for (const auto &subscriber : m_subscribers)
+    m_diskWriter->addSubscriber(subscriber);
+  if (!m_diskWriter->start()) {
+    LOG_ERROR << "[AudioCapture] ERROR: Failed to start disk writer thread!";
+    cleanup();
+    return false;
+  }
+
+  // Sized once so the capture loop never allocates.
+  m_packet.resize(m_source->maxPacketBytes() * MAX_BATCH_PACKETS);
+  return true;
+}
+
+void AudioCapture::startInternal() {
+  m_bRunning = true;
+  if (m_scheduler) {
+    m_streamId =
+        m_scheduler->attach(m_source.get(), m_diskWriter, &m_metrics);
+    if (m_streamId)
+      return;
+    LOG_WARN << "[AudioCapture] WARNING: Scheduler rejected the stream, using "
+                "a dedicated thread";
+  }
+  m_pThread = new std::thread(audioThreadProc, this);
+}
+
+void AudioCapture::audioThread() {
+  Logger::instance().prepareThread();
+  Realtime::prepareThread(ThreadRole::Capture);
+  const uint16_t blockAlign = m_source->format().blockAlign();
+  while (m_bRunning) {
+    if (!m_source->waitReady(READY_TIMEOUT_MS))
+      continue;
+
+    int64_t wakeTime = metricsNowNs();
+    size_t size =
+        m_diskWriter->readFrom(*m_source, m_packet.data(), m_packet.size());
+    if (size == 0) {
+      LOG_INFO << "[AudioCapture] Capture source reached end of stream";
+      m_bRunning = false;
+      break;
+    }
+    m_metrics.recordPacket(static_cast<uint32_t>(size / blockAlign),
+                           static_cast<uint32_t>(size),
+                           m_source->lastReadSilent());
+    m_metrics.recordCallback(metricsNowNs() - wakeTime);
+  }
+}
+
 void AudioCapture::cleanup() {
+  m_bRunning = false;
+  if (m_streamId) {
+    m_scheduler->detach(m_streamId);
+    m_streamId = 0;
+  }
   if (m_pThread) {
     m_pThread->join();
     delete m_pThread;
     m_pThread = nullptr;
   }
+
+  if (m_diskWriter) {
+    m_diskWriter->stop();
+    delete m_diskWriter;
+    m_diskWriter = nullptr;
+  }
+
+  if (m_writer) {
+    m_writer->finalize();
+    delete m_writer;
+    m_writer = nullptr;
+  }
+
+  if (m_source)
+    m_source->close();
 }
 
 void AudioCapture::audioThreadProc(AudioCapture *pThis) {
@@ -207,4 +466,4 @@ void AudioCapture::audioThreadProc(AudioCapture *pThis) {
     pThis->audioThread();
   }
 }
-#endif
\ No newline at end of file
+#endif
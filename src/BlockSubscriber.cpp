@@ -0,0 +1,85 @@
+#include "BlockSubscriber.h"
+#include "DiskWriter.h"
+#include "Logger.h"
+#include <algorithm>
+
+BlockSubscriber::BlockSubscriber(const SubscriberOptions &options)
+    : m_options(options),
+      m_queue(std::max<size_t>(options.maxQueuedBlocks, 1)) {}
+
+void BlockSubscriber::attach(DiskWriter *writer, size_t poolBlocks) {
+  m_writer = writer;
+  m_returned.reset(new SpscQueue<BufferPool::Block *>(poolBlocks));
+}
+
+const BufferPool::Block *BlockSubscriber::poll() {
+  BufferPool::Block *block;
+  return m_queue.pop(block) ? block : nullptr;
+}
+
+const BufferPool::Block *BlockSubscriber::wait(int timeoutMs) {
+  if (const BufferPool::Block *block = poll())
+    return block;
+
+  m_sleeping.store(true, std::memory_order_relaxed);
+  // Pairs with the fence in offer(): either it sees us asleep or we see
+  // its block.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_queue.size() == 0 && !m_ended.load(std::memory_order_relaxed))
+    m_wake.wait(timeoutMs);
+  m_sleeping.store(false, std::memory_order_relaxed);
+  return poll();
+}
+
+void BlockSubscriber::release(const BufferPool::Block *block) {
+  // The writer frees the block on its own thread, so the pool keeps a
+  // single consumer; it is woken in case capture is waiting for blocks.
+  bool last = block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  if (last)
+    m_returned->push(const_cast<BufferPool::Block *>(block));
+  m_released.fetch_add(1, std::memory_order_release);
+  if (last)
+    m_writer->wake();
+}
+
+bool BlockSubscriber::ended() const {
+  return m_ended.load(std::memory_order_acquire) && m_queue.size() == 0;
+}
+
+bool BlockSubscriber::offer(BufferPool::Block *block) {
+  if (m_detached.load(std::memory_order_relaxed) || !m_queue.push(block)) {
+    m_droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+    m_droppedBytes.fetch_add(block->size, std::memory_order_relaxed);
+    if (m_options.policy == SlowSubscriberPolicy::DropBlocks) {
+      LOG_EVERY_MS(LogLevel::Warning, 1000)
+          << "[BlockSubscriber] WARNING: Subscriber is "
+          << m_options.maxQueuedBlocks << " blocks behind, dropping";
+    } else if (!m_detached.exchange(true, std::memory_order_relaxed)) {
+      LOG_WARN << "[BlockSubscriber] WARNING: Subscriber fell "
+               << m_options.maxQueuedBlocks << " blocks behind, detached";
+    }
+    return false;
+  }
+  m_offered.fetch_add(1, std::memory_order_relaxed);
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed))
+    m_wake.signal();
+  return true;
+}
+
+void BlockSubscriber::reclaim(BufferPool &pool) {
+  BufferPool::Block *block;
+  while (m_returned->pop(block))
+    pool.release(block);
+}
+
+bool BlockSubscriber::idle() const {
+  return m_released.load(std::memory_order_acquire) ==
+         m_offered.load(std::memory_order_relaxed);
+}
+
+void BlockSubscriber::end() {
+  m_ended.store(true, std::memory_order_release);
+  m_wake.signal();
+}
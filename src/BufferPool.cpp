@@ -0,0 +1,159 @@
+#include "BufferPool.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static size_t pageSize() {
+#ifdef PLATFORM_WINDOWS
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+static BufferPoolConfig normalized(BufferPoolConfig config) {
+  config.blockSize = std::max<uint32_t>(config.blockSize, 1);
+  config.maxBlocks = std::max(config.maxBlocks, config.blockCount);
+  config.minBlocks = std::min(config.minBlocks, config.blockCount);
+  config.stableIntervals = std::max<uint32_t>(config.stableIntervals, 1);
+  return config;
+}
+
+BufferPool::BufferPool(const BufferPoolConfig &config)
+    : m_config(normalized(config)), m_free(m_config.maxBlocks) {
+  size_t page = pageSize();
+  m_allocSize = (m_config.blockSize + page - 1) / page * page;
+  grow(m_config.blockCount);
+}
+
+BufferPool::~BufferPool() {
+  for (Block *block : m_blocks)
+    freeBlock(block);
+}
+
+BufferPool::Block *BufferPool::acquire() {
+  Block *block;
+  if (!m_free.pop(block))
+    return nullptr;
+  block->size = 0;
+  block->time = BlockTimestamp();
+  block->silent = false;
+  return block;
+}
+
+void BufferPool::release(Block *block) {
+  if (m_retiring > 0) {
+    --m_retiring;
+    m_blocks.erase(std::find(m_blocks.begin(), m_blocks.end(), block));
+    m_blockCount.store(m_blocks.size(), std::memory_order_relaxed);
+    freeBlock(block);
+    return;
+  }
+  // Cannot fail: the free list holds maxBlocks and blocks never exceed that.
+  m_free.push(block);
+}
+
+size_t BufferPool::grow(size_t count) {
+  // Blocks still waiting to be retired are cheaper than new ones.
+  size_t kept = std::min(count, m_retiring);
+  m_retiring -= kept;
+  count = std::min(count - kept, m_config.maxBlocks - m_blocks.size());
+
+  size_t added = 0;
+  for (; added < count; ++added) {
+    Block *block = allocateBlock();
+    if (!block)
+      break;
+    m_blocks.push_back(block);
+    m_free.push(block);
+  }
+  m_blockCount.store(m_blocks.size(), std::memory_order_relaxed);
+  return kept + added;
+}
+
+void BufferPool::shrink(size_t count) {
+  size_t live = m_blocks.size() - m_retiring;
+  if (live > m_config.minBlocks)
+    m_retiring += std::min(count, live - m_config.minBlocks);
+}
+
+BufferPool::Block *BufferPool::allocateBlock() {
+#ifdef PLATFORM_WINDOWS
+  void *data = VirtualAlloc(nullptr, m_allocSize, MEM_RESERVE | MEM_COMMIT,
+                            PAGE_READWRITE);
+  if (!data) {
+    LOG_ERROR << "[BufferPool] ERROR: VirtualAlloc failed: " << GetLastError();
+    return nullptr;
+  }
+  bool locked = m_config.lockPages && VirtualLock(data, m_allocSize);
+  unsigned long lockError = locked ? 0 : GetLastError();
+#else
+  void *data = mmap(nullptr, m_allocSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    LOG_ERROR << "[BufferPool] ERROR: mmap failed: " << strerror(errno);
+    return nullptr;
+  }
+  bool locked = m_config.lockPages && mlock(data, m_allocSize) == 0;
+  const char *lockError = locked ? "" : strerror(errno);
+#endif
+
+  if (m_config.lockPages && !locked && m_locked.load()) {
+    // Every pool hits the same limit, so one line per second is enough.
+    LOG_EVERY_MS(LogLevel::Warning, 1000)
+        << "[BufferPool] WARNING: Cannot lock " << m_allocSize
+        << "-byte blocks (" << lockError << "), running unlocked";
+  }
+  if (!locked)
+    m_locked.store(false);
+
+  // Fault every page in now rather than on the capture thread.
+  memset(data, 0, m_allocSize);
+  return new Block{static_cast<uint8_t *>(data), 0, BlockTimestamp(), false, 0,
+                   {0}};
+}
+
+void BufferPool::freeBlock(Block *block) {
+#ifdef PLATFORM_WINDOWS
+  VirtualFree(block->data, 0, MEM_RELEASE);
+#else
+  munmap(block->data, m_allocSize);
+#endif
+  delete block;
+}
+
+BufferPoolTuner::BufferPoolTuner(const BufferPoolConfig &config)
+    : m_config(normalized(config)) {}
+
+size_t BufferPoolTuner::update(size_t blocks, size_t peakInUse,
+                               uint64_t overruns) {
+  // Out of headroom: each dropped packet needed at least one more block, so
+  // aim for twice that demand and a recurring stall fits next time.
+  if (overruns > 0 || peakInUse * 4 > blocks * 3) {
+    m_stable = 0;
+    size_t demand = peakInUse + static_cast<size_t>(overruns);
+    return std::min(m_config.maxBlocks,
+                    std::max({blocks * 2, demand * 2, m_config.minBlocks}));
+  }
+  if (peakInUse * 4 >= blocks) {
+    m_stable = 0;
+    return blocks;
+  }
+  if (++m_stable < m_config.stableIntervals)
+    return blocks;
+
+  // Usage stayed under a quarter of the pool for the whole stable period:
+  // halve it, keeping at least twice the peak.
+  m_stable = 0;
+  return std::max(m_config.minBlocks, std::max(blocks / 2, peakInUse * 2));
+}
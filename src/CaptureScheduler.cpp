@@ -0,0 +1,230 @@
+#include "CaptureScheduler.h"
+#include "CaptureSource.h"
+#include "DiskWriter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Realtime.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static constexpr int MAX_EVENTS = 64;
+
+CaptureScheduler::CaptureScheduler(unsigned threadCount)
+    : m_threadCount(threadCount ? threadCount : 1), m_epollFd(-1),
+      m_stopFd(-1), m_nextId(1) {}
+
+CaptureScheduler::~CaptureScheduler() {
+  stop();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &entry : m_streams) {
+    if (entry.second->ownsFd)
+      ::close(entry.second->fd);
+  }
+  m_streams.clear();
+}
+
+bool CaptureScheduler::start() {
+  if (m_running)
+    return false;
+
+  m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+  m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_epollFd < 0 || m_stopFd < 0) {
+    LOG_ERROR << "[CaptureScheduler] ERROR: Cannot create epoll set: "
+              << strerror(errno);
+    stop();
+    return false;
+  }
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = 0;
+  epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_stopFd, &event);
+
+  // Streams attached before start() are registered now.
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &entry : m_streams) {
+      event.events = EPOLLIN | EPOLLONESHOT;
+      event.data.u64 = entry.first;
+      epoll_ctl(m_epollFd, EPOLL_CTL_ADD, entry.second->fd, &event);
+    }
+  }
+
+  m_running = true;
+  for (unsigned i = 0; i < m_threadCount; ++i)
+    m_threads.emplace_back(&CaptureScheduler::run, this);
+  return true;
+}
+
+void CaptureScheduler::stop() {
+  if (m_running) {
+    m_running = false;
+    uint64_t one = 1;
+    ssize_t ignored = ::write(m_stopFd, &one, sizeof(one));
+    (void)ignored;
+    for (std::thread &thread : m_threads)
+      thread.join();
+    m_threads.clear();
+  }
+
+  if (m_epollFd >= 0) {
+    ::close(m_epollFd);
+    m_epollFd = -1;
+  }
+  if (m_stopFd >= 0) {
+    ::close(m_stopFd);
+    m_stopFd = -1;
+  }
+}
+
+CaptureScheduler::StreamId CaptureScheduler::attach(CaptureSource *source,
+                                                    DiskWriter *writer,
+                                                    StreamMetrics *metrics) {
+  if (!source || !writer)
+    return 0;
+
+  auto stream = std::make_shared<Stream>();
+  stream->source = source;
+  stream->writer = writer;
+  stream->metrics = metrics;
+  stream->blockAlign = source->format().blockAlign();
+  stream->fd = source->readyFd();
+  stream->ownsFd = stream->fd < 0;
+  if (stream->ownsFd) {
+    // Unpaced sources are always ready; a signaled eventfd that is never
+    // read keeps them in the rotation like any other stream.
+    stream->fd = eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stream->fd < 0)
+      return 0;
+  }
+  // Sized once so servicing never allocates.
+  stream->buffer.resize(source->maxPacketBytes() * MAX_BATCH_PACKETS);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  stream->id = m_nextId++;
+  if (m_epollFd >= 0) {
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = stream->id;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream->fd, &event) != 0) {
+      LOG_ERROR << "[CaptureScheduler] ERROR: Cannot register stream: "
+                << strerror(errno);
+      if (stream->ownsFd)
+        ::close(stream->fd);
+      return 0;
+    }
+  }
+  m_streams.emplace(stream->id, stream);
+  return stream->id;
+}
+
+bool CaptureScheduler::detach(StreamId id) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(id);
+    if (it == m_streams.end())
+      return false;
+    stream = it->second;
+    m_streams.erase(it);
+    if (m_epollFd >= 0)
+      epoll_ctl(m_epollFd, EPOLL_CTL_DEL, stream->fd, nullptr);
+  }
+
+  // Workers only mark a stream busy while it is still in the map, so once
+  // this clears nobody can touch it again.
+  while (stream->busy.load(std::memory_order_acquire))
+    std::this_thread::yield();
+
+  if (stream->ownsFd)
+    ::close(stream->fd);
+  return true;
+}
+
+bool CaptureScheduler::isActive(StreamId id) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_streams.find(id);
+  return it != m_streams.end() && it->second->active.load();
+}
+
+size_t CaptureScheduler::streamCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_streams.size();
+}
+
+std::shared_ptr<CaptureScheduler::Stream>
+CaptureScheduler::acquire(StreamId id) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_streams.find(id);
+  if (it == m_streams.end())
+    return nullptr;
+  it->second->busy.store(true, std::memory_order_relaxed);
+  return it->second;
+}
+
+void CaptureScheduler::run() {
+  Logger::instance().prepareThread();
+  Realtime::prepareThread(ThreadRole::Capture);
+  epoll_event events[MAX_EVENTS];
+  while (m_running) {
+    int count = epoll_wait(m_epollFd, events, MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG_ERROR << "[CaptureScheduler] ERROR: epoll_wait failed: "
+                << strerror(errno);
+      break;
+    }
+    m_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+    for (int i = 0; i < count && m_running; ++i) {
+      if (events[i].data.u64 == 0)
+        continue;
+
+      std::shared_ptr<Stream> stream = acquire(events[i].data.u64);
+      if (!stream)
+        continue;
+      service(*stream);
+      stream->busy.store(false, std::memory_order_release);
+    }
+  }
+}
+
+void CaptureScheduler::service(Stream &stream) {
+  // One batch per turn keeps draining fair across streams.
+  int64_t wakeTime = stream.metrics ? metricsNowNs() : 0;
+  size_t size = stream.writer->readFrom(*stream.source, stream.buffer.data(),
+                                        stream.buffer.size());
+  if (size == 0) {
+    // End of stream: leave it unarmed until it is detached.
+    stream.active.store(false);
+    return;
+  }
+
+  if (stream.metrics) {
+    stream.metrics->recordPacket(static_cast<uint32_t>(size / stream.blockAlign),
+                                 static_cast<uint32_t>(size),
+                                 stream.source->lastReadSilent());
+    stream.metrics->recordCallback(metricsNowNs() - wakeTime);
+  }
+  m_batches.fetch_add(1, std::memory_order_relaxed);
+  rearm(stream);
+}
+
+void CaptureScheduler::rearm(Stream &stream) {
+  epoll_event event = {};
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.u64 = stream.id;
+  // Fails with ENOENT if detach() already removed the stream, which is fine.
+  epoll_ctl(m_epollFd, EPOLL_CTL_MOD, stream.fd, &event);
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "ChannelInterleaver.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define CHANNEL_INTERLEAVER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+void interleaveScalar(const float *const *groups, const uint16_t *channels,
+                      size_t groupCount, size_t frames, float *dst) {
+  size_t width = 0;
+  for (size_t g = 0; g < groupCount; ++g)
+    width += channels[g];
+  size_t offset = 0;
+  for (size_t g = 0; g < groupCount; ++g) {
+    const float *src = groups[g];
+    const size_t count = channels[g];
+    float *out = dst + offset;
+    for (size_t f = 0; f < frames; ++f)
+      for (size_t c = 0; c < count; ++c)
+        out[f * width + c] = src[f * count + c];
+    offset += count;
+  }
+}
+
+// The scalar kernel from frame |done| on.
+void finishScalar(const float *const *groups, const uint16_t *channels,
+                  size_t frames, size_t done, float *dst) {
+  const float *tail[2] = {groups[0] + done * channels[0],
+                          groups[1] + done * channels[1]};
+  interleaveScalar(tail, channels, 2, frames - done,
+                   dst + done * (channels[0] + channels[1]));
+}
+
+#ifdef CHANNEL_INTERLEAVER_X86
+
+// a0 a1 | b0 b1, two frames at a time.
+void interleaveStereoPairSse2(const float *const *groups,
+                              const uint16_t *channels, size_t groupCount,
+                              size_t frames, float *dst) {
+  (void)groupCount;
+  const float *a = groups[0];
+  const float *b = groups[1];
+  size_t f = 0;
+  for (; f + 2 <= frames; f += 2) {
+    __m128 va = _mm_loadu_ps(a + 2 * f);
+    __m128 vb = _mm_loadu_ps(b + 2 * f);
+    _mm_storeu_ps(dst + 4 * f, _mm_movelh_ps(va, vb));
+    _mm_storeu_ps(dst + 4 * f + 4, _mm_movehl_ps(vb, va));
+  }
+  finishScalar(groups, channels, frames, f, dst);
+}
+
+// Stereo frames are moved as 64-bit lanes: four frames at a time.
+TARGET_AVX2 void interleaveStereoPairAvx2(const float *const *groups,
+                                          const uint16_t *channels,
+                                          size_t groupCount, size_t frames,
+                                          float *dst) {
+  (void)groupCount;
+  const float *a = groups[0];
+  const float *b = groups[1];
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    __m256d va = _mm256_castps_pd(_mm256_loadu_ps(a + 2 * f));
+    __m256d vb = _mm256_castps_pd(_mm256_loadu_ps(b + 2 * f));
+    __m256d lo = _mm256_unpacklo_pd(va, vb);
+    __m256d hi = _mm256_unpackhi_pd(va, vb);
+    _mm256_storeu_ps(dst + 4 * f,
+                     _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x20)));
+    _mm256_storeu_ps(dst + 4 * f + 8,
+                     _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x31)));
+  }
+  finishScalar(groups, channels, frames, f, dst);
+}
+
+// a | b, four frames at a time.
+void interleaveMonoPairSse2(const float *const *groups,
+                            const uint16_t *channels, size_t groupCount,
+                            size_t frames, float *dst) {
+  (void)groupCount;
+  const float *a = groups[0];
+  const float *b = groups[1];
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    __m128 va = _mm_loadu_ps(a + f);
+    __m128 vb = _mm_loadu_ps(b + f);
+    _mm_storeu_ps(dst + 2 * f, _mm_unpacklo_ps(va, vb));
+    _mm_storeu_ps(dst + 2 * f + 4, _mm_unpackhi_ps(va, vb));
+  }
+  finishScalar(groups, channels, frames, f, dst);
+}
+
+TARGET_AVX2 void interleaveMonoPairAvx2(const float *const *groups,
+                                        const uint16_t *channels,
+                                        size_t groupCount, size_t frames,
+                                        float *dst) {
+  (void)groupCount;
+  const float *a = groups[0];
+  const float *b = groups[1];
+  size_t f = 0;
+  for (; f + 8 <= frames; f += 8) {
+    __m256 va = _mm256_loadu_ps(a + f);
+    __m256 vb = _mm256_loadu_ps(b + f);
+    __m256 lo = _mm256_unpacklo_ps(va, vb);
+    __m256 hi = _mm256_unpackhi_ps(va, vb);
+    _mm256_storeu_ps(dst + 2 * f, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + 2 * f + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  finishScalar(groups, channels, frames, f, dst);
+}
+
+// a0 a1 | b, four frames (12 samples, three vectors) at a time:
+// [a0 a1 b0 a2] [a3 b1 a4 a5] [b2 a6 a7 b3], numbering samples.
+void interleaveStereoMonoSse2(const float *const *groups,
+                              const uint16_t *channels, size_t groupCount,
+                              size_t frames, float *dst) {
+  (void)groupCount;
+  const float *a = groups[0];
+  const float *b = groups[1];
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    __m128 a0 = _mm_loadu_ps(a + 2 * f);
+    __m128 a1 = _mm_loadu_ps(a + 2 * f + 4);
+    __m128 vb = _mm_loadu_ps(b + f);
+    __m128 x = _mm_shuffle_ps(vb, a0, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 y = _mm_shuffle_ps(a0, vb, _MM_SHUFFLE(1, 1, 3, 3));
+    __m128 z = _mm_shuffle_ps(vb, a1, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 w = _mm_shuffle_ps(a1, vb, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(dst + 3 * f, _mm_shuffle_ps(a0, x, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(dst + 3 * f + 4,
+                  _mm_shuffle_ps(y, a1, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(dst + 3 * f + 8,
+                  _mm_shuffle_ps(z, w, _MM_SHUFFLE(2, 0, 2, 0)));
+  }
+  finishScalar(groups, channels, frames, f, dst);
+}
+
+#endif
+
+} // namespace
+
+ChannelInterleaver::ChannelInterleaver(
+    const std::vector<uint16_t> &groupChannels, SimdLevel level)
+    : m_groupChannels(groupChannels), m_channels(0), m_level(level),
+      m_kernel(interleaveScalar) {
+  for (uint16_t count : m_groupChannels)
+    m_channels = static_cast<uint16_t>(m_channels + count);
+
+  // Never run a kernel the CPU cannot execute; the level reported is the
+  // kernel's own.
+  SimdLevel supported = SampleConverter::detectSimdLevel();
+  if (static_cast<int>(m_level) > static_cast<int>(supported))
+    m_level = supported;
+  if (m_level == SimdLevel::Avx512)
+    m_level = SimdLevel::Avx2;
+  SimdLevel used = SimdLevel::Scalar;
+#ifdef CHANNEL_INTERLEAVER_X86
+  bool avx2 = m_level == SimdLevel::Avx2;
+  bool sse2 = avx2 || m_level == SimdLevel::Sse2;
+  if (sse2 && m_groupChannels.size() == 2) {
+    uint16_t first = m_groupChannels[0];
+    uint16_t second = m_groupChannels[1];
+    if (first == 2 && second == 2) {
+      m_kernel = avx2 ? interleaveStereoPairAvx2 : interleaveStereoPairSse2;
+      used = m_level;
+    } else if (first == 1 && second == 1) {
+      m_kernel = avx2 ? interleaveMonoPairAvx2 : interleaveMonoPairSse2;
+      used = m_level;
+    } else if (first == 2 && second == 1) {
+      m_kernel = interleaveStereoMonoSse2;
+      used = SimdLevel::Sse2;
+    }
+  }
+#endif
+  m_level = used;
+}
+
+void ChannelInterleaver::interleave(const float *const *groups, size_t frames,
+                                    float *dst) const {
+  m_kernel(groups, m_groupChannels.data(), m_groupChannels.size(), frames,
+           dst);
+}
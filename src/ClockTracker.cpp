@@ -0,0 +1,123 @@
+#include "ClockTracker.h"
+#include <cmath>
+
+static constexpr uint8_t STATE_STARTED = 1;
+static constexpr uint8_t STATE_LOCKED = 2;
+
+ClockTracker::ClockTracker(uint32_t nominalRate) : m_nominalRate(nominalRate) {
+  reset(nominalRate);
+}
+
+void ClockTracker::reset(uint32_t nominalRate) {
+  m_nominalRate.store(nominalRate ? nominalRate : 1, std::memory_order_relaxed);
+  m_line = Line{0, 0, 0.0, 0.0, double(this->nominalRate()), false, false};
+  m_weight = 0.0;
+  m_varTime = 0.0;
+  m_covariance = 0.0;
+  m_lastTime = 0.0;
+  m_points = 0;
+  publish(m_line);
+}
+
+void ClockTracker::update(uint64_t position, int64_t hostTimeNs) {
+  if (hostTimeNs == 0)
+    return;
+  if (!m_line.started) {
+    m_line.originNs = hostTimeNs;
+    m_line.originPosition = position;
+    m_line.started = true;
+  }
+
+  // Coordinates relative to the first point keep full precision for days.
+  double t = (hostTimeNs - m_line.originNs) * 1e-9;
+  double p = static_cast<double>(int64_t(position - m_line.originPosition));
+  if (m_points > 0 && t < m_lastTime)
+    return;
+
+  // Older points fade with their age, not with the number of updates, so
+  // the fit window does not depend on the packet rate.
+  double decay = m_points > 0
+                     ? std::exp(-(t - m_lastTime) / FIT_TIME_CONSTANT_S)
+                     : 0.0;
+  m_weight = m_weight * decay + 1.0;
+  double dt = t - m_line.meanTime;
+  double dp = p - m_line.meanPosition;
+  m_line.meanTime += dt / m_weight;
+  m_line.meanPosition += dp / m_weight;
+  m_varTime = m_varTime * decay + dt * (t - m_line.meanTime);
+  m_covariance = m_covariance * decay + dt * (p - m_line.meanPosition);
+  m_lastTime = t;
+  ++m_points;
+
+  if (m_points >= LOCK_POINTS && t >= LOCK_SPAN_S && m_varTime > 0.0) {
+    m_line.slope = m_covariance / m_varTime;
+    m_line.locked = true;
+  }
+  publish(m_line);
+}
+
+void ClockTracker::publish(const Line &line) {
+  uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+  m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_originNs.store(line.originNs, std::memory_order_relaxed);
+  m_originPosition.store(line.originPosition, std::memory_order_relaxed);
+  m_meanTime.store(line.meanTime, std::memory_order_relaxed);
+  m_meanPosition.store(line.meanPosition, std::memory_order_relaxed);
+  m_slope.store(line.slope, std::memory_order_relaxed);
+  m_state.store((line.started ? STATE_STARTED : 0) |
+                    (line.locked ? STATE_LOCKED : 0),
+                std::memory_order_relaxed);
+  m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+ClockTracker::Line ClockTracker::load() const {
+  Line line;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = m_sequence.load(std::memory_order_acquire);
+    line.originNs = m_originNs.load(std::memory_order_relaxed);
+    line.originPosition = m_originPosition.load(std::memory_order_relaxed);
+    line.meanTime = m_meanTime.load(std::memory_order_relaxed);
+    line.meanPosition = m_meanPosition.load(std::memory_order_relaxed);
+    line.slope = m_slope.load(std::memory_order_relaxed);
+    uint8_t state = m_state.load(std::memory_order_relaxed);
+    line.started = (state & STATE_STARTED) != 0;
+    line.locked = (state & STATE_LOCKED) != 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = m_sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+  return line;
+}
+
+bool ClockTracker::started() const {
+  return (m_state.load(std::memory_order_acquire) & STATE_STARTED) != 0;
+}
+
+bool ClockTracker::locked() const {
+  return (m_state.load(std::memory_order_acquire) & STATE_LOCKED) != 0;
+}
+
+double ClockTracker::rateRatio() const {
+  Line line = load();
+  return line.locked ? line.slope / nominalRate() : 1.0;
+}
+
+double ClockTracker::positionAt(int64_t hostTimeNs) const {
+  Line line = load();
+  if (!line.started)
+    return hostTimeNs * 1e-9 * nominalRate();
+  double t = (hostTimeNs - line.originNs) * 1e-9;
+  return double(line.originPosition) + line.meanPosition +
+         line.slope * (t - line.meanTime);
+}
+
+int64_t ClockTracker::hostTimeAt(double position) const {
+  Line line = load();
+  if (!line.started)
+    return static_cast<int64_t>(std::llround(position / nominalRate() * 1e9));
+  double p = position - double(line.originPosition);
+  double t = line.meanTime + (p - line.meanPosition) / line.slope;
+  return line.originNs + static_cast<int64_t>(std::llround(t * 1e9));
+}
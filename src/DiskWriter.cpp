@@ -0,0 +1,355 @@
+#include "DiskWriter.h"
+#include "AudioSink.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Realtime.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef PLATFORM_LINUX
+#include "CaptureSource.h"
+#endif
+
+DiskWriter::DiskWriter(AudioSink *sink, const BufferPoolConfig &poolConfig)
+    : m_sink(sink), m_pool(poolConfig), m_ready(m_pool.config().maxBlocks),
+      m_tuner(m_pool.config()) {}
+
+DiskWriter::~DiskWriter() { stop(); }
+
+void DiskWriter::setClock(ClockTracker *clock) {
+  if (!m_thread.joinable())
+    m_clock = clock;
+}
+
+void DiskWriter::setMetrics(StreamMetrics *metrics) {
+  if (m_thread.joinable())
+    return;
+
+  m_metrics = metrics;
+  if (m_metrics && !m_marks)
+    m_marks.reset(new PushMark[MARK_CAPACITY]);
+}
+
+size_t DiskWriter::addSubscriber(std::shared_ptr<BlockSubscriber> subscriber) {
+  if (m_thread.joinable() || !subscriber)
+    return 0;
+
+  const size_t wanted = subscriber->m_options.maxQueuedBlocks;
+  const size_t shortfall = wanted - m_pool.grow(wanted);
+  if (shortfall > 0) {
+    m_subscriberShortfall += shortfall;
+    LOG_WARN << "[DiskWriter] WARNING: pool could add only "
+             << wanted - shortfall << " of the " << wanted
+             << " blocks a subscriber may hold (maxBlocks "
+             << m_pool.config().maxBlocks << "); capture headroom drops by "
+             << shortfall << " blocks while it lags";
+  }
+  subscriber->attach(this, m_pool.config().maxBlocks);
+  m_subscribers.push_back(std::move(subscriber));
+  return shortfall;
+}
+
+bool DiskWriter::start() {
+  if (m_running || !m_sink)
+    return false;
+
+  m_running = true;
+  m_thread = std::thread(&DiskWriter::run, this);
+  return true;
+}
+
+void DiskWriter::stop() {
+  if (!m_thread.joinable())
+    return;
+
+  m_running = false;
+  m_wake.signal();
+  m_thread.join();
+
+  // The pool is this thread's now; collect what the subscribers hold.
+  for (const auto &subscriber : m_subscribers)
+    subscriber->end();
+  int64_t deadline =
+      metricsNowNs() + int64_t(SUBSCRIBER_STOP_TIMEOUT_MS) * 1000000;
+  for (;;) {
+    reclaim();
+    bool idle = std::all_of(m_subscribers.begin(), m_subscribers.end(),
+                            [](const std::shared_ptr<BlockSubscriber> &s) {
+                              return s->idle();
+                            });
+    if (idle)
+      break;
+    if (metricsNowNs() > deadline) {
+      LOG_WARN << "[DiskWriter] WARNING: Subscribers still hold blocks";
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  reclaim();
+  for (size_t i = 0; i < m_subscribers.size(); ++i) {
+    const BlockSubscriber &subscriber = *m_subscribers[i];
+    if (subscriber.droppedBlocks() > 0) {
+      LOG_WARN << "[DiskWriter] WARNING: Subscriber " << i << " dropped "
+               << subscriber.droppedBlocks() << " blocks"
+               << (subscriber.detached() ? " (detached)" : "");
+    }
+  }
+
+  if (overruns() > 0) {
+    LOG_WARN << "[DiskWriter] WARNING: " << overruns() << " overruns, "
+             << droppedBytes() << " bytes dropped";
+  }
+  LOG_INFO << "[DiskWriter] Pool high-water mark: "
+           << m_highWaterBlocks.load() << " blocks, pool "
+           << m_pool.blockCount() << " x " << m_pool.blockSize() << " bytes"
+           << (m_pool.locked() ? "" : " (unlocked)");
+  if (poolGrows() + poolShrinks() > 0) {
+    LOG_INFO << "[DiskWriter] Pool auto-tuned " << poolGrows() << " up, "
+             << poolShrinks() << " down";
+  }
+  if (m_clock && m_clock->locked()) {
+    LOG_INFO << "[DiskWriter] Device clock " << m_clock->ppm()
+             << " ppm against the host clock";
+  }
+}
+
+bool DiskWriter::push(const uint8_t *data, uint32_t size,
+                      const BlockTimestamp &time) {
+  int64_t pushTime = m_metrics ? metricsNowNs() : 0;
+  const uint32_t blockSize = m_pool.blockSize();
+  size_t needed = (size + blockSize - 1) / blockSize;
+  // Only the writer changes the free count meanwhile, and only upwards.
+  if (needed > m_pool.available() + (m_spare ? 1 : 0)) {
+    m_overruns.fetch_add(1, std::memory_order_relaxed);
+    m_droppedBytes.fetch_add(size, std::memory_order_relaxed);
+    return false;
+  }
+
+  for (uint32_t offset = 0; offset < size; offset += blockSize) {
+    BufferPool::Block *block = acquire();
+    block->size = std::min(blockSize, size - offset);
+    memcpy(block->data, data + offset, block->size);
+    block->time = offset == 0 ? time : BlockTimestamp();
+    m_ready.push(block);
+  }
+  queued(size, pushTime);
+  return true;
+}
+
+BufferPool::Block *DiskWriter::acquire() {
+  if (m_spare) {
+    BufferPool::Block *block = m_spare;
+    m_spare = nullptr;
+    return block;
+  }
+  return m_pool.acquire();
+}
+
+bool DiskWriter::pushSilence(uint32_t size, const BlockTimestamp &time) {
+  int64_t pushTime = m_metrics ? metricsNowNs() : 0;
+  BufferPool::Block *block = acquire();
+  if (!block) {
+    m_overruns.fetch_add(1, std::memory_order_relaxed);
+    m_droppedBytes.fetch_add(size, std::memory_order_relaxed);
+    return false;
+  }
+  block->size = size;
+  block->time = time;
+  block->silent = true;
+  m_ready.push(block);
+  queued(size, pushTime);
+  return true;
+}
+
+void DiskWriter::commit(BufferPool::Block *block, uint32_t size,
+                        const BlockTimestamp &time) {
+  int64_t pushTime = m_metrics ? metricsNowNs() : 0;
+  block->size = size;
+  block->time = time;
+  m_ready.push(block);
+  queued(size, pushTime);
+}
+
+void DiskWriter::cancel(BufferPool::Block *block) {
+  // The free list only flows writer-to-capture, so keep it for next time.
+  block->size = 0;
+  m_spare = block;
+}
+
+#ifdef PLATFORM_LINUX
+size_t DiskWriter::readFrom(CaptureSource &source, uint8_t *scratch,
+                            size_t scratchSize) {
+  BufferPool::Block *block =
+      m_pool.blockSize() >= source.maxPacketBytes() ? acquire() : nullptr;
+  if (!block) {
+    size_t size = source.read(scratch, scratchSize);
+    if (size > 0 && source.lastReadSilent())
+      pushSilence(static_cast<uint32_t>(size), source.lastTimestamp());
+    else if (size > 0)
+      push(scratch, static_cast<uint32_t>(size), source.lastTimestamp());
+    return size;
+  }
+
+  size_t size = source.read(
+      block->data, std::min<size_t>(m_pool.blockSize(), scratchSize));
+  if (size > 0 && source.lastReadSilent()) {
+    block->silent = true;
+    commit(block, static_cast<uint32_t>(size), source.lastTimestamp());
+  } else if (size > 0) {
+    commit(block, static_cast<uint32_t>(size), source.lastTimestamp());
+  } else {
+    cancel(block);
+  }
+  return size;
+}
+#endif
+
+void DiskWriter::queued(uint32_t size, int64_t pushTime) {
+  if (m_metrics) {
+    m_pushedBytes += size;
+    size_t head = m_markHead.load(std::memory_order_relaxed);
+    if (head - m_markTail.load(std::memory_order_acquire) < MARK_CAPACITY) {
+      m_marks[head % MARK_CAPACITY] = {m_pushedBytes, pushTime};
+      m_markHead.store(head + 1, std::memory_order_release);
+    }
+  }
+
+  wake();
+}
+
+void DiskWriter::wake() {
+  // Pairs with the fence in run(): either the writer sees the new or
+  // returned block, or we see that it is asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed))
+    m_wake.signal();
+}
+
+void DiskWriter::run() {
+  Logger::instance().prepareThread();
+  Realtime::prepareThread(ThreadRole::Writer);
+  while (m_running) {
+    if (m_pool.config().autoTune)
+      tune();
+    if (drain() > 0)
+      continue;
+
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool returning = std::any_of(
+        m_subscribers.begin(), m_subscribers.end(),
+        [](const std::shared_ptr<BlockSubscriber> &s) { return s->returning(); });
+    if (m_ready.size() == 0 && !returning && m_running) {
+      m_wake.wait(IDLE_TIMEOUT_MS);
+      m_wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+
+  // Flush whatever the producer managed to push before stop().
+  drain();
+}
+
+void DiskWriter::publish(BufferPool::Block *block) {
+  // Counted up front, as a reader may release before the loop is done. The
+  // writer's own reference keeps the count above zero until it lets go.
+  uint32_t holders = static_cast<uint32_t>(m_subscribers.size()) + 1;
+  block->refs.store(holders, std::memory_order_relaxed);
+  uint32_t refused = 0;
+  for (const auto &subscriber : m_subscribers) {
+    if (!subscriber->offer(block))
+      ++refused;
+  }
+  if (refused > 0)
+    block->refs.fetch_sub(refused, std::memory_order_relaxed);
+}
+
+void DiskWriter::reclaim() {
+  for (const auto &subscriber : m_subscribers)
+    subscriber->reclaim(m_pool);
+}
+
+size_t DiskWriter::drain() {
+  reclaim();
+  size_t total = 0;
+  BufferPool::Block *block;
+  while (m_ready.pop(block)) {
+    // Everything still queued behind this block, plus the block itself.
+    size_t inUse = m_ready.size() + 1;
+    m_intervalPeak = std::max(m_intervalPeak, inUse);
+    if (inUse > m_highWaterBlocks.load(std::memory_order_relaxed))
+      m_highWaterBlocks.store(inUse, std::memory_order_relaxed);
+
+    uint32_t size = block->size;
+    block->offset = m_writtenBytes;
+    if (block->time.valid() && m_clock)
+      m_clock->update(block->time.position, block->time.hostTimeNs);
+    // Live readers first: they should not wait for the disk.
+    if (!m_subscribers.empty())
+      publish(block);
+    if (block->silent) {
+      m_sink->writeSilence(size, block->time);
+    } else if (block->time.valid()) {
+      m_sink->writeTimed(block->data, size, block->time);
+    } else {
+      m_sink->write(block->data, size);
+    }
+    if (m_subscribers.empty() ||
+        block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      m_pool.release(block);
+    total += size;
+
+    m_writtenBytes += size;
+    if (m_metrics) {
+      m_metrics->recordWrite(size);
+      recordLatencies();
+    }
+  }
+
+  if (m_metrics) {
+    m_metrics->updateRing(overruns(), droppedBytes(), highWaterMark());
+    m_metrics->updatePool(m_pool.blockCount(), m_pool.capacityBytes(),
+                          m_subscriberShortfall);
+  }
+  return total;
+}
+
+void DiskWriter::tune() {
+  int64_t now = metricsNowNs();
+  if (now < m_nextTuneNs)
+    return;
+  m_nextTuneNs = now + int64_t(m_pool.config().tuneIntervalMs) * 1000000;
+
+  uint64_t overruns = this->overruns();
+  size_t blocks = m_pool.blockCount();
+  size_t target =
+      m_tuner.update(blocks, m_intervalPeak, overruns - m_tunedOverruns);
+  m_tunedOverruns = overruns;
+  m_intervalPeak = 0;
+
+  if (target > blocks) {
+    m_pool.grow(target - blocks);
+    m_grows.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG << "[DiskWriter] Pool grown to " << m_pool.blockCount()
+              << " blocks";
+  } else if (target < blocks) {
+    m_pool.shrink(blocks - target);
+    m_shrinks.fetch_add(1, std::memory_order_relaxed);
+    LOG_DEBUG << "[DiskWriter] Pool shrinking to " << target << " blocks";
+  }
+}
+
+void DiskWriter::recordLatencies() {
+  int64_t now = metricsNowNs();
+  size_t tail = m_markTail.load(std::memory_order_relaxed);
+  size_t head = m_markHead.load(std::memory_order_acquire);
+  while (tail != head) {
+    const PushMark &mark = m_marks[tail % MARK_CAPACITY];
+    if (mark.endOffset > m_writtenBytes)
+      break;
+    m_metrics->recordLatency(now - mark.timeNs);
+    ++tail;
+  }
+  m_markTail.store(tail, std::memory_order_release);
+}
@@ -0,0 +1,89 @@
+#include "FileReplaySource.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+
+FileReplaySource::FileReplaySource(const std::string &filename,
+                                   uint32_t framesPerPacket, bool realTime,
+                                   bool loop)
+    : m_reader(filename), m_framesPerPacket(std::max<uint32_t>(framesPerPacket, 1)),
+      m_realTime(realTime), m_loop(loop), m_framesDelivered(0) {}
+
+bool FileReplaySource::open() {
+  if (!m_reader.open()) {
+    LOG_ERROR << "[FileReplaySource] ERROR: Cannot open replay file";
+    return false;
+  }
+
+  m_format.sampleRate = m_reader.sampleRate();
+  m_format.channels = m_reader.channels();
+  m_format.sampleFormat = m_reader.sampleFormat();
+  m_framesDelivered = 0;
+  m_openTimeNs = metricsNowNs();
+  m_lastTimestamp = BlockTimestamp();
+  if (m_realTime) {
+    if (!m_timer.start(m_format.sampleRate))
+      return false;
+    m_timer.arm(m_framesPerPacket);
+  }
+  return true;
+}
+
+void FileReplaySource::close() {
+  m_timer.stop();
+  m_reader.close();
+}
+
+size_t FileReplaySource::maxPacketBytes() const {
+  return static_cast<size_t>(m_framesPerPacket) * m_format.blockAlign();
+}
+
+bool FileReplaySource::waitReady(int timeoutMs) {
+  if (!m_realTime)
+    return true;
+  return m_timer.waitFor(m_framesDelivered + m_framesPerPacket, timeoutMs);
+}
+
+size_t FileReplaySource::read(uint8_t *buffer, size_t capacity) {
+  const uint16_t blockAlign = m_format.blockAlign();
+  uint64_t frames = capacity / blockAlign;
+  if (m_realTime) {
+    // Wait for the next period, then hand out every period that is due.
+    uint64_t next = m_framesDelivered +
+                    std::min<uint64_t>(m_framesPerPacket, std::max<uint64_t>(frames, 1));
+    while (!m_timer.waitFor(next, -1)) {
+    }
+    uint64_t due = m_timer.framesElapsed() - m_framesDelivered;
+    frames = std::min(frames, std::max(due, next - m_framesDelivered));
+  } else {
+    frames = std::min<uint64_t>(frames, m_framesPerPacket);
+  }
+  if (frames > m_framesPerPacket)
+    frames -= frames % m_framesPerPacket;
+
+  size_t wanted = static_cast<size_t>(frames) * blockAlign;
+  if (wanted == 0)
+    return 0;
+
+  size_t got = m_reader.read(buffer, wanted);
+  if (got < wanted && m_loop && m_reader.frames() > 0) {
+    m_reader.rewind();
+    got += m_reader.read(buffer + got, wanted - got);
+  }
+  got = got / blockAlign * blockAlign;
+  if (got == 0)
+    return 0;
+
+  m_lastTimestamp.position = m_framesDelivered;
+  m_lastTimestamp.hostTimeNs =
+      m_realTime ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       m_timer.frameTime(m_framesDelivered).time_since_epoch())
+                       .count()
+                 : m_openTimeNs + static_cast<int64_t>(m_framesDelivered *
+                                                       1000000000ull /
+                                                       m_format.sampleRate);
+  m_framesDelivered += got / blockAlign;
+  if (m_realTime)
+    m_timer.arm(m_framesDelivered + m_framesPerPacket);
+  return got;
+}
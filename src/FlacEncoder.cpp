@@ -0,0 +1,646 @@
+#include "FlacEncoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Highest Rice parameter of the 5-bit method; the all-ones value is the
+// escape code.
+constexpr unsigned MAX_RICE_PARAMETER = 30;
+constexpr unsigned MAX_RICE4_PARAMETER = 14;
+// Size of the frame header past its variable fields: sync and codes, a
+// 7-byte coded number, 16-bit block size and rate, CRC-8.
+constexpr size_t MAX_HEADER_BYTES = 16;
+
+// FLAC fields are big-endian and MSB first.
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *out) : m_begin(out), m_out(out) {}
+
+  // |value| must fit in |bits| (at most 32).
+  void put(uint32_t value, unsigned bits) {
+    m_acc = (m_acc << bits) | value;
+    m_count += bits;
+    while (m_count >= 8) {
+      m_count -= 8;
+      *m_out++ = static_cast<uint8_t>(m_acc >> m_count);
+    }
+  }
+
+  void putSigned(int32_t value, unsigned bits) {
+    put(static_cast<uint32_t>(value) & mask(bits), bits);
+  }
+
+  void putZeros(uint32_t count) {
+    for (; count > 32; count -= 32)
+      put(0, 32);
+    put(0, count);
+  }
+
+  // Zigzag-mapped value: quotient in unary, then |k| low bits.
+  void putRice(int32_t value, unsigned k) {
+    uint32_t u = (static_cast<uint32_t>(value) << 1) ^
+                 static_cast<uint32_t>(value >> 31);
+    uint32_t q = u >> k;
+    uint32_t tail = (1u << k) | (u & mask(k));
+    if (q + k < 32) {
+      put(tail, q + k + 1);
+    } else {
+      putZeros(q);
+      put(tail, k + 1);
+    }
+  }
+
+  void alignToByte() {
+    if (m_count)
+      put(0, 8 - m_count);
+  }
+
+  // Whole bytes written so far.
+  size_t bytes() const { return static_cast<size_t>(m_out - m_begin); }
+
+private:
+  static uint32_t mask(unsigned bits) {
+    return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+  }
+
+  uint8_t *m_begin;
+  uint8_t *m_out;
+  uint64_t m_acc = 0;
+  unsigned m_count = 0;
+};
+
+uint32_t zigzag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+uint32_t blockSizeCode(uint32_t frames) {
+  if (frames == 192)
+    return 1;
+  for (uint32_t code = 2; code <= 5; ++code) {
+    if (frames == 576u << (code - 2))
+      return code;
+  }
+  for (uint32_t code = 8; code <= 15; ++code) {
+    if (frames == 256u << (code - 8))
+      return code;
+  }
+  // Stored after the coded number as frames - 1.
+  return frames <= 256 ? 6 : 7;
+}
+
+uint32_t sampleRateCode(uint32_t rate) {
+  static const uint32_t RATES[] = {0,     88200, 176400, 192000,
+                                   8000,  16000, 22050,  24000,
+                                   32000, 44100, 48000,  96000};
+  for (uint32_t code = 1; code < 12; ++code) {
+    if (rate == RATES[code])
+      return code;
+  }
+  if (rate % 1000 == 0 && rate / 1000 <= 255)
+    return 12;
+  if (rate <= 65535)
+    return 13;
+  if (rate % 10 == 0 && rate / 10 <= 65535)
+    return 14;
+  // Taken from STREAMINFO.
+  return 0;
+}
+
+uint32_t sampleSizeCode(uint32_t bits) {
+  switch (bits) {
+  case 8: return 1;
+  case 12: return 2;
+  case 16: return 4;
+  case 20: return 5;
+  case 24: return 6;
+  default: return 0;
+  }
+}
+
+// The frame number in the UTF-8 style variable-length code.
+void putCodedNumber(BitWriter &writer, uint64_t value) {
+  if (value < 0x80) {
+    writer.put(static_cast<uint32_t>(value), 8);
+    return;
+  }
+  unsigned bytes = 2;
+  while (bytes < 7 && value >= (uint64_t(1) << (5 * bytes + 1)))
+    ++bytes;
+  unsigned shift = 6 * (bytes - 1);
+  uint32_t lead = (0xFF00u >> bytes) & 0xFF;
+  writer.put(lead | static_cast<uint32_t>(value >> shift), 8);
+  while (shift > 0) {
+    shift -= 6;
+    writer.put(0x80 | static_cast<uint32_t>((value >> shift) & 0x3F), 8);
+  }
+}
+
+// Coefficient precision by block size, as the reference encoder picks it.
+uint32_t coefficientPrecision(uint32_t bits, uint32_t blockFrames) {
+  if (bits < 16)
+    return std::max<uint32_t>(1, 2 + bits / 2);
+  if (blockFrames <= 192)
+    return 7;
+  if (blockFrames <= 384)
+    return 8;
+  if (blockFrames <= 576)
+    return 9;
+  if (blockFrames <= 1152)
+    return 10;
+  if (blockFrames <= 2304)
+    return 11;
+  if (blockFrames <= 4608)
+    return 12;
+  return 13;
+}
+
+// Cheapest Rice parameter for |count| zigzagged values summing to |sum|,
+// with its estimated cost in bits.
+unsigned riceParameter(uint64_t sum, uint32_t count, uint64_t &bits) {
+  if (count == 0) {
+    bits = 0;
+    return 0;
+  }
+  unsigned estimate = 0;
+  while (estimate < MAX_RICE_PARAMETER &&
+         (uint64_t(count) << (estimate + 1)) <= sum)
+    ++estimate;
+  unsigned best = estimate;
+  bits = UINT64_MAX;
+  for (unsigned k = estimate ? estimate - 1 : 0;
+       k <= std::min(estimate + 1, MAX_RICE_PARAMETER); ++k) {
+    uint64_t cost = uint64_t(count) * (k + 1) + (sum >> k);
+    if (cost < bits) {
+      bits = cost;
+      best = k;
+    }
+  }
+  return best;
+}
+
+} // namespace
+
+struct FlacEncoder::Subframe {
+  enum Type : uint8_t { Constant, Verbatim, Fixed, Lpc };
+
+  Type type = Verbatim;
+  // Sample depth; one more than the stream's for a side channel.
+  uint32_t bits = 0;
+  // Predictor order: the warm-up samples before the residual.
+  uint32_t order = 0;
+  uint32_t precision = 0;
+  int shift = 0;
+  int32_t coeffs[FLAC_MAX_LPC_ORDER] = {};
+  uint32_t partitionOrder = 0;
+  // 5-bit Rice parameters.
+  bool rice2 = false;
+  uint8_t params[1 << FLAC_MAX_PARTITION_ORDER] = {};
+  // Coded size in bits, header included.
+  uint64_t size = 0;
+  const int32_t *samples = nullptr;
+  // Indexed like the samples; the first |order| entries are unused.
+  std::vector<int32_t> residual;
+};
+
+FlacEncoder::FlacEncoder(const FlacEncoderConfig &config)
+    : m_config(config), m_valid(false), m_precision(0), m_windowFrames(0) {
+  m_config.maxLpcOrder = std::min(m_config.maxLpcOrder, FLAC_MAX_LPC_ORDER);
+  m_config.maxPartitionOrder =
+      std::min(m_config.maxPartitionOrder, FLAC_MAX_PARTITION_ORDER);
+  m_valid = m_config.channels >= 1 && m_config.channels <= FLAC_MAX_CHANNELS &&
+            m_config.bitsPerSample >= FLAC_MIN_BITS &&
+            m_config.bitsPerSample <= FLAC_MAX_BITS &&
+            m_config.blockFrames >= 16 &&
+            m_config.blockFrames <= FLAC_MAX_BLOCK_FRAMES &&
+            m_config.sampleRate > 0 && m_config.sampleRate < (1u << 20);
+  if (!m_valid)
+    return;
+
+  m_precision =
+      coefficientPrecision(m_config.bitsPerSample, m_config.blockFrames);
+  size_t coded = m_config.channels == 2 && m_config.stereoDecorrelation
+                     ? 4
+                     : m_config.channels;
+  m_planar.assign(coded, std::vector<int32_t>(m_config.blockFrames));
+  m_subframes.resize(coded);
+  for (Subframe &sf : m_subframes)
+    sf.residual.resize(m_config.blockFrames);
+  m_candidate.reset(new Subframe());
+  m_candidate->residual.resize(m_config.blockFrames);
+  m_accumulator.resize(m_config.blockFrames);
+  m_window.resize(m_config.blockFrames);
+  m_windowed.resize(m_config.blockFrames);
+}
+
+FlacEncoder::~FlacEncoder() = default;
+
+size_t FlacEncoder::maxFrameBytes() const {
+  size_t verbatim =
+      1 + (size_t(m_config.blockFrames) * (m_config.bitsPerSample + 1) + 7) / 8;
+  return MAX_HEADER_BYTES + m_config.channels * verbatim + 2;
+}
+
+size_t FlacEncoder::encodeFrame(const int32_t *samples, uint32_t frames,
+                                uint64_t frameNumber, uint8_t *out) {
+  if (!m_valid || frames == 0 || frames > m_config.blockFrames)
+    return 0;
+
+  const uint16_t channels = m_config.channels;
+  const uint32_t bits = m_config.bitsPerSample;
+  for (uint16_t c = 0; c < channels; ++c) {
+    int32_t *dst = m_planar[c].data();
+    for (uint32_t i = 0; i < frames; ++i)
+      dst[i] = samples[size_t(i) * channels + c];
+  }
+  const bool decorrelate = m_planar.size() == 4;
+  if (decorrelate) {
+    const int32_t *left = m_planar[0].data();
+    const int32_t *right = m_planar[1].data();
+    int32_t *side = m_planar[2].data();
+    int32_t *mid = m_planar[3].data();
+    for (uint32_t i = 0; i < frames; ++i) {
+      side[i] = left[i] - right[i];
+      mid[i] = (left[i] + right[i]) >> 1;
+    }
+  }
+  for (size_t c = 0; c < m_planar.size(); ++c)
+    analyze(m_planar[c].data(), frames, bits + (decorrelate && c == 2),
+            m_subframes[c]);
+
+  // Coded channels in stream order.
+  uint32_t assignment = channels - 1;
+  size_t order[FLAC_MAX_CHANNELS];
+  for (uint16_t c = 0; c < channels; ++c)
+    order[c] = c;
+  if (decorrelate) {
+    uint64_t left = m_subframes[0].size;
+    uint64_t right = m_subframes[1].size;
+    uint64_t side = m_subframes[2].size;
+    uint64_t mid = m_subframes[3].size;
+    uint64_t best = left + right;
+    if (left + side < best) {
+      best = left + side;
+      assignment = uint32_t(FlacChannels::LeftSide);
+      order[0] = 0;
+      order[1] = 2;
+    }
+    if (side + right < best) {
+      best = side + right;
+      assignment = uint32_t(FlacChannels::RightSide);
+      order[0] = 2;
+      order[1] = 1;
+    }
+    if (mid + side < best) {
+      assignment = uint32_t(FlacChannels::MidSide);
+      order[0] = 3;
+      order[1] = 2;
+    }
+  }
+
+  BitWriter writer(out);
+  // Sync code, reserved bit, fixed block size.
+  writer.put(0xFFF8, 16);
+  const uint32_t rate = m_config.sampleRate;
+  const uint32_t blockCode = blockSizeCode(frames);
+  const uint32_t rateCode = sampleRateCode(rate);
+  writer.put(blockCode, 4);
+  writer.put(rateCode, 4);
+  writer.put(assignment, 4);
+  writer.put(sampleSizeCode(bits), 3);
+  writer.put(0, 1);
+  putCodedNumber(writer, frameNumber);
+  if (blockCode == 6)
+    writer.put(frames - 1, 8);
+  else if (blockCode == 7)
+    writer.put(frames - 1, 16);
+  if (rateCode == 12)
+    writer.put(rate / 1000, 8);
+  else if (rateCode == 13)
+    writer.put(rate, 16);
+  else if (rateCode == 14)
+    writer.put(rate / 10, 16);
+  writer.put(flacCrc8(out, writer.bytes()), 8);
+
+  auto writeResidual = [&](const Subframe &sf) {
+    const unsigned paramBits = sf.rice2 ? 5 : 4;
+    writer.put(sf.rice2 ? 1 : 0, 2);
+    writer.put(sf.partitionOrder, 4);
+    const uint32_t partitions = 1u << sf.partitionOrder;
+    const uint32_t partitionFrames = frames >> sf.partitionOrder;
+    const int32_t *residual = sf.residual.data();
+    for (uint32_t p = 0; p < partitions; ++p) {
+      unsigned k = sf.params[p];
+      writer.put(k, paramBits);
+      uint32_t end = (p + 1) * partitionFrames;
+      for (uint32_t i = p ? p * partitionFrames : sf.order; i < end; ++i)
+        writer.putRice(residual[i], k);
+    }
+  };
+
+  for (uint16_t c = 0; c < channels; ++c) {
+    const Subframe &sf = m_subframes[order[c]];
+    const int32_t *x = sf.samples;
+    // Zero padding bit, type, no wasted bits.
+    switch (sf.type) {
+    case Subframe::Constant:
+      writer.put(0x00, 8);
+      writer.putSigned(x[0], sf.bits);
+      break;
+    case Subframe::Verbatim:
+      writer.put(0x02, 8);
+      for (uint32_t i = 0; i < frames; ++i)
+        writer.putSigned(x[i], sf.bits);
+      break;
+    case Subframe::Fixed:
+      writer.put((0x08 | sf.order) << 1, 8);
+      for (uint32_t i = 0; i < sf.order; ++i)
+        writer.putSigned(x[i], sf.bits);
+      writeResidual(sf);
+      break;
+    case Subframe::Lpc:
+      writer.put((0x20 | (sf.order - 1)) << 1, 8);
+      for (uint32_t i = 0; i < sf.order; ++i)
+        writer.putSigned(x[i], sf.bits);
+      writer.put(sf.precision - 1, 4);
+      writer.putSigned(sf.shift, 5);
+      for (uint32_t j = 0; j < sf.order; ++j)
+        writer.putSigned(sf.coeffs[j], sf.precision);
+      writeResidual(sf);
+      break;
+    }
+  }
+
+  writer.alignToByte();
+  writer.put(flacCrc16(out, writer.bytes()), 16);
+  return writer.bytes();
+}
+
+void FlacEncoder::analyze(const int32_t *x, uint32_t frames, uint32_t bits,
+                          Subframe &best) {
+  best.samples = x;
+  best.bits = bits;
+  best.order = 0;
+  bool constant = true;
+  for (uint32_t i = 1; i < frames && constant; ++i)
+    constant = x[i] == x[0];
+  if (constant) {
+    best.type = Subframe::Constant;
+    best.size = 8 + bits;
+    return;
+  }
+
+  best.type = Subframe::Verbatim;
+  best.size = 8 + uint64_t(frames) * bits;
+  tryFixed(x, frames, bits, best);
+  if (m_config.maxLpcOrder > 0)
+    tryLpc(x, frames, bits, best);
+}
+
+void FlacEncoder::tryFixed(const int32_t *x, uint32_t frames, uint32_t bits,
+                           Subframe &best) {
+  if (frames <= 8)
+    return;
+
+  // Sum of absolute residuals per order, over the frames every order covers.
+  uint64_t totals[5] = {};
+  for (uint32_t i = 4; i < frames; ++i) {
+    int64_t a = x[i], b = x[i - 1], c = x[i - 2], d = x[i - 3], e = x[i - 4];
+    int64_t r[5] = {a, a - b, a - 2 * b + c, a - 3 * b + 3 * c - d,
+                    a - 4 * b + 6 * c - 4 * d + e};
+    for (int k = 0; k < 5; ++k)
+      totals[k] += uint64_t(r[k] < 0 ? -r[k] : r[k]);
+  }
+  uint32_t order = 0;
+  for (uint32_t k = 1; k < 5; ++k) {
+    if (totals[k] < totals[order])
+      order = k;
+  }
+
+  Subframe &sf = *m_candidate;
+  sf.type = Subframe::Fixed;
+  sf.samples = x;
+  sf.bits = bits;
+  sf.order = order;
+  int32_t *r = sf.residual.data();
+  for (uint32_t i = order; i < frames; ++i) {
+    int64_t a = x[i];
+    switch (order) {
+    case 0: r[i] = int32_t(a); break;
+    case 1: r[i] = int32_t(a - x[i - 1]); break;
+    case 2: r[i] = int32_t(a - 2 * int64_t(x[i - 1]) + x[i - 2]); break;
+    case 3:
+      r[i] = int32_t(a - 3 * int64_t(x[i - 1]) + 3 * int64_t(x[i - 2]) -
+                     x[i - 3]);
+      break;
+    default:
+      r[i] = int32_t(a - 4 * int64_t(x[i - 1]) + 6 * int64_t(x[i - 2]) -
+                     4 * int64_t(x[i - 3]) + x[i - 4]);
+      break;
+    }
+  }
+  sf.size = 8 + uint64_t(order) * bits + chooseRice(sf, frames);
+  if (sf.size < best.size)
+    std::swap(best, sf);
+}
+
+void FlacEncoder::tryLpc(const int32_t *x, uint32_t frames, uint32_t bits,
+                         Subframe &best) {
+  uint32_t maxOrder = std::min(m_config.maxLpcOrder, frames / 2);
+  if (maxOrder == 0)
+    return;
+
+  if (m_windowFrames != frames)
+    buildWindow(frames);
+  double *w = m_windowed.data();
+  for (uint32_t i = 0; i < frames; ++i)
+    w[i] = x[i] * m_window[i];
+  double autoc[FLAC_MAX_LPC_ORDER + 1];
+  for (uint32_t lag = 0; lag <= maxOrder; ++lag) {
+    double sum = 0.0;
+    for (uint32_t i = lag; i < frames; ++i)
+      sum += w[i] * w[i - lag];
+    autoc[lag] = sum;
+  }
+  if (autoc[0] <= 0.0)
+    return;
+
+  // Levinson-Durbin: predictors of every order up to maxOrder and their
+  // residual energy.
+  double lpc[FLAC_MAX_LPC_ORDER][FLAC_MAX_LPC_ORDER];
+  double error[FLAC_MAX_LPC_ORDER];
+  double a[FLAC_MAX_LPC_ORDER] = {};
+  double err = autoc[0];
+  uint32_t orders = 0;
+  for (uint32_t i = 0; i < maxOrder && err > 0.0; ++i) {
+    double r = -autoc[i + 1];
+    for (uint32_t j = 0; j < i; ++j)
+      r -= a[j] * autoc[i - j];
+    r /= err;
+    a[i] = r;
+    uint32_t j = 0;
+    for (; j < i / 2; ++j) {
+      double t = a[j];
+      a[j] += r * a[i - 1 - j];
+      a[i - 1 - j] += r * t;
+    }
+    if (i & 1)
+      a[j] += a[j] * r;
+    err *= 1.0 - r * r;
+    for (j = 0; j <= i; ++j)
+      lpc[i][j] = -a[j];
+    error[i] = err;
+    orders = i + 1;
+  }
+
+  // Order with the fewest expected bits: residual plus coefficients.
+  const uint32_t precision = m_precision;
+  const double errorScale = 0.5 / frames;
+  uint32_t order = 0;
+  double bestEstimate = 0.0;
+  for (uint32_t o = 1; o <= orders; ++o) {
+    double perSample =
+        error[o - 1] > 0.0
+            ? std::max(0.0, 0.5 * std::log2(errorScale * error[o - 1]))
+            : 0.0;
+    double estimate = perSample * (frames - o) + o * double(bits + precision);
+    if (order == 0 || estimate < bestEstimate) {
+      order = o;
+      bestEstimate = estimate;
+    }
+  }
+  if (order == 0)
+    return;
+
+  // Quantize with the rounding error carried into the next coefficient.
+  const double *coeffs = lpc[order - 1];
+  double cmax = 0.0;
+  for (uint32_t j = 0; j < order; ++j)
+    cmax = std::max(cmax, std::fabs(coeffs[j]));
+  if (!(cmax > 0.0))
+    return;
+  int exponent;
+  std::frexp(cmax, &exponent);
+  int shift = std::min(int(precision) - 1 - exponent, 15);
+  if (shift < 0)
+    return;
+  Subframe &sf = *m_candidate;
+  const int32_t qmax = (1 << (precision - 1)) - 1;
+  double carry = 0.0;
+  for (uint32_t j = 0; j < order; ++j) {
+    carry += coeffs[j] * double(1 << shift);
+    long q = std::lround(carry);
+    q = std::max<long>(-qmax - 1, std::min<long>(qmax, q));
+    carry -= double(q);
+    sf.coeffs[j] = int32_t(q);
+  }
+
+  // Residual, accumulated one coefficient at a time so the inner loop runs
+  // over contiguous samples.
+  const uint32_t count = frames - order;
+  int64_t *acc = m_accumulator.data();
+  std::fill(acc, acc + count, int64_t(0));
+  for (uint32_t j = 0; j < order; ++j) {
+    const int64_t c = sf.coeffs[j];
+    const int32_t *src = x + order - 1 - j;
+    for (uint32_t k = 0; k < count; ++k)
+      acc[k] += c * src[k];
+  }
+  int32_t *r = sf.residual.data();
+  uint64_t outOfRange = 0;
+  for (uint32_t k = 0; k < count; ++k) {
+    int64_t v = x[order + k] - (acc[k] >> shift);
+    r[order + k] = int32_t(v);
+    outOfRange |= uint64_t(v + (int64_t(1) << 30)) >> 31;
+  }
+  // A wild predictor; the Rice coder takes values below 2^30.
+  if (outOfRange)
+    return;
+
+  sf.type = Subframe::Lpc;
+  sf.samples = x;
+  sf.bits = bits;
+  sf.order = order;
+  sf.precision = precision;
+  sf.shift = shift;
+  sf.size = 8 + uint64_t(order) * bits + 4 + 5 + uint64_t(order) * precision +
+            chooseRice(sf, frames);
+  if (sf.size < best.size)
+    std::swap(best, sf);
+}
+
+uint64_t FlacEncoder::chooseRice(Subframe &sf, uint32_t frames) const {
+  const int32_t *r = sf.residual.data();
+  const uint32_t order = sf.order;
+  uint32_t maxOrder = m_config.maxPartitionOrder;
+  while (maxOrder > 0 &&
+         ((frames & ((1u << maxOrder) - 1)) || (frames >> maxOrder) <= order))
+    --maxOrder;
+
+  // Sums at the finest order, merged pairwise for each coarser one.
+  uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+  uint32_t partitionFrames = frames >> maxOrder;
+  for (uint32_t p = 0; p < (1u << maxOrder); ++p) {
+    uint64_t sum = 0;
+    uint32_t end = (p + 1) * partitionFrames;
+    for (uint32_t i = p ? p * partitionFrames : order; i < end; ++i)
+      sum += zigzag(r[i]);
+    sums[p] = sum;
+  }
+
+  uint64_t bestBits = UINT64_MAX;
+  uint8_t params[1 << FLAC_MAX_PARTITION_ORDER];
+  for (int po = int(maxOrder); po >= 0; --po) {
+    const uint32_t partitions = 1u << po;
+    const uint32_t size = frames >> po;
+    uint64_t bits = 0;
+    bool rice2 = false;
+    for (uint32_t p = 0; p < partitions; ++p) {
+      uint64_t cost;
+      params[p] = uint8_t(riceParameter(sums[p], size - (p ? 0 : order), cost));
+      bits += cost;
+      rice2 |= params[p] > MAX_RICE4_PARAMETER;
+    }
+    bits += partitions * (rice2 ? 5 : 4);
+    if (bits < bestBits) {
+      bestBits = bits;
+      sf.partitionOrder = uint32_t(po);
+      sf.rice2 = rice2;
+      memcpy(sf.params, params, partitions);
+    }
+    for (uint32_t p = 0; p < partitions / 2; ++p)
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+  }
+
+  // The estimate picks the parameters; the size compared against the other
+  // predictors is exact.
+  const uint32_t partitions = 1u << sf.partitionOrder;
+  partitionFrames = frames >> sf.partitionOrder;
+  uint64_t exact = 2 + 4 + partitions * (sf.rice2 ? 5 : 4);
+  for (uint32_t p = 0; p < partitions; ++p) {
+    const unsigned k = sf.params[p];
+    const uint32_t begin = p ? p * partitionFrames : order;
+    const uint32_t end = (p + 1) * partitionFrames;
+    uint64_t quotients = 0;
+    for (uint32_t i = begin; i < end; ++i)
+      quotients += zigzag(r[i]) >> k;
+    exact += uint64_t(end - begin) * (k + 1) + quotients;
+  }
+  return exact;
+}
+
+// Tukey window with half the block tapered.
+void FlacEncoder::buildWindow(uint32_t frames) {
+  std::fill(m_window.begin(), m_window.begin() + frames, 1.0);
+  const uint32_t taper = frames / 4;
+  const double pi = std::acos(-1.0);
+  for (uint32_t i = 0; i < taper; ++i) {
+    double w = 0.5 - 0.5 * std::cos(pi * i / taper);
+    m_window[i] = w;
+    m_window[frames - 1 - i] = w;
+  }
+  m_windowFrames = frames;
+}
@@ -0,0 +1,84 @@
+#include "FlacFormat.h"
+
+namespace {
+
+struct CrcTables {
+  uint8_t crc8[256];
+  uint16_t crc16[256];
+
+  CrcTables() {
+    for (unsigned i = 0; i < 256; ++i) {
+      unsigned c8 = i;
+      unsigned c16 = i << 8;
+      for (int bit = 0; bit < 8; ++bit) {
+        c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+        c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+      }
+      crc8[i] = static_cast<uint8_t>(c8);
+      crc16[i] = static_cast<uint16_t>(c16);
+    }
+  }
+};
+
+const CrcTables &crcTables() {
+  static const CrcTables tables;
+  return tables;
+}
+
+} // namespace
+
+uint8_t flacCrc8(const uint8_t *data, size_t size) {
+  const CrcTables &tables = crcTables();
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; ++i)
+    crc = tables.crc8[crc ^ data[i]];
+  return crc;
+}
+
+uint16_t flacCrc16(const uint8_t *data, size_t size) {
+  const CrcTables &tables = crcTables();
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; ++i)
+    crc = static_cast<uint16_t>((crc << 8) ^ tables.crc16[(crc >> 8) ^ data[i]]);
+  return crc;
+}
+
+// Big-endian bit fields: 16 min block, 16 max block, 24 min frame, 24 max
+// frame, 20 rate, 3 channels - 1, 5 bits - 1, 36 total frames, 128 MD5.
+void FlacStreamInfo::serialize(uint8_t out[FLAC_STREAMINFO_SIZE]) const {
+  out[0] = static_cast<uint8_t>(minBlockFrames >> 8);
+  out[1] = static_cast<uint8_t>(minBlockFrames);
+  out[2] = static_cast<uint8_t>(maxBlockFrames >> 8);
+  out[3] = static_cast<uint8_t>(maxBlockFrames);
+  out[4] = static_cast<uint8_t>(minFrameBytes >> 16);
+  out[5] = static_cast<uint8_t>(minFrameBytes >> 8);
+  out[6] = static_cast<uint8_t>(minFrameBytes);
+  out[7] = static_cast<uint8_t>(maxFrameBytes >> 16);
+  out[8] = static_cast<uint8_t>(maxFrameBytes >> 8);
+  out[9] = static_cast<uint8_t>(maxFrameBytes);
+  uint64_t packed = uint64_t(sampleRate & 0xFFFFF) << 44 |
+                    uint64_t((channels - 1) & 0x7) << 41 |
+                    uint64_t((bitsPerSample - 1) & 0x1F) << 36 |
+                    (totalFrames & 0xFFFFFFFFFull);
+  for (int i = 0; i < 8; ++i)
+    out[10 + i] = static_cast<uint8_t>(packed >> (56 - 8 * i));
+  for (int i = 0; i < 16; ++i)
+    out[18 + i] = md5[i];
+}
+
+bool FlacStreamInfo::parse(const uint8_t in[FLAC_STREAMINFO_SIZE]) {
+  minBlockFrames = uint32_t(in[0]) << 8 | in[1];
+  maxBlockFrames = uint32_t(in[2]) << 8 | in[3];
+  minFrameBytes = uint32_t(in[4]) << 16 | uint32_t(in[5]) << 8 | in[6];
+  maxFrameBytes = uint32_t(in[7]) << 16 | uint32_t(in[8]) << 8 | in[9];
+  uint64_t packed = 0;
+  for (int i = 0; i < 8; ++i)
+    packed = packed << 8 | in[10 + i];
+  sampleRate = static_cast<uint32_t>(packed >> 44);
+  channels = static_cast<uint16_t>(((packed >> 41) & 0x7) + 1);
+  bitsPerSample = static_cast<uint16_t>(((packed >> 36) & 0x1F) + 1);
+  totalFrames = packed & 0xFFFFFFFFFull;
+  for (int i = 0; i < 16; ++i)
+    md5[i] = in[18 + i];
+  return sampleRate > 0 && maxBlockFrames >= 16;
+}
@@ -0,0 +1,447 @@
+#include "FlacReader.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+// Zero bytes kept after the buffered data; a bit read loads 8 bytes.
+static constexpr size_t READ_PADDING = 8;
+// Bytes read from the file per refill, beyond the frame being decoded.
+static constexpr size_t READ_CHUNK = 256 << 10;
+
+static unsigned leadingZeros(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return 63 - index;
+#else
+  return static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+// MSB-first reads from an in-memory frame. Reads past the end return zeros
+// and set overrun(), so a truncated frame fails its checks instead of
+// reading out of bounds.
+class FlacReader::BitReader {
+public:
+  BitReader(const uint8_t *data, size_t size)
+      : m_data(data), m_limit(uint64_t(size) * 8) {}
+
+  // |bits| <= 32.
+  uint32_t read(unsigned bits) {
+    if (bits == 0)
+      return 0;
+    uint64_t w = window();
+    m_bit += bits;
+    return static_cast<uint32_t>(w >> (64 - bits));
+  }
+
+  int32_t readSigned(unsigned bits) {
+    if (bits == 0)
+      return 0;
+    uint32_t value = read(bits) << (32 - bits);
+    return static_cast<int32_t>(value) >> (32 - bits);
+  }
+
+  // Zeros before the next one bit, which is consumed.
+  uint32_t readUnary() {
+    uint32_t zeros = 0;
+    while (m_bit < m_limit) {
+      uint64_t w = window();
+      if (w == 0) {
+        unsigned valid = 64 - unsigned(m_bit & 7);
+        zeros += valid;
+        m_bit += valid;
+        continue;
+      }
+      unsigned lz = leadingZeros(w);
+      m_bit += lz + 1;
+      return zeros + lz;
+    }
+    m_bit = m_limit + 1;
+    return 0;
+  }
+
+  // The frame or sample number's UTF-8 style variable-length code.
+  bool readCodedNumber(uint64_t &value) {
+    uint32_t first = read(8);
+    if (!(first & 0x80)) {
+      value = first;
+      return true;
+    }
+    unsigned bytes = 0;
+    while (bytes < 8 && (first & (0x80u >> bytes)))
+      ++bytes;
+    if (bytes < 2 || bytes > 7)
+      return false;
+    value = first & (0x7Fu >> bytes);
+    for (unsigned i = 1; i < bytes; ++i) {
+      uint32_t next = read(8);
+      if ((next & 0xC0) != 0x80)
+        return false;
+      value = value << 6 | (next & 0x3F);
+    }
+    return true;
+  }
+
+  void alignToByte() { m_bit = (m_bit + 7) & ~uint64_t(7); }
+  size_t bytePosition() const { return static_cast<size_t>(m_bit / 8); }
+  bool overrun() const { return m_bit > m_limit; }
+
+private:
+  // The next 57 to 64 bits, MSB aligned.
+  uint64_t window() const {
+    if (m_bit >= m_limit)
+      return 0;
+    const uint8_t *p = m_data + m_bit / 8;
+    uint64_t w = 0;
+    for (int i = 0; i < 8; ++i)
+      w = w << 8 | p[i];
+    return w << (m_bit & 7);
+  }
+
+  const uint8_t *m_data;
+  uint64_t m_limit;
+  uint64_t m_bit = 0;
+};
+
+FlacReader::FlacReader(const std::string &filename)
+    : m_filename(filename), m_file(nullptr),
+      m_sampleFormat(SampleFormat::Int16), m_blockAlign(0),
+      m_firstFrameOffset(0), m_frameLimit(0), m_begin(0), m_end(0),
+      m_eof(false), m_decodedBegin(0), m_decodedEnd(0), m_framesDecoded(0),
+      m_failed(false) {}
+
+FlacReader::~FlacReader() { close(); }
+
+bool FlacReader::open() {
+  m_file = fopen(m_filename.c_str(), "rb");
+  if (!m_file)
+    return false;
+
+  bool haveInfo = false;
+  uint8_t marker[4];
+  bool ok = fread(marker, 1, 4, m_file) == 4 &&
+            memcmp(marker, FLAC_STREAM_MARKER, 4) == 0;
+  for (bool last = false; ok && !last;) {
+    uint8_t header[4];
+    if (fread(header, 1, 4, m_file) != 4) {
+      ok = false;
+      break;
+    }
+    last = (header[0] & 0x80) != 0;
+    uint32_t type = header[0] & 0x7F;
+    uint32_t size = uint32_t(header[1]) << 16 | uint32_t(header[2]) << 8 | header[3];
+    int64_t start = ftell64(m_file);
+    if (type == FLAC_METADATA_STREAMINFO && size >= FLAC_STREAMINFO_SIZE) {
+      uint8_t body[FLAC_STREAMINFO_SIZE];
+      ok = fread(body, 1, sizeof(body), m_file) == sizeof(body) &&
+           m_info.parse(body);
+      haveInfo = ok;
+    }
+    if (ok && fseek64(m_file, start + size, SEEK_SET) != 0)
+      ok = false;
+  }
+  ok = ok && haveInfo && m_info.bitsPerSample >= FLAC_MIN_BITS &&
+       m_info.bitsPerSample <= FLAC_MAX_BITS &&
+       m_info.channels <= FLAC_MAX_CHANNELS;
+  if (!ok) {
+    LOG_ERROR << "[FlacReader] ERROR: Unsupported or malformed file: "
+              << m_filename;
+    close();
+    return false;
+  }
+  m_firstFrameOffset = static_cast<uint64_t>(ftell64(m_file));
+
+  m_sampleFormat =
+      m_info.bitsPerSample <= 16 ? SampleFormat::Int16 : SampleFormat::Int24;
+  m_blockAlign =
+      static_cast<uint16_t>(m_info.channels * bytesPerSample(m_sampleFormat));
+  // A verbatim frame is the largest a sane encoder writes; the reference
+  // encoder records the real maximum.
+  size_t verbatim =
+      16 + m_info.channels *
+               (1 + (size_t(m_info.maxBlockFrames) * (m_info.bitsPerSample + 1) + 7) / 8) +
+      2;
+  m_frameLimit = std::max<size_t>(m_info.maxFrameBytes, verbatim);
+  m_buffer.assign(m_frameLimit + READ_CHUNK + READ_PADDING, 0);
+  m_planar.assign(m_info.channels, std::vector<int32_t>(m_info.maxBlockFrames));
+  m_decoded.resize(size_t(m_info.maxBlockFrames) * m_blockAlign);
+  return rewind();
+}
+
+void FlacReader::close() {
+  if (m_file) {
+    fclose(m_file);
+    m_file = nullptr;
+  }
+}
+
+bool FlacReader::rewind() {
+  if (!m_file ||
+      fseek64(m_file, static_cast<int64_t>(m_firstFrameOffset), SEEK_SET) != 0)
+    return false;
+  m_begin = m_end = 0;
+  m_eof = false;
+  m_decodedBegin = m_decodedEnd = 0;
+  m_framesDecoded = 0;
+  m_failed = false;
+  return true;
+}
+
+size_t FlacReader::read(uint8_t *data, size_t size) {
+  size_t total = 0;
+  while (total < size && m_file) {
+    if (m_decodedBegin == m_decodedEnd) {
+      if (m_failed || !decodeFrame())
+        break;
+    }
+    size_t chunk = std::min(size - total, m_decodedEnd - m_decodedBegin);
+    memcpy(data + total, m_decoded.data() + m_decodedBegin, chunk);
+    m_decodedBegin += chunk;
+    total += chunk;
+  }
+  return total;
+}
+
+size_t FlacReader::fill(size_t bytes) {
+  size_t available = m_end - m_begin;
+  if (available >= bytes || m_eof)
+    return available;
+  memmove(m_buffer.data(), m_buffer.data() + m_begin, available);
+  m_begin = 0;
+  m_end = available;
+  const size_t capacity = m_buffer.size() - READ_PADDING;
+  while (m_end < capacity) {
+    size_t got = fread(m_buffer.data() + m_end, 1, capacity - m_end, m_file);
+    if (got == 0) {
+      m_eof = true;
+      break;
+    }
+    m_end += got;
+  }
+  memset(m_buffer.data() + m_end, 0, READ_PADDING);
+  return m_end - m_begin;
+}
+
+bool FlacReader::decodeFrame() {
+  size_t available = fill(m_frameLimit);
+  if (available == 0)
+    return false;
+
+  const uint8_t *frame = m_buffer.data() + m_begin;
+  BitReader reader(frame, available);
+  m_failed = true;
+
+  // Sync code and reserved bit; either blocking strategy.
+  if ((reader.read(16) & 0xFFFE) != 0xFFF8)
+    return false;
+  uint32_t blockCode = reader.read(4);
+  uint32_t rateCode = reader.read(4);
+  uint32_t assignment = reader.read(4);
+  uint32_t sizeCode = reader.read(3);
+  uint64_t number;
+  if (reader.read(1) || !reader.readCodedNumber(number))
+    return false;
+
+  uint32_t frames;
+  if (blockCode == 0)
+    return false;
+  else if (blockCode == 1)
+    frames = 192;
+  else if (blockCode <= 5)
+    frames = 576u << (blockCode - 2);
+  else if (blockCode == 6)
+    frames = reader.read(8) + 1;
+  else if (blockCode == 7)
+    frames = reader.read(16) + 1;
+  else
+    frames = 256u << (blockCode - 8);
+
+  // Rates in the header only repeat STREAMINFO here.
+  if (rateCode == 12)
+    reader.read(8);
+  else if (rateCode == 13 || rateCode == 14)
+    reader.read(16);
+  else if (rateCode == 15)
+    return false;
+
+  static const uint32_t SIZES[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  uint32_t bits = sizeCode ? SIZES[sizeCode] : m_info.bitsPerSample;
+  uint32_t channels = assignment < 8 ? assignment + 1 : 2;
+  if (assignment > uint32_t(FlacChannels::MidSide) ||
+      bits != m_info.bitsPerSample || channels != m_info.channels ||
+      frames > m_info.maxBlockFrames)
+    return false;
+
+  size_t headerBytes = reader.bytePosition();
+  if (reader.read(8) != flacCrc8(frame, headerBytes))
+    return false;
+
+  for (uint32_t c = 0; c < channels; ++c) {
+    bool side = (assignment == uint32_t(FlacChannels::LeftSide) && c == 1) ||
+                (assignment == uint32_t(FlacChannels::RightSide) && c == 0) ||
+                (assignment == uint32_t(FlacChannels::MidSide) && c == 1);
+    if (!decodeSubframe(reader, frames, bits + side, m_planar[c].data()))
+      return false;
+  }
+  reader.alignToByte();
+  size_t bodyBytes = reader.bytePosition();
+  uint32_t crc = reader.read(16);
+  if (reader.overrun() || crc != flacCrc16(frame, bodyBytes))
+    return false;
+  m_begin += bodyBytes + 2;
+
+  if (assignment >= 8) {
+    int32_t *a = m_planar[0].data();
+    int32_t *b = m_planar[1].data();
+    for (uint32_t i = 0; i < frames; ++i) {
+      if (assignment == uint32_t(FlacChannels::LeftSide)) {
+        b[i] = a[i] - b[i];
+      } else if (assignment == uint32_t(FlacChannels::RightSide)) {
+        a[i] += b[i];
+      } else {
+        int32_t mid = int32_t(uint32_t(a[i]) << 1) | (b[i] & 1);
+        int32_t side = b[i];
+        a[i] = (mid + side) >> 1;
+        b[i] = (mid - side) >> 1;
+      }
+    }
+  }
+
+  const unsigned shift = bytesPerSample(m_sampleFormat) * 8 - bits;
+  uint8_t *out = m_decoded.data();
+  for (uint32_t i = 0; i < frames; ++i) {
+    for (uint32_t c = 0; c < channels; ++c) {
+      uint32_t value = uint32_t(m_planar[c][i]) << shift;
+      *out++ = static_cast<uint8_t>(value);
+      *out++ = static_cast<uint8_t>(value >> 8);
+      if (m_sampleFormat == SampleFormat::Int24)
+        *out++ = static_cast<uint8_t>(value >> 16);
+    }
+  }
+  m_decodedBegin = 0;
+  m_decodedEnd = size_t(frames) * m_blockAlign;
+  ++m_framesDecoded;
+  m_failed = false;
+  return true;
+}
+
+bool FlacReader::decodeSubframe(BitReader &reader, uint32_t frames,
+                                uint32_t bits, int32_t *out) {
+  if (reader.read(1))
+    return false;
+  uint32_t type = reader.read(6);
+  uint32_t wasted = 0;
+  if (reader.read(1)) {
+    wasted = reader.readUnary() + 1;
+    if (wasted >= bits)
+      return false;
+    bits -= wasted;
+  }
+
+  if (type == 0) {
+    int32_t value = reader.readSigned(bits);
+    std::fill(out, out + frames, value);
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < frames; ++i)
+      out[i] = reader.readSigned(bits);
+  } else if (type >= 8 && type <= 12) {
+    uint32_t order = type - 8;
+    if (order > frames)
+      return false;
+    for (uint32_t i = 0; i < order; ++i)
+      out[i] = reader.readSigned(bits);
+    if (!decodeResidual(reader, frames, order, out))
+      return false;
+    for (uint32_t i = order; i < frames; ++i) {
+      int64_t prediction = 0;
+      switch (order) {
+      case 1: prediction = out[i - 1]; break;
+      case 2: prediction = 2 * int64_t(out[i - 1]) - out[i - 2]; break;
+      case 3:
+        prediction = 3 * int64_t(out[i - 1]) - 3 * int64_t(out[i - 2]) +
+                     out[i - 3];
+        break;
+      case 4:
+        prediction = 4 * int64_t(out[i - 1]) - 6 * int64_t(out[i - 2]) +
+                     4 * int64_t(out[i - 3]) - out[i - 4];
+        break;
+      }
+      out[i] = int32_t(out[i] + prediction);
+    }
+  } else if (type >= 32) {
+    uint32_t order = type - 31;
+    if (order > frames)
+      return false;
+    for (uint32_t i = 0; i < order; ++i)
+      out[i] = reader.readSigned(bits);
+    uint32_t precision = reader.read(4) + 1;
+    int shift = reader.readSigned(5);
+    if (precision == 16 || shift < 0)
+      return false;
+    int32_t coeffs[FLAC_MAX_LPC_ORDER];
+    for (uint32_t j = 0; j < order; ++j)
+      coeffs[j] = reader.readSigned(precision);
+    if (!decodeResidual(reader, frames, order, out))
+      return false;
+    for (uint32_t i = order; i < frames; ++i) {
+      int64_t sum = 0;
+      for (uint32_t j = 0; j < order; ++j)
+        sum += int64_t(coeffs[j]) * out[i - 1 - j];
+      out[i] = int32_t(out[i] + (sum >> shift));
+    }
+  } else {
+    return false;
+  }
+
+  if (wasted) {
+    for (uint32_t i = 0; i < frames; ++i)
+      out[i] = int32_t(uint32_t(out[i]) << wasted);
+  }
+  return !reader.overrun();
+}
+
+bool FlacReader::decodeResidual(BitReader &reader, uint32_t frames,
+                                uint32_t order, int32_t *out) {
+  uint32_t method = reader.read(2);
+  if (method > 1)
+    return false;
+  const unsigned paramBits = method ? 5 : 4;
+  const uint32_t escape = method ? 31 : 15;
+  const uint32_t partitionOrder = reader.read(4);
+  const uint32_t partitions = 1u << partitionOrder;
+  const uint32_t size = frames >> partitionOrder;
+  if ((frames & (partitions - 1)) || size < order)
+    return false;
+
+  uint32_t i = order;
+  for (uint32_t p = 0; p < partitions; ++p) {
+    const uint32_t end = (p + 1) * size;
+    uint32_t k = reader.read(paramBits);
+    if (k == escape) {
+      unsigned rawBits = reader.read(5);
+      for (; i < end; ++i)
+        out[i] = reader.readSigned(rawBits);
+    } else {
+      for (; i < end; ++i) {
+        uint64_t u = uint64_t(reader.readUnary()) << k | reader.read(k);
+        out[i] = int32_t(uint32_t(u >> 1) ^ (0u - uint32_t(u & 1)));
+      }
+    }
+    if (reader.overrun())
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,287 @@
+#include "FlacWriter.h"
+#include "FlacEncoder.h"
+#include "Logger.h"
+#include "OutputFile.h"
+#include "SampleConverter.h"
+#include <algorithm>
+#include <cstring>
+
+FlacWriter::FlacWriter(const std::string &filename, uint32_t sampleRate,
+                       uint16_t channels, SampleFormat inputFormat,
+                       const FlacWriterOptions &options)
+    : m_filename(filename), m_options(options), m_sampleRate(sampleRate),
+      m_channels(channels), m_inputFormat(inputFormat),
+      m_outputFormat(inputFormat),
+      m_inputFrameBytes(
+          static_cast<uint16_t>(channels * bytesPerSample(inputFormat))),
+      m_submitted(0), m_taken(0), m_written(0), m_stopping(false),
+      m_isOpen(false), m_framesWritten(0), m_bytesWritten(0), m_stalls(0) {
+  if (isFloatFormat(inputFormat)) {
+    m_outputFormat = options.outputFormat.value_or(SampleFormat::Int16);
+    if (m_outputFormat != SampleFormat::Int16 &&
+        m_outputFormat != SampleFormat::Int24) {
+      LOG_WARN << "[FlacWriter] FLAC stores Int16 or Int24 only, writing Int24";
+      m_outputFormat = SampleFormat::Int24;
+    }
+    m_converter.reset(new SampleConverter(m_outputFormat, options.dither));
+  } else if (options.outputFormat && *options.outputFormat != inputFormat) {
+    LOG_WARN << "[FlacWriter] Only float input can be converted, writing "
+                "input format";
+  }
+  m_frameCarry.reserve(m_inputFrameBytes);
+}
+
+FlacWriter::~FlacWriter() { finalize(); }
+
+bool FlacWriter::initialize() {
+  if (m_isOpen)
+    return true;
+  if (m_outputFormat == SampleFormat::Int32) {
+    LOG_ERROR << "[FlacWriter] ERROR: 32-bit integer input cannot be stored "
+                 "as FLAC";
+    return false;
+  }
+
+  FlacEncoderConfig config;
+  config.sampleRate = m_sampleRate;
+  config.channels = m_channels;
+  config.bitsPerSample =
+      static_cast<uint16_t>(bytesPerSample(m_outputFormat) * 8);
+  config.blockFrames = m_options.blockFrames;
+  config.maxLpcOrder = m_options.maxLpcOrder;
+  config.maxPartitionOrder = m_options.maxPartitionOrder;
+  unsigned threads = m_options.threads
+                         ? m_options.threads
+                         : std::max(1u, std::thread::hardware_concurrency() / 2);
+  m_encoders.clear();
+  for (unsigned i = 0; i < threads; ++i)
+    m_encoders.emplace_back(new FlacEncoder(config));
+  if (!m_encoders[0]->valid()) {
+    LOG_ERROR << "[FlacWriter] ERROR: Cannot encode " << m_channels
+              << " channels at " << m_sampleRate << " Hz in blocks of "
+              << config.blockFrames << " frames";
+    m_encoders.clear();
+    return false;
+  }
+
+  m_output.reset(new StdioOutputFile());
+  if (!m_output->open(m_filename)) {
+    m_output.reset();
+    m_encoders.clear();
+    return false;
+  }
+
+  // The marker and a single metadata block, STREAMINFO, patched at
+  // finalize.
+  m_info = FlacStreamInfo();
+  m_info.minBlockFrames = config.blockFrames;
+  m_info.maxBlockFrames = config.blockFrames;
+  m_info.sampleRate = m_sampleRate;
+  m_info.channels = m_channels;
+  m_info.bitsPerSample = config.bitsPerSample;
+  uint8_t header[FLAC_STREAMINFO_OFFSET + FLAC_STREAMINFO_SIZE];
+  memcpy(header, FLAC_STREAM_MARKER, 4);
+  header[4] = 0x80 | FLAC_METADATA_STREAMINFO;
+  header[5] = 0;
+  header[6] = 0;
+  header[7] = FLAC_STREAMINFO_SIZE;
+  m_info.serialize(header + FLAC_STREAMINFO_OFFSET);
+  m_output->append(header, sizeof(header));
+
+  unsigned jobs = m_options.maxBlocksInFlight ? m_options.maxBlocksInFlight
+                                              : 4 * threads;
+  m_jobs = std::vector<Job>(std::max(jobs, 2u));
+  for (Job &job : m_jobs) {
+    job.samples.resize(size_t(config.blockFrames) * m_channels);
+    job.encoded.resize(m_encoders[0]->maxFrameBytes());
+  }
+  if (m_converter) {
+    m_floatScratch.resize(size_t(config.blockFrames) * m_channels);
+    m_pcmScratch.resize(m_floatScratch.size() * bytesPerSample(m_outputFormat));
+  }
+  m_frameCarry.clear();
+  m_submitted = m_taken = m_written = 0;
+  m_stopping = false;
+  m_framesWritten = 0;
+  m_bytesWritten = sizeof(header);
+  m_stalls = 0;
+  m_info.minFrameBytes = UINT32_MAX;
+  for (auto &encoder : m_encoders)
+    m_workers.emplace_back(&FlacWriter::encodeLoop, this, encoder.get());
+
+  LOG_INFO << "[FlacWriter] Encoding " << m_channels << " channels, "
+           << m_sampleRate << " Hz, " << config.bitsPerSample << " bits on "
+           << threads << " threads";
+  m_isOpen = true;
+  return true;
+}
+
+void FlacWriter::write(const uint8_t *data, uint32_t size) {
+  if (!m_isOpen || !data)
+    return;
+
+  if (!m_frameCarry.empty()) {
+    size_t take = std::min<size_t>(m_inputFrameBytes - m_frameCarry.size(), size);
+    m_frameCarry.insert(m_frameCarry.end(), data, data + take);
+    data += take;
+    size -= static_cast<uint32_t>(take);
+    if (m_frameCarry.size() < m_inputFrameBytes)
+      return;
+    appendFrames(m_frameCarry.data(), 1);
+    m_frameCarry.clear();
+  }
+
+  size_t frames = size / m_inputFrameBytes;
+  appendFrames(data, frames);
+  size_t used = frames * m_inputFrameBytes;
+  m_frameCarry.insert(m_frameCarry.end(), data + used, data + size);
+}
+
+void FlacWriter::appendFrames(const uint8_t *data, size_t frames) {
+  const uint32_t blockFrames = m_encoders[0]->config().blockFrames;
+  while (frames > 0) {
+    Job &job = currentJob();
+    size_t count = std::min<size_t>(frames, blockFrames - job.frames);
+    size_t samples = count * m_channels;
+    const uint8_t *pcm = data;
+    if (m_converter) {
+      // The input may not be float aligned.
+      memcpy(m_floatScratch.data(), data, samples * sizeof(float));
+      m_converter->convert(m_floatScratch.data(), samples, m_pcmScratch.data());
+      pcm = m_pcmScratch.data();
+    }
+
+    int32_t *dst = job.samples.data() + size_t(job.frames) * m_channels;
+    if (m_outputFormat == SampleFormat::Int16) {
+      for (size_t i = 0; i < samples; ++i) {
+        int16_t value;
+        memcpy(&value, pcm + 2 * i, 2);
+        dst[i] = value;
+      }
+    } else {
+      for (size_t i = 0; i < samples; ++i) {
+        const uint8_t *p = pcm + 3 * i;
+        dst[i] = static_cast<int32_t>(uint32_t(p[0]) << 8 |
+                                      uint32_t(p[1]) << 16 |
+                                      uint32_t(p[2]) << 24) >>
+                 8;
+      }
+    }
+
+    job.frames += static_cast<uint32_t>(count);
+    data += count * m_inputFrameBytes;
+    frames -= count;
+    if (job.frames == blockFrames)
+      submit();
+  }
+}
+
+FlacWriter::Job &FlacWriter::currentJob() {
+  if (m_submitted - m_written >= m_jobs.size()) {
+    ++m_stalls;
+    while (m_submitted - m_written >= m_jobs.size())
+      writeNext(true);
+  }
+  return m_jobs[m_submitted % m_jobs.size()];
+}
+
+void FlacWriter::submit() {
+  Job &job = m_jobs[m_submitted % m_jobs.size()];
+  job.number = m_submitted;
+  job.done = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_submitted;
+  }
+  m_queued.notify_one();
+  while (writeNext(false)) {
+  }
+}
+
+bool FlacWriter::writeNext(bool wait) {
+  Job *job;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_written == m_submitted)
+      return false;
+    job = &m_jobs[m_written % m_jobs.size()];
+    if (!job->done) {
+      if (!wait)
+        return false;
+      m_encoded.wait(lock, [job] { return job->done; });
+    }
+  }
+
+  m_output->append(job->encoded.data(), job->encodedSize);
+  uint32_t size = static_cast<uint32_t>(job->encodedSize);
+  m_info.minFrameBytes = std::min(m_info.minFrameBytes, size);
+  m_info.maxFrameBytes = std::max(m_info.maxFrameBytes, size);
+  m_bytesWritten += size;
+  m_framesWritten += job->frames;
+  job->frames = 0;
+  job->done = false;
+  ++m_written;
+  return true;
+}
+
+void FlacWriter::encodeLoop(FlacEncoder *encoder) {
+  // Encoding is background work: these threads keep normal priority even
+  // in real-time mode, so they never compete with capture.
+  Logger::instance().prepareThread();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  for (;;) {
+    m_queued.wait(lock, [this] { return m_stopping || m_taken < m_submitted; });
+    if (m_taken == m_submitted)
+      return;
+    Job &job = m_jobs[m_taken++ % m_jobs.size()];
+    lock.unlock();
+    job.encodedSize = encoder->encodeFrame(job.samples.data(), job.frames,
+                                           job.number, job.encoded.data());
+    lock.lock();
+    job.done = true;
+    m_encoded.notify_one();
+  }
+}
+
+void FlacWriter::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queued.notify_all();
+  for (std::thread &worker : m_workers)
+    worker.join();
+  m_workers.clear();
+}
+
+bool FlacWriter::flush() {
+  if (!m_isOpen)
+    return false;
+  while (writeNext(true)) {
+  }
+  return m_output->flush();
+}
+
+bool FlacWriter::finalize() {
+  if (!m_isOpen)
+    return false;
+
+  // A partial input frame left in the carry is dropped.
+  if (m_submitted - m_written < m_jobs.size() &&
+      m_jobs[m_submitted % m_jobs.size()].frames > 0)
+    submit();
+  while (writeNext(true)) {
+  }
+  stopWorkers();
+
+  if (m_info.minFrameBytes == UINT32_MAX)
+    m_info.minFrameBytes = 0;
+  m_info.totalFrames = m_framesWritten;
+  uint8_t info[FLAC_STREAMINFO_SIZE];
+  m_info.serialize(info);
+  bool ok = m_output->writeAt(FLAC_STREAMINFO_OFFSET, info, sizeof(info));
+  ok = m_output->close() && ok;
+  m_output.reset();
+  m_isOpen = false;
+  return ok;
+}
@@ -0,0 +1,362 @@
+#include "LevelMeter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define LEVEL_METER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#define POPCOUNT32(x) __popcnt(x)
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define POPCOUNT32(x) __builtin_popcount(x)
+#endif
+#endif
+
+double LevelSums::rms() const {
+  return samples ? std::sqrt(sumSquares / double(samples)) : 0.0;
+}
+
+namespace {
+
+inline int32_t loadSample(const uint8_t *p, SampleFormat format) {
+  switch (format) {
+  case SampleFormat::Int16: {
+    int16_t value;
+    memcpy(&value, p, 2);
+    return value;
+  }
+  case SampleFormat::Int24:
+    return static_cast<int32_t>(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 |
+                                uint32_t(p[2]) << 24) >>
+           8;
+  default: {
+    int32_t value;
+    memcpy(&value, p, 4);
+    return value;
+  }
+  }
+}
+
+// Integer formats: exact sums in 64 bits.
+template <SampleFormat Format>
+void measureIntScalar(const uint8_t *data, size_t samples, uint16_t channels,
+                      LevelSums *sums) {
+  constexpr size_t BYTES = Format == SampleFormat::Int16   ? 2
+                           : Format == SampleFormat::Int24 ? 3
+                                                           : 4;
+  constexpr double SCALE = Format == SampleFormat::Int16   ? 32768.0
+                           : Format == SampleFormat::Int24 ? 8388608.0
+                                                           : 2147483648.0;
+  // Squares of 32-bit samples would overflow; they are summed as doubles.
+  uint64_t squares = 0;
+  double wideSquares = 0.0;
+  int64_t peak = 0;
+  uint64_t crossings = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    int64_t value = loadSample(data + BYTES * i, Format);
+    if (Format == SampleFormat::Int32)
+      wideSquares += double(value) * double(value);
+    else
+      squares += uint64_t(value * value);
+    peak = std::max(peak, value < 0 ? -value : value);
+    if (i >= channels)
+      crossings += (value < 0) != (loadSample(data + BYTES * (i - channels),
+                                              Format) < 0);
+  }
+  sums->sumSquares += (double(squares) + wideSquares) / (SCALE * SCALE);
+  sums->peak = std::max(sums->peak, float(double(peak) / SCALE));
+  sums->zeroCrossings += crossings;
+}
+
+void measureFloatScalar(const uint8_t *data, size_t samples, uint16_t channels,
+                        LevelSums *sums) {
+  double squares = 0.0;
+  float peak = 0.0f;
+  uint64_t crossings = 0;
+  for (size_t i = 0; i < samples; ++i) {
+    float value;
+    memcpy(&value, data + 4 * i, 4);
+    squares += double(value) * value;
+    peak = std::max(peak, std::fabs(value));
+    if (i >= channels) {
+      float previous;
+      memcpy(&previous, data + 4 * (i - channels), 4);
+      crossings += std::signbit(value) != std::signbit(previous);
+    }
+  }
+  sums->sumSquares += squares;
+  sums->peak = std::max(sums->peak, peak);
+  sums->zeroCrossings += crossings;
+}
+
+#ifdef LEVEL_METER_X86
+
+// Each kernel compares sample i with sample i - channels, loaded as a second
+// unaligned vector, so any channel count works. The scalar kernel finishes
+// the tail.
+void measureInt16Sse2(const uint8_t *data, size_t samples, uint16_t channels,
+                      LevelSums *sums) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i squares = zero;
+  __m128i maxima = _mm_set1_epi16(0);
+  __m128i minima = _mm_set1_epi16(0);
+  uint64_t crossings = 0;
+  size_t i = channels;
+  // Sample 0..channels-1 have no predecessor here; add them separately.
+  measureIntScalar<SampleFormat::Int16>(data, std::min<size_t>(channels, samples),
+                                        channels, sums);
+  for (; i + 8 <= samples; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 2 * i));
+    __m128i p = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + 2 * (i - channels)));
+    // Pairs of squares fit in 32 bits unsigned.
+    __m128i pairs = _mm_madd_epi16(v, v);
+    squares = _mm_add_epi64(squares, _mm_unpacklo_epi32(pairs, zero));
+    squares = _mm_add_epi64(squares, _mm_unpackhi_epi32(pairs, zero));
+    maxima = _mm_max_epi16(maxima, v);
+    minima = _mm_min_epi16(minima, v);
+    __m128i signs = _mm_srai_epi16(_mm_xor_si128(v, p), 15);
+    crossings += POPCOUNT32(
+        unsigned(_mm_movemask_epi8(_mm_packs_epi16(signs, zero))));
+  }
+  alignas(16) uint64_t squareLanes[2];
+  alignas(16) int16_t maxLanes[8], minLanes[8];
+  _mm_store_si128(reinterpret_cast<__m128i *>(squareLanes), squares);
+  _mm_store_si128(reinterpret_cast<__m128i *>(maxLanes), maxima);
+  _mm_store_si128(reinterpret_cast<__m128i *>(minLanes), minima);
+  int32_t peak = 0;
+  for (int k = 0; k < 8; ++k)
+    peak = std::max({peak, int32_t(maxLanes[k]), -int32_t(minLanes[k])});
+  sums->sumSquares +=
+      double(squareLanes[0] + squareLanes[1]) / (32768.0 * 32768.0);
+  sums->peak = std::max(sums->peak, float(peak / 32768.0));
+  sums->zeroCrossings += crossings;
+
+  // The tail, with its predecessors.
+  if (i < samples) {
+    LevelSums tail;
+    measureIntScalar<SampleFormat::Int16>(data + 2 * (i - channels),
+                                          samples - i + channels, channels,
+                                          &tail);
+    LevelSums head;
+    measureIntScalar<SampleFormat::Int16>(data + 2 * (i - channels), channels,
+                                          channels, &head);
+    sums->sumSquares += tail.sumSquares - head.sumSquares;
+    sums->peak = std::max(sums->peak, tail.peak);
+    sums->zeroCrossings += tail.zeroCrossings;
+  }
+}
+
+void measureFloatSse2(const uint8_t *data, size_t samples, uint16_t channels,
+                      LevelSums *sums) {
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128d squares = _mm_setzero_pd();
+  __m128 peak = _mm_setzero_ps();
+  uint64_t crossings = 0;
+  measureFloatScalar(data, std::min<size_t>(channels, samples), channels, sums);
+  size_t i = channels;
+  for (; i + 4 <= samples; i += 4) {
+    __m128 v = _mm_loadu_ps(reinterpret_cast<const float *>(data + 4 * i));
+    __m128 p = _mm_loadu_ps(
+        reinterpret_cast<const float *>(data + 4 * (i - channels)));
+    __m128d lo = _mm_cvtps_pd(v);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+    squares = _mm_add_pd(squares, _mm_add_pd(_mm_mul_pd(lo, lo),
+                                             _mm_mul_pd(hi, hi)));
+    peak = _mm_max_ps(peak, _mm_and_ps(v, absMask));
+    crossings += POPCOUNT32(unsigned(_mm_movemask_ps(_mm_xor_ps(v, p))));
+  }
+  alignas(16) double squareLanes[2];
+  alignas(16) float peakLanes[4];
+  _mm_store_pd(squareLanes, squares);
+  _mm_store_ps(peakLanes, peak);
+  sums->sumSquares += squareLanes[0] + squareLanes[1];
+  sums->peak = std::max({sums->peak, peakLanes[0], peakLanes[1], peakLanes[2],
+                         peakLanes[3]});
+  sums->zeroCrossings += crossings;
+
+  if (i < samples) {
+    LevelSums tail;
+    measureFloatScalar(data + 4 * (i - channels), samples - i + channels,
+                       channels, &tail);
+    LevelSums head;
+    measureFloatScalar(data + 4 * (i - channels), channels, channels, &head);
+    sums->sumSquares += tail.sumSquares - head.sumSquares;
+    sums->peak = std::max(sums->peak, tail.peak);
+    sums->zeroCrossings += tail.zeroCrossings;
+  }
+}
+
+TARGET_AVX2 void measureInt16Avx2(const uint8_t *data, size_t samples,
+                                  uint16_t channels, LevelSums *sums) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i squares = zero;
+  __m256i maxima = zero;
+  __m256i minima = zero;
+  uint64_t crossings = 0;
+  size_t i = channels;
+  measureIntScalar<SampleFormat::Int16>(data, std::min<size_t>(channels, samples),
+                                        channels, sums);
+  for (; i + 16 <= samples; i += 16) {
+    __m256i v =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 2 * i));
+    __m256i p = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(data + 2 * (i - channels)));
+    __m256i pairs = _mm256_madd_epi16(v, v);
+    squares = _mm256_add_epi64(squares, _mm256_unpacklo_epi32(pairs, zero));
+    squares = _mm256_add_epi64(squares, _mm256_unpackhi_epi32(pairs, zero));
+    maxima = _mm256_max_epi16(maxima, v);
+    minima = _mm256_min_epi16(minima, v);
+    __m256i signs = _mm256_srai_epi16(_mm256_xor_si256(v, p), 15);
+    // Two sign bytes per sample.
+    crossings +=
+        POPCOUNT32(unsigned(_mm256_movemask_epi8(signs))) / 2;
+  }
+  alignas(32) uint64_t squareLanes[4];
+  alignas(32) int16_t maxLanes[16], minLanes[16];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(squareLanes), squares);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(maxLanes), maxima);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(minLanes), minima);
+  int32_t peak = 0;
+  for (int k = 0; k < 16; ++k)
+    peak = std::max({peak, int32_t(maxLanes[k]), -int32_t(minLanes[k])});
+  sums->sumSquares += double(squareLanes[0] + squareLanes[1] + squareLanes[2] +
+                             squareLanes[3]) /
+                      (32768.0 * 32768.0);
+  sums->peak = std::max(sums->peak, float(peak / 32768.0));
+  sums->zeroCrossings += crossings;
+
+  if (i < samples) {
+    LevelSums tail;
+    measureIntScalar<SampleFormat::Int16>(data + 2 * (i - channels),
+                                          samples - i + channels, channels,
+                                          &tail);
+    LevelSums head;
+    measureIntScalar<SampleFormat::Int16>(data + 2 * (i - channels), channels,
+                                          channels, &head);
+    sums->sumSquares += tail.sumSquares - head.sumSquares;
+    sums->peak = std::max(sums->peak, tail.peak);
+    sums->zeroCrossings += tail.zeroCrossings;
+  }
+}
+
+TARGET_AVX2 void measureFloatAvx2(const uint8_t *data, size_t samples,
+                                  uint16_t channels, LevelSums *sums) {
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256d squares = _mm256_setzero_pd();
+  __m256 peak = _mm256_setzero_ps();
+  uint64_t crossings = 0;
+  measureFloatScalar(data, std::min<size_t>(channels, samples), channels, sums);
+  size_t i = channels;
+  for (; i + 8 <= samples; i += 8) {
+    __m256 v = _mm256_loadu_ps(reinterpret_cast<const float *>(data + 4 * i));
+    __m256 p = _mm256_loadu_ps(
+        reinterpret_cast<const float *>(data + 4 * (i - channels)));
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+    squares = _mm256_add_pd(
+        squares, _mm256_add_pd(_mm256_mul_pd(lo, lo), _mm256_mul_pd(hi, hi)));
+    peak = _mm256_max_ps(peak, _mm256_and_ps(v, absMask));
+    crossings +=
+        POPCOUNT32(unsigned(_mm256_movemask_ps(_mm256_xor_ps(v, p))));
+  }
+  alignas(32) double squareLanes[4];
+  alignas(32) float peakLanes[8];
+  _mm256_store_pd(squareLanes, squares);
+  _mm256_store_ps(peakLanes, peak);
+  sums->sumSquares +=
+      squareLanes[0] + squareLanes[1] + squareLanes[2] + squareLanes[3];
+  for (float lane : peakLanes)
+    sums->peak = std::max(sums->peak, lane);
+  sums->zeroCrossings += crossings;
+
+  if (i < samples) {
+    LevelSums tail;
+    measureFloatScalar(data + 4 * (i - channels), samples - i + channels,
+                       channels, &tail);
+    LevelSums head;
+    measureFloatScalar(data + 4 * (i - channels), channels, channels, &head);
+    sums->sumSquares += tail.sumSquares - head.sumSquares;
+    sums->peak = std::max(sums->peak, tail.peak);
+    sums->zeroCrossings += tail.zeroCrossings;
+  }
+}
+
+#endif
+
+LevelMeter::Kernel selectKernel(SampleFormat format, SimdLevel level) {
+#ifdef LEVEL_METER_X86
+  bool avx2 = level == SimdLevel::Avx2 || level == SimdLevel::Avx512;
+  bool sse2 = avx2 || level == SimdLevel::Sse2;
+  if (format == SampleFormat::Int16 && sse2)
+    return avx2 ? measureInt16Avx2 : measureInt16Sse2;
+  if (format == SampleFormat::Float32 && sse2)
+    return avx2 ? measureFloatAvx2 : measureFloatSse2;
+#else
+  (void)level;
+#endif
+  switch (format) {
+  case SampleFormat::Int16:
+    return measureIntScalar<SampleFormat::Int16>;
+  case SampleFormat::Int24:
+    return measureIntScalar<SampleFormat::Int24>;
+  case SampleFormat::Int32:
+    return measureIntScalar<SampleFormat::Int32>;
+  case SampleFormat::Float32:
+    break;
+  }
+  return measureFloatScalar;
+}
+
+} // namespace
+
+LevelMeter::LevelMeter(SampleFormat format, uint16_t channels, SimdLevel level)
+    : m_format(format), m_channels(std::max<uint16_t>(channels, 1)),
+      m_frameBytes(
+          static_cast<uint16_t>(m_channels * bytesPerSample(format))),
+      m_level(level), m_lastFrame(m_frameBytes), m_haveLast(false) {
+  // Never run a kernel the CPU cannot execute; there is no AVX-512 kernel,
+  // and Int24/Int32 are scalar only.
+  SimdLevel supported = SampleConverter::detectSimdLevel();
+  if (static_cast<int>(m_level) > static_cast<int>(supported))
+    m_level = supported;
+  if (m_level == SimdLevel::Avx512)
+    m_level = SimdLevel::Avx2;
+  if (format == SampleFormat::Int24 || format == SampleFormat::Int32)
+    m_level = SimdLevel::Scalar;
+  m_kernel = selectKernel(format, m_level);
+}
+
+void LevelMeter::measure(const uint8_t *data, size_t frames, LevelSums &sums) {
+  if (frames == 0)
+    return;
+  if (m_haveLast) {
+    // Crossings between the previous call's last frame and this one's first.
+    uint16_t bytes = bytesPerSample(m_format);
+    for (uint16_t c = 0; c < m_channels; ++c) {
+      const uint8_t *previous = m_lastFrame.data() + c * bytes;
+      const uint8_t *current = data + c * bytes;
+      bool wasNegative, isNegative;
+      if (m_format == SampleFormat::Float32) {
+        float a, b;
+        memcpy(&a, previous, 4);
+        memcpy(&b, current, 4);
+        wasNegative = std::signbit(a);
+        isNegative = std::signbit(b);
+      } else {
+        wasNegative = loadSample(previous, m_format) < 0;
+        isNegative = loadSample(current, m_format) < 0;
+      }
+      sums.zeroCrossings += wasNegative != isNegative;
+    }
+  }
+  m_kernel(data, frames * m_channels, m_channels, &sums);
+  sums.samples += frames * m_channels;
+  memcpy(m_lastFrame.data(), data + (frames - 1) * m_frameBytes, m_frameBytes);
+  m_haveLast = true;
+}
@@ -0,0 +1,218 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+struct RecordHeader {
+  int64_t timeNs;
+  uint16_t length;
+  LogLevel level;
+};
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Records are pushed whole, so once a header is readable its text is too;
+// it may still wrap around the end of the ring.
+void readBytes(SpscRingBuffer &ring, void *out, size_t size) {
+  uint8_t *dst = static_cast<uint8_t *>(out);
+  while (size > 0) {
+    const uint8_t *data = nullptr;
+    size_t chunk = std::min(ring.peek(&data), size);
+    memcpy(dst, data, chunk);
+    ring.consume(chunk);
+    dst += chunk;
+    size -= chunk;
+  }
+}
+
+} // namespace
+
+struct Logger::ThreadBuffer {
+  ThreadBuffer() : ring(THREAD_BUFFER_SIZE) {}
+
+  SpscRingBuffer ring;
+  // Set when the owning thread exits; the buffer is freed once drained.
+  std::atomic<bool> retired{false};
+};
+
+namespace {
+
+struct ThreadHandle {
+  Logger::ThreadBuffer *buffer = nullptr;
+  ~ThreadHandle() {
+    if (buffer)
+      buffer->retired.store(true, std::memory_order_release);
+  }
+};
+
+thread_local ThreadHandle t_handle;
+
+} // namespace
+
+Logger &Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger() : m_info(stdout), m_error(stderr) {
+  m_thread = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+  m_running = false;
+  m_wake.signal();
+  m_thread.join();
+}
+
+void Logger::setOutput(FILE *info, FILE *error) {
+  m_info.store(info ? info : stdout);
+  m_error.store(error ? error : stderr);
+}
+
+Logger::ThreadBuffer *Logger::threadBuffer() {
+  if (!t_handle.buffer) {
+    auto buffer = std::make_unique<ThreadBuffer>();
+    t_handle.buffer = buffer.get();
+    std::lock_guard<std::mutex> lock(m_buffersMutex);
+    m_buffers.push_back(std::move(buffer));
+  }
+  return t_handle.buffer;
+}
+
+void Logger::prepareThread() { threadBuffer(); }
+
+void Logger::submit(LogLevel level, const char *text, size_t length) {
+  length = std::min(length, MAX_MESSAGE);
+  uint8_t record[sizeof(RecordHeader) + MAX_MESSAGE];
+  RecordHeader header = {nowNs(), static_cast<uint16_t>(length), level};
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), text, length);
+
+  SpscRingBuffer &ring = threadBuffer()->ring;
+  if (!ring.push(record, sizeof(header) + length)) {
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  m_submitted.fetch_add(1, std::memory_order_relaxed);
+  if (ring.readAvailable() < ring.capacity() / 2)
+    return;
+
+  // Same handshake as DiskWriter: only wake the writer if it is asleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed))
+    m_wake.signal();
+}
+
+void Logger::flush() {
+  uint64_t target = m_submitted.load();
+  while (m_written.load() < target && m_running) {
+    m_wake.signal();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Logger::run() {
+  while (true) {
+    size_t count = collect();
+    if (count > 0) {
+      write(count);
+      continue;
+    }
+    if (!m_running)
+      break;
+
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (collect() == 0 && m_running)
+      m_wake.wait(FLUSH_INTERVAL_MS);
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+size_t Logger::collect() {
+  size_t count = 0;
+  std::lock_guard<std::mutex> lock(m_buffersMutex);
+  for (auto it = m_buffers.begin(); it != m_buffers.end();) {
+    ThreadBuffer &buffer = **it;
+    // Check before draining so a line pushed just before retirement is
+    // still picked up.
+    bool retired = buffer.retired.load(std::memory_order_acquire);
+
+    while (buffer.ring.readAvailable() >= sizeof(RecordHeader)) {
+      RecordHeader header;
+      readBytes(buffer.ring, &header, sizeof(header));
+      Pending line;
+      line.timeNs = header.timeNs;
+      line.level = header.level;
+      line.text.resize(header.length);
+      readBytes(buffer.ring, &line.text[0], header.length);
+      m_pending.push_back(std::move(line));
+      ++count;
+    }
+
+    if (retired)
+      it = m_buffers.erase(it);
+    else
+      ++it;
+  }
+  return count;
+}
+
+void Logger::write(size_t count) {
+  std::stable_sort(m_pending.begin(), m_pending.end(),
+                   [](const Pending &a, const Pending &b) {
+                     return a.timeNs < b.timeNs;
+                   });
+
+  FILE *info = m_info.load();
+  FILE *error = m_error.load();
+  for (const Pending &line : m_pending) {
+    FILE *stream = line.level >= LogLevel::Warning ? error : info;
+    fwrite(line.text.data(), 1, line.text.size(), stream);
+    fputc('\n', stream);
+  }
+  fflush(info);
+  fflush(error);
+  m_pending.clear();
+  m_written.fetch_add(count);
+}
+
+bool LogRateLimiter::allow(uint32_t intervalMs) {
+  int64_t now = nowNs();
+  int64_t next = m_nextNs.load(std::memory_order_relaxed);
+  if (now >= next &&
+      m_nextNs.compare_exchange_strong(
+          next, now + static_cast<int64_t>(intervalMs) * 1000000,
+          std::memory_order_relaxed))
+    return true;
+
+  m_suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+LogLine::~LogLine() {
+  if (m_limiter) {
+    uint64_t suppressed = m_limiter->takeSuppressed();
+    if (suppressed > 0)
+      *this << " (" << static_cast<unsigned long long>(suppressed)
+            << " similar lines suppressed)";
+  }
+  Logger::instance().submit(m_level, m_text, m_length);
+}
+
+LogLine &LogLine::operator<<(const char *text) {
+  return append(text, text ? strlen(text) : 0);
+}
+
+LogLine &LogLine::append(const char *text, size_t length) {
+  length = std::min(length, Logger::MAX_MESSAGE - m_length);
+  memcpy(m_text + m_length, text, length);
+  m_length += length;
+  return *this;
+}
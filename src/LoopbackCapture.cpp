@@ -1,12 +1,18 @@
 #include "LoopbackCapture.h"
+#include "DiskWriter.h"
+#include "FlacWriter.h"
+#include "Logger.h"
+#include "Realtime.h"
 #include "Utils.h"
 #include "WavWriter.h"
-#include <iostream>
+#include <algorithm>
+#include <memory>
 #include <thread>
 
 #ifdef PLATFORM_WINDOWS
 
 #include <functiondiscoverykeys_devpkey.h>
+#include <mmreg.h>
 #include <windows.h>
 
 LoopbackCapture::LoopbackCapture(const std::string &outputFile)
@@ -14,120 +20,179 @@ LoopbackCapture::LoopbackCapture(const std::string &outputFile)
 
 LoopbackCapture::~LoopbackCapture() { stop(); }
 
+void LoopbackCapture::setOutputFormat(SampleFormat format, bool dither) {
+  m_outputFormat = format;
+  m_dither = dither;
+}
+
+void LoopbackCapture::setOutputRate(uint32_t sampleRate, bool mono) {
+  m_outputRate = sampleRate;
+  m_mono = mono;
+}
+
+void LoopbackCapture::setFlacOutput(const FlacWriterOptions &options) {
+  m_flac = true;
+  m_flacOptions = options;
+}
+
+void LoopbackCapture::setDriftCorrection(bool enabled,
+                                         const ClockTracker *reference) {
+  m_driftCorrection = enabled;
+  m_referenceClock = reference;
+}
+
+SampleFormat LoopbackCapture::mixSampleFormat() const {
+  if (m_waveFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT)
+    return SampleFormat::Float32;
+
+  if (m_waveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+    // KSDATAFORMAT_SUBTYPE_* GUIDs carry the plain format tag in Data1.
+    auto *ext = reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(m_waveFormat);
+    if (ext->SubFormat.Data1 == WAVE_FORMAT_IEEE_FLOAT)
+      return SampleFormat::Float32;
+  }
+  return pcmFormatForBits(m_waveFormat->wBitsPerSample);
+}
+
 bool LoopbackCapture::initialize() {
-  std::cout << "[LoopbackCapture] Initializing COM..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Initializing COM...";
   HRESULT hr;
 
   hr = CoInitialize(nullptr);
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: CoInitialize failed with HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+    LOG_ERROR
+        << "[LoopbackCapture] ERROR: CoInitialize failed with HRESULT: 0x"
+        << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] COM initialized successfully" << std::endl;
+  LOG_INFO << "[LoopbackCapture] COM initialized successfully";
 
-  std::cout << "[LoopbackCapture] Creating device enumerator..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Creating device enumerator...";
   IMMDeviceEnumerator *enumerator = nullptr;
   hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL,
                         __uuidof(IMMDeviceEnumerator), (void **)&enumerator);
   if (FAILED(hr)) {
-    std::cerr
+    LOG_ERROR
         << "[LoopbackCapture] ERROR: CoCreateInstance failed with HRESULT: 0x"
-        << std::hex << hr << std::dec << std::endl;
+        << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Device enumerator created" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Device enumerator created";
 
-  std::cout << "[LoopbackCapture] Getting default audio endpoint..."
-            << std::endl;
+  LOG_INFO << "[LoopbackCapture] Getting default audio endpoint...";
   hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &m_device);
   enumerator->Release();
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: GetDefaultAudioEndpoint failed with "
+    LOG_ERROR << "[LoopbackCapture] ERROR: GetDefaultAudioEndpoint failed with "
                  "HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+              << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Default audio endpoint obtained" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Default audio endpoint obtained";
 
-  std::cout << "[LoopbackCapture] Activating audio client..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Activating audio client...";
   hr = m_device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr,
                           (void **)&m_audioClient);
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: Activate failed with HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+    LOG_ERROR << "[LoopbackCapture] ERROR: Activate failed with HRESULT: 0x"
+              << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Audio client activated" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Audio client activated";
 
-  std::cout << "[LoopbackCapture] Getting mix format..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Getting mix format...";
   hr = m_audioClient->GetMixFormat(&m_waveFormat);
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: GetMixFormat failed with HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+    LOG_ERROR
+        << "[LoopbackCapture] ERROR: GetMixFormat failed with HRESULT: 0x"
+        << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Mix format: " << m_waveFormat->nChannels
-            << " channels, " << m_waveFormat->nSamplesPerSec << " Hz, "
-            << m_waveFormat->wBitsPerSample << " bits" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Mix format: " << m_waveFormat->nChannels
+           << " channels, " << m_waveFormat->nSamplesPerSec << " Hz, "
+           << m_waveFormat->wBitsPerSample << " bits";
+
+  LOG_INFO << "[LoopbackCapture] Initializing audio client in loopback mode...";
+  hr = m_audioClient->Initialize(
+      AUDCLNT_SHAREMODE_SHARED,
+      AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK, 0, 0,
+      m_waveFormat, nullptr);
+  if (FAILED(hr)) {
+    LOG_ERROR << "[LoopbackCapture] ERROR: Initialize failed with HRESULT: 0x"
+              << logHex(hr);
+    return false;
+  }
+  LOG_INFO << "[LoopbackCapture] Audio client initialized in loopback mode";
 
-  std::cout << "[LoopbackCapture] Initializing audio client in loopback mode..."
-            << std::endl;
-  hr = m_audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED,
-                                 AUDCLNT_STREAMFLAGS_LOOPBACK, 0, 0,
-                                 m_waveFormat, nullptr);
+  m_captureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+  if (!m_captureEvent) {
+    LOG_ERROR << "[LoopbackCapture] ERROR: CreateEvent failed: "
+              << Utils::getLastErrorString();
+    return false;
+  }
+  hr = m_audioClient->SetEventHandle(m_captureEvent);
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: Initialize failed with HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+    LOG_ERROR
+        << "[LoopbackCapture] ERROR: SetEventHandle failed with HRESULT: 0x"
+        << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Audio client initialized in loopback mode"
-            << std::endl;
 
-  std::cout << "[LoopbackCapture] Getting capture client service..."
-            << std::endl;
+  // Two device periods: normally the event fires first.
+  REFERENCE_TIME defaultPeriod = 0;
+  if (SUCCEEDED(m_audioClient->GetDevicePeriod(&defaultPeriod, nullptr)) &&
+      defaultPeriod > 0) {
+    m_waitTimeoutMs = static_cast<DWORD>(defaultPeriod * 2 / 10000);
+  }
+
+  LOG_INFO << "[LoopbackCapture] Getting capture client service...";
   hr = m_audioClient->GetService(__uuidof(IAudioCaptureClient),
                                  (void **)&m_captureClient);
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: GetService failed with HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+    LOG_ERROR << "[LoopbackCapture] ERROR: GetService failed with HRESULT: 0x"
+              << logHex(hr);
     return false;
   }
-  std::cout << "[LoopbackCapture] Capture client service obtained" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Capture client service obtained";
 
   return true;
 }
 
 bool LoopbackCapture::start() {
-  std::cout << "[LoopbackCapture] Starting speaker capture..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Starting speaker capture...";
   Utils::createDirectory("output");
 
   if (!initialize()) {
-    std::cerr << "[LoopbackCapture] ERROR: Loopback initialization failed!"
-              << std::endl;
+    LOG_ERROR << "[LoopbackCapture] ERROR: Loopback initialization failed!";
     return false;
   }
 
-  std::cout << "[LoopbackCapture] Starting audio client..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Starting audio client...";
   HRESULT hr = m_audioClient->Start();
   if (FAILED(hr)) {
-    std::cerr << "[LoopbackCapture] ERROR: Audio client Start() failed with "
+    LOG_ERROR << "[LoopbackCapture] ERROR: Audio client Start() failed with "
                  "HRESULT: 0x"
-              << std::hex << hr << std::dec << std::endl;
+              << logHex(hr);
     return false;
   }
 
-  std::cout << "[LoopbackCapture] Creating capture thread..." << std::endl;
+  LOG_INFO << "[LoopbackCapture] Creating capture thread...";
   m_running = true;
-  std::thread(&LoopbackCapture::captureLoop, this).detach();
+  m_thread = std::thread(&LoopbackCapture::captureLoop, this);
 
-  std::cout << "[LoopbackCapture] Speaker capture started successfully!"
-            << std::endl;
+  LOG_INFO << "[LoopbackCapture] Speaker capture started successfully!";
   return true;
 }
 
 void LoopbackCapture::stop() {
   m_running = false;
+  // Wake the loop rather than wait out its timeout, and let it flush and
+  // finalize the file before the client, event and format go away.
+  if (m_thread.joinable()) {
+    if (m_captureEvent)
+      SetEvent(m_captureEvent);
+    m_thread.join();
+  }
 
   if (m_audioClient) {
     m_audioClient->Stop();
@@ -150,26 +215,94 @@ void LoopbackCapture::stop() {
     m_waveFormat = nullptr;
   }
 
+  if (m_captureEvent) {
+    CloseHandle(m_captureEvent);
+    m_captureEvent = nullptr;
+  }
+
   CoUninitialize();
 }
 
 void LoopbackCapture::captureLoop() {
-  std::cout << "[LoopbackCapture] Capture loop started" << std::endl;
-
-  WavWriter writer(m_outputFile, m_waveFormat->nSamplesPerSec,
-                   m_waveFormat->nChannels, m_waveFormat->wBitsPerSample);
+  Logger::instance().prepareThread();
+  Realtime::prepareThread(ThreadRole::Capture);
+  LOG_INFO << "[LoopbackCapture] Capture loop started";
+
+  SampleFormat inputFormat = mixSampleFormat();
+  WavWriterOptions options;
+  if (isFloatFormat(inputFormat)) {
+    options.outputFormat = m_outputFormat;
+    options.dither = m_dither;
+  }
+  options.sampleRate = m_outputRate;
+  options.mono = m_mono;
+  options.encoding = m_encoding;
+  if (m_driftCorrection) {
+    options.clock = &m_clock;
+    options.referenceClock = m_referenceClock;
+  }
+  m_clock.reset(m_waveFormat->nSamplesPerSec);
+
+  const uint32_t sampleRate = m_waveFormat->nSamplesPerSec;
+  const uint16_t channels = m_waveFormat->nChannels;
+  const uint16_t frameBytes = m_waveFormat->nBlockAlign;
+  if (m_segmented) {
+    double seconds = m_segmentOptions.maxSeconds;
+    if (m_segmentOptions.maxBytes > 0) {
+      double bySize =
+          double(m_segmentOptions.maxBytes) / (double(sampleRate) * frameBytes);
+      seconds = seconds > 0.0 ? std::min(seconds, bySize) : bySize;
+    }
+    options.reserveSeconds = seconds;
+  }
+  FlacWriterOptions flacOptions = m_flacOptions;
+  if (isFloatFormat(inputFormat) && !flacOptions.outputFormat) {
+    flacOptions.outputFormat = m_outputFormat;
+    flacOptions.dither = m_dither;
+  }
+  bool flac = m_flac;
+  auto open = [=](const std::string &path) -> std::unique_ptr<AudioSink> {
+    if (flac)
+      return std::unique_ptr<AudioSink>(new FlacWriter(
+          path, sampleRate, channels, inputFormat, flacOptions));
+    return std::unique_ptr<AudioSink>(
+        new WavWriter(path, sampleRate, channels, inputFormat, options));
+  };
+
+  std::unique_ptr<AudioSink> writer;
+  if (m_combined)
+    writer = m_combined->createInput(m_combinedGroup, sampleRate, channels,
+                                     inputFormat);
+  else if (m_segmented)
+    writer.reset(new SegmentedSink(m_outputFile, sampleRate, frameBytes,
+                                   m_segmentOptions, open));
+  else
+    writer = open(m_outputFile);
+
+  if (!writer->initialize()) {
+    LOG_ERROR << "[LoopbackCapture] ERROR: Failed to initialize writer!";
+    return;
+  }
 
-  if (!writer.initialize()) {
-    std::cerr << "[LoopbackCapture] ERROR: Failed to initialize WAV writer!"
-              << std::endl;
+  DiskWriter diskWriter(writer.get(), m_bufferConfig);
+  diskWriter.setMetrics(&m_metrics);
+  diskWriter.setClock(&m_clock);
+  for (const auto &subscriber : m_subscribers)
+    diskWriter.addSubscriber(subscriber);
+  if (!diskWriter.start()) {
+    LOG_ERROR << "[LoopbackCapture] ERROR: Failed to start disk writer thread!";
     return;
   }
 
-  std::cout << "[LoopbackCapture] WAV writer initialized, starting capture..."
-            << std::endl;
+  LOG_INFO << "[LoopbackCapture] Writer initialized, starting capture...";
 
-  int captureCount = 0;
   while (m_running) {
+    // Sleep until the engine has a period ready, then drain everything it
+    // holds in one pass.
+    if (WaitForSingleObject(m_captureEvent, m_waitTimeoutMs) == WAIT_FAILED)
+      break;
+    int64_t wakeTime = metricsNowNs();
+
     UINT32 packetLength = 0;
     HRESULT hr = m_captureClient->GetNextPacketSize(&packetLength);
     if (FAILED(hr))
@@ -179,35 +312,46 @@ void LoopbackCapture::captureLoop() {
       BYTE *data;
       UINT32 frames;
       DWORD flags;
+      UINT64 devicePosition = 0;
+      UINT64 qpcPosition = 0;
 
-      hr = m_captureClient->GetBuffer(&data, &frames, &flags, nullptr, nullptr);
+      hr = m_captureClient->GetBuffer(&data, &frames, &flags, &devicePosition,
+                                      &qpcPosition);
       if (FAILED(hr))
         break;
 
-      if (!(flags & AUDCLNT_BUFFERFLAGS_SILENT)) {
-        writer.write(data, frames * m_waveFormat->nBlockAlign);
-
-        if (captureCount % 100 ==
-            0) { // Print every 100th capture to avoid spam
-          std::cout << "[LoopbackCapture] Capturing audio... (packet #"
-                    << captureCount << ", " << frames << " frames)"
-                    << std::endl;
-        }
-        captureCount++;
+      // The QPC position is in 100 ns units, the same timeline as
+      // steady_clock; a timestamp error leaves the packet unstamped.
+      BlockTimestamp time;
+      if (!(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR)) {
+        time.position = devicePosition;
+        time.hostTimeNs = static_cast<int64_t>(qpcPosition) * 100;
       }
 
+      // Silent packets keep their place on the timeline but are stored as
+      // holes; |data| may not even hold zeros.
+      uint32_t bytes = frames * m_waveFormat->nBlockAlign;
+      bool silent = (flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+      if (silent)
+        diskWriter.pushSilence(bytes, time);
+      else
+        diskWriter.push(data, bytes, time);
+      if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)
+        m_metrics.recordDiscontinuity();
+      m_metrics.recordPacket(frames, bytes, silent);
+
       m_captureClient->ReleaseBuffer(frames);
       hr = m_captureClient->GetNextPacketSize(&packetLength);
       if (FAILED(hr))
         break;
     }
-
-    Utils::sleep(5);
+    m_metrics.recordCallback(metricsNowNs() - wakeTime);
   }
 
-  std::cout << "[LoopbackCapture] Finalizing WAV file..." << std::endl;
-  writer.finalize();
-  std::cout << "[LoopbackCapture] Capture loop finished" << std::endl;
+  LOG_INFO << "[LoopbackCapture] Finalizing output file...";
+  diskWriter.stop();
+  writer->finalize();
+  LOG_INFO << "[LoopbackCapture] Capture loop finished";
 }
 
 #endif
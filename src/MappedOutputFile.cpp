@@ -0,0 +1,186 @@
+#include "MappedOutputFile.h"
+#include "Logger.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedOutputFile::MappedOutputFile(const MappedOutputOptions &options)
+    : m_options(options) {
+  m_pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  m_options.windowSize =
+      std::max(m_pageSize, (m_options.windowSize + m_pageSize - 1) /
+                               m_pageSize * m_pageSize);
+  m_options.extentSize =
+      std::max<uint64_t>(m_options.extentSize, m_options.windowSize);
+}
+
+MappedOutputFile::~MappedOutputFile() { close(); }
+
+bool MappedOutputFile::open(const std::string &path) {
+  m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (m_fd < 0)
+    return false;
+
+  m_size = 0;
+  m_reserved = 0;
+  if (!mapWindow(0)) {
+    close();
+    return false;
+  }
+
+  m_headerPage = static_cast<uint8_t *>(mmap(
+      nullptr, m_pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0));
+  if (m_headerPage == MAP_FAILED) {
+    m_headerPage = nullptr;
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool MappedOutputFile::reserveTo(uint64_t end) {
+  if (end <= m_reserved)
+    return true;
+
+  uint64_t target = (end + m_options.extentSize - 1) / m_options.extentSize *
+                    m_options.extentSize;
+  // Every mapped page must have disk blocks behind it: a store into a
+  // sparse page the filesystem cannot back raises SIGBUS. posix_fallocate()
+  // writes the extent out where fallocate() is unsupported; if neither
+  // works, mapped mode is refused rather than falling back to ftruncate().
+  int err = posix_fallocate(m_fd, static_cast<off_t>(m_reserved),
+                            static_cast<off_t>(target - m_reserved));
+  if (err != 0) {
+    LOG_ERROR << "[MappedOutputFile] ERROR: cannot reserve file space: "
+              << strerror(err);
+    return false;
+  }
+
+  m_reserved = target;
+  return true;
+}
+
+bool MappedOutputFile::reserve(uint64_t size) {
+  return m_fd >= 0 &&
+         fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+}
+
+bool MappedOutputFile::mapWindow(uint64_t offset) {
+  unmapWindow();
+
+  // Space skipped by a hole is not reserved.
+  m_reserved = std::max(m_reserved,
+                        offset / m_options.extentSize * m_options.extentSize);
+  if (!reserveTo(offset + m_options.windowSize))
+    return false;
+
+  void *window =
+      mmap(nullptr, m_options.windowSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+           m_fd, static_cast<off_t>(offset));
+  if (window == MAP_FAILED)
+    return false;
+
+  madvise(window, m_options.windowSize, MADV_SEQUENTIAL);
+  m_window = static_cast<uint8_t *>(window);
+  m_windowOffset = offset;
+  return true;
+}
+
+void MappedOutputFile::unmapWindow() {
+  if (!m_window)
+    return;
+
+  // Start writeback of the finished window without waiting for it.
+  msync(m_window, m_options.windowSize, MS_ASYNC);
+  munmap(m_window, m_options.windowSize);
+  m_window = nullptr;
+}
+
+bool MappedOutputFile::append(const uint8_t *data, size_t size) {
+  if (m_fd < 0 || !m_window)
+    return false;
+
+  while (size > 0) {
+    uint64_t windowEnd = m_windowOffset + m_options.windowSize;
+    if (m_size == windowEnd && !mapWindow(windowEnd))
+      return false;
+
+    size_t chunk = static_cast<size_t>(
+        std::min<uint64_t>(size, m_windowOffset + m_options.windowSize - m_size));
+    memcpy(m_window + (m_size - m_windowOffset), data, chunk);
+    m_size += chunk;
+    data += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+bool MappedOutputFile::appendZeros(uint64_t size) {
+  if (m_fd < 0 || !m_window)
+    return false;
+
+  uint64_t end = m_size + size;
+  uint64_t holeStart = (m_size + m_pageSize - 1) / m_pageSize * m_pageSize;
+  uint64_t holeEnd = std::min(end / m_pageSize * m_pageSize, m_reserved);
+  if (holeEnd >= holeStart + MIN_HOLE_BYTES) {
+    // Best effort: if the filesystem cannot punch, the space stays
+    // allocated but still reads as zeros.
+    fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              static_cast<off_t>(holeStart),
+              static_cast<off_t>(holeEnd - holeStart));
+  }
+
+  m_size = end;
+  if (m_size > m_windowOffset + m_options.windowSize)
+    return mapWindow(m_size / m_pageSize * m_pageSize);
+  return true;
+}
+
+bool MappedOutputFile::writeAt(uint64_t offset, const uint8_t *data,
+                               size_t size) {
+  if (m_fd < 0 || offset + size > m_size)
+    return false;
+
+  if (m_headerPage && offset + size <= m_pageSize) {
+    memcpy(m_headerPage + offset, data, size);
+    return true;
+  }
+  if (m_window && offset >= m_windowOffset) {
+    memcpy(m_window + (offset - m_windowOffset), data, size);
+    return true;
+  }
+  return pwrite(m_fd, data, size, static_cast<off_t>(offset)) ==
+         static_cast<ssize_t>(size);
+}
+
+bool MappedOutputFile::flush() {
+  // Mapped pages are already part of the file; nothing is buffered in user
+  // space.
+  return m_fd >= 0;
+}
+
+bool MappedOutputFile::close() {
+  if (m_fd < 0)
+    return true;
+
+  unmapWindow();
+  if (m_headerPage) {
+    munmap(m_headerPage, m_pageSize);
+    m_headerPage = nullptr;
+  }
+
+  // Give back the unused part of the last reserved extent.
+  bool ok = ftruncate(m_fd, static_cast<off_t>(m_size)) == 0;
+  if (::close(m_fd) != 0)
+    ok = false;
+  m_fd = -1;
+  return ok;
+}
+
+#endif
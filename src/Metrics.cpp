@@ -0,0 +1,126 @@
+#include "Metrics.h"
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned highestBit(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return index;
+#else
+  return 63 - __builtin_clzll(value);
+#endif
+}
+
+unsigned LatencyHistogram::bucketIndex(uint64_t value) {
+  if (value < SUB_BUCKETS)
+    return static_cast<unsigned>(value);
+
+  unsigned exponent = highestBit(value);
+  if (exponent > MAX_EXPONENT)
+    return BUCKET_COUNT - 1;
+  // The SUB_BUCKET_BITS bits below the leading one pick the sub-bucket.
+  unsigned shift = exponent - SUB_BUCKET_BITS;
+  unsigned sub = static_cast<unsigned>(value >> shift) - SUB_BUCKETS;
+  return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(unsigned index) {
+  if (index < SUB_BUCKETS)
+    return index;
+
+  unsigned shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+  uint64_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t valueNs) {
+  uint64_t value = valueNs > 0 ? static_cast<uint64_t>(valueNs) : 0;
+  m_buckets[bucketIndex(value)].add();
+  m_count.add();
+  m_sum.add(value);
+  m_max.raise(value);
+}
+
+double LatencyHistogram::meanNs() const {
+  uint64_t count = m_count.value();
+  return count ? static_cast<double>(m_sum.value()) / count : 0.0;
+}
+
+uint64_t LatencyHistogram::quantileNs(double quantile) const {
+  // Sum the buckets rather than trusting m_count, which a concurrent writer
+  // may have bumped ahead of them.
+  uint64_t total = 0;
+  for (const MetricCounter &bucket : m_buckets)
+    total += bucket.value();
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(quantile * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < BUCKET_COUNT; ++i) {
+    seen += m_buckets[i].value();
+    if (seen >= rank) {
+      uint64_t bound = bucketUpperBound(i);
+      uint64_t max = m_max.value();
+      return bound < max ? bound : max;
+    }
+  }
+  return m_max.value();
+}
+
+std::string LatencyHistogram::toJson() const {
+  char buffer[256];
+  snprintf(buffer, sizeof(buffer),
+           "{\"count\": %llu, \"mean_us\": %.3f, \"p50_us\": %.3f, "
+           "\"p90_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, "
+           "\"max_us\": %.3f}",
+           static_cast<unsigned long long>(count()), meanNs() / 1000.0,
+           quantileNs(0.50) / 1000.0, quantileNs(0.90) / 1000.0,
+           quantileNs(0.99) / 1000.0, quantileNs(0.999) / 1000.0,
+           maxNs() / 1000.0);
+  return buffer;
+}
+
+std::string StreamMetrics::toJsonFields() const {
+  char buffer[768];
+  snprintf(buffer, sizeof(buffer),
+           "\"frames\": %llu, \"bytes\": %llu, \"packets\": %llu, "
+           "\"silent_packets\": %llu, \"discontinuities\": %llu, "
+           "\"bytes_written\": %llu, \"overruns\": %llu, "
+           "\"dropped_bytes\": %llu, \"ring_high_water\": %llu, "
+           "\"pool_blocks\": %llu, \"pool_bytes\": %llu, "
+           "\"pool_shortfall_blocks\": %llu",
+           static_cast<unsigned long long>(m_frames.value()),
+           static_cast<unsigned long long>(m_bytes.value()),
+           static_cast<unsigned long long>(m_packets.value()),
+           static_cast<unsigned long long>(m_silentPackets.value()),
+           static_cast<unsigned long long>(m_discontinuities.value()),
+           static_cast<unsigned long long>(m_bytesWritten.value()),
+           static_cast<unsigned long long>(m_overruns.value()),
+           static_cast<unsigned long long>(m_droppedBytes.value()),
+           static_cast<unsigned long long>(m_ringHighWater.value()),
+           static_cast<unsigned long long>(m_poolBlocks.value()),
+           static_cast<unsigned long long>(m_poolBytes.value()),
+           static_cast<unsigned long long>(m_poolShortfall.value()));
+
+  std::string json = buffer;
+  if (m_voiceFrames.value() > 0) {
+    snprintf(buffer, sizeof(buffer),
+             ", \"voice\": {\"rms_db\": %.1f, \"peak_db\": %.1f, "
+             "\"speech\": %s, \"speech_frames\": %llu, "
+             "\"speech_segments\": %llu}",
+             m_levelRmsDb.load(std::memory_order_relaxed),
+             m_levelPeakDb.load(std::memory_order_relaxed),
+             m_speech.value() ? "true" : "false",
+             static_cast<unsigned long long>(m_speechFrames.value()),
+             static_cast<unsigned long long>(m_speechSegments.value()));
+    json += buffer;
+  }
+  json += ", \"callback_duration\": " + m_callback.toJson();
+  json += ", \"capture_to_disk_latency\": " + m_captureToDisk.toJson();
+  return json;
+}
@@ -0,0 +1,184 @@
+#include "MetricsReporter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#ifdef PLATFORM_LINUX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+MetricsReporter::MetricsReporter(const MetricsReporterOptions &options)
+    : m_options(options), m_startNs(metricsNowNs()), m_running(false),
+      m_listenFd(-1) {
+  if (m_options.intervalMs == 0)
+    m_options.intervalMs = 1000;
+}
+
+MetricsReporter::~MetricsReporter() { stop(); }
+
+void MetricsReporter::add(const std::string &name,
+                          const StreamMetrics *metrics) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_streams.emplace_back(name, metrics);
+}
+
+void MetricsReporter::remove(const StreamMetrics *metrics) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_streams.erase(std::remove_if(m_streams.begin(), m_streams.end(),
+                                 [metrics](const auto &entry) {
+                                   return entry.second == metrics;
+                                 }),
+                  m_streams.end());
+}
+
+bool MetricsReporter::start() {
+  if (m_running)
+    return false;
+
+  if (!m_options.socketPath.empty() && !openSocket())
+    return false;
+
+  m_running = true;
+  m_thread = std::thread(&MetricsReporter::run, this);
+  return true;
+}
+
+void MetricsReporter::stop() {
+  if (!m_running)
+    return;
+
+  m_running = false;
+  m_stop.signal();
+  m_thread.join();
+  writeFile(snapshot());
+
+#ifdef PLATFORM_LINUX
+  if (m_listenFd >= 0) {
+    ::close(m_listenFd);
+    m_listenFd = -1;
+    unlink(m_options.socketPath.c_str());
+  }
+#endif
+}
+
+std::string MetricsReporter::snapshot() const {
+  char header[128];
+  snprintf(header, sizeof(header),
+           "{\n  \"timestamp\": %lld,\n  \"uptime_s\": %.3f,\n"
+           "  \"streams\": [",
+           static_cast<long long>(time(nullptr)),
+           (metricsNowNs() - m_startNs) / 1e9);
+
+  std::string json = header;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < m_streams.size(); ++i) {
+    json += i ? ",\n" : "\n";
+    json += "    {\"name\": \"" + m_streams[i].first + "\", " +
+            m_streams[i].second->toJsonFields() + "}";
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+void MetricsReporter::writeFile(const std::string &json) const {
+  if (m_options.filePath.empty())
+    return;
+
+  // Readers never see a half-written file.
+  std::string tempPath = m_options.filePath + ".tmp";
+  FILE *file = fopen(tempPath.c_str(), "wb");
+  if (!file) {
+    LOG_ERROR << "[MetricsReporter] ERROR: Cannot write " << tempPath;
+    return;
+  }
+  fwrite(json.data(), 1, json.size(), file);
+  fclose(file);
+#ifdef PLATFORM_WINDOWS
+  // rename() does not replace an existing file on Windows.
+  ::remove(m_options.filePath.c_str());
+#endif
+  rename(tempPath.c_str(), m_options.filePath.c_str());
+}
+
+void MetricsReporter::run() {
+  int64_t nextDump = metricsNowNs();
+  while (m_running) {
+    int64_t now = metricsNowNs();
+    if (now >= nextDump) {
+      writeFile(snapshot());
+      nextDump = now + static_cast<int64_t>(m_options.intervalMs) * 1000000;
+    }
+    int waitMs = static_cast<int>((nextDump - now + 999999) / 1000000);
+
+#ifdef PLATFORM_LINUX
+    if (m_listenFd >= 0) {
+      pollfd fds[2] = {{m_stop.fd(), POLLIN, 0}, {m_listenFd, POLLIN, 0}};
+      if (poll(fds, 2, waitMs) > 0 && (fds[1].revents & POLLIN))
+        serveClients();
+      continue;
+    }
+#endif
+    m_stop.wait(waitMs);
+  }
+}
+
+#ifdef PLATFORM_LINUX
+
+bool MetricsReporter::openSocket() {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (m_options.socketPath.size() >= sizeof(address.sun_path)) {
+    LOG_ERROR << "[MetricsReporter] ERROR: Socket path too long";
+    return false;
+  }
+  strcpy(address.sun_path, m_options.socketPath.c_str());
+
+  m_listenFd =
+      socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(address.sun_path);
+  if (m_listenFd < 0 ||
+      bind(m_listenFd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(m_listenFd, 8) != 0) {
+    LOG_ERROR << "[MetricsReporter] ERROR: Cannot listen on "
+              << m_options.socketPath << ": " << strerror(errno);
+    if (m_listenFd >= 0)
+      ::close(m_listenFd);
+    m_listenFd = -1;
+    return false;
+  }
+  return true;
+}
+
+void MetricsReporter::serveClients() {
+  int client;
+  while ((client = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) {
+    std::string json = snapshot();
+    // A client that does not read is simply cut off after the first
+    // short write; the reporter thread never waits on it.
+    fcntl(client, F_SETFL, O_NONBLOCK);
+    ssize_t ignored = send(client, json.data(), json.size(), MSG_NOSIGNAL);
+    (void)ignored;
+    ::close(client);
+  }
+}
+
+#else
+
+bool MetricsReporter::openSocket() {
+  LOG_WARN
+      << "[MetricsReporter] WARNING: Socket output is only supported on Linux";
+  return true;
+}
+
+void MetricsReporter::serveClients() {}
+
+#endif
@@ -1,75 +1,89 @@
 #include "MicCapture.h"
+#include "Logger.h"
 #include "Utils.h"
 #include "WavWriter.h"
-#include <iostream>
+
+#ifdef PLATFORM_LINUX
+#include "SyntheticSource.h"
+#endif
 
 MicCapture::MicCapture(const std::string &outputFile) : AudioCapture() {
-  std::cout << "[MicCapture] Constructor called with output file: "
-            << outputFile << std::endl;
+  LOG_INFO << "[MicCapture] Constructor called with output file: "
+           << outputFile;
   m_outputFile = outputFile; // Set the base class member
 }
 
 bool MicCapture::start() {
-  std::cout << "[MicCapture] Starting microphone capture..." << std::endl;
+  LOG_INFO << "[MicCapture] Starting microphone capture...";
   Utils::createDirectory("output");
 
 #ifdef PLATFORM_WINDOWS
-  std::cout << "[MicCapture] Initializing WaveIn device..." << std::endl;
+  LOG_INFO << "[MicCapture] Initializing WaveIn device...";
 
   if (!initializeWaveIn()) {
-    std::cerr << "[MicCapture] ERROR: initializeWaveIn() failed!" << std::endl;
+    LOG_ERROR << "[MicCapture] ERROR: initializeWaveIn() failed!";
     return false;
   }
 
-  std::cout << "[MicCapture] WaveIn initialized successfully" << std::endl;
-  std::cout << "[MicCapture] Starting internal capture..." << std::endl;
+  LOG_INFO << "[MicCapture] WaveIn initialized successfully";
+  LOG_INFO << "[MicCapture] Starting internal capture...";
 
   startInternal();
 
-  std::cout << "[MicCapture] Creating capture thread..." << std::endl;
+  LOG_INFO << "[MicCapture] Creating capture thread...";
   m_hThread = CreateThread(nullptr, 0, audioThreadProc, this, 0, nullptr);
 
   if (m_hThread == nullptr) {
     DWORD error = GetLastError();
-    std::cerr << "[MicCapture] ERROR: Failed to create thread! Error code: "
-              << error << std::endl;
+    LOG_ERROR << "[MicCapture] ERROR: Failed to create thread! Error code: "
+              << error;
     return false;
   }
 
-  std::cout << "[MicCapture] Microphone capture started successfully!"
-            << std::endl;
+  LOG_INFO << "[MicCapture] Microphone capture started successfully!";
   return true;
 #else
-  // Linux stub implementation
-  m_bRunning = true;
-  m_pThread = new std::thread(audioThreadProc, this);
+  if (!m_source) {
+    // No microphone backend on Linux; stand in with a signal shaped like
+    // the Windows waveIn stream (PCM 16-bit stereo 44.1kHz).
+    LOG_INFO << "[MicCapture] No source set, using synthetic sine";
+    SyntheticSourceConfig config;
+    config.format.sampleRate = 44100;
+    config.format.channels = 2;
+    config.format.sampleFormat = SampleFormat::Int16;
+    config.framesPerPacket = 1024;
+    m_source.reset(new SyntheticSource(config));
+  }
+
+  if (!startSource()) {
+    LOG_ERROR << "[MicCapture] ERROR: Failed to start capture source!";
+    return false;
+  }
+
+  startInternal();
+  LOG_INFO << "[MicCapture] Microphone capture started successfully!";
   return true;
 #endif
 }
 
 void MicCapture::stop() {
-  std::cout << "[MicCapture] Stopping microphone capture..." << std::endl;
-  m_bRunning = false;
+  LOG_INFO << "[MicCapture] Stopping microphone capture...";
 
 #ifdef PLATFORM_WINDOWS
-  if (m_hWaveIn) {
-    std::cout << "[MicCapture] Stopping WaveIn device..." << std::endl;
-    waveInStop(m_hWaveIn);
-    waveInReset(m_hWaveIn);
-  }
+  // Stops the device, drains the disk writer and finalizes the WAV header.
+  LOG_INFO << "[MicCapture] Stopping WaveIn device...";
+  AudioCapture::stop();
+  m_bRunning = false;
 
   if (m_hThread) {
-    std::cout << "[MicCapture] Waiting for thread to finish..." << std::endl;
+    LOG_INFO << "[MicCapture] Waiting for thread to finish...";
     WaitForSingleObject(m_hThread, 5000);
     CloseHandle(m_hThread);
     m_hThread = nullptr;
   }
-  std::cout << "[MicCapture] Microphone capture stopped" << std::endl;
+  LOG_INFO << "[MicCapture] Microphone capture stopped";
 #else
-  if (m_pThread) {
-    m_pThread->join();
-    delete m_pThread;
-    m_pThread = nullptr;
-  }
+  cleanup();
+  LOG_INFO << "[MicCapture] Microphone capture stopped";
 #endif
 }
@@ -0,0 +1,503 @@
+#include "MultichannelWavWriter.h"
+#include "ClockTracker.h"
+#include "Logger.h"
+#include "Resampler.h"
+#include "SampleConverter.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+static constexpr size_t INPUT_CHUNK_FRAMES = 4096;
+// Seconds over which an alignment error is steered out, and the largest
+// rate adjustment that may take, as for WavWriter's drift correction.
+static constexpr double ALIGN_SECONDS = 2.0;
+static constexpr double MAX_RATE_ADJUST = 0.002;
+
+static int countBits(uint32_t mask) {
+  int count = 0;
+  for (; mask; mask &= mask - 1)
+    ++count;
+  return count;
+}
+
+static int highestBit(uint32_t mask) {
+  int bit = -1;
+  for (; mask; mask >>= 1)
+    ++bit;
+  return bit;
+}
+
+// Reads |size| bytes from |ring|, across its wrap if need be.
+static void readRing(SpscRingBuffer &ring, uint8_t *dst, size_t size) {
+  while (size > 0) {
+    const uint8_t *data;
+    size_t take = std::min(ring.peek(&data), size);
+    memcpy(dst, data, take);
+    ring.consume(take);
+    dst += take;
+    size -= take;
+  }
+}
+
+static void skipRing(SpscRingBuffer &ring, size_t size) {
+  while (size > 0) {
+    const uint8_t *data;
+    size_t take = std::min(ring.peek(&data), size);
+    ring.consume(take);
+    size -= take;
+  }
+}
+
+// Feeds one group: decodes, resamples to the file rate and places the
+// stream on the timeline, then lets the writer mix.
+class MultichannelWavWriter::Input : public AudioSink {
+public:
+  Input(std::shared_ptr<MultichannelWavWriter> writer, size_t group,
+        uint32_t sampleRate, uint16_t channels, SampleFormat format);
+  ~Input() override;
+
+  bool initialize() override;
+  void write(const uint8_t *data, uint32_t size) override;
+  void writeTimed(const uint8_t *data, uint32_t size,
+                  const BlockTimestamp &time) override;
+  bool finalize() override;
+
+private:
+  void align(const BlockTimestamp &time);
+  void resampleFrames(const uint8_t *data, size_t frames);
+  void push(const float *samples, size_t frames);
+  void pushSilence(uint64_t frames);
+
+  std::shared_ptr<MultichannelWavWriter> m_writer;
+  Group &m_group;
+  uint32_t m_sampleRate;
+  uint16_t m_channels;
+  SampleFormat m_format;
+  uint16_t m_frameBytes;
+  ClockTracker m_clock;
+  std::unique_ptr<Resampler> m_resampler;
+  std::vector<float> m_floatInput;
+  std::vector<float> m_resampled;
+  std::vector<float> m_zeros;
+  // Bytes of an input frame split across write() calls.
+  std::vector<uint8_t> m_frameCarry;
+  bool m_started = false;
+  bool m_finalized = false;
+  // Device position of the resampler's input frame 0; moves when the
+  // device skips frames.
+  int64_t m_positionOffset = 0;
+  // Group frames given a place on the timeline, and resampled frames still
+  // to discard because the group ran ahead.
+  uint64_t m_placed = 0;
+  uint64_t m_skip = 0;
+};
+
+MultichannelWavWriter::Input::Input(
+    std::shared_ptr<MultichannelWavWriter> writer, size_t group,
+    uint32_t sampleRate, uint16_t channels, SampleFormat format)
+    : m_writer(std::move(writer)), m_group(*m_writer->m_groups[group]),
+      m_sampleRate(sampleRate), m_channels(channels), m_format(format),
+      m_frameBytes(static_cast<uint16_t>(channels * bytesPerSample(format))),
+      m_clock(sampleRate) {
+  ResamplerConfig config;
+  config.inputRate = sampleRate;
+  config.outputRate = m_writer->m_sampleRate;
+  config.channels = channels;
+  config.mono = m_group.channels == 1 && channels > 1;
+  config.variableRate = true;
+  m_resampler.reset(new Resampler(config));
+  m_floatInput.resize(INPUT_CHUNK_FRAMES * channels);
+  size_t maxFrames =
+      std::max(m_resampler->maxOutputFrames(INPUT_CHUNK_FRAMES),
+               m_resampler->maxOutputFrames(m_resampler->tapsPerPhase()));
+  m_resampled.resize(maxFrames * m_resampler->outputChannels());
+  m_zeros.resize(INPUT_CHUNK_FRAMES * m_group.channels);
+  m_frameCarry.reserve(m_frameBytes);
+}
+
+MultichannelWavWriter::Input::~Input() {
+  // The file is only finished once every input is.
+  finalize();
+}
+
+bool MultichannelWavWriter::Input::initialize() {
+  if (!m_resampler->valid() ||
+      m_resampler->outputChannels() != m_group.channels) {
+    LOG_ERROR << "[MultichannelWavWriter] Group " << m_group.name << " has "
+              << m_group.channels << " channels, cannot take " << m_channels
+              << " at " << m_sampleRate << " Hz";
+    return false;
+  }
+  LOG_INFO << "[MultichannelWavWriter] Group " << m_group.name << ": "
+           << m_channels << " channels at " << m_sampleRate << " Hz"
+           << (m_channels != m_group.channels ? ", downmixed" : "");
+  return m_writer->open();
+}
+
+void MultichannelWavWriter::Input::writeTimed(const uint8_t *data,
+                                              uint32_t size,
+                                              const BlockTimestamp &time) {
+  if (time.valid())
+    align(time);
+  write(data, size);
+}
+
+void MultichannelWavWriter::Input::align(const BlockTimestamp &time) {
+  m_clock.update(time.position, time.hostTimeNs);
+  m_positionOffset =
+      static_cast<int64_t>(time.position - m_resampler->inputFrames());
+  if (!m_started) {
+    m_started = true;
+    m_group.startNs.store(time.hostTimeNs, std::memory_order_release);
+    return;
+  }
+
+  // Where the next resampled frame belongs, from the fitted device clock,
+  // against where it is going.
+  const double rate = m_writer->m_sampleRate;
+  int64_t startNs = m_group.startNs.load(std::memory_order_relaxed);
+  int64_t nextNs = m_clock.hostTimeAt(m_resampler->outputPosition() +
+                                      double(m_positionOffset));
+  double target = double(nextNs - startNs) * 1e-9 * rate;
+  double error = double(m_placed) - double(m_skip) - target;
+  const double resync = m_writer->m_options.resyncMs * 1e-3 * rate;
+  if (error < -resync) {
+    pushSilence(static_cast<uint64_t>(std::llround(-error)));
+    error = 0.0;
+  } else if (error > resync) {
+    m_skip += static_cast<uint64_t>(std::llround(error));
+    error = 0.0;
+  }
+
+  // Feed forward the device's measured rate and steer the rest out.
+  double factor =
+      (1.0 - error / (rate * ALIGN_SECONDS)) / m_clock.rateRatio();
+  m_resampler->setRateAdjust(std::min(
+      std::max(factor, 1.0 - MAX_RATE_ADJUST), 1.0 + MAX_RATE_ADJUST));
+}
+
+void MultichannelWavWriter::Input::write(const uint8_t *data,
+                                         uint32_t size) {
+  if (m_finalized)
+    return;
+  // Complete an input frame split by the previous call.
+  if (!m_frameCarry.empty()) {
+    size_t take = std::min<size_t>(m_frameBytes - m_frameCarry.size(), size);
+    m_frameCarry.insert(m_frameCarry.end(), data, data + take);
+    data += take;
+    size -= static_cast<uint32_t>(take);
+    if (m_frameCarry.size() < m_frameBytes)
+      return;
+    resampleFrames(m_frameCarry.data(), 1);
+    m_frameCarry.clear();
+  }
+
+  size_t frames = size / m_frameBytes;
+  for (size_t done = 0; done < frames;) {
+    size_t chunk = std::min(frames - done, INPUT_CHUNK_FRAMES);
+    resampleFrames(data + done * m_frameBytes, chunk);
+    done += chunk;
+  }
+  size_t used = frames * m_frameBytes;
+  m_frameCarry.insert(m_frameCarry.end(), data + used, data + size);
+  m_writer->pump();
+}
+
+void MultichannelWavWriter::Input::resampleFrames(const uint8_t *data,
+                                                  size_t frames) {
+  decodeSamples(data, m_format, frames * m_channels, m_floatInput.data());
+  size_t produced =
+      m_resampler->process(m_floatInput.data(), frames, m_resampled.data());
+  push(m_resampled.data(), produced);
+}
+
+void MultichannelWavWriter::Input::push(const float *samples, size_t frames) {
+  if (m_skip > 0) {
+    size_t skipped = static_cast<size_t>(std::min<uint64_t>(m_skip, frames));
+    m_skip -= skipped;
+    samples += skipped * m_group.channels;
+    frames -= skipped;
+    m_group.droppedFrames.fetch_add(skipped, std::memory_order_relaxed);
+  }
+  if (frames == 0)
+    return;
+  // A full ring means the mixer is not keeping up; the frames are lost and
+  // the next timestamp puts silence in their place.
+  if (m_group.ring->push(reinterpret_cast<const uint8_t *>(samples),
+                         frames * m_group.channels * sizeof(float)))
+    m_placed += frames;
+  else
+    m_group.droppedFrames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+void MultichannelWavWriter::Input::pushSilence(uint64_t frames) {
+  m_group.silentFrames.fetch_add(frames, std::memory_order_relaxed);
+  while (frames > 0) {
+    size_t chunk =
+        static_cast<size_t>(std::min<uint64_t>(frames, INPUT_CHUNK_FRAMES));
+    push(m_zeros.data(), chunk);
+    frames -= chunk;
+  }
+}
+
+bool MultichannelWavWriter::Input::finalize() {
+  if (m_finalized)
+    return true;
+  // Flush what the filter delay still holds; a partial input frame left in
+  // the carry is dropped.
+  push(m_resampled.data(), m_resampler->drain(m_resampled.data()));
+  m_finalized = true;
+  m_group.ended.store(true, std::memory_order_release);
+  return m_writer->finishInput();
+}
+
+MultichannelWavWriter::MultichannelWavWriter(
+    const std::string &filename, uint32_t sampleRate,
+    const MultichannelWavOptions &options)
+    : m_filename(filename), m_sampleRate(sampleRate), m_options(options) {}
+
+MultichannelWavWriter::~MultichannelWavWriter() = default;
+
+size_t MultichannelWavWriter::addGroup(const std::string &name,
+                                       uint16_t channels,
+                                       uint32_t channelMask) {
+  // Positions at or below the previous group's highest are taken.
+  const int above = m_groups.empty() ? -1 : highestBit(m_groups.back()->mask);
+  const uint32_t taken = above < 0 ? 0 : (2u << above) - 1;
+  uint32_t mask = channelMask;
+  if (mask != 0 && (countBits(mask) != channels || (mask & taken) != 0)) {
+    LOG_WARN << "[MultichannelWavWriter] WARNING: Channel mask 0x"
+             << logHex(mask) << " does not fit group " << name
+             << ", using the next free positions";
+    mask = 0;
+  }
+  for (int bit = above + 1; mask == 0 || countBits(mask) < channels; ++bit)
+    mask |= 1u << bit;
+
+  std::unique_ptr<Group> group(new Group);
+  group->name = name;
+  group->channels = channels;
+  group->mask = mask;
+  // Room for a group to run maxSkewMs ahead twice over, plus what one write
+  // adds.
+  size_t frames = size_t(m_options.maxSkewMs) * m_sampleRate / 1000 * 2 +
+                  4 * INPUT_CHUNK_FRAMES;
+  group->ring.reset(
+      new SpscRingBuffer(frames * channels * sizeof(float)));
+  group->chunk.resize(MIX_CHUNK_FRAMES * channels);
+  m_groups.push_back(std::move(group));
+  return m_groups.size() - 1;
+}
+
+std::unique_ptr<AudioSink>
+MultichannelWavWriter::createInput(size_t group, uint32_t sampleRate,
+                                   uint16_t channels, SampleFormat format) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_inputs;
+  }
+  return std::unique_ptr<AudioSink>(
+      new Input(shared_from_this(), group, sampleRate, channels, format));
+}
+
+uint16_t MultichannelWavWriter::channels() const {
+  uint16_t channels = 0;
+  for (const auto &group : m_groups)
+    channels = static_cast<uint16_t>(channels + group->channels);
+  return channels;
+}
+
+uint32_t MultichannelWavWriter::channelMask() const {
+  uint32_t mask = 0;
+  for (const auto &group : m_groups)
+    mask |= group->mask;
+  return mask;
+}
+
+bool MultichannelWavWriter::open() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_opened)
+    return !m_failed;
+  m_opened = true;
+
+  WavWriterOptions options;
+  options.container = m_options.container;
+  options.mode = m_options.mode;
+  options.outputFormat = m_options.outputFormat;
+  options.dither = m_options.dither;
+  options.channelMask = channelMask();
+  m_file.reset(new WavWriter(m_filename, m_sampleRate, channels(),
+                             SampleFormat::Float32, options));
+  if (!m_file->initialize()) {
+    m_failed = true;
+    m_file.reset();
+    return false;
+  }
+
+  std::vector<uint16_t> groupChannels;
+  for (const auto &group : m_groups)
+    groupChannels.push_back(group->channels);
+  m_interleaver.reset(new ChannelInterleaver(groupChannels));
+  m_groupData.resize(m_groups.size());
+  m_interleaved.resize(MIX_CHUNK_FRAMES * channels());
+
+  LOG_INFO << "[MultichannelWavWriter] " << m_filename << ": "
+           << channels() << " channels at " << m_sampleRate
+           << " Hz, mask 0x" << logHex(channelMask()) << " ("
+           << SampleConverter::simdLevelName(m_interleaver->simdLevel())
+           << " interleave)";
+  for (const auto &group : m_groups)
+    LOG_INFO << "[MultichannelWavWriter]   " << group->name << ": mask 0x"
+             << logHex(group->mask);
+  return true;
+}
+
+void MultichannelWavWriter::pump() {
+  std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+  if (lock.owns_lock())
+    mix(false);
+}
+
+bool MultichannelWavWriter::placeGroups(bool final) {
+  if (!m_originSet) {
+    // The earliest start, once every group has one or a started group
+    // has waited maxSkewMs for the rest.
+    const size_t skewFrames =
+        size_t(m_options.maxSkewMs) * m_sampleRate / 1000;
+    bool all = true;
+    size_t waiting = 0;
+    int64_t origin = INT64_MAX;
+    for (const auto &group : m_groups) {
+      bool ended = group->ended.load(std::memory_order_acquire);
+      int64_t start = group->startNs.load(std::memory_order_acquire);
+      if (start == 0) {
+        all = all && ended;
+        continue;
+      }
+      origin = std::min(origin, start);
+      waiting = std::max(waiting, group->ring->readAvailable() /
+                                      (group->channels * sizeof(float)));
+    }
+    if (origin == INT64_MAX || (!all && !final && waiting < skewFrames))
+      return false;
+    m_originSet = true;
+    m_originNs = origin;
+  }
+
+  for (const auto &group : m_groups) {
+    int64_t start = group->startNs.load(std::memory_order_acquire);
+    if (group->placed || start == 0)
+      continue;
+    group->offset =
+        std::llround(double(start - m_originNs) * 1e-9 * m_sampleRate);
+    group->placed = true;
+  }
+  return true;
+}
+
+int64_t MultichannelWavWriter::available(Group &group) {
+  if (!group.placed)
+    return 0;
+  const size_t frameBytes = group.channels * sizeof(float);
+  int64_t local = int64_t(m_position) - group.offset;
+  uint64_t frames = group.ring->readAvailable() / frameBytes;
+  if (local > int64_t(group.consumed)) {
+    // Frames whose place was already written, as silence.
+    uint64_t late = std::min(frames, uint64_t(local) - group.consumed);
+    skipRing(*group.ring, late * frameBytes);
+    group.consumed += late;
+    group.droppedFrames.fetch_add(late, std::memory_order_relaxed);
+    frames -= late;
+    if (local > int64_t(group.consumed))
+      return 0;
+  }
+  // A group that starts later has silence until then.
+  return std::max<int64_t>(-local, 0) + int64_t(frames);
+}
+
+void MultichannelWavWriter::mix(bool final) {
+  if (!m_file || !placeGroups(final))
+    return;
+
+  const int64_t skewFrames = int64_t(m_options.maxSkewMs) * m_sampleRate / 1000;
+  std::vector<int64_t> avail(m_groups.size());
+  for (;;) {
+    int64_t lead = 0;
+    int64_t need = INT64_MAX;
+    for (size_t g = 0; g < m_groups.size(); ++g) {
+      Group &group = *m_groups[g];
+      // Read before the ring: an input pushes its last frames first.
+      bool ended = group.ended.load(std::memory_order_acquire);
+      avail[g] = available(group);
+      lead = std::max(lead, avail[g]);
+      // Groups that have ended and run out no longer hold the rest back.
+      if (!(ended && avail[g] == 0))
+        need = std::min(need, avail[g]);
+    }
+    int64_t frames;
+    if (final || need == INT64_MAX)
+      frames = lead;
+    else if (lead - need > skewFrames)
+      frames = lead - skewFrames;
+    else
+      frames = need;
+    frames = std::min<int64_t>(frames, MIX_CHUNK_FRAMES);
+    if (frames <= 0)
+      break;
+
+    for (size_t g = 0; g < m_groups.size(); ++g) {
+      Group &group = *m_groups[g];
+      float *chunk = group.chunk.data();
+      int64_t before = frames;
+      int64_t data = 0;
+      if (group.placed) {
+        int64_t local = int64_t(m_position) - group.offset;
+        before = std::min<int64_t>(std::max<int64_t>(-local, 0), frames);
+        data = std::min(avail[g] - std::max<int64_t>(-local, 0),
+                        frames - before);
+        data = std::max<int64_t>(data, 0);
+      }
+      int64_t after = frames - before - data;
+      std::fill(chunk, chunk + before * group.channels, 0.0f);
+      readRing(*group.ring,
+               reinterpret_cast<uint8_t *>(chunk + before * group.channels),
+               data * group.channels * sizeof(float));
+      std::fill(chunk + (before + data) * group.channels,
+                chunk + frames * group.channels, 0.0f);
+      group.consumed += data;
+      if (before + after > 0)
+        group.silentFrames.fetch_add(before + after, std::memory_order_relaxed);
+      m_groupData[g] = chunk;
+    }
+    m_interleaver->interleave(m_groupData.data(), frames,
+                              m_interleaved.data());
+    m_file->write(reinterpret_cast<const uint8_t *>(m_interleaved.data()),
+                  static_cast<uint32_t>(frames * m_interleaver->channels() *
+                                        sizeof(float)));
+    m_position += frames;
+    m_framesWritten.store(m_position, std::memory_order_relaxed);
+  }
+}
+
+bool MultichannelWavWriter::finishInput() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (++m_finishedInputs < m_inputs) {
+    mix(false);
+    return true;
+  }
+  if (!m_file)
+    return !m_failed;
+  mix(true);
+  bool ok = m_file->finalize();
+  m_file.reset();
+  LOG_INFO << "[MultichannelWavWriter] " << m_filename << ": " << m_position
+           << " frames";
+  for (const auto &group : m_groups)
+    LOG_INFO << "[MultichannelWavWriter]   " << group->name << ": "
+             << group->silentFrames.load(std::memory_order_relaxed)
+             << " frames of silence filled in, "
+             << group->droppedFrames.load(std::memory_order_relaxed)
+             << " dropped";
+  return ok;
+}
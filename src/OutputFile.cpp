@@ -0,0 +1,121 @@
+#include "OutputFile.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#include <winioctl.h>
+#define fseek64 _fseeki64
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define fseek64 fseeko
+#endif
+
+// Source for zero runs that are written out rather than skipped.
+static const uint8_t ZERO_BLOCK[64 << 10] = {};
+
+bool OutputFile::appendZeros(uint64_t size) {
+  while (size > 0) {
+    size_t chunk =
+        static_cast<size_t>(std::min<uint64_t>(size, sizeof(ZERO_BLOCK)));
+    if (!append(ZERO_BLOCK, chunk))
+      return false;
+    size -= chunk;
+  }
+  return true;
+}
+
+StdioOutputFile::~StdioOutputFile() { close(); }
+
+bool StdioOutputFile::open(const std::string &path) {
+  m_file = fopen(path.c_str(), "wb");
+  m_size = 0;
+  m_holeAtEnd = false;
+  m_reserved = false;
+#ifdef _WIN32
+  // NTFS only keeps skipped ranges unallocated in sparse files.
+  if (m_file) {
+    DWORD returned;
+    DeviceIoControl(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_file))),
+                    FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned,
+                    nullptr);
+  }
+#endif
+  return m_file != nullptr;
+}
+
+bool StdioOutputFile::append(const uint8_t *data, size_t size) {
+  if (!m_file)
+    return false;
+
+  size_t written = fwrite(data, 1, size, m_file);
+  m_size += written;
+  if (written > 0)
+    m_holeAtEnd = false;
+  return written == size;
+}
+
+bool StdioOutputFile::appendZeros(uint64_t size) {
+  if (!m_file)
+    return false;
+  if (size < MIN_HOLE_BYTES)
+    return OutputFile::appendZeros(size);
+
+  // Bytes skipped past the end read back as zeros; the next write or
+  // close() sets the length.
+  if (fflush(m_file) != 0 ||
+      fseek64(m_file, static_cast<int64_t>(size), SEEK_CUR) != 0)
+    return false;
+  m_size += size;
+  m_holeAtEnd = true;
+  return true;
+}
+
+bool StdioOutputFile::writeAt(uint64_t offset, const uint8_t *data,
+                              size_t size) {
+  if (!m_file)
+    return false;
+
+  if (fseek64(m_file, static_cast<int64_t>(offset), SEEK_SET) != 0)
+    return false;
+  bool ok = fwrite(data, 1, size, m_file) == size;
+  // Back to the logical end, which lies past the physical one after a hole.
+  fseek64(m_file, static_cast<int64_t>(m_size), SEEK_SET);
+  return ok;
+}
+
+bool StdioOutputFile::reserve(uint64_t size) {
+  if (!m_file)
+    return false;
+#ifdef _WIN32
+  FILE_ALLOCATION_INFO info;
+  info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+  m_reserved = SetFileInformationByHandle(
+                   reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(m_file))),
+                   FileAllocationInfo, &info, sizeof(info)) != 0;
+#else
+  m_reserved = fallocate(fileno(m_file), FALLOC_FL_KEEP_SIZE, 0,
+                         static_cast<off_t>(size)) == 0;
+#endif
+  return m_reserved;
+}
+
+bool StdioOutputFile::flush() { return m_file && fflush(m_file) == 0; }
+
+bool StdioOutputFile::close() {
+  if (!m_file)
+    return true;
+
+  bool ok = fflush(m_file) == 0;
+  if (m_holeAtEnd || m_reserved) {
+#ifdef _WIN32
+    ok = _chsize_s(_fileno(m_file), static_cast<int64_t>(m_size)) == 0 && ok;
+#else
+    ok = ftruncate(fileno(m_file), static_cast<off_t>(m_size)) == 0 && ok;
+#endif
+  }
+  ok = fclose(m_file) == 0 && ok;
+  m_file = nullptr;
+  return ok;
+}
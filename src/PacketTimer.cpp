@@ -0,0 +1,131 @@
+#include "PacketTimer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef PLATFORM_LINUX
+#include <cerrno>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+PacketTimer::PacketTimer()
+    : m_sampleRate(0), m_clockScale(1.0), m_wakeups(0)
+#ifdef PLATFORM_LINUX
+      ,
+      m_fd(-1), m_armedFrame(0)
+#endif
+{
+}
+
+PacketTimer::~PacketTimer() { stop(); }
+
+bool PacketTimer::start(uint32_t sampleRate, double skewPpm) {
+  if (sampleRate == 0)
+    return false;
+
+  stop();
+  m_sampleRate = sampleRate;
+  m_clockScale = 1.0 + skewPpm * 1e-6;
+  m_wakeups = 0;
+#ifdef PLATFORM_LINUX
+  // steady_clock is CLOCK_MONOTONIC, so deadlines map 1:1 onto the timer.
+  m_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (m_fd < 0)
+    return false;
+  m_armedFrame = 0;
+#endif
+  m_startTime = Clock::now();
+  return true;
+}
+
+void PacketTimer::stop() {
+#ifdef PLATFORM_LINUX
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+#endif
+}
+
+PacketTimer::Clock::time_point PacketTimer::frameTime(uint64_t frame) const {
+  // Split to keep full precision for very long runs. Rounded up so that
+  // framesElapsed() at frameTime(frame) is never short of |frame|.
+  uint64_t seconds = frame / m_sampleRate;
+  uint64_t remainder = frame % m_sampleRate;
+  uint64_t ns = seconds * 1000000000ull +
+                (remainder * 1000000000ull + m_sampleRate - 1) / m_sampleRate;
+  if (m_clockScale != 1.0)
+    ns = static_cast<uint64_t>(std::ceil(ns / m_clockScale)) + 1;
+  return m_startTime + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::nanoseconds(ns));
+}
+
+uint64_t PacketTimer::framesElapsed() const {
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     Clock::now() - m_startTime)
+                     .count();
+  if (elapsed <= 0)
+    return 0;
+  uint64_t ns = static_cast<uint64_t>(elapsed);
+  if (m_clockScale != 1.0)
+    ns = static_cast<uint64_t>(ns * m_clockScale);
+  return ns / 1000000000ull * m_sampleRate +
+         ns % 1000000000ull * m_sampleRate / 1000000000ull;
+}
+
+void PacketTimer::arm(uint64_t frame) {
+#ifdef PLATFORM_LINUX
+  if (m_fd < 0)
+    return;
+
+  // Clear any stale expiration; the fd must only be readable once |frame|
+  // is due.
+  uint64_t expirations;
+  ssize_t ignored = ::read(m_fd, &expirations, sizeof(expirations));
+  (void)ignored;
+
+  auto deadline = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      frameTime(frame).time_since_epoch())
+                      .count();
+  itimerspec spec = {};
+  spec.it_value.tv_sec = deadline / 1000000000;
+  spec.it_value.tv_nsec = deadline % 1000000000;
+  // A zero it_value would disarm the timer instead of firing immediately.
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+    spec.it_value.tv_nsec = 1;
+  timerfd_settime(m_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+  m_armedFrame = frame;
+#else
+  (void)frame;
+#endif
+}
+
+bool PacketTimer::waitFor(uint64_t frame, int timeoutMs) {
+  if (framesElapsed() >= frame)
+    return true;
+
+#ifdef PLATFORM_LINUX
+  if (m_fd >= 0) {
+    if (m_armedFrame != frame)
+      arm(frame);
+
+    pollfd pfd = {m_fd, POLLIN, 0};
+    int ready;
+    do {
+      ready = ::poll(&pfd, 1, timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    ++m_wakeups;
+    return framesElapsed() >= frame;
+  }
+#endif
+
+  Clock::time_point deadline = frameTime(frame);
+  if (timeoutMs >= 0)
+    deadline = std::min(deadline,
+                        Clock::now() + std::chrono::milliseconds(timeoutMs));
+  std::this_thread::sleep_until(deadline);
+  ++m_wakeups;
+  return framesElapsed() >= frame;
+}
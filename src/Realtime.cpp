@@ -0,0 +1,298 @@
+#include "Realtime.h"
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#include <avrt.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+// Touched on every real-time thread so its first calls never fault.
+static constexpr size_t STACK_PREFAULT_BYTES = 128 << 10;
+
+struct RealtimeState {
+  std::mutex mutex;
+  RealtimeConfig config;
+  std::string report = "real-time mode off";
+  bool memoryLocked = false;
+  std::atomic<bool> enabled{false};
+  std::atomic<uint64_t> refused{0};
+  std::atomic<bool> warned{false};
+};
+
+static RealtimeState &state() {
+  static RealtimeState instance;
+  return instance;
+}
+
+static void prefaultStack() {
+  volatile uint8_t stack[STACK_PREFAULT_BYTES];
+  for (size_t i = 0; i < STACK_PREFAULT_BYTES; i += 4096)
+    stack[i] = 0;
+  // Read one back so the stores are not set-but-unused to the compiler.
+  (void)stack[0];
+}
+
+// Logs the first refusal only; refusedThreads() counts the rest.
+static void warnRefused(const std::string &what) {
+  if (!state().warned.exchange(true)) {
+    LOG_WARN << "[Realtime] WARNING: " << what;
+  }
+}
+
+#ifdef PLATFORM_LINUX
+static constexpr int CAP_IPC_LOCK_BIT = 14;
+static constexpr int CAP_SYS_NICE_BIT = 23;
+
+static bool hasCapability(int bit) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 7, "CapEff:") == 0)
+      return (std::stoull(line.substr(7), nullptr, 16) >> bit) & 1;
+  }
+  return false;
+}
+
+static std::string limitText(rlim_t value) {
+  return value == RLIM_INFINITY ? "unlimited" : std::to_string(value);
+}
+
+static std::string schedulingReport(const RealtimeConfig &config) {
+  const char *policy = config.roundRobin ? "SCHED_RR" : "SCHED_FIFO";
+  int needed = std::max(config.capturePriority, config.writerPriority);
+  std::string line = std::string(policy) + " capture " +
+                     std::to_string(config.capturePriority) + ", writer " +
+                     std::to_string(config.writerPriority) + ": ";
+
+  rlimit limit = {};
+  getrlimit(RLIMIT_RTPRIO, &limit);
+  if (hasCapability(CAP_SYS_NICE_BIT))
+    return line + "granted (CAP_SYS_NICE)";
+  if (limit.rlim_cur == RLIM_INFINITY ||
+      limit.rlim_cur >= static_cast<rlim_t>(needed))
+    return line + "granted (RLIMIT_RTPRIO " + limitText(limit.rlim_cur) + ")";
+  return line + "MISSING CAP_SYS_NICE or RLIMIT_RTPRIO >= " +
+         std::to_string(needed) + " (now " + limitText(limit.rlim_cur) + ")";
+}
+
+static std::string affinityReport(const std::vector<int> &cpus,
+                                  const char *role) {
+  if (cpus.empty())
+    return std::string(role) + " affinity: unpinned";
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  std::string line = std::string(role) + " affinity: CPU";
+  std::string unavailable;
+  for (int cpu : cpus) {
+    line += " " + std::to_string(cpu);
+    if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+      unavailable += " " + std::to_string(cpu);
+  }
+  if (!unavailable.empty())
+    return line + ": MISSING CPU" + unavailable + " (not in process mask)";
+  return line;
+}
+
+static std::string lockMemory(RealtimeState &s) {
+  rlimit limit = {};
+  getrlimit(RLIMIT_MEMLOCK, &limit);
+  // With a finite limit MCL_FUTURE would make later allocations fail once
+  // it is reached, so only what is mapped now gets locked.
+  bool unlimited =
+      hasCapability(CAP_IPC_LOCK_BIT) || limit.rlim_cur == RLIM_INFINITY;
+  if (mlockall(MCL_CURRENT) != 0) {
+    return std::string("mlockall: MISSING CAP_IPC_LOCK or a larger "
+                       "RLIMIT_MEMLOCK (now ") +
+           limitText(limit.rlim_cur) + ", " + strerror(errno) + ")";
+  }
+  s.memoryLocked = true;
+#ifdef MCL_ONFAULT
+  // Later mappings are locked as they are touched, so a new thread pins the
+  // stack it uses rather than all 8 MiB; pools prefault their own blocks.
+  if (unlimited && mlockall(MCL_FUTURE | MCL_ONFAULT) != 0)
+    unlimited = false;
+#else
+  if (unlimited && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    unlimited = false;
+#endif
+  if (!unlimited) {
+    return "mlockall: current mappings only (RLIMIT_MEMLOCK " +
+           limitText(limit.rlim_cur) + "), later pools lock their own blocks";
+  }
+#ifdef __GLIBC__
+  // Keep freed heap mapped so it is not faulted in again later.
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+#endif
+  return "mlockall: current and future mappings";
+}
+#else
+// Working-set headroom reserved so VirtualLock() on buffer pools succeeds.
+static constexpr SIZE_T LOCK_BUDGET_BYTES = 64 << 20;
+
+static std::string lockMemory(RealtimeState &s) {
+  SIZE_T minimum = 0;
+  SIZE_T maximum = 0;
+  HANDLE process = GetCurrentProcess();
+  if (!GetProcessWorkingSetSize(process, &minimum, &maximum) ||
+      !SetProcessWorkingSetSize(process, minimum + LOCK_BUDGET_BYTES,
+                                maximum + LOCK_BUDGET_BYTES)) {
+    return "working set: MISSING, cannot raise minimum (error " +
+           std::to_string(GetLastError()) + "), pools may run unlocked";
+  }
+  s.memoryLocked = true;
+  return "working set: minimum raised by " +
+         std::to_string(LOCK_BUDGET_BYTES >> 20) + " MiB for locked pools";
+}
+
+// Reverts the calling thread's MMCSS registration when it exits.
+struct MmcssRegistration {
+  HANDLE task = nullptr;
+  ~MmcssRegistration() {
+    if (task)
+      AvRevertMmThreadCharacteristics(task);
+  }
+};
+static thread_local MmcssRegistration t_mmcss;
+#endif
+
+void Realtime::configure(const RealtimeConfig &config) {
+  RealtimeState &s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+#ifdef PLATFORM_LINUX
+  if (s.memoryLocked && !(config.enabled && config.lockMemory)) {
+    munlockall();
+    s.memoryLocked = false;
+  }
+#endif
+  s.config = config;
+  s.refused = 0;
+  s.warned = false;
+  s.enabled.store(config.enabled);
+  if (!config.enabled) {
+    s.report = "real-time mode off";
+    return;
+  }
+
+  std::vector<std::string> lines;
+#ifdef PLATFORM_LINUX
+  lines.push_back(schedulingReport(config));
+  lines.push_back(affinityReport(config.captureCpus, "capture"));
+  lines.push_back(affinityReport(config.writerCpus, "writer"));
+#else
+  lines.push_back("MMCSS: capture \"" + config.captureTask + "\", writer \"" +
+                  config.writerTask + "\"");
+#endif
+  if (config.lockMemory && !s.memoryLocked)
+    lines.push_back(lockMemory(s));
+
+  s.report.clear();
+  for (const std::string &line : lines) {
+    if (line.find("MISSING") != std::string::npos)
+      LOG_WARN << "[Realtime] WARNING: " << line;
+    else
+      LOG_INFO << "[Realtime] " << line;
+    s.report += line + "\n";
+  }
+}
+
+RealtimeConfig Realtime::config() {
+  std::lock_guard<std::mutex> lock(state().mutex);
+  return state().config;
+}
+
+bool Realtime::enabled() { return state().enabled.load(); }
+
+bool Realtime::prepareThread(ThreadRole role) {
+  if (!enabled())
+    return true;
+
+  RealtimeConfig config = Realtime::config();
+  bool capture = role == ThreadRole::Capture;
+  const std::vector<int> &cpus = capture ? config.captureCpus
+                                         : config.writerCpus;
+  bool granted = true;
+
+#ifdef PLATFORM_LINUX
+  sched_param param = {};
+  param.sched_priority =
+      capture ? config.capturePriority : config.writerPriority;
+  int err = pthread_setschedparam(
+      pthread_self(), config.roundRobin ? SCHED_RR : SCHED_FIFO, &param);
+  if (err != 0) {
+    granted = false;
+    warnRefused(std::string("Cannot set real-time priority ") +
+                std::to_string(param.sched_priority) + ": " + strerror(err));
+  }
+
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+      granted = false;
+      warnRefused(std::string("Cannot pin thread: ") + strerror(err));
+    }
+  }
+#else
+  if (!t_mmcss.task) {
+    DWORD taskIndex = 0;
+    const std::string &task = capture ? config.captureTask : config.writerTask;
+    t_mmcss.task = AvSetMmThreadCharacteristicsA(task.c_str(), &taskIndex);
+    if (t_mmcss.task) {
+      AvSetMmThreadPriority(t_mmcss.task, capture ? AVRT_PRIORITY_CRITICAL
+                                                  : AVRT_PRIORITY_HIGH);
+    } else {
+      granted = false;
+      warnRefused("Cannot join MMCSS task \"" + task + "\" (error " +
+                  std::to_string(GetLastError()) + ")");
+    }
+  }
+
+  if (!cpus.empty()) {
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+      if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8))
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+      granted = false;
+      warnRefused("Cannot pin thread (error " +
+                  std::to_string(GetLastError()) + ")");
+    }
+  }
+#endif
+
+  prefaultStack();
+  if (!granted)
+    state().refused.fetch_add(1);
+  return granted;
+}
+
+std::string Realtime::report() {
+  std::lock_guard<std::mutex> lock(state().mutex);
+  return state().report;
+}
+
+uint64_t Realtime::refusedThreads() { return state().refused.load(); }
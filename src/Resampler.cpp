@@ -0,0 +1,365 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define RESAMPLER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+// Taps per phase are padded to this so every vector kernel runs whole
+// iterations.
+static constexpr uint32_t TAP_ALIGN = 16;
+static constexpr double PI = 3.14159265358979323846;
+
+struct Resampler::FilterBank {
+  // L (+1) phases of `taps` coefficients, each stored newest-sample-last so
+  // a phase is a plain dot product with the input history.
+  std::vector<float> coeffs;
+};
+
+namespace {
+
+// Zeroth-order modified Bessel function of the first kind.
+double besselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+float dotScalar(const float *coeffs, const float *samples, size_t taps) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < taps; ++i)
+    sum += coeffs[i] * samples[i];
+  return sum;
+}
+
+#ifdef RESAMPLER_X86
+
+float dotSse2(const float *coeffs, const float *samples, size_t taps) {
+  __m128 acc[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(),
+                   _mm_setzero_ps()};
+  for (size_t i = 0; i < taps; i += 16) {
+    for (int k = 0; k < 4; ++k)
+      acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(_mm_loadu_ps(coeffs + i + 4 * k),
+                                             _mm_loadu_ps(samples + i + 4 * k)));
+  }
+  __m128 sum = _mm_add_ps(_mm_add_ps(acc[0], acc[1]), _mm_add_ps(acc[2], acc[3]));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+TARGET_AVX2 float dotAvx2(const float *coeffs, const float *samples,
+                          size_t taps) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (size_t i = 0; i < taps; i += 16) {
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(coeffs + i),
+                                             _mm256_loadu_ps(samples + i)));
+    acc1 = _mm256_add_ps(acc1,
+                         _mm256_mul_ps(_mm256_loadu_ps(coeffs + i + 8),
+                                       _mm256_loadu_ps(samples + i + 8)));
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                          _mm256_extractf128_ps(acc, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+TARGET_AVX512 float dotAvx512(const float *coeffs, const float *samples,
+                              size_t taps) {
+  __m512 acc = _mm512_setzero_ps();
+  for (size_t i = 0; i < taps; i += 16)
+    acc = _mm512_fmadd_ps(_mm512_loadu_ps(coeffs + i),
+                          _mm512_loadu_ps(samples + i), acc);
+  return _mm512_reduce_add_ps(acc);
+}
+
+#endif
+
+Resampler::Kernel selectKernel(SimdLevel level) {
+#ifdef RESAMPLER_X86
+  switch (level) {
+  case SimdLevel::Avx512:
+    return dotAvx512;
+  case SimdLevel::Avx2:
+    return dotAvx2;
+  case SimdLevel::Sse2:
+    return dotSse2;
+  default:
+    break;
+  }
+#else
+  (void)level;
+#endif
+  return dotScalar;
+}
+
+using BankKey = std::tuple<uint32_t, uint32_t, double, double>;
+
+} // namespace
+
+std::shared_ptr<const Resampler::FilterBank>
+Resampler::bankFor(uint32_t phases, uint32_t taps, double bandwidth,
+                   double kaiserBeta) {
+  // Banks depend only on the reduced ratio and the filter shape, so every
+  // stream at e.g. 48 kHz -> 16 kHz shares one.
+  static std::mutex mutex;
+  static std::map<BankKey, std::shared_ptr<const FilterBank>> cache;
+  BankKey key(phases, taps, bandwidth, kaiserBeta);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = cache.find(key);
+  if (found != cache.end())
+    return found->second;
+
+  // Windowed-sinc prototype at the upsampled rate. One tap short of
+  // phases * taps so the centre lands on a sample and the delay is whole.
+  const size_t length = size_t(phases) * taps - 1;
+  const double centre = (length - 1) / 2.0;
+  const double fc = 0.5 * bandwidth / phases;
+  const double window = besselI0(kaiserBeta);
+  std::vector<double> prototype(length);
+  double total = 0.0;
+  for (size_t j = 0; j < length; ++j) {
+    double t = j - centre;
+    double sinc = t == 0.0 ? 1.0 : std::sin(2 * PI * fc * t) / (2 * PI * fc * t);
+    double r = centre > 0 ? t / centre : 0.0;
+    double w =
+        besselI0(kaiserBeta * std::sqrt(std::max(0.0, 1 - r * r))) / window;
+    prototype[j] = sinc * w;
+    total += prototype[j];
+  }
+
+  // Each phase then sums to roughly one, i.e. unity gain at DC.
+  auto bank = std::make_shared<FilterBank>();
+  bank->coeffs.assign(size_t(phases + 1) * taps, 0.0f);
+  for (uint32_t phase = 0; phase <= phases; ++phase) {
+    for (uint32_t k = 0; k < taps; ++k) {
+      size_t j = phase + size_t(k) * phases;
+      if (j < length)
+        bank->coeffs[size_t(phase) * taps + (taps - 1 - k)] =
+            static_cast<float>(prototype[j] * phases / total);
+    }
+  }
+  cache.emplace(key, bank);
+  return bank;
+}
+
+Resampler::Resampler(const ResamplerConfig &config, SimdLevel level)
+    : m_config(config), m_level(level) {
+  // Never run a kernel the CPU cannot execute.
+  SimdLevel supported = SampleConverter::detectSimdLevel();
+  if (static_cast<int>(m_level) > static_cast<int>(supported))
+    m_level = supported;
+  m_kernel = selectKernel(m_level);
+  m_outChannels = config.mono ? 1 : config.channels;
+  m_downmix = blockKernels(SampleFormat::Float32, config.channels).downmix;
+
+  if (config.inputRate == 0 || config.outputRate == 0 || config.channels == 0)
+    return;
+  uint32_t divisor = std::gcd(config.inputRate, config.outputRate);
+  m_up = config.outputRate / divisor;
+  m_down = config.inputRate / divisor;
+  if (m_up > MAX_PHASES && !config.variableRate)
+    return;
+
+  // Decimation narrows the passband, so keep the same number of taps per
+  // cycle of the cutoff frequency.
+  double decimation = double(config.inputRate) / config.outputRate;
+  double taps = double(std::max<uint32_t>(config.taps, 1)) *
+                std::max(1.0, decimation);
+  m_taps = (static_cast<uint32_t>(std::ceil(taps)) + TAP_ALIGN - 1) /
+           TAP_ALIGN * TAP_ALIGN;
+  m_step = m_down / m_up;
+  m_stepPhase = m_down % m_up;
+  uint32_t phases = config.variableRate ? VARIABLE_PHASES : m_up;
+  m_latency = (phases * m_taps / 2 - 1) / phases + 1;
+  m_delay = (phases * m_taps / 2 - 1) / double(phases);
+
+  m_bank = bankFor(phases, m_taps, config.cutoff * std::min(1.0, 1 / decimation),
+                   config.kaiserBeta);
+  m_planar.assign(m_outChannels,
+                  std::vector<float>(m_taps - 1 + CHUNK_FRAMES, 0.0f));
+  reset();
+}
+
+Resampler::~Resampler() = default;
+
+void Resampler::reset() {
+  if (!m_bank)
+    return;
+  for (std::vector<float> &channel : m_planar)
+    std::fill(channel.begin(), channel.end(), 0.0f);
+  // Start half a filter ahead so output 0 is centred on input frame 0.
+  uint32_t phases = m_config.variableRate ? VARIABLE_PHASES : m_up;
+  uint32_t delay = phases * m_taps / 2 - 1;
+  m_next = m_taps - 1 + delay / phases;
+  m_phase = delay % phases;
+  if (m_config.variableRate)
+    m_phase = static_cast<uint32_t>((uint64_t(m_phase) << 32) / phases);
+  m_shifted = 0;
+  setRateAdjust(1.0);
+  m_inputFrames = 0;
+  m_outputFrames = 0;
+}
+
+void Resampler::setRateAdjust(double factor) {
+  if (!m_config.variableRate || factor <= 0.0)
+    return;
+  m_adjust = factor;
+  double step = double(m_config.inputRate) / m_config.outputRate / factor;
+  // Rounded up, so output positions never run ahead of the exact ones and
+  // drain() stops at ceil(input * L / M) at a neutral adjustment.
+  m_stepFixed = static_cast<uint64_t>(std::ceil(std::ldexp(step, 32)));
+}
+
+double Resampler::outputPosition() const {
+  double fraction = m_config.variableRate ? std::ldexp(double(m_phase), -32)
+                                          : double(m_phase) / m_up;
+  return double(m_shifted + m_next - (m_taps - 1)) + fraction - m_delay;
+}
+
+size_t Resampler::maxOutputFrames(size_t inputFrames) const {
+  // Variable rate allows for up to 1% speed-up.
+  uint64_t frames = uint64_t(inputFrames) * m_up / m_down;
+  if (m_config.variableRate)
+    frames += frames / 100;
+  return static_cast<size_t>(frames) + 2;
+}
+
+size_t Resampler::process(const float *in, size_t frames, float *out) {
+  if (!m_bank)
+    return 0;
+
+  size_t produced = 0;
+  for (size_t offset = 0; offset < frames; offset += CHUNK_FRAMES) {
+    size_t chunk = std::min(CHUNK_FRAMES, frames - offset);
+    produced += processChunk(in + offset * m_config.channels, chunk,
+                             out + produced * m_outChannels, SIZE_MAX);
+  }
+  m_inputFrames += frames;
+  return produced;
+}
+
+size_t Resampler::drain(float *out) {
+  if (!m_bank)
+    return 0;
+
+  uint64_t total = (m_inputFrames * m_up + m_down - 1) / m_down;
+  if (m_config.variableRate) {
+    // Outputs still due are those placed before the end of the input.
+    double remaining = double(m_inputFrames) - outputPosition();
+    double step = std::ldexp(double(m_stepFixed), -32);
+    total = m_outputFrames +
+            (remaining > 0 ? static_cast<uint64_t>(std::ceil(remaining / step))
+                           : 0);
+  }
+  size_t produced = 0;
+  // Zeros push the remaining real input through the filter; stop once the
+  // output covers it.
+  while (m_outputFrames < total) {
+    size_t wanted = static_cast<size_t>(total - m_outputFrames);
+    produced += processChunk(nullptr, CHUNK_FRAMES,
+                             out + produced * m_outChannels, wanted);
+  }
+  return produced;
+}
+
+void Resampler::deinterleave(const float *in, size_t frames) {
+  const size_t keep = m_taps - 1;
+  const uint16_t channels = m_config.channels;
+
+  // Behind the history, mixing down if requested.
+  if (!in) {
+    for (std::vector<float> &channel : m_planar)
+      std::fill(channel.begin() + keep, channel.begin() + keep + frames, 0.0f);
+  } else if (m_config.mono && channels > 1) {
+    m_downmix(reinterpret_cast<const uint8_t *>(in), frames, channels,
+              m_planar[0].data() + keep);
+  } else {
+    for (uint16_t c = 0; c < channels; ++c) {
+      float *dst = m_planar[c].data() + keep;
+      for (size_t i = 0; i < frames; ++i)
+        dst[i] = in[i * channels + c];
+    }
+  }
+}
+
+size_t Resampler::processChunk(const float *in, size_t frames, float *out,
+                               size_t maxOut) {
+  const size_t keep = m_taps - 1;
+  deinterleave(in, frames);
+
+  const size_t available = keep + frames;
+  const float *coeffs = m_bank->coeffs.data();
+  size_t produced = 0;
+  if (m_config.variableRate) {
+    // The top bits of the fraction pick the phase; the rest weight the
+    // next phase in.
+    constexpr int FRACTION_BITS = 32 - 8;
+    static_assert(VARIABLE_PHASES == 1u << 8, "phase bits");
+    while (m_next < available && produced < maxOut) {
+      const float *phase = coeffs + size_t(m_phase >> FRACTION_BITS) * m_taps;
+      const float weight = static_cast<float>(
+          std::ldexp(double(m_phase & ((1u << FRACTION_BITS) - 1)),
+                     -FRACTION_BITS));
+      const size_t first = m_next - keep;
+      for (uint16_t c = 0; c < m_outChannels; ++c) {
+        const float *samples = m_planar[c].data() + first;
+        float a = m_kernel(phase, samples, m_taps);
+        float b = m_kernel(phase + m_taps, samples, m_taps);
+        out[produced * m_outChannels + c] = a + weight * (b - a);
+      }
+      ++produced;
+
+      uint64_t position = uint64_t(m_phase) + m_stepFixed;
+      m_next += static_cast<size_t>(position >> 32);
+      m_phase = static_cast<uint32_t>(position);
+    }
+  } else {
+    while (m_next < available && produced < maxOut) {
+      const float *phase = coeffs + size_t(m_phase) * m_taps;
+      const size_t first = m_next - keep;
+      for (uint16_t c = 0; c < m_outChannels; ++c)
+        out[produced * m_outChannels + c] =
+            m_kernel(phase, m_planar[c].data() + first, m_taps);
+      ++produced;
+
+      m_next += m_step;
+      m_phase += m_stepPhase;
+      if (m_phase >= m_up) {
+        m_phase -= m_up;
+        ++m_next;
+      }
+    }
+  }
+
+  for (std::vector<float> &channel : m_planar)
+    memmove(channel.data(), channel.data() + frames, keep * sizeof(float));
+  m_next -= frames;
+  m_shifted += frames;
+  m_outputFrames += produced;
+  return produced;
+}
@@ -0,0 +1,61 @@
+#include "RingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+  size_t result = 1;
+  while (result < value)
+    result <<= 1;
+  return result;
+}
+
+SpscRingBuffer::SpscRingBuffer(size_t capacity)
+    : m_capacity(roundUpToPowerOfTwo(std::max<size_t>(capacity, 2))),
+      m_mask(m_capacity - 1), m_buffer(m_capacity) {}
+
+bool SpscRingBuffer::push(const uint8_t *data, size_t size) {
+  const size_t writePos = m_writePos.load(std::memory_order_relaxed);
+
+  if (m_capacity - (writePos - m_cachedReadPos) < size) {
+    m_cachedReadPos = m_readPos.load(std::memory_order_acquire);
+    if (m_capacity - (writePos - m_cachedReadPos) < size) {
+      m_overruns.fetch_add(1, std::memory_order_relaxed);
+      m_droppedBytes.fetch_add(size, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  const size_t offset = writePos & m_mask;
+  const size_t first = std::min(size, m_capacity - offset);
+  memcpy(&m_buffer[offset], data, first);
+  if (size > first)
+    memcpy(&m_buffer[0], data + first, size - first);
+
+  m_writePos.store(writePos + size, std::memory_order_release);
+  return true;
+}
+
+size_t SpscRingBuffer::peek(const uint8_t **data) const {
+  const size_t readPos = m_readPos.load(std::memory_order_relaxed);
+  const size_t writePos = m_writePos.load(std::memory_order_acquire);
+
+  // Tracked on the consumer side: the producer only has a stale read index
+  // and would over-report.
+  const size_t available = writePos - readPos;
+  if (available > m_highWaterMark.load(std::memory_order_relaxed))
+    m_highWaterMark.store(available, std::memory_order_relaxed);
+
+  const size_t offset = readPos & m_mask;
+  *data = &m_buffer[offset];
+  return std::min(available, m_capacity - offset);
+}
+
+void SpscRingBuffer::consume(size_t size) {
+  m_readPos.store(m_readPos.load(std::memory_order_relaxed) + size,
+                  std::memory_order_release);
+}
+
+size_t SpscRingBuffer::readAvailable() const {
+  return m_writePos.load(std::memory_order_acquire) -
+         m_readPos.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,44 @@
+#include "SampleBlock.h"
+
+namespace {
+
+template <SampleFormat Format, uint16_t Channels>
+void decodeKernel(const uint8_t *src, size_t frames, uint16_t channels,
+                  float *dst) {
+  decodeBlock(SampleBlock<Format, Channels>(src, frames, channels), dst);
+}
+
+template <SampleFormat Format, uint16_t Channels>
+void downmixKernel(const uint8_t *src, size_t frames, uint16_t channels,
+                   float *dst) {
+  downmixBlock(SampleBlock<Format, Channels>(src, frames, channels), dst);
+}
+
+template <SampleFormat Format, uint16_t Channels>
+constexpr BlockKernels kernelsFor() {
+  return {decodeKernel<Format, Channels>, downmixKernel<Format, Channels>,
+          Channels};
+}
+
+// Run-time channel count, mono, stereo.
+template <SampleFormat Format>
+constexpr BlockKernels FORMAT_KERNELS[3] = {
+    kernelsFor<Format, DYNAMIC_CHANNELS>(), kernelsFor<Format, 1>(),
+    kernelsFor<Format, 2>()};
+
+} // namespace
+
+const BlockKernels &blockKernels(SampleFormat format, uint16_t channels) {
+  const size_t layout = channels == 1 ? 1 : channels == 2 ? 2 : 0;
+  switch (format) {
+  case SampleFormat::Int16:
+    return FORMAT_KERNELS<SampleFormat::Int16>[layout];
+  case SampleFormat::Int24:
+    return FORMAT_KERNELS<SampleFormat::Int24>[layout];
+  case SampleFormat::Int32:
+    return FORMAT_KERNELS<SampleFormat::Int32>[layout];
+  case SampleFormat::Float32:
+    break;
+  }
+  return FORMAT_KERNELS<SampleFormat::Float32>[layout];
+}
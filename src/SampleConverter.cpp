@@ -0,0 +1,466 @@
+#include "SampleConverter.h"
+#include "SampleBlock.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define SAMPLE_CONVERTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+#endif
+
+using DitherState = SampleConverter::DitherState;
+
+namespace {
+
+constexpr int DITHER_LANES = SampleConverter::DITHER_LANES;
+
+// Clip limits are applied in the float domain before rounding. 2147483520 is
+// the largest float below 2^31.
+struct Int16Traits {
+  static constexpr size_t BYTES = 2;
+  static constexpr float SCALE = 32768.0f;
+  static constexpr float LO = -32768.0f;
+  static constexpr float HI = 32767.0f;
+  static void store(uint8_t *dst, int32_t value) {
+    int16_t sample = static_cast<int16_t>(value);
+    memcpy(dst, &sample, 2);
+  }
+};
+
+struct Int24Traits {
+  static constexpr size_t BYTES = 3;
+  static constexpr float SCALE = 8388608.0f;
+  static constexpr float LO = -8388608.0f;
+  static constexpr float HI = 8388607.0f;
+  static void store(uint8_t *dst, int32_t value) {
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+    dst[2] = static_cast<uint8_t>(value >> 16);
+  }
+};
+
+struct Int32Traits {
+  static constexpr size_t BYTES = 4;
+  static constexpr float SCALE = 2147483648.0f;
+  static constexpr float LO = -2147483648.0f;
+  static constexpr float HI = 2147483520.0f;
+  static void store(uint8_t *dst, int32_t value) { memcpy(dst, &value, 4); }
+};
+
+inline uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// Triangular noise in (-1, 1) LSB: difference of the two 16-bit halves of one
+// xorshift32 draw.
+inline float ditherSample(DitherState *dither) {
+  uint32_t r = nextRandom(dither->lanes[dither->phase]);
+  dither->phase = (dither->phase + 1) % DITHER_LANES;
+  return (static_cast<float>(static_cast<int32_t>(r & 0xFFFF)) -
+          static_cast<float>(static_cast<int32_t>(r >> 16))) *
+         (1.0f / 65536.0f);
+}
+
+// Comparison order matches MAXPS/MINPS so NaN clips to LO in every kernel.
+template <typename Traits> inline int32_t quantize(float x, float dither) {
+  float y = x * Traits::SCALE + dither;
+  y = y > Traits::LO ? y : Traits::LO;
+  y = y < Traits::HI ? y : Traits::HI;
+  return static_cast<int32_t>(std::lrintf(y));
+}
+
+template <typename Traits>
+void convertScalar(const float *src, size_t samples, uint8_t *dst,
+                   DitherState *dither) {
+  for (size_t i = 0; i < samples; ++i) {
+    float d = dither ? ditherSample(dither) : 0.0f;
+    Traits::store(dst + i * Traits::BYTES, quantize<Traits>(src[i], d));
+  }
+}
+
+void copyFloat(const float *src, size_t samples, uint8_t *dst, DitherState *) {
+  memcpy(dst, src, samples * sizeof(float));
+}
+
+// Runs the scalar kernel until the dither phase is back at lane 0 so the
+// vector loop can map generator i to vector lane i.
+template <typename Traits>
+size_t alignDitherPhase(const float *src, size_t samples, uint8_t *dst,
+                        DitherState *dither) {
+  size_t lead = std::min<size_t>(
+      samples, (DITHER_LANES - dither->phase) % DITHER_LANES);
+  convertScalar<Traits>(src, lead, dst, dither);
+  return lead;
+}
+
+#ifdef SAMPLE_CONVERTER_X86
+
+// ---- SSE2 -----------------------------------------------------------------
+
+inline __m128i nextRandomSse2(__m128i state) {
+  state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+  state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+  return _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+}
+
+inline __m128 ditherSse2(__m128i r) {
+  __m128 a = _mm_cvtepi32_ps(_mm_and_si128(r, _mm_set1_epi32(0xFFFF)));
+  __m128 b = _mm_cvtepi32_ps(_mm_srli_epi32(r, 16));
+  return _mm_mul_ps(_mm_sub_ps(a, b), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+template <typename Traits> inline void storeSse2(uint8_t *dst, __m128i v);
+
+template <> inline void storeSse2<Int16Traits>(uint8_t *dst, __m128i v) {
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packs_epi32(v, v));
+}
+
+template <> inline void storeSse2<Int24Traits>(uint8_t *dst, __m128i v) {
+  alignas(16) int32_t values[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(values), v);
+  for (int k = 0; k < 4; ++k)
+    Int24Traits::store(dst + 3 * k, values[k]);
+}
+
+template <> inline void storeSse2<Int32Traits>(uint8_t *dst, __m128i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+}
+
+template <typename Traits>
+inline __m128i quantizeSse2(const float *src, __m128 dither) {
+  __m128 y = _mm_add_ps(
+      _mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(Traits::SCALE)), dither);
+  y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(Traits::LO)),
+                 _mm_set1_ps(Traits::HI));
+  return _mm_cvtps_epi32(y);
+}
+
+template <typename Traits>
+void convertSse2(const float *src, size_t samples, uint8_t *dst,
+                 DitherState *dither) {
+  size_t i = 0;
+  if (dither) {
+    i = alignDitherPhase<Traits>(src, samples, dst, dither);
+    __m128i state[4];
+    for (int k = 0; k < 4; ++k)
+      state[k] = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(dither->lanes + 4 * k));
+    for (; i + DITHER_LANES <= samples; i += DITHER_LANES) {
+      for (int k = 0; k < 4; ++k) {
+        state[k] = nextRandomSse2(state[k]);
+        __m128i v =
+            quantizeSse2<Traits>(src + i + 4 * k, ditherSse2(state[k]));
+        storeSse2<Traits>(dst + (i + 4 * k) * Traits::BYTES, v);
+      }
+    }
+    for (int k = 0; k < 4; ++k)
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dither->lanes + 4 * k),
+                       state[k]);
+  } else {
+    for (; i + 4 <= samples; i += 4)
+      storeSse2<Traits>(dst + i * Traits::BYTES,
+                        quantizeSse2<Traits>(src + i, _mm_setzero_ps()));
+  }
+  convertScalar<Traits>(src + i, samples - i, dst + i * Traits::BYTES, dither);
+}
+
+// ---- AVX2 -----------------------------------------------------------------
+
+TARGET_AVX2 inline __m256i nextRandomAvx2(__m256i state) {
+  state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+  state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+  return _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+}
+
+TARGET_AVX2 inline __m256 ditherAvx2(__m256i r) {
+  __m256 a =
+      _mm256_cvtepi32_ps(_mm256_and_si256(r, _mm256_set1_epi32(0xFFFF)));
+  __m256 b = _mm256_cvtepi32_ps(_mm256_srli_epi32(r, 16));
+  return _mm256_mul_ps(_mm256_sub_ps(a, b), _mm256_set1_ps(1.0f / 65536.0f));
+}
+
+template <typename Traits> struct StoreAvx2;
+
+template <> struct StoreAvx2<Int16Traits> {
+  TARGET_AVX2 static void store(uint8_t *dst, __m256i v) {
+    __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(v),
+                                     _mm256_extracti128_si256(v, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), packed);
+  }
+};
+
+template <> struct StoreAvx2<Int24Traits> {
+  TARGET_AVX2 static void store(uint8_t *dst, __m256i v) {
+    // Drop the top byte of every sample, packing each 128-bit lane's four
+    // samples into its low 12 bytes.
+    const __m256i pack = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5,
+        6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    v = _mm256_shuffle_epi8(v, pack);
+    __m128i lo = _mm256_castsi256_si128(v);
+    __m128i hi = _mm256_extracti128_si256(v, 1);
+    int32_t tail;
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), lo);
+    tail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+    memcpy(dst + 8, &tail, 4);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 12), hi);
+    tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+    memcpy(dst + 20, &tail, 4);
+  }
+};
+
+template <> struct StoreAvx2<Int32Traits> {
+  TARGET_AVX2 static void store(uint8_t *dst, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), v);
+  }
+};
+
+template <typename Traits>
+TARGET_AVX2 inline __m256i quantizeAvx2(const float *src, __m256 dither) {
+  __m256 y = _mm256_add_ps(
+      _mm256_mul_ps(_mm256_loadu_ps(src), _mm256_set1_ps(Traits::SCALE)),
+      dither);
+  y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(Traits::LO)),
+                    _mm256_set1_ps(Traits::HI));
+  return _mm256_cvtps_epi32(y);
+}
+
+template <typename Traits>
+TARGET_AVX2 void convertAvx2(const float *src, size_t samples, uint8_t *dst,
+                             DitherState *dither) {
+  size_t i = 0;
+  if (dither) {
+    i = alignDitherPhase<Traits>(src, samples, dst, dither);
+    __m256i state[2];
+    for (int k = 0; k < 2; ++k)
+      state[k] = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(dither->lanes + 8 * k));
+    for (; i + DITHER_LANES <= samples; i += DITHER_LANES) {
+      for (int k = 0; k < 2; ++k) {
+        state[k] = nextRandomAvx2(state[k]);
+        __m256i v =
+            quantizeAvx2<Traits>(src + i + 8 * k, ditherAvx2(state[k]));
+        StoreAvx2<Traits>::store(dst + (i + 8 * k) * Traits::BYTES, v);
+      }
+    }
+    for (int k = 0; k < 2; ++k)
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dither->lanes + 8 * k),
+                          state[k]);
+  } else {
+    for (; i + 8 <= samples; i += 8)
+      StoreAvx2<Traits>::store(
+          dst + i * Traits::BYTES,
+          quantizeAvx2<Traits>(src + i, _mm256_setzero_ps()));
+  }
+  convertScalar<Traits>(src + i, samples - i, dst + i * Traits::BYTES, dither);
+}
+
+// ---- AVX-512 --------------------------------------------------------------
+
+TARGET_AVX512 inline __m512i nextRandomAvx512(__m512i state) {
+  state = _mm512_xor_si512(state, _mm512_slli_epi32(state, 13));
+  state = _mm512_xor_si512(state, _mm512_srli_epi32(state, 17));
+  return _mm512_xor_si512(state, _mm512_slli_epi32(state, 5));
+}
+
+TARGET_AVX512 inline __m512 ditherAvx512(__m512i r) {
+  __m512 a =
+      _mm512_cvtepi32_ps(_mm512_and_si512(r, _mm512_set1_epi32(0xFFFF)));
+  __m512 b = _mm512_cvtepi32_ps(_mm512_srli_epi32(r, 16));
+  return _mm512_mul_ps(_mm512_sub_ps(a, b), _mm512_set1_ps(1.0f / 65536.0f));
+}
+
+template <typename Traits> struct StoreAvx512;
+
+template <> struct StoreAvx512<Int16Traits> {
+  TARGET_AVX512 static void store(uint8_t *dst, __m512i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        _mm512_cvtepi32_epi16(v));
+  }
+};
+
+template <> struct StoreAvx512<Int24Traits> {
+  TARGET_AVX512 static void store(uint8_t *dst, __m512i v) {
+    const __m512i pack = _mm512_broadcast_i32x4(_mm_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+    const __m512i gather = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10, 12,
+                                             13, 14, 3, 7, 11, 15);
+    v = _mm512_permutexvar_epi32(gather, _mm512_shuffle_epi8(v, pack));
+    _mm512_mask_storeu_epi32(dst, 0x0FFF, v);
+  }
+};
+
+template <> struct StoreAvx512<Int32Traits> {
+  TARGET_AVX512 static void store(uint8_t *dst, __m512i v) {
+    _mm512_storeu_si512(dst, v);
+  }
+};
+
+template <typename Traits>
+TARGET_AVX512 inline __m512i quantizeAvx512(const float *src, __m512 dither) {
+  __m512 y = _mm512_add_ps(
+      _mm512_mul_ps(_mm512_loadu_ps(src), _mm512_set1_ps(Traits::SCALE)),
+      dither);
+  y = _mm512_min_ps(_mm512_max_ps(y, _mm512_set1_ps(Traits::LO)),
+                    _mm512_set1_ps(Traits::HI));
+  return _mm512_cvtps_epi32(y);
+}
+
+template <typename Traits>
+TARGET_AVX512 void convertAvx512(const float *src, size_t samples,
+                                 uint8_t *dst, DitherState *dither) {
+  size_t i = 0;
+  if (dither) {
+    i = alignDitherPhase<Traits>(src, samples, dst, dither);
+    __m512i state = _mm512_loadu_si512(dither->lanes);
+    for (; i + DITHER_LANES <= samples; i += DITHER_LANES) {
+      state = nextRandomAvx512(state);
+      StoreAvx512<Traits>::store(
+          dst + i * Traits::BYTES,
+          quantizeAvx512<Traits>(src + i, ditherAvx512(state)));
+    }
+    _mm512_storeu_si512(dither->lanes, state);
+  } else {
+    for (; i + 16 <= samples; i += 16)
+      StoreAvx512<Traits>::store(
+          dst + i * Traits::BYTES,
+          quantizeAvx512<Traits>(src + i, _mm512_setzero_ps()));
+  }
+  convertScalar<Traits>(src + i, samples - i, dst + i * Traits::BYTES, dither);
+}
+
+#endif
+
+template <typename Traits>
+SampleConverter::Kernel selectKernel(SimdLevel level) {
+#ifdef SAMPLE_CONVERTER_X86
+  switch (level) {
+  case SimdLevel::Avx512:
+    return convertAvx512<Traits>;
+  case SimdLevel::Avx2:
+    return convertAvx2<Traits>;
+  case SimdLevel::Sse2:
+    return convertSse2<Traits>;
+  default:
+    break;
+  }
+#else
+  (void)level;
+#endif
+  return convertScalar<Traits>;
+}
+
+} // namespace
+
+SampleConverter::SampleConverter(SampleFormat output, bool dither,
+                                 SimdLevel level)
+    : m_output(output), m_level(level), m_dither(dither) {
+  // Never run a kernel the CPU cannot execute.
+  SimdLevel supported = detectSimdLevel();
+  if (static_cast<int>(m_level) > static_cast<int>(supported))
+    m_level = supported;
+
+  switch (output) {
+  case SampleFormat::Int16:
+    m_kernel = selectKernel<Int16Traits>(m_level);
+    break;
+  case SampleFormat::Int24:
+    m_kernel = selectKernel<Int24Traits>(m_level);
+    break;
+  case SampleFormat::Int32:
+    m_kernel = selectKernel<Int32Traits>(m_level);
+    break;
+  case SampleFormat::Float32:
+  default:
+    m_kernel = copyFloat;
+    m_dither = false;
+    break;
+  }
+  resetDither();
+}
+
+void SampleConverter::resetDither(uint32_t seed) {
+  for (int i = 0; i < DITHER_LANES; ++i) {
+    // splitmix-style scramble; xorshift state must be non-zero.
+    uint32_t z = seed + 0x9E3779B9u * static_cast<uint32_t>(i + 1);
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    z ^= z >> 16;
+    m_ditherState.lanes[i] = z ? z : 0x6D2B79F5u;
+  }
+  m_ditherState.phase = 0;
+}
+
+size_t SampleConverter::convert(const float *src, size_t samples,
+                                uint8_t *dst) {
+  m_kernel(src, samples, dst, m_dither ? &m_ditherState : nullptr);
+  return samples * bytesPerSample(m_output);
+}
+
+SimdLevel SampleConverter::detectSimdLevel() {
+#if defined(SAMPLE_CONVERTER_X86) && defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  int maxLeaf = info[0];
+  __cpuid(info, 1);
+  bool sse2 = (info[3] & (1 << 26)) != 0;
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  bool ymmState = (xcr0 & 0x6) == 0x6;
+  bool zmmState = (xcr0 & 0xE6) == 0xE6;
+  bool avx2 = false, avx512 = false;
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+    avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+  }
+  if (avx512 && zmmState)
+    return SimdLevel::Avx512;
+  if (avx2 && ymmState)
+    return SimdLevel::Avx2;
+  return sse2 ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#elif defined(SAMPLE_CONVERTER_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return SimdLevel::Avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return SimdLevel::Avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return SimdLevel::Sse2;
+  return SimdLevel::Scalar;
+#else
+  return SimdLevel::Scalar;
+#endif
+}
+
+const char *SampleConverter::simdLevelName(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Sse2:
+    return "sse2";
+  case SimdLevel::Avx2:
+    return "avx2";
+  case SimdLevel::Avx512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
+
+void decodeSamples(const uint8_t *src, SampleFormat format, size_t count,
+                   float *dst) {
+  // Decoding does not depend on the channel count.
+  blockKernels(format, 1).decode(src, count, 1, dst);
+}
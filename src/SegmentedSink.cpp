@@ -0,0 +1,253 @@
+#include "SegmentedSink.h"
+#include "Logger.h"
+#include "Utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+SegmentedSink::SegmentedSink(const std::string &path, uint32_t sampleRate,
+                             uint16_t frameBytes,
+                             const SegmentOptions &options, Factory factory)
+    : m_path(path), m_sampleRate(sampleRate),
+      m_frameBytes(std::max<uint16_t>(frameBytes, 1)), m_options(options),
+      m_factory(std::move(factory)) {
+  // Limits in whole frames, so every cut falls on a frame boundary.
+  uint64_t limitFrames = std::numeric_limits<uint64_t>::max() / m_frameBytes;
+  if (options.maxSeconds > 0.0)
+    limitFrames = std::min(
+        limitFrames,
+        std::max<uint64_t>(uint64_t(options.maxSeconds * sampleRate), 1));
+  if (options.maxBytes > 0)
+    limitFrames = std::min(
+        limitFrames, std::max<uint64_t>(options.maxBytes / m_frameBytes, 1));
+  m_segmentLimit = limitFrames * m_frameBytes;
+  m_preopenBytes = std::min<uint64_t>(
+      uint64_t(std::max(options.preopenSeconds, 0.0) * sampleRate) *
+          m_frameBytes,
+      m_segmentLimit / 2);
+  m_cutAt = m_segmentLimit;
+}
+
+SegmentedSink::~SegmentedSink() { finalize(); }
+
+std::string SegmentedSink::segmentPath(const std::string &path,
+                                       unsigned index) {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "-%04u", index);
+  size_t slash = path.find_last_of("/\\");
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + suffix;
+  return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+bool SegmentedSink::initialize() {
+  m_index = 1;
+  m_current = m_factory(segmentPath(m_path, m_index));
+  if (!m_current || !m_current->initialize()) {
+    LOG_ERROR << "[SegmentedSink] Could not create "
+              << segmentPath(m_path, m_index);
+    m_current.reset();
+    return false;
+  }
+  m_segmentBytes = 0;
+  m_cutAt = m_segmentLimit;
+  m_stop = false;
+  m_thread = std::thread(&SegmentedSink::rotationThread, this);
+  return true;
+}
+
+void SegmentedSink::write(const uint8_t *data, uint32_t size) {
+  append(data, size, nullptr, false);
+}
+
+void SegmentedSink::writeTimed(const uint8_t *data, uint32_t size,
+                               const BlockTimestamp &time) {
+  append(data, size, &time, false);
+}
+
+void SegmentedSink::writeSilence(uint32_t size, const BlockTimestamp &time) {
+  append(nullptr, size, &time, true);
+}
+
+bool SegmentedSink::flush() { return !m_current || m_current->flush(); }
+
+void SegmentedSink::append(const uint8_t *data, uint32_t size,
+                           const BlockTimestamp *time, bool silent) {
+  if (!m_current)
+    return;
+
+  BlockTimestamp start;
+  if (time)
+    start = *time;
+  while (size > 0) {
+    if (m_segmentBytes >= m_cutAt)
+      cut();
+    if (!m_opening && m_segmentBytes + size + m_preopenBytes > m_cutAt)
+      requestOpen();
+
+    uint32_t chunk = static_cast<uint32_t>(
+        std::min<uint64_t>(size, m_cutAt - m_segmentBytes));
+    if (silent)
+      m_current->writeSilence(chunk, start);
+    else if (start.valid())
+      m_current->writeTimed(data, chunk, start);
+    else
+      m_current->write(data, chunk);
+    m_segmentBytes += chunk;
+    size -= chunk;
+    if (!silent)
+      data += chunk;
+
+    // What is left opens the next segment, at this timestamp.
+    if (start.valid()) {
+      uint64_t frames = chunk / m_frameBytes;
+      start.position += frames;
+      start.hostTimeNs += static_cast<int64_t>(frames * 1e9 / m_sampleRate);
+    }
+  }
+}
+
+void SegmentedSink::requestOpen() {
+  m_opening = true;
+  Job job;
+  job.type = Job::Type::Open;
+  job.index = m_index + 1;
+  job.frames = 0;
+  post(std::move(job));
+}
+
+bool SegmentedSink::cut() {
+  if (!m_opening)
+    requestOpen();
+  std::unique_ptr<AudioSink> next;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_nextDone) {
+      ++m_lateCuts;
+      m_cv.wait(lock, [this] { return m_nextDone; });
+    }
+    next = std::move(m_next);
+    m_nextDone = false;
+  }
+  m_opening = false;
+
+  if (!next) {
+    // Nothing is lost: the current segment runs on for another length.
+    LOG_ERROR << "[SegmentedSink] Could not create "
+              << segmentPath(m_path, m_index + 1) << ", continuing "
+              << segmentPath(m_path, m_index);
+    m_failed = true;
+    m_cutAt += m_segmentLimit;
+    return false;
+  }
+
+  Job job;
+  job.type = Job::Type::Close;
+  job.index = m_index;
+  job.sink = std::move(m_current);
+  job.frames = m_segmentBytes / m_frameBytes;
+  post(std::move(job));
+  m_current = std::move(next);
+  ++m_index;
+  m_segmentBytes = 0;
+  m_cutAt = m_segmentLimit;
+  return true;
+}
+
+bool SegmentedSink::finalize() {
+  if (!m_current)
+    return !m_failed;
+
+  // A segment created ahead of a cut that never came.
+  if (m_opening) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return m_nextDone; });
+      job.sink = std::move(m_next);
+      m_nextDone = false;
+    }
+    m_opening = false;
+    job.type = Job::Type::Discard;
+    job.index = m_index + 1;
+    job.frames = 0;
+    post(std::move(job));
+  }
+
+  Job job;
+  job.type = Job::Type::Close;
+  job.index = m_index;
+  job.sink = std::move(m_current);
+  job.frames = m_segmentBytes / m_frameBytes;
+  post(std::move(job));
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  return !m_failed;
+}
+
+void SegmentedSink::post(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_cv.notify_all();
+}
+
+void SegmentedSink::rotationThread() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        return;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+
+    std::string path = segmentPath(m_path, job.index);
+    switch (job.type) {
+    case Job::Type::Open: {
+      std::unique_ptr<AudioSink> sink = m_factory(path);
+      if (sink && !sink->initialize())
+        sink.reset();
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_next = std::move(sink);
+        m_nextDone = true;
+      }
+      m_cv.notify_all();
+      break;
+    }
+    case Job::Type::Close: {
+      bool ok = job.sink->finalize();
+      job.sink.reset();
+      ok = Utils::syncFile(path) && ok;
+      if (!ok) {
+        m_failed = true;
+        LOG_ERROR << "[SegmentedSink] Failed to finalize " << path;
+      } else {
+        LOG_INFO << "[SegmentedSink] Closed " << path << " (" << job.frames
+                 << " frames)";
+      }
+      if (m_options.onClosed)
+        m_options.onClosed(path, job.frames, ok);
+      break;
+    }
+    case Job::Type::Discard:
+      if (job.sink) {
+        job.sink->finalize();
+        job.sink.reset();
+        std::remove(path.c_str());
+      }
+      break;
+    }
+  }
+}
@@ -0,0 +1,143 @@
+#include "SharedMemoryReader.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SharedMemoryReader::SharedMemoryReader(const std::string &name)
+    : m_name(sharedStreamObjectName(name)) {}
+
+SharedMemoryReader::~SharedMemoryReader() { close(); }
+
+bool SharedMemoryReader::open(bool fromOldest) {
+  close();
+  // Read-write only for the header's waiter count; the ring is read-only.
+  m_fd = shm_open(m_name.c_str(), O_RDWR, 0);
+  if (m_fd < 0)
+    return false;
+
+  struct stat info;
+  const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  m_headerSize = (sizeof(SharedStreamHeader) + page - 1) / page * page;
+  if (fstat(m_fd, &info) != 0 || uint64_t(info.st_size) < m_headerSize) {
+    close();
+    return false;
+  }
+  void *header = mmap(nullptr, m_headerSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, m_fd, 0);
+  if (header == MAP_FAILED) {
+    close();
+    return false;
+  }
+  m_header = static_cast<SharedStreamHeader *>(header);
+  if (m_header->magic.load(std::memory_order_acquire) != SHARED_STREAM_MAGIC ||
+      m_header->version != SHARED_STREAM_VERSION ||
+      m_header->headerSize != m_headerSize ||
+      uint64_t(info.st_size) < m_headerSize + m_header->capacity) {
+    close();
+    return false;
+  }
+
+  m_capacity = m_header->capacity;
+  m_ring = sharedStreamMapRing(m_fd, m_headerSize, m_capacity, false);
+  if (!m_ring) {
+    close();
+    return false;
+  }
+  m_frameBytes = static_cast<uint16_t>(
+      std::max(m_header->channels * (m_header->bitsPerSample / 8), 1));
+  uint64_t written = m_header->written.load(std::memory_order_acquire);
+  m_position = written;
+  if (fromOldest) {
+    // Up to three quarters of a ring back, clear of the bytes the writer
+    // overwrites next.
+    uint64_t keep = std::min(written, m_capacity - m_capacity / 4);
+    m_position = written - keep / m_frameBytes * m_frameBytes;
+  }
+  m_lostBytes = 0;
+  m_overruns = 0;
+  return true;
+}
+
+void SharedMemoryReader::close() {
+  sharedStreamUnmapRing(m_ring, m_capacity);
+  m_ring = nullptr;
+  if (m_header) {
+    munmap(m_header, m_headerSize);
+    m_header = nullptr;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+size_t SharedMemoryReader::peek(const uint8_t **data) {
+  if (!m_header)
+    return 0;
+
+  uint64_t written = m_header->written.load(std::memory_order_acquire);
+  if (written - m_position > m_capacity) {
+    // A whole ring behind: what is left may be overwritten at any moment,
+    // so pick up at the live edge.
+    m_lostBytes += written - m_position;
+    ++m_overruns;
+    m_position = written;
+  }
+  *data = m_ring + m_position % m_capacity;
+  return static_cast<size_t>(written - m_position);
+}
+
+size_t SharedMemoryReader::wait(const uint8_t **data, int timeoutMs) {
+  if (size_t size = peek(data))
+    return size;
+  if (!m_header ||
+      m_header->state.load(std::memory_order_acquire) ==
+          static_cast<uint32_t>(SharedStreamState::Ended))
+    return 0;
+
+  // The writer bumps the sequence after every publish: if it moved since
+  // we looked, the futex returns at once instead of sleeping.
+  uint32_t sequence = m_header->wakeSequence.load(std::memory_order_seq_cst);
+  if (size_t size = peek(data))
+    return size;
+  m_header->waiters.fetch_add(1, std::memory_order_seq_cst);
+  sharedStreamWait(&m_header->wakeSequence, sequence, timeoutMs);
+  m_header->waiters.fetch_sub(1, std::memory_order_relaxed);
+  return peek(data);
+}
+
+bool SharedMemoryReader::consume(size_t size) {
+  if (!m_header)
+    return false;
+
+  uint64_t start = m_position;
+  m_position += size;
+  // Seqlock-style validation: whatever the writer may have started
+  // overwriting is covered by |reserved|.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t reserved = m_header->reserved.load(std::memory_order_relaxed);
+  if (reserved <= start + m_capacity)
+    return true;
+  m_lostBytes += size;
+  ++m_overruns;
+  return false;
+}
+
+bool SharedMemoryReader::ended() const {
+  return !m_header ||
+         (m_header->state.load(std::memory_order_acquire) ==
+              static_cast<uint32_t>(SharedStreamState::Ended) &&
+          m_position == m_header->written.load(std::memory_order_acquire));
+}
+
+bool SharedMemoryReader::latestTime(uint64_t &offset,
+                                    BlockTimestamp &time) const {
+  return m_header && sharedStreamLoadTime(*m_header, offset, time);
+}
+
+#endif // PLATFORM_LINUX
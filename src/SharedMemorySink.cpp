@@ -0,0 +1,178 @@
+#include "SharedMemorySink.h"
+
+#ifdef PLATFORM_LINUX
+
+#include "Logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+SharedMemorySink::SharedMemorySink(const std::string &name,
+                                   uint32_t sampleRate, uint16_t channels,
+                                   SampleFormat format,
+                                   const SharedStreamOptions &options,
+                                   std::unique_ptr<AudioSink> inner)
+    : m_name(sharedStreamObjectName(name)), m_sampleRate(sampleRate),
+      m_channels(channels), m_format(format), m_options(options),
+      m_inner(std::move(inner)) {}
+
+SharedMemorySink::~SharedMemorySink() { close(); }
+
+bool SharedMemorySink::initialize() {
+  if (!create()) {
+    LOG_WARN << "[SharedMemorySink] WARNING: Could not create live stream "
+             << m_name << ": " << strerror(errno);
+    if (m_fd >= 0)
+      shm_unlink(m_name.c_str());
+    close();
+  } else {
+    LOG_INFO << "[SharedMemorySink] Publishing " << m_name << " ("
+             << m_capacity << "-byte ring)";
+  }
+  return !m_inner || m_inner->initialize();
+}
+
+bool SharedMemorySink::create() {
+  const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  const uint64_t frameBytes =
+      std::max<uint64_t>(uint64_t(m_channels) * bytesPerSample(m_format), 1);
+  // Whole pages for the mirror mapping, whole frames so a reader that
+  // skips ahead lands on a frame.
+  uint64_t unit = page;
+  while (unit % frameBytes != 0)
+    unit += page;
+  uint64_t wanted = static_cast<uint64_t>(
+      std::max(m_options.capacitySeconds, 0.0) * m_sampleRate * frameBytes);
+  m_capacity = std::max<uint64_t>((wanted + unit - 1) / unit, 1) * unit;
+  m_headerSize = (sizeof(SharedStreamHeader) + page - 1) / page * page;
+
+  // Replace a stream left behind by an earlier run; its readers keep their
+  // mapping of the old object.
+  shm_unlink(m_name.c_str());
+  m_fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL,
+                  static_cast<mode_t>(m_options.mode));
+  if (m_fd < 0)
+    return false;
+  if (ftruncate(m_fd, static_cast<off_t>(m_headerSize + m_capacity)) != 0)
+    return false;
+
+  void *header = mmap(nullptr, m_headerSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, m_fd, 0);
+  if (header == MAP_FAILED)
+    return false;
+  m_header = new (header) SharedStreamHeader();
+  m_ring = sharedStreamMapRing(m_fd, m_headerSize, m_capacity, true);
+  if (!m_ring)
+    return false;
+
+  m_header->version = SHARED_STREAM_VERSION;
+  m_header->headerSize = static_cast<uint32_t>(m_headerSize);
+  m_header->sampleRate = m_sampleRate;
+  m_header->channels = m_channels;
+  m_header->bitsPerSample = static_cast<uint16_t>(bytesPerSample(m_format) * 8);
+  m_header->sampleFormat = static_cast<uint32_t>(m_format);
+  m_header->capacity = m_capacity;
+  m_header->writerPid = static_cast<int32_t>(getpid());
+  m_header->reserved.store(0, std::memory_order_relaxed);
+  m_header->written.store(0, std::memory_order_relaxed);
+  m_header->state.store(static_cast<uint32_t>(SharedStreamState::Live),
+                        std::memory_order_relaxed);
+  m_header->wakeSequence.store(0, std::memory_order_relaxed);
+  m_header->waiters.store(0, std::memory_order_relaxed);
+  m_header->timeSequence.store(0, std::memory_order_relaxed);
+  m_header->magic.store(SHARED_STREAM_MAGIC, std::memory_order_release);
+  m_written = 0;
+  return true;
+}
+
+void SharedMemorySink::close() {
+  sharedStreamUnmapRing(m_ring, m_capacity);
+  m_ring = nullptr;
+  if (m_header) {
+    munmap(m_header, m_headerSize);
+    m_header = nullptr;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void SharedMemorySink::write(const uint8_t *data, uint32_t size) {
+  publish(data, size, nullptr);
+  if (m_inner)
+    m_inner->write(data, size);
+}
+
+void SharedMemorySink::writeTimed(const uint8_t *data, uint32_t size,
+                                  const BlockTimestamp &time) {
+  publish(data, size, &time);
+  if (m_inner)
+    m_inner->writeTimed(data, size, time);
+}
+
+void SharedMemorySink::writeSilence(uint32_t size,
+                                    const BlockTimestamp &time) {
+  // Readers get real zeros; the inner sink may store a hole.
+  publish(nullptr, size, &time);
+  if (m_inner)
+    m_inner->writeSilence(size, time);
+}
+
+bool SharedMemorySink::flush() { return !m_inner || m_inner->flush(); }
+
+void SharedMemorySink::publish(const uint8_t *data, uint32_t size,
+                               const BlockTimestamp *time) {
+  if (!m_header || size == 0)
+    return;
+
+  if (time && time->valid()) {
+    uint32_t sequence = m_header->timeSequence.load(std::memory_order_relaxed);
+    m_header->timeSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->timeOffset.store(m_written, std::memory_order_relaxed);
+    m_header->timePosition.store(time->position, std::memory_order_relaxed);
+    m_header->timeHostNs.store(time->hostTimeNs, std::memory_order_relaxed);
+    m_header->timeSequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // A block larger than the ring only leaves its tail readable.
+  uint64_t skip = size > m_capacity ? size - m_capacity : 0;
+  uint64_t start = m_written + skip;
+  uint64_t end = m_written + size;
+  m_header->reserved.store(end, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  uint8_t *target = m_ring + start % m_capacity;
+  if (data)
+    memcpy(target, data + skip, end - start);
+  else
+    memset(target, 0, end - start);
+  m_header->written.store(end, std::memory_order_release);
+  m_written = end;
+
+  // Pairs with the waiters increment in SharedMemoryReader::wait(): either
+  // it sees the new sequence and does not sleep, or we see it waiting.
+  m_header->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+  if (m_header->waiters.load(std::memory_order_seq_cst) > 0)
+    sharedStreamWakeAll(&m_header->wakeSequence);
+}
+
+bool SharedMemorySink::finalize() {
+  if (m_header) {
+    m_header->state.store(static_cast<uint32_t>(SharedStreamState::Ended),
+                          std::memory_order_release);
+    m_header->wakeSequence.fetch_add(1, std::memory_order_seq_cst);
+    sharedStreamWakeAll(&m_header->wakeSequence);
+    shm_unlink(m_name.c_str());
+    LOG_INFO << "[SharedMemorySink] Ended " << m_name << " after "
+             << m_written << " bytes";
+  }
+  close();
+  return !m_inner || m_inner->finalize();
+}
+
+#endif // PLATFORM_LINUX
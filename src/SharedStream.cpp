@@ -0,0 +1,72 @@
+#include "SharedStream.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::string sharedStreamObjectName(const std::string &name) {
+  size_t start = name.find_first_not_of('/');
+  return "/" + (start == std::string::npos ? std::string() : name.substr(start));
+}
+
+uint8_t *sharedStreamMapRing(int fd, uint64_t offset, uint64_t capacity,
+                             bool writable) {
+  // Reserve both halves first so the two mappings land back to back.
+  void *base = mmap(nullptr, capacity * 2, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED)
+    return nullptr;
+
+  uint8_t *ring = static_cast<uint8_t *>(base);
+  int protection = PROT_READ | (writable ? PROT_WRITE : 0);
+  for (uint8_t *half : {ring, ring + capacity}) {
+    if (mmap(half, capacity, protection, MAP_SHARED | MAP_FIXED, fd,
+             static_cast<off_t>(offset)) == MAP_FAILED) {
+      munmap(base, capacity * 2);
+      return nullptr;
+    }
+  }
+  return ring;
+}
+
+void sharedStreamUnmapRing(uint8_t *ring, uint64_t capacity) {
+  if (ring)
+    munmap(ring, capacity * 2);
+}
+
+// Not FUTEX_PRIVATE_FLAG: the word is shared between processes.
+void sharedStreamWait(std::atomic<uint32_t> *word, uint32_t expected,
+                      int timeoutMs) {
+  timespec timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expected,
+          timeoutMs < 0 ? nullptr : &timeout, nullptr, 0);
+}
+
+void sharedStreamWakeAll(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX,
+          nullptr, nullptr, 0);
+}
+
+bool sharedStreamLoadTime(const SharedStreamHeader &header, uint64_t &offset,
+                          BlockTimestamp &time) {
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = header.timeSequence.load(std::memory_order_acquire);
+    offset = header.timeOffset.load(std::memory_order_relaxed);
+    time.position = header.timePosition.load(std::memory_order_relaxed);
+    time.hostTimeNs = header.timeHostNs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = header.timeSequence.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+  return time.valid();
+}
+
+#endif // PLATFORM_LINUX
@@ -0,0 +1,32 @@
+#include "SourceCapture.h"
+#include "Logger.h"
+#include "Utils.h"
+
+#ifdef PLATFORM_LINUX
+
+SourceCapture::SourceCapture(const std::string &outputFile,
+                             std::unique_ptr<CaptureSource> source)
+    : AudioCapture() {
+  m_outputFile = outputFile;
+  setSource(std::move(source));
+}
+
+bool SourceCapture::start() {
+  LOG_INFO << "[SourceCapture] Starting capture to " << m_outputFile;
+  Utils::createDirectory("output");
+
+  if (!startSource()) {
+    LOG_ERROR << "[SourceCapture] ERROR: Failed to start capture source!";
+    return false;
+  }
+
+  startInternal();
+  return true;
+}
+
+void SourceCapture::stop() {
+  LOG_INFO << "[SourceCapture] Stopping capture to " << m_outputFile;
+  cleanup();
+}
+
+#endif
@@ -0,0 +1,415 @@
+#include "StreamSink.h"
+
+#ifdef PLATFORM_LINUX
+
+#include "Logger.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static constexpr int FINALIZE_TIMEOUT_MS = 1000;
+static constexpr size_t MIN_QUEUE_BYTES = 4096;
+
+static void putU16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(static_cast<uint8_t>(value));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void putU32(std::vector<uint8_t> &out, uint32_t value) {
+  putU16(out, static_cast<uint16_t>(value));
+  putU16(out, static_cast<uint16_t>(value >> 16));
+}
+
+static void putTag(std::vector<uint8_t> &out, const char *tag) {
+  for (int i = 0; i < 4; ++i)
+    out.push_back(static_cast<uint8_t>(tag[i]));
+}
+
+StreamSink::StreamSink(const std::string &target, uint32_t sampleRate,
+                       uint16_t channels, SampleFormat format,
+                       const StreamSinkOptions &options,
+                       std::unique_ptr<AudioSink> inner)
+    : m_target(target), m_sampleRate(sampleRate), m_channels(channels),
+      m_format(format),
+      m_frameBytes(
+          std::max<uint16_t>(channels * bytesPerSample(format), 1)),
+      m_options(options), m_inner(std::move(inner)) {
+  if (target == "-") {
+    m_kind = Kind::Stdout;
+  } else if (target.compare(0, 5, "unix:") == 0) {
+    m_kind = Kind::Socket;
+    m_path = target.substr(5);
+  } else {
+    m_kind = Kind::Fifo;
+    m_path = target;
+  }
+  size_t queueBytes = std::max(options.queueBytes, MIN_QUEUE_BYTES);
+  m_queue.resize(std::max<size_t>(queueBytes / m_frameBytes, 1) *
+                 m_frameBytes);
+}
+
+StreamSink::~StreamSink() {
+  if (m_fd >= 0 && m_kind != Kind::Stdout)
+    close(m_fd);
+  if (m_listenFd >= 0)
+    close(m_listenFd);
+}
+
+bool StreamSink::initialize() {
+  // A reader that goes away must show up as EPIPE, not end the process.
+  if (m_kind != Kind::Socket)
+    signal(SIGPIPE, SIG_IGN);
+
+  switch (m_kind) {
+  case Kind::Stdout: {
+    int flags = fcntl(STDOUT_FILENO, F_GETFL);
+    fcntl(STDOUT_FILENO, F_SETFL, flags | O_NONBLOCK);
+    m_fd = STDOUT_FILENO;
+    ++m_connections;
+    buildHeader();
+    break;
+  }
+  case Kind::Fifo: {
+    struct stat info;
+    if (stat(m_path.c_str(), &info) != 0) {
+      if (mkfifo(m_path.c_str(), 0600) != 0) {
+        LOG_ERROR << "[StreamSink] Could not create FIFO " << m_path << ": "
+                  << strerror(errno);
+        return false;
+      }
+    } else if (!S_ISFIFO(info.st_mode)) {
+      LOG_ERROR << "[StreamSink] " << m_path << " is not a FIFO";
+      return false;
+    }
+    break;
+  }
+  case Kind::Socket: {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (m_path.empty() || m_path.size() >= sizeof(address.sun_path)) {
+      LOG_ERROR << "[StreamSink] Bad socket path " << m_path;
+      return false;
+    }
+    memcpy(address.sun_path, m_path.c_str(), m_path.size() + 1);
+    // A socket left behind by an earlier run.
+    struct stat info;
+    if (stat(m_path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+      unlink(m_path.c_str());
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0 ||
+        bind(m_listenFd, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(m_listenFd, 4) != 0) {
+      LOG_ERROR << "[StreamSink] Could not listen on " << m_path << ": "
+                << strerror(errno);
+      return false;
+    }
+    break;
+  }
+  }
+  LOG_INFO << "[StreamSink] Streaming to " << m_target;
+  return !m_inner || m_inner->initialize();
+}
+
+void StreamSink::write(const uint8_t *data, uint32_t size) {
+  append(data, size);
+  if (m_inner)
+    m_inner->write(data, size);
+}
+
+void StreamSink::writeTimed(const uint8_t *data, uint32_t size,
+                            const BlockTimestamp &time) {
+  append(data, size);
+  if (m_inner)
+    m_inner->writeTimed(data, size, time);
+}
+
+void StreamSink::writeSilence(uint32_t size, const BlockTimestamp &time) {
+  // The reader gets real zeros; the inner sink may store a hole.
+  append(nullptr, size);
+  if (m_inner)
+    m_inner->writeSilence(size, time);
+}
+
+void StreamSink::append(const uint8_t *data, size_t size) {
+  while (size > 0) {
+    size_t chunk;
+    if (!m_partial.empty() || size < m_frameBytes) {
+      chunk = std::min<size_t>(m_frameBytes - m_partial.size(), size);
+      if (data)
+        m_partial.insert(m_partial.end(), data, data + chunk);
+      else
+        m_partial.insert(m_partial.end(), chunk, 0);
+      if (m_partial.size() == m_frameBytes) {
+        enqueue(m_partial.data(), m_frameBytes);
+        m_partial.clear();
+      }
+    } else {
+      chunk = size / m_frameBytes * m_frameBytes;
+      enqueue(data, chunk);
+    }
+    size -= chunk;
+    if (data)
+      data += chunk;
+  }
+}
+
+void StreamSink::enqueue(const uint8_t *data, size_t size) {
+  if (!connected() && !connect()) {
+    m_unsentBytes += size;
+    return;
+  }
+
+  const size_t capacity = m_queue.size();
+  if (m_queued + size > capacity)
+    sendQueued();
+  if (m_options.policy == StreamOverflowPolicy::Block) {
+    while (connected() && m_queued + std::min(size, capacity) > capacity) {
+      if (waitWritable(100))
+        sendQueued();
+    }
+    // More than a whole queue goes in queue-sized pieces.
+    while (connected() && size > capacity) {
+      copyIn(data, capacity);
+      if (data)
+        data += capacity;
+      size -= capacity;
+      while (connected() && m_queued > 0) {
+        if (waitWritable(100))
+          sendQueued();
+      }
+    }
+    if (!connected()) {
+      m_unsentBytes += size;
+      return;
+    }
+  } else if (m_queued + size > capacity) {
+    if (m_options.policy == StreamOverflowPolicy::DropOldest) {
+      size_t excess = m_queued + size - capacity;
+      dropOldest((excess + m_frameBytes - 1) / m_frameBytes * m_frameBytes);
+      // Not enough could go (a frame is half sent, or |size| alone is
+      // more than the queue): keep the newest part of |size|.
+      size_t room = (capacity - m_queued) / m_frameBytes * m_frameBytes;
+      if (size > room) {
+        m_droppedBytes += size - room;
+        if (data)
+          data += size - room;
+        size = room;
+      }
+    } else {
+      size_t room = (capacity - m_queued) / m_frameBytes * m_frameBytes;
+      m_droppedBytes += size - room;
+      size = room;
+    }
+  }
+  if (size == 0)
+    return;
+  copyIn(data, size);
+
+  size_t pending = m_header.size() - m_headerSent + m_unbatched;
+  if (pending >= m_options.batchBytes ||
+      metricsNowNs() - m_waitingSinceNs >=
+          int64_t(m_options.maxDelayMs) * 1000000)
+    sendQueued();
+}
+
+void StreamSink::copyIn(const uint8_t *data, size_t size) {
+  const size_t capacity = m_queue.size();
+  if (m_unbatched == 0)
+    m_waitingSinceNs = metricsNowNs();
+  size_t tail = (m_queueHead + m_queued) % capacity;
+  size_t first = std::min(size, capacity - tail);
+  if (data) {
+    memcpy(&m_queue[tail], data, first);
+    memcpy(&m_queue[0], data + first, size - first);
+  } else {
+    memset(&m_queue[tail], 0, first);
+    memset(&m_queue[0], 0, size - first);
+  }
+  m_queued += size;
+  m_unbatched += size;
+}
+
+void StreamSink::dropOldest(size_t size) {
+  const size_t capacity = m_queue.size();
+  // The rest of a frame the reader already has part of must still go.
+  size_t keep = (m_frameBytes - m_connectionBytes % m_frameBytes) % m_frameBytes;
+  size = std::min(size, m_queued - keep);
+  if (size == 0)
+    return;
+  for (size_t i = keep; i-- > 0;)
+    m_queue[(m_queueHead + size + i) % capacity] =
+        m_queue[(m_queueHead + i) % capacity];
+  m_queueHead = (m_queueHead + size) % capacity;
+  m_queued -= size;
+  m_droppedBytes += size;
+}
+
+bool StreamSink::connect() {
+  if (m_kind == Kind::Stdout || m_closed)
+    return false;
+  int64_t now = metricsNowNs();
+  if (now < m_nextConnectNs)
+    return false;
+  m_nextConnectNs = now + int64_t(m_options.reconnectIntervalMs) * 1000000;
+
+  int fd;
+  if (m_kind == Kind::Fifo)
+    // ENXIO until a reader has the FIFO open.
+    fd = open(m_path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  else
+    fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  m_fd = fd;
+  ++m_connections;
+  buildHeader();
+  LOG_INFO << "[StreamSink] Reader connected to " << m_target;
+  return true;
+}
+
+void StreamSink::disconnect(const char *reason) {
+  LOG_INFO << "[StreamSink] Reader of " << m_target << " went away ("
+           << reason << ")";
+  m_unsentBytes += m_queued;
+  m_queued = 0;
+  m_queueHead = 0;
+  m_unbatched = 0;
+  m_header.clear();
+  m_headerSent = 0;
+  if (m_kind == Kind::Stdout)
+    m_closed = true;
+  else
+    close(m_fd);
+  m_fd = -1;
+}
+
+void StreamSink::buildHeader() {
+  m_header.clear();
+  m_headerSent = 0;
+  m_queued = 0;
+  m_queueHead = 0;
+  m_unbatched = 0;
+  m_connectionBytes = 0;
+  if (m_options.framing != StreamFraming::Wav)
+    return;
+
+  // Sizes are unknown on a stream: 0xFFFFFFFF, as sox and ffmpeg write.
+  bool isFloat = isFloatFormat(m_format);
+  uint16_t bits = static_cast<uint16_t>(bytesPerSample(m_format) * 8);
+  putTag(m_header, "RIFF");
+  putU32(m_header, 0xFFFFFFFF);
+  putTag(m_header, "WAVE");
+  putTag(m_header, "fmt ");
+  putU32(m_header, isFloat ? 18 : 16);
+  putU16(m_header, isFloat ? 0x0003 : 0x0001);
+  putU16(m_header, m_channels);
+  putU32(m_header, m_sampleRate);
+  putU32(m_header, m_sampleRate * m_frameBytes);
+  putU16(m_header, m_frameBytes);
+  putU16(m_header, bits);
+  if (isFloat)
+    putU16(m_header, 0); // cbSize
+  putTag(m_header, "data");
+  putU32(m_header, 0xFFFFFFFF);
+}
+
+bool StreamSink::sendQueued() {
+  if (!connected())
+    return false;
+
+  iovec iov[3];
+  int count = 0;
+  size_t headerLeft = m_header.size() - m_headerSent;
+  if (headerLeft > 0)
+    iov[count++] = {&m_header[m_headerSent], headerLeft};
+  size_t first = std::min(m_queued, m_queue.size() - m_queueHead);
+  if (first > 0)
+    iov[count++] = {&m_queue[m_queueHead], first};
+  if (m_queued > first)
+    iov[count++] = {&m_queue[0], m_queued - first};
+  if (count == 0)
+    return true;
+
+  ssize_t done;
+  if (m_kind == Kind::Socket) {
+    msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+    done = sendmsg(m_fd, &message, MSG_NOSIGNAL);
+  } else {
+    done = writev(m_fd, iov, count);
+  }
+  ++m_sendCalls;
+  m_unbatched = 0;
+  if (done < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return true;
+    disconnect(strerror(errno));
+    return false;
+  }
+
+  size_t sent = static_cast<size_t>(done);
+  size_t fromHeader = std::min(sent, headerLeft);
+  m_headerSent += fromHeader;
+  sent -= fromHeader;
+  m_queueHead = (m_queueHead + sent) % m_queue.size();
+  m_queued -= sent;
+  m_connectionBytes += sent;
+  m_sentBytes += sent;
+  return true;
+}
+
+bool StreamSink::waitWritable(int timeoutMs) {
+  pollfd entry = {m_fd, POLLOUT, 0};
+  int ready = poll(&entry, 1, timeoutMs);
+  if (ready > 0 && (entry.revents & (POLLERR | POLLHUP))) {
+    disconnect("hung up");
+    return false;
+  }
+  return ready > 0;
+}
+
+bool StreamSink::flush() {
+  sendQueued();
+  return !m_inner || m_inner->flush();
+}
+
+bool StreamSink::finalize() {
+  int64_t deadline = metricsNowNs() + int64_t(FINALIZE_TIMEOUT_MS) * 1000000;
+  while (connected() && (m_queued > 0 || m_headerSent < m_header.size())) {
+    int64_t left = (deadline - metricsNowNs()) / 1000000;
+    if (left <= 0) {
+      LOG_WARN << "[StreamSink] WARNING: Reader of " << m_target
+               << " too slow, " << m_queued << " bytes not sent";
+      break;
+    }
+    if (waitWritable(static_cast<int>(left)))
+      sendQueued();
+  }
+  if (m_fd >= 0 && m_kind != Kind::Stdout)
+    close(m_fd);
+  m_fd = -1;
+  m_closed = true;
+  if (m_listenFd >= 0) {
+    close(m_listenFd);
+    m_listenFd = -1;
+    unlink(m_path.c_str());
+  }
+  LOG_INFO << "[StreamSink] " << m_target << ": " << m_sentBytes
+           << " bytes sent in " << m_sendCalls << " calls, " << m_droppedBytes
+           << " dropped, " << m_unsentBytes << " with no reader";
+  return !m_inner || m_inner->finalize();
+}
+
+#endif // PLATFORM_LINUX
@@ -0,0 +1,169 @@
+#include "SyntheticSource.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr double TWO_PI = 6.283185307179586;
+
+SyntheticSource::SyntheticSource(const SyntheticSourceConfig &config)
+    : m_config(config), m_phase(0.0), m_noiseState(1), m_framesGenerated(0),
+      m_openTimeNs(0), m_lastSilent(false) {
+  if (m_config.framesPerPacket == 0)
+    m_config.framesPerPacket = 1;
+}
+
+bool SyntheticSource::open() {
+  if (m_config.format.channels == 0 || m_config.format.sampleRate == 0)
+    return false;
+
+  if (!isFloatFormat(m_config.format.sampleFormat))
+    m_converter.reset(new SampleConverter(m_config.format.sampleFormat));
+  m_samples.resize(static_cast<size_t>(m_config.framesPerPacket) *
+                   m_config.format.channels);
+
+  m_phase = 0.0;
+  m_noiseState = m_config.seed ? m_config.seed : 1;
+  m_framesGenerated = 0;
+  m_openTimeNs = metricsNowNs();
+  m_lastTimestamp = BlockTimestamp();
+  m_lastSilent = false;
+  if (m_config.realTime) {
+    if (!m_timer.start(m_config.format.sampleRate, m_config.clockSkewPpm))
+      return false;
+    m_timer.arm(m_config.framesPerPacket);
+  }
+  return true;
+}
+
+void SyntheticSource::close() { m_timer.stop(); }
+
+size_t SyntheticSource::maxPacketBytes() const {
+  return static_cast<size_t>(m_config.framesPerPacket) *
+         m_config.format.blockAlign();
+}
+
+bool SyntheticSource::waitReady(int timeoutMs) {
+  if (!m_config.realTime)
+    return true;
+
+  uint64_t next = m_framesGenerated + m_config.framesPerPacket;
+  if (m_config.totalFrames > 0) {
+    if (m_framesGenerated >= m_config.totalFrames)
+      return true;
+    next = std::min(next, m_config.totalFrames);
+  }
+  return m_timer.waitFor(next, timeoutMs);
+}
+
+size_t SyntheticSource::read(uint8_t *buffer, size_t capacity) {
+  const uint32_t packetFrames = m_config.framesPerPacket;
+  uint64_t frames = capacity / m_config.format.blockAlign();
+  if (m_config.totalFrames > 0)
+    frames = std::min(frames, m_config.totalFrames - m_framesGenerated);
+  if (frames == 0)
+    return 0;
+
+  if (m_config.realTime) {
+    // A period is available once its last frame has been "recorded". Every
+    // period that is already due goes out in this one call.
+    uint64_t next = m_framesGenerated + std::min<uint64_t>(packetFrames, frames);
+    while (!m_timer.waitFor(next, -1)) {
+    }
+    uint64_t due = m_timer.framesElapsed() - m_framesGenerated;
+    frames = std::min(frames, std::max(due, next - m_framesGenerated));
+  } else {
+    frames = std::min<uint64_t>(frames, packetFrames);
+  }
+  if (frames > packetFrames)
+    frames -= frames % packetFrames;
+
+  // A read never spans a gate edge, so it is silent as a whole or not.
+  bool silent = m_config.signal == SyntheticSourceConfig::Signal::Silence;
+  if (m_config.activePackets > 0 && m_config.silentPackets > 0) {
+    uint64_t active = uint64_t(m_config.activePackets) * packetFrames;
+    uint64_t cycle = active + uint64_t(m_config.silentPackets) * packetFrames;
+    uint64_t offset = m_framesGenerated % cycle;
+    silent = silent || offset >= active;
+    frames = std::min(frames, (offset < active ? active : cycle) - offset);
+  }
+  m_lastSilent = silent;
+
+  m_lastTimestamp.position = m_framesGenerated;
+  if (m_config.realTime) {
+    m_lastTimestamp.hostTimeNs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            m_timer.frameTime(m_framesGenerated).time_since_epoch())
+            .count();
+  } else {
+    double hostRate =
+        m_config.format.sampleRate * (1.0 + m_config.clockSkewPpm * 1e-6);
+    m_lastTimestamp.hostTimeNs =
+        m_openTimeNs + std::llround(m_framesGenerated * 1e9 / hostRate);
+  }
+
+  const uint16_t channels = m_config.format.channels;
+  if (silent) {
+    size_t bytes = static_cast<size_t>(frames) * m_config.format.blockAlign();
+    memset(buffer, 0, bytes);
+    m_framesGenerated += frames;
+    if (m_config.realTime)
+      m_timer.arm(m_framesGenerated + packetFrames);
+    return bytes;
+  }
+
+  size_t written = 0;
+  for (uint64_t done = 0; done < frames;) {
+    uint32_t chunk =
+        static_cast<uint32_t>(std::min<uint64_t>(packetFrames, frames - done));
+    generate(m_samples.data(), chunk);
+    size_t samples = static_cast<size_t>(chunk) * channels;
+    if (m_converter) {
+      written += m_converter->convert(m_samples.data(), samples, buffer + written);
+    } else {
+      memcpy(buffer + written, m_samples.data(), samples * sizeof(float));
+      written += samples * sizeof(float);
+    }
+    done += chunk;
+  }
+  m_framesGenerated += frames;
+
+  if (m_config.realTime)
+    m_timer.arm(m_framesGenerated + packetFrames);
+  return written;
+}
+
+void SyntheticSource::generate(float *samples, uint32_t frames) {
+  const uint16_t channels = m_config.format.channels;
+  const float amplitude = static_cast<float>(m_config.amplitude);
+
+  switch (m_config.signal) {
+  case SyntheticSourceConfig::Signal::Sine: {
+    const double step =
+        TWO_PI * m_config.frequency / m_config.format.sampleRate;
+    for (uint32_t i = 0; i < frames; ++i) {
+      float value = amplitude * static_cast<float>(std::sin(m_phase));
+      for (uint16_t c = 0; c < channels; ++c)
+        samples[i * channels + c] = value;
+      m_phase += step;
+      if (m_phase >= TWO_PI)
+        m_phase -= TWO_PI;
+    }
+    break;
+  }
+  case SyntheticSourceConfig::Signal::Noise:
+    for (size_t i = 0; i < static_cast<size_t>(frames) * channels; ++i) {
+      m_noiseState ^= m_noiseState << 13;
+      m_noiseState ^= m_noiseState >> 17;
+      m_noiseState ^= m_noiseState << 5;
+      // Uniform in [-1, 1).
+      float value =
+          static_cast<float>(static_cast<int32_t>(m_noiseState)) / 2147483648.0f;
+      samples[i] = amplitude * value;
+    }
+    break;
+  case SyntheticSourceConfig::Signal::Silence:
+    std::fill(samples, samples + static_cast<size_t>(frames) * channels, 0.0f);
+    break;
+  }
+}
@@ -7,6 +7,7 @@
 #include <windows.h>
 #include <shlwapi.h>
 #else
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -49,4 +50,36 @@ void Utils::sleep(uint32_t milliseconds) {
 #else
     usleep(milliseconds * 1000);
 #endif
-}
\ No newline at end of file
+}
+bool Utils::syncFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+
+    // A new file is only durable once its directory entry is.
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    if (directory.empty()) {
+        directory = "/";
+    }
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        ok = fsync(dirFd) == 0 && ok;
+        close(dirFd);
+    }
+    return ok;
+#endif
+}
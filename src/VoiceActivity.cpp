@@ -0,0 +1,298 @@
+#include "VoiceActivity.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+
+// Band whose share of the energy, and whose flatness, mark voiced speech.
+static constexpr float SPEECH_BAND_LOW_HZ = 80.0f;
+static constexpr float SPEECH_BAND_HIGH_HZ = 4000.0f;
+static constexpr float MIN_DB = -120.0f;
+// Added to power spectrum bins so flatness stays defined on silence.
+static constexpr float POWER_EPSILON = 1e-12f;
+
+static float toDb(double value) {
+  return value > 0.0 ? std::max(MIN_DB, float(20.0 * std::log10(value)))
+                     : MIN_DB;
+}
+
+VoiceActivityDetector::VoiceActivityDetector(const VoiceActivityConfig &config)
+    : m_config(config), m_events(config.eventCapacity) {}
+
+void VoiceActivityDetector::reset(uint32_t sampleRate, uint16_t channels,
+                                  SampleFormat format) {
+  m_sampleRate = sampleRate;
+  m_channels = std::max<uint16_t>(channels, 1);
+  m_format = format;
+  m_frameBytes = static_cast<uint16_t>(m_channels * bytesPerSample(format));
+  m_meter.reset(new LevelMeter(format, m_channels));
+  m_downmix = blockKernels(format, m_channels).downmix;
+
+  uint32_t frameMs = std::max<uint32_t>(m_config.frameMs, 1);
+  m_framesPerAnalysis =
+      std::max<uint32_t>(uint32_t(uint64_t(sampleRate) * frameMs / 1000), 16);
+  m_onsetFrames = std::max<uint32_t>(
+      (m_config.onsetMs + frameMs - 1) / frameMs, 1);
+  m_hangoverFrames = std::max<uint32_t>(
+      (m_config.hangoverMs + frameMs - 1) / frameMs, 1);
+
+  // Hann window over the frame, zero-padded to a power of two.
+  size_t size = 1;
+  while (size < m_framesPerAnalysis)
+    size <<= 1;
+  const double pi = std::acos(-1.0);
+  m_mono.assign(m_framesPerAnalysis, 0.0f);
+  m_window.resize(m_framesPerAnalysis);
+  for (uint32_t i = 0; i < m_framesPerAnalysis; ++i)
+    m_window[i] = float(0.5 - 0.5 * std::cos(2 * pi * (i + 0.5) /
+                                             m_framesPerAnalysis));
+  m_real.assign(size, 0.0f);
+  m_imag.assign(size, 0.0f);
+  m_twiddles.resize(size);
+  for (size_t k = 0; k < size / 2; ++k) {
+    m_twiddles[2 * k] = float(std::cos(2 * pi * k / size));
+    m_twiddles[2 * k + 1] = float(-std::sin(2 * pi * k / size));
+  }
+
+  m_filled = 0;
+  m_sums = LevelSums();
+  m_frameCarry.clear();
+  m_frameCarry.reserve(m_frameBytes);
+  m_position = 0;
+  m_haveFloor = false;
+  m_noiseFloorDb = MIN_DB;
+  m_speech = false;
+  m_run = 0;
+  m_runStart = 0;
+  m_quiet = 0;
+  m_speechFrames.store(0, std::memory_order_relaxed);
+  m_segments.store(0, std::memory_order_relaxed);
+  publish(LevelSnapshot());
+}
+
+uint32_t VoiceActivityDetector::decisionDelayFrames() const {
+  // The onset frames, plus the partly filled frame being analyzed.
+  return (m_onsetFrames + 1) * m_framesPerAnalysis;
+}
+
+void VoiceActivityDetector::process(const uint8_t *data, size_t size,
+                                    std::vector<VoiceEvent> *events) {
+  if (!m_meter || !data)
+    return;
+
+  // Complete a frame split by the previous call.
+  if (!m_frameCarry.empty()) {
+    size_t take = std::min<size_t>(m_frameBytes - m_frameCarry.size(), size);
+    m_frameCarry.insert(m_frameCarry.end(), data, data + take);
+    data += take;
+    size -= take;
+    if (m_frameCarry.size() < m_frameBytes)
+      return;
+    analyzeFrames(m_frameCarry.data(), 1, events);
+    m_frameCarry.clear();
+  }
+
+  size_t frames = size / m_frameBytes;
+  analyzeFrames(data, frames, events);
+  size_t used = frames * m_frameBytes;
+  m_frameCarry.insert(m_frameCarry.end(), data + used, data + size);
+}
+
+void VoiceActivityDetector::processSilence(size_t size,
+                                           std::vector<VoiceEvent> *events) {
+  static const uint8_t zeros[4096] = {};
+  for (size_t offset = 0; offset < size; offset += sizeof(zeros))
+    process(zeros, std::min(size - offset, sizeof(zeros)), events);
+}
+
+void VoiceActivityDetector::analyzeFrames(const uint8_t *data, size_t frames,
+                                          std::vector<VoiceEvent> *events) {
+  while (frames > 0) {
+    size_t count =
+        std::min<size_t>(frames, m_framesPerAnalysis - m_filled);
+    m_meter->measure(data, count, m_sums);
+
+    // Mono mix for the spectrum.
+    m_downmix(data, count, m_channels, m_mono.data() + m_filled);
+
+    m_filled += static_cast<uint32_t>(count);
+    m_position += count;
+    data += count * m_frameBytes;
+    frames -= count;
+    if (m_filled == m_framesPerAnalysis)
+      finishFrame(events);
+  }
+}
+
+void VoiceActivityDetector::spectrum(float &speechBandRatio, float &flatness) {
+  const size_t size = m_real.size();
+  for (uint32_t i = 0; i < m_framesPerAnalysis; ++i)
+    m_real[i] = m_mono[i] * m_window[i];
+  std::fill(m_real.begin() + m_framesPerAnalysis, m_real.end(), 0.0f);
+  std::fill(m_imag.begin(), m_imag.end(), 0.0f);
+
+  // In-place iterative radix-2 FFT.
+  for (size_t i = 1, j = 0; i < size; ++i) {
+    size_t bit = size >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j |= bit;
+    if (i < j)
+      std::swap(m_real[i], m_real[j]);
+  }
+  for (size_t length = 2; length <= size; length <<= 1) {
+    size_t stride = size / length;
+    for (size_t start = 0; start < size; start += length) {
+      for (size_t k = 0; k < length / 2; ++k) {
+        float wr = m_twiddles[2 * k * stride];
+        float wi = m_twiddles[2 * k * stride + 1];
+        size_t a = start + k, b = a + length / 2;
+        float tr = m_real[b] * wr - m_imag[b] * wi;
+        float ti = m_real[b] * wi + m_imag[b] * wr;
+        m_real[b] = m_real[a] - tr;
+        m_imag[b] = m_imag[a] - ti;
+        m_real[a] += tr;
+        m_imag[a] += ti;
+      }
+    }
+  }
+
+  const float binHz = float(m_sampleRate) / size;
+  size_t low = std::max<size_t>(1, size_t(SPEECH_BAND_LOW_HZ / binHz));
+  size_t high = std::min(size / 2, size_t(SPEECH_BAND_HIGH_HZ / binHz));
+  double total = 0.0, band = 0.0, logSum = 0.0;
+  for (size_t k = 1; k <= size / 2; ++k) {
+    double power = double(m_real[k]) * m_real[k] +
+                   double(m_imag[k]) * m_imag[k] + POWER_EPSILON;
+    total += power;
+    if (k >= low && k <= high) {
+      band += power;
+      logSum += std::log(power);
+    }
+  }
+  size_t bins = high >= low ? high - low + 1 : 0;
+  speechBandRatio = total > 0.0 ? float(band / total) : 0.0f;
+  // Geometric over arithmetic mean: near 0.56 for white noise, far lower
+  // for the harmonics of voiced speech.
+  flatness = bins && band > 0.0
+                 ? float(std::exp(logSum / bins) / (band / bins))
+                 : 1.0f;
+}
+
+void VoiceActivityDetector::finishFrame(std::vector<VoiceEvent> *events) {
+  const float frameSeconds = float(m_framesPerAnalysis) / m_sampleRate;
+  LevelSnapshot snapshot;
+  snapshot.frame = m_position;
+  snapshot.rmsDb = toDb(m_sums.rms());
+  snapshot.peakDb = toDb(m_sums.peak);
+  snapshot.zeroCrossingRate =
+      float(m_sums.zeroCrossings) / m_channels / frameSeconds;
+  spectrum(snapshot.speechBandRatio, snapshot.flatness);
+
+  float level = snapshot.rmsDb;
+  bool candidate = level >= m_config.minLevelDb &&
+                   (!m_haveFloor ||
+                    level >= m_noiseFloorDb + m_config.thresholdDb) &&
+                   snapshot.speechBandRatio >= m_config.minSpeechBandRatio &&
+                   snapshot.flatness <= m_config.maxFlatness;
+
+  // Track the noise floor: down at once, up slowly.
+  if (!m_haveFloor || level < m_noiseFloorDb) {
+    m_noiseFloorDb = level;
+    m_haveFloor = true;
+  } else {
+    float rise = m_config.noiseRiseDbPerSecond * frameSeconds *
+                 (candidate ? 0.1f : 1.0f);
+    m_noiseFloorDb = std::min(level, m_noiseFloorDb + rise);
+  }
+  snapshot.noiseFloorDb = m_noiseFloorDb;
+
+  uint64_t frameStart = m_position - m_framesPerAnalysis;
+  if (!m_speech) {
+    if (candidate) {
+      if (m_run++ == 0)
+        m_runStart = frameStart;
+      if (m_run >= m_onsetFrames) {
+        m_speech = true;
+        m_quiet = 0;
+        m_segments.store(m_segments.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        // The onset frames were speech too.
+        m_speechFrames.store(m_speechFrames.load(std::memory_order_relaxed) +
+                                 (m_position - m_runStart),
+                             std::memory_order_relaxed);
+        emit(VoiceEvent::Type::SpeechStart, m_runStart, events);
+      }
+    } else {
+      m_run = 0;
+    }
+  } else {
+    m_quiet = candidate ? 0 : m_quiet + 1;
+    m_speechFrames.store(m_speechFrames.load(std::memory_order_relaxed) +
+                             m_framesPerAnalysis,
+                         std::memory_order_relaxed);
+    if (m_quiet >= m_hangoverFrames) {
+      m_speech = false;
+      m_run = 0;
+      emit(VoiceEvent::Type::SpeechEnd, m_position, events);
+    }
+  }
+  snapshot.speech = m_speech;
+  publish(snapshot);
+  if (m_metrics)
+    m_metrics->recordVoice(snapshot.rmsDb, snapshot.peakDb, m_speech,
+                           speechFrames(), speechSegments());
+
+  m_filled = 0;
+  m_sums = LevelSums();
+}
+
+void VoiceActivityDetector::emit(VoiceEvent::Type type, uint64_t frame,
+                                 std::vector<VoiceEvent> *events) {
+  VoiceEvent event;
+  event.type = type;
+  event.frame = frame;
+  if (events)
+    events->push_back(event);
+  if (!m_events.push(event))
+    m_droppedEvents.store(m_droppedEvents.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+}
+
+void VoiceActivityDetector::publish(const LevelSnapshot &snapshot) {
+  uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+  m_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_snapFrame.store(snapshot.frame, std::memory_order_relaxed);
+  m_snapRmsDb.store(snapshot.rmsDb, std::memory_order_relaxed);
+  m_snapPeakDb.store(snapshot.peakDb, std::memory_order_relaxed);
+  m_snapZeroCrossingRate.store(snapshot.zeroCrossingRate,
+                               std::memory_order_relaxed);
+  m_snapNoiseFloorDb.store(snapshot.noiseFloorDb, std::memory_order_relaxed);
+  m_snapSpeechBandRatio.store(snapshot.speechBandRatio,
+                              std::memory_order_relaxed);
+  m_snapFlatness.store(snapshot.flatness, std::memory_order_relaxed);
+  m_snapSpeech.store(snapshot.speech, std::memory_order_relaxed);
+  m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+LevelSnapshot VoiceActivityDetector::levels() const {
+  LevelSnapshot snapshot;
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = m_sequence.load(std::memory_order_acquire);
+    snapshot.frame = m_snapFrame.load(std::memory_order_relaxed);
+    snapshot.rmsDb = m_snapRmsDb.load(std::memory_order_relaxed);
+    snapshot.peakDb = m_snapPeakDb.load(std::memory_order_relaxed);
+    snapshot.zeroCrossingRate =
+        m_snapZeroCrossingRate.load(std::memory_order_relaxed);
+    snapshot.noiseFloorDb = m_snapNoiseFloorDb.load(std::memory_order_relaxed);
+    snapshot.speechBandRatio =
+        m_snapSpeechBandRatio.load(std::memory_order_relaxed);
+    snapshot.flatness = m_snapFlatness.load(std::memory_order_relaxed);
+    snapshot.speech = m_snapSpeech.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = m_sequence.load(std::memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+  return snapshot;
+}
@@ -0,0 +1,146 @@
+#include "VoiceActivitySink.h"
+#include <algorithm>
+#include <limits>
+
+static constexpr uint64_t OPEN = std::numeric_limits<uint64_t>::max();
+
+VoiceActivitySink::VoiceActivitySink(std::unique_ptr<AudioSink> inner,
+                                     VoiceActivityDetector *detector)
+    : m_inner(std::move(inner)), m_detector(detector),
+      m_gate(detector->config().gate),
+      m_frameBytes(std::max<uint16_t>(detector->frameBytes(), 1)) {
+  m_prerollFrames =
+      uint64_t(detector->sampleRate()) * detector->config().prerollMs / 1000;
+  m_holdFrames = detector->decisionDelayFrames() + m_prerollFrames;
+}
+
+bool VoiceActivitySink::initialize() { return m_inner->initialize(); }
+
+void VoiceActivitySink::write(const uint8_t *data, uint32_t size) {
+  if (m_gate) {
+    append(data, size, nullptr);
+    return;
+  }
+  m_detector->process(data, size);
+  m_inner->write(data, size);
+}
+
+void VoiceActivitySink::writeTimed(const uint8_t *data, uint32_t size,
+                                   const BlockTimestamp &time) {
+  if (m_gate) {
+    append(data, size, &time);
+    return;
+  }
+  m_detector->process(data, size);
+  m_inner->writeTimed(data, size, time);
+}
+
+void VoiceActivitySink::writeSilence(uint32_t size,
+                                     const BlockTimestamp &time) {
+  if (m_gate) {
+    // Held as zeros; outside speech it leaves as silence again.
+    AudioSink::writeSilence(size, time);
+    return;
+  }
+  m_detector->processSilence(size);
+  m_inner->writeSilence(size, time);
+}
+
+bool VoiceActivitySink::flush() { return m_inner->flush(); }
+
+bool VoiceActivitySink::finalize() {
+  if (m_gate)
+    release(OPEN);
+  return m_inner->finalize();
+}
+
+void VoiceActivitySink::append(const uint8_t *data, uint32_t size,
+                               const BlockTimestamp *time) {
+  if (time && time->valid())
+    m_marks.emplace_back(m_heldOffset + (m_held.size() - m_heldStart), *time);
+  m_held.insert(m_held.end(), data, data + size);
+
+  m_events.clear();
+  m_detector->process(data, size, &m_events);
+  track(m_events);
+
+  // Nothing within the decision delay plus preroll of the analysis
+  // position can still turn out to be speech it has not reported.
+  uint64_t position = m_detector->position();
+  if (position > m_holdFrames)
+    release((position - m_holdFrames) * m_frameBytes);
+}
+
+void VoiceActivitySink::track(const std::vector<VoiceEvent> &events) {
+  for (const VoiceEvent &event : events) {
+    if (event.type == VoiceEvent::Type::SpeechStart) {
+      uint64_t frame =
+          event.frame > m_prerollFrames ? event.frame - m_prerollFrames : 0;
+      uint64_t start = frame * m_frameBytes;
+      if (!m_regions.empty() && m_regions.back().end >= start)
+        m_regions.back().end = OPEN;
+      else
+        m_regions.push_back({start, OPEN});
+    } else if (!m_regions.empty()) {
+      m_regions.back().end = event.frame * m_frameBytes;
+    }
+  }
+}
+
+bool VoiceActivitySink::kept(uint64_t offset, uint64_t &until) const {
+  for (const Region &region : m_regions) {
+    if (offset < region.start) {
+      until = region.start;
+      return false;
+    }
+    if (offset < region.end) {
+      until = region.end;
+      return true;
+    }
+  }
+  until = OPEN;
+  return false;
+}
+
+void VoiceActivitySink::release(uint64_t limit) {
+  uint64_t end = m_heldOffset + (m_held.size() - m_heldStart);
+  limit = std::min(limit, end);
+
+  while (m_heldOffset < limit) {
+    uint64_t next;
+    bool keep = kept(m_heldOffset, next);
+    next = std::min(next, limit);
+
+    // Split at packet starts so their timestamps reach the sink.
+    BlockTimestamp time;
+    while (!m_marks.empty() && m_marks.front().first <= m_heldOffset) {
+      if (m_marks.front().first == m_heldOffset)
+        time = m_marks.front().second;
+      m_marks.pop_front();
+    }
+    if (!m_marks.empty())
+      next = std::min(next, m_marks.front().first);
+
+    uint32_t size = static_cast<uint32_t>(
+        std::min<uint64_t>(next - m_heldOffset, UINT32_MAX));
+    const uint8_t *data = m_held.data() + m_heldStart;
+    if (!keep) {
+      m_inner->writeSilence(size, time);
+      m_gatedBytes += size;
+    } else if (time.valid()) {
+      m_inner->writeTimed(data, size, time);
+    } else {
+      m_inner->write(data, size);
+    }
+    m_heldStart += size;
+    m_heldOffset += size;
+  }
+
+  while (!m_regions.empty() && m_regions.front().end <= m_heldOffset)
+    m_regions.pop_front();
+  // Reclaim released bytes once they are the larger part of the buffer.
+  if (m_heldStart > m_held.size() / 2) {
+    m_held.erase(m_held.begin(), m_held.begin() + m_heldStart);
+    m_heldStart = 0;
+  }
+}
@@ -0,0 +1,55 @@
+#include "WakeEvent.h"
+
+#ifdef PLATFORM_LINUX
+
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+WakeEvent::WakeEvent() : m_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+WakeEvent::~WakeEvent() {
+  if (m_fd >= 0)
+    ::close(m_fd);
+}
+
+void WakeEvent::signal() {
+  uint64_t one = 1;
+  // EAGAIN only happens when the counter is saturated, i.e. already signaled.
+  ssize_t ignored = ::write(m_fd, &one, sizeof(one));
+  (void)ignored;
+}
+
+bool WakeEvent::wait(int timeoutMs) {
+  pollfd pfd = {m_fd, POLLIN, 0};
+  int ready;
+  do {
+    ready = ::poll(&pfd, 1, timeoutMs);
+  } while (ready < 0 && errno == EINTR);
+  if (ready <= 0)
+    return false;
+
+  uint64_t count;
+  return ::read(m_fd, &count, sizeof(count)) == sizeof(count);
+}
+
+#else
+
+#include <windows.h>
+
+WakeEvent::WakeEvent() : m_handle(CreateEvent(nullptr, FALSE, FALSE, nullptr)) {}
+
+WakeEvent::~WakeEvent() {
+  if (m_handle)
+    CloseHandle(m_handle);
+}
+
+void WakeEvent::signal() { SetEvent(m_handle); }
+
+bool WakeEvent::wait(int timeoutMs) {
+  DWORD timeout = timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs);
+  return WaitForSingleObject(m_handle, timeout) == WAIT_OBJECT_0;
+}
+
+#endif
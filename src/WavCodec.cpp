@@ -0,0 +1,566 @@
+#include "WavCodec.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define WAV_CODEC_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static constexpr uint16_t WAVE_FORMAT_PCM_TAG = 0x0001;
+static constexpr uint16_t WAVE_FORMAT_ALAW_TAG = 0x0006;
+static constexpr uint16_t WAVE_FORMAT_MULAW_TAG = 0x0007;
+static constexpr uint16_t WAVE_FORMAT_IMA_ADPCM_TAG = 0x0011;
+
+// mu-law encodes 14-bit magnitudes, clipped, then biased so the segment
+// is the position of the leading one; decoding works in 16 bits.
+static constexpr int MULAW_CLIP = 8158;
+static constexpr int MULAW_ENCODE_BIAS = 0x21;
+static constexpr int MULAW_BIAS = 0x84;
+
+static const int16_t IMA_STEPS[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+static const int8_t IMA_INDEX_ADJUST[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+static constexpr int IMA_MAX_INDEX = 88;
+
+uint16_t waveFormatTag(WavEncoding encoding) {
+  switch (encoding) {
+  case WavEncoding::MuLaw:
+    return WAVE_FORMAT_MULAW_TAG;
+  case WavEncoding::ALaw:
+    return WAVE_FORMAT_ALAW_TAG;
+  case WavEncoding::ImaAdpcm:
+    return WAVE_FORMAT_IMA_ADPCM_TAG;
+  case WavEncoding::Pcm:
+    break;
+  }
+  return WAVE_FORMAT_PCM_TAG;
+}
+
+bool encodingForTag(uint16_t tag, WavEncoding &encoding) {
+  switch (tag) {
+  case WAVE_FORMAT_MULAW_TAG:
+    encoding = WavEncoding::MuLaw;
+    return true;
+  case WAVE_FORMAT_ALAW_TAG:
+    encoding = WavEncoding::ALaw;
+    return true;
+  case WAVE_FORMAT_IMA_ADPCM_TAG:
+    encoding = WavEncoding::ImaAdpcm;
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *encodingName(WavEncoding encoding) {
+  switch (encoding) {
+  case WavEncoding::MuLaw:
+    return "mulaw";
+  case WavEncoding::ALaw:
+    return "alaw";
+  case WavEncoding::ImaAdpcm:
+    return "ima-adpcm";
+  case WavEncoding::Pcm:
+    break;
+  }
+  return "pcm";
+}
+
+uint8_t G711Codec::encodeMuLaw(int16_t sample) {
+  int value = sample >> 2;
+  int sign = value < 0 ? 0x80 : 0;
+  int magnitude = std::min(value < 0 ? -value : value, MULAW_CLIP);
+  magnitude += MULAW_ENCODE_BIAS;
+  int segment = 0;
+  while (magnitude >> (segment + 6))
+    ++segment;
+  int mantissa = (magnitude >> (segment + 1)) & 0x0F;
+  return static_cast<uint8_t>(~(sign | segment << 4 | mantissa));
+}
+
+uint8_t G711Codec::encodeALaw(int16_t sample) {
+  int value = sample >> 3;
+  int mask = 0xD5;
+  if (value < 0) {
+    mask = 0x55;
+    value = -value - 1;
+  }
+  int code;
+  if (value < 32) {
+    code = value >> 1;
+  } else {
+    int segment = 1;
+    while (value >> (segment + 5))
+      ++segment;
+    code = segment << 4 | ((value >> segment) & 0x0F);
+  }
+  return static_cast<uint8_t>(code ^ mask);
+}
+
+int16_t G711Codec::decodeMuLaw(uint8_t code) {
+  code = static_cast<uint8_t>(~code);
+  int value = (((code & 0x0F) << 3) + MULAW_BIAS) << ((code & 0x70) >> 4);
+  return static_cast<int16_t>(code & 0x80 ? MULAW_BIAS - value
+                                          : value - MULAW_BIAS);
+}
+
+int16_t G711Codec::decodeALaw(uint8_t code) {
+  code ^= 0x55;
+  int value = (code & 0x0F) << 4;
+  int segment = (code & 0x70) >> 4;
+  if (segment == 0)
+    value += 8;
+  else
+    value = (value + 0x108) << (segment - 1);
+  return static_cast<int16_t>(code & 0x80 ? value : -value);
+}
+
+namespace {
+
+struct G711Tables {
+  uint8_t muLaw[65536];
+  uint8_t aLaw[65536];
+  int16_t muLawDecode[256];
+  int16_t aLawDecode[256];
+
+  G711Tables() {
+    for (int i = 0; i < 65536; ++i) {
+      int16_t sample = static_cast<int16_t>(i);
+      muLaw[i] = G711Codec::encodeMuLaw(sample);
+      aLaw[i] = G711Codec::encodeALaw(sample);
+    }
+    for (int i = 0; i < 256; ++i) {
+      muLawDecode[i] = G711Codec::decodeMuLaw(static_cast<uint8_t>(i));
+      aLawDecode[i] = G711Codec::decodeALaw(static_cast<uint8_t>(i));
+    }
+  }
+};
+
+const G711Tables &g711Tables() {
+  static const G711Tables tables;
+  return tables;
+}
+
+void encodeMuLawScalar(const uint8_t *src, size_t samples, uint8_t *dst) {
+  const uint8_t *table = g711Tables().muLaw;
+  for (size_t i = 0; i < samples; ++i)
+    dst[i] = table[src[2 * i] | src[2 * i + 1] << 8];
+}
+
+void encodeALawScalar(const uint8_t *src, size_t samples, uint8_t *dst) {
+  const uint8_t *table = g711Tables().aLaw;
+  for (size_t i = 0; i < samples; ++i)
+    dst[i] = table[src[2 * i] | src[2 * i + 1] << 8];
+}
+
+#ifdef WAV_CODEC_X86
+
+// Both laws reduce to the position of the leading one plus the four bits
+// after it, which is exactly what the exponent and the top of the mantissa
+// of the value converted to float hold: (float bits >> 19) is
+// (exponent + 127) << 4 | mantissa, and every value here converts exactly.
+
+// 8 magnitudes in 33..8191 to mu-law codes before sign and inversion.
+inline __m128i muLawCodesSse2(__m128i biased) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi32((127 + 5) << 4);
+  __m128i lo = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(biased, zero)));
+  __m128i hi = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(biased, zero)));
+  lo = _mm_sub_epi32(_mm_srli_epi32(lo, 19), offset);
+  hi = _mm_sub_epi32(_mm_srli_epi32(hi, 19), offset);
+  return _mm_packs_epi32(lo, hi);
+}
+
+inline __m128i muLawSse2(__m128i samples) {
+  __m128i negative = _mm_srai_epi16(samples, 15);
+  __m128i value = _mm_srai_epi16(samples, 2);
+  __m128i magnitude = _mm_sub_epi16(_mm_xor_si128(value, negative), negative);
+  magnitude = _mm_min_epi16(magnitude, _mm_set1_epi16(MULAW_CLIP));
+  __m128i codes = muLawCodesSse2(
+      _mm_add_epi16(magnitude, _mm_set1_epi16(MULAW_ENCODE_BIAS)));
+  codes = _mm_or_si128(codes, _mm_and_si128(negative, _mm_set1_epi16(0x80)));
+  return _mm_xor_si128(codes, _mm_set1_epi16(0xFF));
+}
+
+inline __m128i aLawSse2(__m128i samples) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i offset = _mm_set1_epi32((127 + 4) << 4);
+  __m128i negative = _mm_srai_epi16(samples, 15);
+  // 0..4095; negative values are folded as -value - 1.
+  __m128i value = _mm_xor_si128(_mm_srai_epi16(samples, 3), negative);
+  __m128i lo = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero)));
+  __m128i hi = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(value, zero)));
+  lo = _mm_sub_epi32(_mm_srli_epi32(lo, 19), offset);
+  hi = _mm_sub_epi32(_mm_srli_epi32(hi, 19), offset);
+  __m128i segmented = _mm_packs_epi32(lo, hi);
+  // Segment 0 is linear.
+  __m128i small = _mm_cmplt_epi16(value, _mm_set1_epi16(32));
+  __m128i codes = _mm_or_si128(_mm_and_si128(small, _mm_srli_epi16(value, 1)),
+                               _mm_andnot_si128(small, segmented));
+  __m128i mask = _mm_or_si128(_mm_set1_epi16(0x55),
+                              _mm_andnot_si128(negative, _mm_set1_epi16(0x80)));
+  return _mm_xor_si128(codes, mask);
+}
+
+template <__m128i (*Law)(__m128i), void (*Tail)(const uint8_t *, size_t,
+                                                uint8_t *)>
+void encodeSse2(const uint8_t *src, size_t samples, uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m128i a = Law(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i)));
+    __m128i b = Law(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * i + 16)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(a, b));
+  }
+  Tail(src + 2 * i, samples - i, dst + i);
+}
+
+TARGET_AVX2 inline __m256i floatCodesAvx2(__m256i values, int offset) {
+  __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(values));
+  __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(values, 1));
+  const __m256i bias = _mm256_set1_epi32(offset << 4);
+  lo = _mm256_sub_epi32(
+      _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(lo)), 19), bias);
+  hi = _mm256_sub_epi32(
+      _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(hi)), 19), bias);
+  // packs works per 128-bit lane; restore sample order.
+  return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+}
+
+TARGET_AVX2 inline __m256i muLawAvx2(__m256i samples) {
+  __m256i negative = _mm256_srai_epi16(samples, 15);
+  __m256i value = _mm256_srai_epi16(samples, 2);
+  __m256i magnitude =
+      _mm256_sub_epi16(_mm256_xor_si256(value, negative), negative);
+  magnitude = _mm256_min_epi16(magnitude, _mm256_set1_epi16(MULAW_CLIP));
+  __m256i codes = floatCodesAvx2(
+      _mm256_add_epi16(magnitude, _mm256_set1_epi16(MULAW_ENCODE_BIAS)),
+      127 + 5);
+  codes = _mm256_or_si256(codes,
+                          _mm256_and_si256(negative, _mm256_set1_epi16(0x80)));
+  return _mm256_xor_si256(codes, _mm256_set1_epi16(0xFF));
+}
+
+TARGET_AVX2 inline __m256i aLawAvx2(__m256i samples) {
+  __m256i negative = _mm256_srai_epi16(samples, 15);
+  __m256i value = _mm256_xor_si256(_mm256_srai_epi16(samples, 3), negative);
+  __m256i segmented = floatCodesAvx2(value, 127 + 4);
+  __m256i small = _mm256_cmpgt_epi16(_mm256_set1_epi16(32), value);
+  __m256i codes = _mm256_blendv_epi8(segmented, _mm256_srli_epi16(value, 1), small);
+  __m256i mask = _mm256_or_si256(
+      _mm256_set1_epi16(0x55),
+      _mm256_andnot_si256(negative, _mm256_set1_epi16(0x80)));
+  return _mm256_xor_si256(codes, mask);
+}
+
+TARGET_AVX2 void encodeMuLawAvx2(const uint8_t *src, size_t samples,
+                                 uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 32 <= samples; i += 32) {
+    __m256i a = muLawAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i)));
+    __m256i b = muLawAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i + 32)));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+  encodeMuLawScalar(src + 2 * i, samples - i, dst + i);
+}
+
+TARGET_AVX2 void encodeALawAvx2(const uint8_t *src, size_t samples,
+                                uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 32 <= samples; i += 32) {
+    __m256i a = aLawAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i)));
+    __m256i b = aLawAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * i + 32)));
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+  encodeALawScalar(src + 2 * i, samples - i, dst + i);
+}
+
+#endif
+
+G711Codec::Kernel selectKernel(WavEncoding law, SimdLevel level) {
+  bool aLaw = law == WavEncoding::ALaw;
+#ifdef WAV_CODEC_X86
+  switch (level) {
+  case SimdLevel::Avx512:
+  case SimdLevel::Avx2:
+    return aLaw ? encodeALawAvx2 : encodeMuLawAvx2;
+  case SimdLevel::Sse2:
+    return aLaw ? encodeSse2<aLawSse2, encodeALawScalar>
+                : encodeSse2<muLawSse2, encodeMuLawScalar>;
+  default:
+    break;
+  }
+#else
+  (void)level;
+#endif
+  return aLaw ? encodeALawScalar : encodeMuLawScalar;
+}
+
+} // namespace
+
+G711Codec::G711Codec(WavEncoding law, SimdLevel level)
+    : m_law(law == WavEncoding::ALaw ? WavEncoding::ALaw : WavEncoding::MuLaw),
+      m_level(level) {
+  // Never run a kernel the CPU cannot execute; there is no AVX-512 kernel.
+  SimdLevel supported = SampleConverter::detectSimdLevel();
+  if (static_cast<int>(m_level) > static_cast<int>(supported))
+    m_level = supported;
+  if (m_level == SimdLevel::Avx512)
+    m_level = SimdLevel::Avx2;
+  m_kernel = selectKernel(m_law, m_level);
+  const G711Tables &tables = g711Tables();
+  m_decodeTable =
+      m_law == WavEncoding::ALaw ? tables.aLawDecode : tables.muLawDecode;
+}
+
+void G711Codec::decode(const uint8_t *src, size_t samples, int16_t *dst) const {
+  for (size_t i = 0; i < samples; ++i)
+    dst[i] = m_decodeTable[src[i]];
+}
+
+uint16_t imaAdpcmBlockAlign(uint32_t sampleRate, uint16_t channels) {
+  uint32_t perChannel = 256;
+  for (uint32_t rate = 11025 * 2; rate <= sampleRate && perChannel < 1024;
+       rate *= 2)
+    perChannel *= 2;
+  return static_cast<uint16_t>(perChannel * channels);
+}
+
+uint32_t imaAdpcmFramesPerBlock(uint16_t blockAlign, uint16_t channels) {
+  if (channels == 0 || blockAlign < 4u * channels)
+    return 0;
+  return (blockAlign - 4u * channels) * 2 / channels + 1;
+}
+
+namespace {
+
+inline uint8_t imaEncodeSample(ImaAdpcmState &state, int sample) {
+  int step = IMA_STEPS[state.index];
+  int diff = sample - state.predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  // The delta is rebuilt exactly as the decoder will, so both predictors
+  // stay in step.
+  int delta = step >> 3;
+  if (diff >= step) {
+    nibble |= 4;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 2;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 1;
+    delta += step;
+  }
+  int predictor = state.predictor + (nibble & 8 ? -delta : delta);
+  state.predictor = std::min(std::max(predictor, -32768), 32767);
+  state.index =
+      std::min(std::max(state.index + IMA_INDEX_ADJUST[nibble & 7], 0),
+               IMA_MAX_INDEX);
+  return nibble;
+}
+
+inline int16_t imaDecodeSample(ImaAdpcmState &state, uint8_t nibble) {
+  int step = IMA_STEPS[state.index];
+  int delta = step >> 3;
+  if (nibble & 4)
+    delta += step;
+  if (nibble & 2)
+    delta += step >> 1;
+  if (nibble & 1)
+    delta += step >> 2;
+  int predictor = state.predictor + (nibble & 8 ? -delta : delta);
+  state.predictor = std::min(std::max(predictor, -32768), 32767);
+  state.index =
+      std::min(std::max(state.index + IMA_INDEX_ADJUST[nibble & 7], 0),
+               IMA_MAX_INDEX);
+  return static_cast<int16_t>(state.predictor);
+}
+
+} // namespace
+
+void encodeImaAdpcmBlock(const int16_t *frames, uint16_t channels,
+                         uint32_t framesPerBlock, ImaAdpcmState *states,
+                         uint8_t *block) {
+  for (uint16_t c = 0; c < channels; ++c) {
+    ImaAdpcmState &state = states[c];
+    state.predictor = frames[c];
+    uint8_t *header = block + 4 * c;
+    header[0] = static_cast<uint8_t>(state.predictor);
+    header[1] = static_cast<uint8_t>(state.predictor >> 8);
+    header[2] = static_cast<uint8_t>(state.index);
+    header[3] = 0;
+  }
+
+  // Groups of 8 samples per channel, channels interleaved per group.
+  uint8_t *out = block + 4 * channels;
+  for (uint32_t first = 1; first < framesPerBlock; first += 8) {
+    for (uint16_t c = 0; c < channels; ++c) {
+      const int16_t *in = frames + size_t(first) * channels + c;
+      for (int k = 0; k < 8; k += 2) {
+        uint8_t low = imaEncodeSample(states[c], in[size_t(k) * channels]);
+        uint8_t high = imaEncodeSample(states[c], in[size_t(k + 1) * channels]);
+        *out++ = static_cast<uint8_t>(low | high << 4);
+      }
+    }
+  }
+}
+
+uint32_t decodeImaAdpcmBlock(const uint8_t *block, size_t size,
+                             uint16_t channels, int16_t *frames) {
+  if (channels == 0 || size < 4u * channels)
+    return 0;
+  ImaAdpcmState states[8];
+  std::vector<ImaAdpcmState> extraStates;
+  ImaAdpcmState *state = states;
+  if (channels > 8) {
+    extraStates.resize(channels);
+    state = extraStates.data();
+  }
+  for (uint16_t c = 0; c < channels; ++c) {
+    const uint8_t *header = block + 4 * c;
+    state[c].predictor = static_cast<int16_t>(header[0] | header[1] << 8);
+    state[c].index = header[2];
+    if (state[c].index > IMA_MAX_INDEX)
+      return 0;
+    frames[c] = static_cast<int16_t>(state[c].predictor);
+  }
+
+  // Whole groups only; a block cut short mid-group loses that group.
+  size_t groups = (size - 4u * channels) / (4u * channels);
+  const uint8_t *in = block + 4 * channels;
+  for (size_t g = 0; g < groups; ++g) {
+    size_t first = 1 + 8 * g;
+    for (uint16_t c = 0; c < channels; ++c) {
+      int16_t *out = frames + first * channels + c;
+      for (int k = 0; k < 8; k += 2) {
+        uint8_t byte = *in++;
+        out[size_t(k) * channels] = imaDecodeSample(state[c], byte & 0x0F);
+        out[size_t(k + 1) * channels] = imaDecodeSample(state[c], byte >> 4);
+      }
+    }
+  }
+  return static_cast<uint32_t>(1 + 8 * groups);
+}
+
+WavEncoder::WavEncoder(WavEncoding encoding, uint32_t sampleRate,
+                       uint16_t channels)
+    : m_encoding(encoding), m_sampleRate(sampleRate), m_channels(channels),
+      m_blockAlign(channels),
+      m_framesPerBlock(1), m_g711(encoding), m_inputBytes(0), m_frames(0) {
+  if (encoding == WavEncoding::ImaAdpcm) {
+    m_blockAlign = imaAdpcmBlockAlign(sampleRate, channels);
+    m_framesPerBlock = imaAdpcmFramesPerBlock(m_blockAlign, channels);
+    m_states.resize(channels);
+    m_block.resize(size_t(m_framesPerBlock) * channels);
+    m_pending.reserve(m_block.size() * 2);
+  }
+}
+
+uint32_t WavEncoder::byteRate() const {
+  return static_cast<uint32_t>(uint64_t(m_sampleRate) * m_blockAlign /
+                               m_framesPerBlock);
+}
+
+size_t WavEncoder::maxOutputBytes(size_t size) const {
+  if (m_encoding != WavEncoding::ImaAdpcm)
+    return size / 2 + 1;
+  size_t blockBytes = size_t(m_framesPerBlock) * m_channels * 2;
+  return (m_pending.size() + size) / blockBytes * m_blockAlign;
+}
+
+size_t WavEncoder::encode(const uint8_t *data, size_t size, uint8_t *out) {
+  m_inputBytes += size;
+  m_frames = m_inputBytes / (2u * m_channels);
+  size_t written = 0;
+
+  if (m_encoding != WavEncoding::ImaAdpcm) {
+    if (!m_pending.empty() && size > 0) {
+      uint8_t sample[2] = {m_pending[0], data[0]};
+      m_g711.encode(sample, 1, out);
+      m_pending.clear();
+      ++data;
+      --size;
+      ++written;
+    }
+    size_t samples = size / 2;
+    m_g711.encode(data, samples, out + written);
+    written += samples;
+    if (size % 2)
+      m_pending.push_back(data[size - 1]);
+    return written;
+  }
+
+  const size_t blockBytes = m_block.size() * 2;
+  if (!m_pending.empty()) {
+    size_t take = std::min(blockBytes - m_pending.size(), size);
+    m_pending.insert(m_pending.end(), data, data + take);
+    data += take;
+    size -= take;
+    if (m_pending.size() < blockBytes)
+      return 0;
+    written += encodeBlock(m_pending.data(), out);
+    m_pending.clear();
+  }
+  for (; size >= blockBytes; data += blockBytes, size -= blockBytes)
+    written += encodeBlock(data, out + written);
+  m_pending.insert(m_pending.end(), data, data + size);
+  return written;
+}
+
+size_t WavEncoder::encodeBlock(const uint8_t *pcm, uint8_t *out) {
+  memcpy(m_block.data(), pcm, m_block.size() * 2);
+  encodeImaAdpcmBlock(m_block.data(), m_channels, m_framesPerBlock,
+                      m_states.data(), out);
+  return m_blockAlign;
+}
+
+size_t WavEncoder::finish(uint8_t *out) {
+  if (m_encoding != WavEncoding::ImaAdpcm || m_pending.empty()) {
+    // A split G.711 sample is dropped.
+    m_pending.clear();
+    return 0;
+  }
+  // Whole frames only; the rest of the block is silence.
+  size_t frameBytes = 2u * m_channels;
+  m_pending.resize(m_pending.size() / frameBytes * frameBytes);
+  if (m_pending.empty())
+    return 0;
+  m_pending.resize(m_block.size() * 2, 0);
+  size_t written = encodeBlock(m_pending.data(), out);
+  m_pending.clear();
+  return written;
+}
+
+void WavEncoder::reset() {
+  m_pending.clear();
+  for (ImaAdpcmState &state : m_states)
+    state = ImaAdpcmState();
+  m_inputBytes = 0;
+  m_frames = 0;
+}
@@ -0,0 +1,328 @@
+#include "WavReader.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+static const uint8_t W64_RIFF_GUID[16] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11,
+                                          0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t W64_GUID_TAIL[12] = {0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1,
+                                          0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+static constexpr uint16_t WAVE_FORMAT_PCM_TAG = 0x0001;
+static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT_TAG = 0x0003;
+static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE_TAG = 0xFFFE;
+
+// Samples decoded per G.711 read.
+static constexpr size_t G711_CHUNK_SAMPLES = 4096;
+
+static uint16_t getU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const uint8_t* p) {
+    return getU16(p) | (static_cast<uint32_t>(getU16(p + 2)) << 16);
+}
+
+static uint64_t getU64(const uint8_t* p) {
+    return getU32(p) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+WavReader::WavReader(const std::string& filename)
+    : m_filename(filename)
+    , m_file(nullptr)
+    , m_sampleRate(0)
+    , m_channels(0)
+    , m_channelMask(0)
+    , m_blockAlign(0)
+    , m_sampleFormat(SampleFormat::Int16)
+    , m_dataOffset(0)
+    , m_dataSize(0)
+    , m_position(0)
+    , m_encoding(WavEncoding::Pcm)
+    , m_encodedBlockAlign(0)
+    , m_framesPerBlock(0)
+    , m_encodedSize(0)
+    , m_encodedPosition(0)
+    , m_decodedSize(0)
+    , m_decodedPosition(0) {
+}
+
+WavReader::~WavReader() {
+    close();
+}
+
+bool WavReader::open() {
+    m_file = fopen(m_filename.c_str(), "rb");
+    if (!m_file) {
+        return false;
+    }
+
+    uint8_t magic[16];
+    bool ok = false;
+    if (fread(magic, 1, 12, m_file) == 12) {
+        if (memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0) {
+            ok = parseRiff(false);
+        } else if (memcmp(magic, "RF64", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0) {
+            ok = parseRiff(true);
+        } else if (fread(magic + 12, 1, 4, m_file) == 4 && memcmp(magic, W64_RIFF_GUID, 16) == 0) {
+            ok = parseWave64();
+        }
+    }
+
+    if (!ok) {
+        LOG_ERROR << "[WavReader] ERROR: Unsupported or malformed file: " << m_filename;
+        close();
+        return false;
+    }
+    return rewind();
+}
+
+void WavReader::close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool WavReader::parseFmt(const uint8_t* fmt, size_t size) {
+    if (size < 16) {
+        return false;
+    }
+
+    uint16_t tag = getU16(fmt);
+    m_channels = getU16(fmt + 2);
+    m_sampleRate = getU32(fmt + 4);
+    m_blockAlign = getU16(fmt + 12);
+    uint16_t bits = getU16(fmt + 14);
+
+    m_channelMask = 0;
+    if (tag == WAVE_FORMAT_EXTENSIBLE_TAG && size >= 40) {
+        m_channelMask = getU32(fmt + 20);
+        // First two bytes of the SubFormat GUID hold the plain tag.
+        tag = getU16(fmt + 24);
+    }
+
+    WavEncoding encoding;
+    if (encodingForTag(tag, encoding)) {
+        m_encoding = encoding;
+        m_encodedBlockAlign = m_blockAlign;
+        m_sampleFormat = SampleFormat::Int16;
+        if (encoding == WavEncoding::ImaAdpcm) {
+            m_framesPerBlock = imaAdpcmFramesPerBlock(m_blockAlign, m_channels);
+            if (bits != 4 || m_framesPerBlock == 0 || (m_blockAlign - 4u * m_channels) % (4u * m_channels) != 0 ||
+                (size >= 20 && getU16(fmt + 18) != m_framesPerBlock)) {
+                return false;
+            }
+        } else if (bits != 8 || m_blockAlign != m_channels) {
+            return false;
+        }
+        m_blockAlign = static_cast<uint16_t>(m_channels * 2);
+        return m_channels > 0;
+    }
+    m_encoding = WavEncoding::Pcm;
+
+    if (tag == WAVE_FORMAT_IEEE_FLOAT_TAG && bits == 32) {
+        m_sampleFormat = SampleFormat::Float32;
+    } else if (tag == WAVE_FORMAT_PCM_TAG && (bits == 16 || bits == 24 || bits == 32)) {
+        m_sampleFormat = pcmFormatForBits(bits);
+    } else {
+        return false;
+    }
+    return m_channels > 0 && m_blockAlign == m_channels * bytesPerSample(m_sampleFormat);
+}
+
+bool WavReader::parseRiff(bool rf64) {
+    uint64_t ds64DataSize = 0;
+    uint64_t ds64Frames = 0;
+    uint64_t factFrames = 0;
+    bool haveFmt = false;
+    uint8_t header[8];
+
+    while (fread(header, 1, 8, m_file) == 8) {
+        uint32_t size = getU32(header + 4);
+        int64_t start = ftell64(m_file);
+
+        if (memcmp(header, "ds64", 4) == 0 && size >= 24) {
+            uint8_t body[24];
+            if (fread(body, 1, 24, m_file) != 24) {
+                return false;
+            }
+            ds64DataSize = getU64(body + 8);
+            ds64Frames = getU64(body + 16);
+        } else if (memcmp(header, "fact", 4) == 0 && size >= 4) {
+            uint8_t body[4];
+            if (fread(body, 1, 4, m_file) != 4) {
+                return false;
+            }
+            factFrames = getU32(body);
+            if (rf64 && factFrames == 0xFFFFFFFF) {
+                factFrames = ds64Frames;
+            }
+        } else if (memcmp(header, "fmt ", 4) == 0) {
+            std::vector<uint8_t> fmt(size);
+            if (fread(fmt.data(), 1, size, m_file) != size || !parseFmt(fmt.data(), size)) {
+                return false;
+            }
+            haveFmt = true;
+        } else if (memcmp(header, "data", 4) == 0) {
+            setData(static_cast<uint64_t>(start), (rf64 && size == 0xFFFFFFFF) ? ds64DataSize : size, factFrames);
+            return haveFmt;
+        }
+
+        // Chunks are word aligned.
+        if (fseek64(m_file, start + size + (size & 1), SEEK_SET) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool WavReader::parseWave64() {
+    // Skip the riff size and the wave GUID.
+    if (fseek64(m_file, 40, SEEK_SET) != 0) {
+        return false;
+    }
+
+    bool haveFmt = false;
+    uint64_t factFrames = 0;
+    uint8_t header[24];
+    while (fread(header, 1, 24, m_file) == 24) {
+        uint64_t size = getU64(header + 16);
+        int64_t start = ftell64(m_file);
+        if (size < 24 || memcmp(header + 4, W64_GUID_TAIL, 12) != 0) {
+            return false;
+        }
+        uint64_t body = size - 24;
+
+        if (memcmp(header, "fmt ", 4) == 0) {
+            std::vector<uint8_t> fmt(static_cast<size_t>(body));
+            if (fread(fmt.data(), 1, fmt.size(), m_file) != fmt.size() || !parseFmt(fmt.data(), fmt.size())) {
+                return false;
+            }
+            haveFmt = true;
+        } else if (memcmp(header, "fact", 4) == 0 && body >= 8) {
+            uint8_t fact[8];
+            if (fread(fact, 1, 8, m_file) != 8) {
+                return false;
+            }
+            factFrames = getU64(fact);
+        } else if (memcmp(header, "data", 4) == 0) {
+            setData(static_cast<uint64_t>(start), body, factFrames);
+            return haveFmt;
+        }
+
+        // Chunks are 8-byte aligned.
+        if (fseek64(m_file, start + ((body + 7) & ~uint64_t(7)), SEEK_SET) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void WavReader::setData(uint64_t offset, uint64_t size, uint64_t factFrames) {
+    m_dataOffset = offset;
+    if (m_encoding == WavEncoding::Pcm) {
+        m_dataSize = size;
+        return;
+    }
+
+    // The fact chunk trims the padding of the last ADPCM block.
+    m_encodedSize = size;
+    uint64_t frames;
+    if (m_encoding == WavEncoding::ImaAdpcm) {
+        frames = size / m_encodedBlockAlign * m_framesPerBlock;
+        uint64_t tail = size % m_encodedBlockAlign;
+        if (tail >= 4u * m_channels) {
+            frames += 1 + (tail - 4u * m_channels) / (4u * m_channels) * 8;
+        }
+        m_encoded.resize(m_encodedBlockAlign);
+        m_decoded.resize(size_t(m_framesPerBlock) * m_channels);
+    } else {
+        frames = size / m_channels;
+        m_encoded.resize(G711_CHUNK_SAMPLES);
+        m_decoded.resize(G711_CHUNK_SAMPLES);
+        m_g711.reset(new G711Codec(m_encoding));
+    }
+    if (factFrames > 0 && factFrames < frames) {
+        frames = factFrames;
+    }
+    m_dataSize = frames * m_blockAlign;
+}
+
+size_t WavReader::readDecoded(uint8_t* data, size_t size) {
+    size = static_cast<size_t>(std::min<uint64_t>(size, m_dataSize - m_position));
+    size -= size % 2;
+    size_t done = 0;
+
+    while (done < size) {
+        if (m_decodedPosition == m_decodedSize) {
+            size_t want;
+            if (m_encoding == WavEncoding::ImaAdpcm) {
+                want = m_encodedBlockAlign;
+            } else {
+                want = std::min((size - done) / 2, G711_CHUNK_SAMPLES);
+            }
+            want = static_cast<size_t>(std::min<uint64_t>(want, m_encodedSize - m_encodedPosition));
+            size_t got = want > 0 ? fread(m_encoded.data(), 1, want, m_file) : 0;
+            m_encodedPosition += got;
+            size_t samples;
+            if (m_encoding == WavEncoding::ImaAdpcm) {
+                samples = size_t(decodeImaAdpcmBlock(m_encoded.data(), got, m_channels, m_decoded.data())) *
+                          m_channels;
+            } else {
+                m_g711->decode(m_encoded.data(), got, m_decoded.data());
+                samples = got;
+            }
+            if (samples == 0) {
+                break;
+            }
+            m_decodedSize = samples * 2;
+            m_decodedPosition = 0;
+        }
+
+        size_t take = std::min(size - done, m_decodedSize - m_decodedPosition);
+        memcpy(data + done, reinterpret_cast<const uint8_t*>(m_decoded.data()) + m_decodedPosition, take);
+        m_decodedPosition += take;
+        done += take;
+    }
+
+    m_position += done;
+    return done;
+}
+
+size_t WavReader::read(uint8_t* data, size_t size) {
+    if (!m_file) {
+        return 0;
+    }
+    if (m_encoding != WavEncoding::Pcm) {
+        return readDecoded(data, size);
+    }
+
+    uint64_t remaining = m_dataSize - m_position;
+    if (size > remaining) {
+        size = static_cast<size_t>(remaining);
+    }
+    size_t got = fread(data, 1, size, m_file);
+    m_position += got;
+    return got;
+}
+
+bool WavReader::rewind() {
+    if (!m_file || fseek64(m_file, static_cast<int64_t>(m_dataOffset), SEEK_SET) != 0) {
+        return false;
+    }
+    m_position = 0;
+    m_encodedPosition = 0;
+    m_decodedSize = 0;
+    m_decodedPosition = 0;
+    return true;
+}
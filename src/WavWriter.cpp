@@ -1,79 +1,647 @@
 #include "WavWriter.h"
+#include "AsyncOutputFile.h"
+#include "ClockTracker.h"
+#include "Logger.h"
+#include "MappedOutputFile.h"
+#include "OutputFile.h"
+#include "Resampler.h"
+#include "SampleConverter.h"
+#include "WavCodec.h"
+#include <algorithm>
+#include <cmath>
 #include <cstring>
-#include <fstream>
 
-WavWriter::WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample)
+// Wave64 chunk identifiers (little-endian GUID layout).
+static const uint8_t W64_RIFF_GUID[16] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11,
+                                          0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00};
+static const uint8_t W64_WAVE_GUID[16] = {0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11,
+                                          0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t W64_FMT_GUID[16] = {0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11,
+                                         0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t W64_FACT_GUID[16] = {0x66, 0x61, 0x63, 0x74, 0xF3, 0xAC, 0xD3, 0x11,
+                                          0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+static const uint8_t W64_DATA_GUID[16] = {0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11,
+                                          0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A};
+
+// Size of the ds64 chunk body (riff size, data size, sample count, table
+// length); the JUNK placeholder has exactly the same size.
+static constexpr uint32_t DS64_BODY_SIZE = 28;
+static constexpr uint32_t RIFF_SIZE_LIMIT = 0xFFFFFFFF;
+
+static constexpr uint16_t WAVE_FORMAT_PCM_TAG = 0x0001;
+static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT_TAG = 0x0003;
+static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE_TAG = 0xFFFE;
+
+// KSDATAFORMAT_SUBTYPE_* GUID minus its first two bytes, which carry the
+// format tag.
+static const uint8_t KSDATAFORMAT_SUBTYPE_TAIL[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                                      0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+static void putBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static void putU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    putU16(out, static_cast<uint16_t>(value));
+    putU16(out, static_cast<uint16_t>(value >> 16));
+}
+
+static void putU64(std::vector<uint8_t>& out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value));
+    putU32(out, static_cast<uint32_t>(value >> 32));
+}
+
+WavWriter::WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample,
+                     const WavWriterOptions& options)
+    : WavWriter(filename, sampleRate, channels, pcmFormatForBits(bitsPerSample), options) {
+}
+
+WavWriter::WavWriter(const std::string& filename, uint32_t sampleRate, uint16_t channels, SampleFormat inputFormat,
+                     const WavWriterOptions& options)
     : m_filename(filename)
-    , m_file(nullptr)
+    , m_options(options)
+    , m_inputFormat(inputFormat)
+    , m_outputFormat(options.outputFormat.value_or(
+          options.encoding != WavEncoding::Pcm && isFloatFormat(inputFormat) ? SampleFormat::Int16 : inputFormat))
+    , m_inputFrameBytes(0)
+    , m_carrySize(0)
     , m_bytesWritten(0)
-    , m_isOpen(false) {
-    
-    memset(&m_header, 0, sizeof(m_header));
-    
-    memcpy(m_header.riff, "RIFF", 4);
-    memcpy(m_header.wave, "WAVE", 4);
-    memcpy(m_header.fmt, "fmt ", 4);
-    memcpy(m_header.data, "data", 4);
-    
-    m_header.fmtChunkSize = 16;
-    m_header.audioFormat = 1;
-    m_header.channels = channels;
-    m_header.sampleRate = sampleRate;
-    m_header.bitsPerSample = bitsPerSample;
-    m_header.blockAlign = (channels * bitsPerSample) / 8;
-    m_header.byteRate = sampleRate * m_header.blockAlign;
+    , m_silenceBytes(0)
+    , m_pendingSilence(0)
+    , m_isOpen(false)
+    , m_isRf64(false)
+    , m_timed(false)
+    , m_startPosition(0)
+    , m_positionOffset(0)
+    , m_gapFrames(0)
+    , m_anchored(false)
+    , m_referenceStart(0.0)
+    , m_driftError(0.0) {
+
+    bool resample = (options.sampleRate != 0 && options.sampleRate != sampleRate) ||
+                    (options.mono && channels > 1) || options.clock;
+    if (resample) {
+        setupResampler(sampleRate, channels);
+        if (m_resampler) {
+            return;
+        }
+    }
+
+    if (m_outputFormat != m_inputFormat) {
+        if (isFloatFormat(m_inputFormat)) {
+            m_converter.reset(new SampleConverter(m_outputFormat, m_options.dither));
+        } else {
+            LOG_WARN << "[WavWriter] Only float input can be converted, writing input format";
+            m_outputFormat = m_inputFormat;
+        }
+    }
+
+    setupFormat(sampleRate, channels);
+}
+
+void WavWriter::setupResampler(uint32_t sampleRate, uint16_t channels) {
+    ResamplerConfig config;
+    config.inputRate = sampleRate;
+    config.outputRate = m_options.sampleRate ? m_options.sampleRate : sampleRate;
+    config.channels = channels;
+    config.mono = m_options.mono;
+    config.variableRate = m_options.clock != nullptr;
+    std::unique_ptr<Resampler> resampler(new Resampler(config));
+    if (!resampler->valid()) {
+        LOG_WARN << "[WavWriter] Cannot resample " << sampleRate << " Hz to " << config.outputRate
+                 << " Hz, writing the input rate";
+        return;
+    }
+
+    // Everything is float between the resampler and the converter, so any
+    // input format can be written in any output format.
+    m_resampler = std::move(resampler);
+    if (!isFloatFormat(m_outputFormat)) {
+        m_converter.reset(new SampleConverter(m_outputFormat, m_options.dither));
+    }
+    m_inputFrameBytes = static_cast<uint16_t>(channels * bytesPerSample(m_inputFormat));
+    m_frameCarry.reserve(m_inputFrameBytes);
+    m_floatInput.resize(RESAMPLE_CHUNK_FRAMES * channels);
+    size_t maxFrames = std::max(m_resampler->maxOutputFrames(RESAMPLE_CHUNK_FRAMES),
+                                m_resampler->maxOutputFrames(m_resampler->tapsPerPhase()));
+    m_resampled.resize(maxFrames * m_resampler->outputChannels());
+    m_scratch.resize(m_resampled.size() * bytesPerSample(m_outputFormat));
+
+    LOG_INFO << "[WavWriter] Resampling " << sampleRate << " Hz to " << config.outputRate << " Hz ("
+             << m_resampler->upFactor() << "/" << m_resampler->downFactor() << ", "
+             << m_resampler->tapsPerPhase() << " taps, "
+             << SampleConverter::simdLevelName(m_resampler->simdLevel()) << ")"
+             << (config.mono ? ", mono" : "") << (config.variableRate ? ", drift corrected" : "");
+    setupFormat(config.outputRate, m_resampler->outputChannels());
+}
+
+void WavWriter::setupFormat(uint32_t sampleRate, uint16_t channels) {
+    if (m_options.encoding != WavEncoding::Pcm) {
+        if (m_outputFormat == SampleFormat::Int16) {
+            m_encoder.reset(new WavEncoder(m_options.encoding, sampleRate, channels));
+        } else {
+            LOG_WARN << "[WavWriter] " << encodingName(m_options.encoding)
+                     << " takes 16-bit samples, writing PCM";
+        }
+    }
+    if (m_encoder) {
+        m_format.audioFormat = m_encoder->formatTag();
+        m_format.channels = channels;
+        m_format.sampleRate = sampleRate;
+        m_format.bitsPerSample = m_encoder->bitsPerSample();
+        m_format.blockAlign = m_encoder->blockAlign();
+        m_format.byteRate = m_encoder->byteRate();
+        m_format.channelMask = 0;
+        // Compressed formats are never wrapped in WAVE_FORMAT_EXTENSIBLE.
+        m_format.extensible = false;
+        return;
+    }
+
+    uint16_t bytes = bytesPerSample(m_outputFormat);
+
+    m_format.audioFormat = isFloatFormat(m_outputFormat) ? WAVE_FORMAT_IEEE_FLOAT_TAG : WAVE_FORMAT_PCM_TAG;
+    m_format.channels = channels;
+    m_format.sampleRate = sampleRate;
+    m_format.bitsPerSample = static_cast<uint16_t>(bytes * 8);
+    m_format.blockAlign = static_cast<uint16_t>(channels * bytes);
+    m_format.byteRate = sampleRate * m_format.blockAlign;
+
+    m_format.channelMask = m_options.channelMask;
+    if (m_format.channelMask == 0) {
+        if (channels == 1) {
+            m_format.channelMask = 0x4; // SPEAKER_FRONT_CENTER
+        } else if (channels < 32) {
+            m_format.channelMask = (1u << channels) - 1;
+        }
+    }
+
+    // WAVE_FORMAT_EXTENSIBLE is required for more than two channels and for
+    // integer PCM deeper than 16 bits.
+    m_format.extensible = channels > 2 || m_options.channelMask != 0 ||
+                          (!isFloatFormat(m_outputFormat) && m_format.bitsPerSample > 16);
 }
 
 WavWriter::~WavWriter() {
     finalize();
 }
 
+bool WavWriter::needsFactChunk() const {
+    // Every format other than plain integer PCM carries a fact chunk.
+    return m_format.audioFormat != WAVE_FORMAT_PCM_TAG;
+}
+
 bool WavWriter::initialize() {
-    m_file = fopen(m_filename.c_str(), "wb");
-    if (!m_file) {
+#ifdef PLATFORM_LINUX
+    if (m_options.mode == WavWriteMode::Batched) {
+        AsyncOutputOptions asyncOptions;
+        asyncOptions.blockSize = m_options.blockSize;
+        asyncOptions.maxBlocksInFlight = m_options.maxBlocksInFlight;
+        asyncOptions.directIo = m_options.directIo;
+        m_output.reset(new AsyncOutputFile(asyncOptions));
+    } else if (m_options.mode == WavWriteMode::Mapped) {
+        MappedOutputOptions mappedOptions;
+        mappedOptions.extentSize = m_options.preallocateSize;
+        mappedOptions.windowSize = m_options.mapWindowSize;
+        m_output.reset(new MappedOutputFile(mappedOptions));
+    }
+#else
+    if (m_options.mode != WavWriteMode::Stdio) {
+        LOG_WARN << "[WavWriter] Requested write mode not available on this platform, using stdio";
+    }
+#endif
+    if (!m_output) {
+        m_output.reset(new StdioOutputFile());
+    }
+
+    if (!m_output->open(m_filename)) {
+        m_output.reset();
         return false;
     }
     
     m_isOpen = true;
+    m_isRf64 = false;
     m_bytesWritten = 0;
+    m_silenceBytes = 0;
+    m_pendingSilence = 0;
+    m_carrySize = 0;
+    m_frameCarry.clear();
+    if (m_resampler) {
+        m_resampler->reset();
+    }
+    if (m_encoder) {
+        m_encoder->reset();
+    }
+    m_timed = false;
+    m_gapFrames = 0;
+    m_anchored = false;
+    m_driftError = 0.0;
     writeHeader();
+    if (m_options.reserveSeconds > 0.0 &&
+        !m_output->reserve(m_header.size() + static_cast<uint64_t>(m_options.reserveSeconds * m_format.byteRate))) {
+        LOG_WARN << "[WavWriter] Could not reserve disk space for " << m_filename;
+    }
     return true;
 }
 
 void WavWriter::write(const uint8_t* data, uint32_t size) {
-    if (!m_isOpen || !m_file || !data) {
+    if (!m_isOpen || !data) {
         return;
     }
-    
-    fwrite(data, 1, size, m_file);
-    m_bytesWritten += size;
+    if (m_pendingSilence > 0) {
+        flushSilence();
+    }
+
+    if (m_resampler) {
+        writeResampled(data, size);
+        return;
+    }
+
+    if (!m_converter) {
+        appendPcm(data, size);
+        return;
+    }
+
+    // Complete a float sample split by the previous call.
+    if (m_carrySize > 0) {
+        while (m_carrySize < sizeof(float) && size > 0) {
+            m_carry[m_carrySize++] = *data++;
+            --size;
+        }
+        if (m_carrySize < sizeof(float)) {
+            return;
+        }
+        float sample;
+        memcpy(&sample, m_carry, sizeof(sample));
+        uint8_t converted[4];
+        size_t bytes = m_converter->convert(&sample, 1, converted);
+        appendPcm(converted, bytes);
+        m_carrySize = 0;
+    }
+
+    size_t samples = size / sizeof(float);
+    if (samples > 0) {
+        size_t needed = samples * bytesPerSample(m_outputFormat);
+        if (m_scratch.size() < needed) {
+            m_scratch.resize(needed);
+        }
+        // The ring hands over arbitrary byte ranges, so the source may not be
+        // float-aligned.
+        const float* src = reinterpret_cast<const float*>(data);
+        if (reinterpret_cast<uintptr_t>(data) % alignof(float) != 0) {
+            if (m_alignedInput.size() < samples) {
+                m_alignedInput.resize(samples);
+            }
+            memcpy(m_alignedInput.data(), data, samples * sizeof(float));
+            src = m_alignedInput.data();
+        }
+        size_t bytes = m_converter->convert(src, samples, m_scratch.data());
+        appendPcm(m_scratch.data(), bytes);
+    }
+
+    m_carrySize = size - samples * sizeof(float);
+    memcpy(m_carry, data + samples * sizeof(float), m_carrySize);
 }
 
-void WavWriter::finalize() {
-    if (m_isOpen && m_file) {
-        updateHeader();
-        fclose(m_file);
-        m_file = nullptr;
-        m_isOpen = false;
+void WavWriter::writeTimed(const uint8_t* data, uint32_t size, const BlockTimestamp& time) {
+    if (m_isOpen && m_resampler && m_options.clock && time.valid()) {
+        steerDrift(time);
     }
+    write(data, size);
+}
+
+void WavWriter::writeSilence(uint32_t size, const BlockTimestamp& time) {
+    if (!m_isOpen) {
+        return;
+    }
+    if (m_resampler || m_encoder) {
+        // The filter rings out into the silence, so it has to run, and
+        // encoded silence is not zeros.
+        AudioSink::writeSilence(size, time);
+        return;
+    }
+
+    // Finish a float sample split by the previous packet, so the rest maps
+    // to whole output samples.
+    static const uint8_t zeros[sizeof(float)] = {};
+    if (m_converter && m_carrySize > 0) {
+        uint32_t take = std::min<uint32_t>(static_cast<uint32_t>(sizeof(float) - m_carrySize), size);
+        write(zeros, take);
+        size -= take;
+    }
+
+    uint64_t bytes = size;
+    uint32_t tail = 0;
+    if (m_converter) {
+        bytes = uint64_t(size / sizeof(float)) * bytesPerSample(m_outputFormat);
+        tail = size % sizeof(float);
+    }
+    m_pendingSilence += bytes;
+    if (tail > 0) {
+        write(zeros, tail);
+    }
+}
+
+void WavWriter::flushSilence() {
+    // A failed hole may still have moved the end of the file; only what is
+    // missing is written again, as plain zeros, so later samples keep their
+    // place on the timeline.
+    uint64_t start = m_output->size();
+    if (!m_output->appendZeros(m_pendingSilence)) {
+        uint64_t missing = start + m_pendingSilence - std::max(m_output->size(), start);
+        LOG_WARN << "[WavWriter] WARNING: could not leave " << m_pendingSilence
+                 << " bytes of silence as a hole in " << m_filename << ", writing zeros";
+        if (!m_output->OutputFile::appendZeros(missing)) {
+            LOG_ERROR << "[WavWriter] ERROR: failed to write " << missing << " bytes of silence to " << m_filename
+                      << "; the audio after it is early by the bytes missing";
+        }
+    }
+    uint64_t written = m_output->size() - start;
+    m_bytesWritten += written;
+    m_silenceBytes += written;
+    m_pendingSilence = 0;
+}
+
+void WavWriter::steerDrift(const BlockTimestamp& time) {
+    const ClockTracker& clock = *m_options.clock;
+    const ClockTracker* reference = m_options.referenceClock;
+    double inputRate = clock.nominalRate();
+    double outputRate = m_resampler->outputRate();
+
+    // Device position of the resampler's input frame 0. A jump means the
+    // device skipped frames, which the output cannot contain.
+    int64_t offset = static_cast<int64_t>(time.position - m_resampler->inputFrames());
+    if (!m_timed) {
+        m_timed = true;
+        m_startPosition = time.position;
+        m_positionOffset = offset;
+    } else if (offset != m_positionOffset) {
+        m_gapFrames += offset - m_positionOffset;
+        m_positionOffset = offset;
+    }
+
+    // Nothing to align to until the reference stream runs.
+    if (reference && !reference->started()) {
+        return;
+    }
+    auto referenceSeconds = [reference](int64_t hostTimeNs) {
+        return reference ? reference->positionAt(hostTimeNs) / reference->nominalRate() : hostTimeNs * 1e-9;
+    };
+
+    // Host time of the next output frame, read off this device's fitted
+    // clock, then measured on the reference clock.
+    int64_t now = clock.hostTimeAt(m_resampler->outputPosition() + double(m_positionOffset));
+    if (!m_anchored) {
+        int64_t start = clock.hostTimeAt(double(m_startPosition));
+        m_referenceStart = referenceSeconds(start);
+        m_anchored = now - start >= static_cast<int64_t>(ClockTracker::FIT_TIME_CONSTANT_S * 1e9);
+    }
+    double elapsed = referenceSeconds(now) - m_referenceStart;
+    double target = (elapsed - m_gapFrames / inputRate) * outputRate;
+    m_driftError = double(m_resampler->outputFrames()) - target;
+
+    // Feed forward the measured rate ratio and steer the remaining error out
+    // over DRIFT_CORRECTION_SECONDS.
+    double ratio = (reference ? reference->rateRatio() : 1.0) / clock.rateRatio();
+    double factor = ratio * (1.0 - m_driftError / (outputRate * DRIFT_CORRECTION_SECONDS));
+    m_resampler->setRateAdjust(std::min(std::max(factor, 1.0 - MAX_DRIFT_ADJUST), 1.0 + MAX_DRIFT_ADJUST));
+}
+
+void WavWriter::writeResampled(const uint8_t* data, uint32_t size) {
+    // Complete an input frame split by the previous call.
+    if (!m_frameCarry.empty()) {
+        size_t take = std::min<size_t>(m_inputFrameBytes - m_frameCarry.size(), size);
+        m_frameCarry.insert(m_frameCarry.end(), data, data + take);
+        data += take;
+        size -= static_cast<uint32_t>(take);
+        if (m_frameCarry.size() < m_inputFrameBytes) {
+            return;
+        }
+        resampleFrames(m_frameCarry.data(), 1);
+        m_frameCarry.clear();
+    }
+
+    size_t frames = size / m_inputFrameBytes;
+    for (size_t done = 0; done < frames;) {
+        size_t chunk = std::min(frames - done, RESAMPLE_CHUNK_FRAMES);
+        resampleFrames(data + done * m_inputFrameBytes, chunk);
+        done += chunk;
+    }
+    size_t used = frames * m_inputFrameBytes;
+    m_frameCarry.insert(m_frameCarry.end(), data + used, data + size);
+}
+
+void WavWriter::resampleFrames(const uint8_t* data, size_t frames) {
+    size_t channels = m_inputFrameBytes / bytesPerSample(m_inputFormat);
+    decodeSamples(data, m_inputFormat, frames * channels, m_floatInput.data());
+    size_t produced = m_resampler->process(m_floatInput.data(), frames, m_resampled.data());
+    appendFloat(m_resampled.data(), produced * m_resampler->outputChannels());
+}
+
+void WavWriter::appendFloat(const float* samples, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (m_converter) {
+        size_t bytes = m_converter->convert(samples, count, m_scratch.data());
+        appendPcm(m_scratch.data(), bytes);
+    } else {
+        m_output->append(reinterpret_cast<const uint8_t*>(samples), count * sizeof(float));
+        m_bytesWritten += count * sizeof(float);
+    }
+}
+
+void WavWriter::appendPcm(const uint8_t* data, size_t size) {
+    if (!m_encoder) {
+        m_output->append(data, size);
+        m_bytesWritten += size;
+        return;
+    }
+    size_t needed = m_encoder->maxOutputBytes(size);
+    if (m_encoded.size() < needed) {
+        m_encoded.resize(needed);
+    }
+    size_t bytes = m_encoder->encode(data, size, m_encoded.data());
+    if (bytes > 0) {
+        m_output->append(m_encoded.data(), bytes);
+        m_bytesWritten += bytes;
+    }
+}
+
+bool WavWriter::flush() {
+    if (m_isOpen && m_pendingSilence > 0) {
+        flushSilence();
+    }
+    return m_isOpen && m_output->flush();
+}
+
+bool WavWriter::finalize() {
+    if (!m_isOpen) {
+        return false;
+    }
+
+    if (m_resampler) {
+        // Flush what the filter delay still holds; a partial input frame
+        // left in the carry is dropped.
+        size_t produced = m_resampler->drain(m_resampled.data());
+        appendFloat(m_resampled.data(), produced * m_resampler->outputChannels());
+    }
+    if (m_pendingSilence > 0) {
+        flushSilence();
+    }
+    if (m_encoder) {
+        // The last ADPCM block is padded with silence; the fact chunk keeps
+        // the true length.
+        m_encoded.resize(std::max<size_t>(m_encoded.size(), m_encoder->blockAlign()));
+        size_t bytes = m_encoder->finish(m_encoded.data());
+        m_output->append(m_encoded.data(), bytes);
+        m_bytesWritten += bytes;
+    }
+
+    // The pad is not part of the data chunk's size, only of its parent's.
+    if (uint64_t padding = dataPadding()) {
+        static const uint8_t zeros[8] = {};
+        m_output->append(zeros, padding);
+    }
+    updateHeader();
+    bool ok = m_output->close();
+    m_output.reset();
+    m_isOpen = false;
+    return ok;
 }
 
 bool WavWriter::isOpen() const {
     return m_isOpen;
 }
 
+uint64_t WavWriter::framesWritten() const {
+    if (m_encoder) {
+        return m_encoder->frames();
+    }
+    return m_format.blockAlign ? m_bytesWritten / m_format.blockAlign : 0;
+}
+
+uint64_t WavWriter::dataPadding() const {
+    if (m_options.container == WavContainer::Wave64) {
+        return (8 - m_bytesWritten % 8) % 8;
+    }
+    return m_bytesWritten & 1;
+}
+
+void WavWriter::buildFmtPayload(std::vector<uint8_t>& payload) const {
+    putU16(payload, m_format.extensible ? WAVE_FORMAT_EXTENSIBLE_TAG : m_format.audioFormat);
+    putU16(payload, m_format.channels);
+    putU32(payload, m_format.sampleRate);
+    putU32(payload, m_format.byteRate);
+    putU16(payload, m_format.blockAlign);
+    putU16(payload, m_format.bitsPerSample);
+
+    if (m_format.extensible) {
+        putU16(payload, 22);
+        putU16(payload, m_format.bitsPerSample); // wValidBitsPerSample
+        putU32(payload, m_format.channelMask);
+        putU16(payload, m_format.audioFormat);
+        putBytes(payload, KSDATAFORMAT_SUBTYPE_TAIL, sizeof(KSDATAFORMAT_SUBTYPE_TAIL));
+    } else if (m_encoder && m_encoder->encoding() == WavEncoding::ImaAdpcm) {
+        putU16(payload, 2); // cbSize
+        putU16(payload, static_cast<uint16_t>(m_encoder->framesPerBlock()));
+    } else if (m_format.audioFormat != WAVE_FORMAT_PCM_TAG) {
+        putU16(payload, 0); // cbSize
+    }
+}
+
+void WavWriter::buildRiffHeader(bool rf64) {
+    std::vector<uint8_t> fmt;
+    buildFmtPayload(fmt);
+
+    uint64_t frames = framesWritten();
+    bool fact = needsFactChunk();
+
+    // Everything after the 8-byte RIFF preamble up to the start of the data.
+    uint64_t headerBody = 4 + (8 + DS64_BODY_SIZE) + (8 + fmt.size()) + (fact ? 12 : 0) + 8;
+    uint64_t riffSize = headerBody + m_bytesWritten + dataPadding();
+
+    m_header.clear();
+    putBytes(m_header, rf64 ? "RF64" : "RIFF", 4);
+    putU32(m_header, rf64 ? RIFF_SIZE_LIMIT : static_cast<uint32_t>(riffSize));
+    putBytes(m_header, "WAVE", 4);
+
+    putBytes(m_header, rf64 ? "ds64" : "JUNK", 4);
+    putU32(m_header, DS64_BODY_SIZE);
+    if (rf64) {
+        putU64(m_header, riffSize);
+        putU64(m_header, m_bytesWritten);
+        putU64(m_header, frames);
+        putU32(m_header, 0);
+    } else {
+        m_header.insert(m_header.end(), DS64_BODY_SIZE, 0);
+    }
+
+    putBytes(m_header, "fmt ", 4);
+    putU32(m_header, static_cast<uint32_t>(fmt.size()));
+    putBytes(m_header, fmt.data(), fmt.size());
+
+    if (fact) {
+        putBytes(m_header, "fact", 4);
+        putU32(m_header, 4);
+        putU32(m_header, frames > RIFF_SIZE_LIMIT ? RIFF_SIZE_LIMIT : static_cast<uint32_t>(frames));
+    }
+
+    putBytes(m_header, "data", 4);
+    putU32(m_header, rf64 ? RIFF_SIZE_LIMIT : static_cast<uint32_t>(m_bytesWritten));
+}
+
+void WavWriter::buildWave64Header() {
+    std::vector<uint8_t> fmt;
+    buildFmtPayload(fmt);
+    // Wave64 chunks are 8-byte aligned.
+    fmt.resize((fmt.size() + 7) & ~size_t(7), 0);
+
+    bool fact = needsFactChunk();
+    uint64_t headerSize = 40 + (24 + fmt.size()) + (fact ? 32 : 0) + 24;
+
+    m_header.clear();
+    putBytes(m_header, W64_RIFF_GUID, 16);
+    putU64(m_header, headerSize + m_bytesWritten + dataPadding());
+    putBytes(m_header, W64_WAVE_GUID, 16);
+
+    putBytes(m_header, W64_FMT_GUID, 16);
+    putU64(m_header, 24 + fmt.size());
+    putBytes(m_header, fmt.data(), fmt.size());
+
+    if (fact) {
+        putBytes(m_header, W64_FACT_GUID, 16);
+        putU64(m_header, 32);
+        putU64(m_header, framesWritten());
+    }
+
+    putBytes(m_header, W64_DATA_GUID, 16);
+    putU64(m_header, 24 + m_bytesWritten);
+}
+
 void WavWriter::writeHeader() {
-    if (!m_file) return;
-    
-    fwrite(&m_header, sizeof(m_header), 1, m_file);
+    if (m_options.container == WavContainer::Wave64) {
+        buildWave64Header();
+    } else {
+        buildRiffHeader(false);
+    }
+    m_output->append(m_header.data(), m_header.size());
 }
 
 void WavWriter::updateHeader() {
-    if (!m_file) return;
-    
-    m_header.dataSize = m_bytesWritten;
-    m_header.fileSize = sizeof(m_header) - 8 + m_bytesWritten;
-    
-    fseek(m_file, 0, SEEK_SET);
-    fwrite(&m_header, sizeof(m_header), 1, m_file);
-}
\ No newline at end of file
+    // Only the fixed-size header at the start of the file is rewritten, so
+    // finalize cost does not depend on the amount of audio.
+    if (m_options.container == WavContainer::Wave64) {
+        buildWave64Header();
+    } else {
+        uint64_t riffSize = m_header.size() - 8 + m_bytesWritten + dataPadding();
+        m_isRf64 = riffSize > std::min<uint64_t>(m_options.rf64Threshold, RIFF_SIZE_LIMIT);
+        buildRiffHeader(m_isRf64);
+    }
+    m_output->writeAt(0, m_header.data(), m_header.size());
+}
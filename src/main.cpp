@@ -1,62 +1,357 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <string>
 
+#include "CaptureScheduler.h"
+#include "Logger.h"
 #include "LoopbackCapture.h"
+#include "MetricsReporter.h"
+#include "MultichannelWavWriter.h"
 #include "MicCapture.h"
+#include "Realtime.h"
+#include "SourceCapture.h"
+#include "SyntheticSource.h"
 #include "Utils.h"
+#include "WavCodec.h"
 
-int main() {
-  std::cout << "========================================" << std::endl;
-  std::cout << "  Audio Capture Application (Windows)" << std::endl;
-  std::cout << "========================================" << std::endl;
-  std::cout << std::endl;
+static bool parseEncoding(const char *name, WavEncoding &encoding) {
+  for (WavEncoding candidate :
+       {WavEncoding::MuLaw, WavEncoding::ALaw, WavEncoding::ImaAdpcm}) {
+    if (strcmp(name, encodingName(candidate)) == 0) {
+      encoding = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef PLATFORM_LINUX
+static bool parseStreamPolicy(const char *name, StreamOverflowPolicy &policy) {
+  if (strcmp(name, "block") == 0)
+    policy = StreamOverflowPolicy::Block;
+  else if (strcmp(name, "drop-oldest") == 0)
+    policy = StreamOverflowPolicy::DropOldest;
+  else if (strcmp(name, "drop-newest") == 0)
+    policy = StreamOverflowPolicy::DropNewest;
+  else
+    return false;
+  return true;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  // --realtime [--capture-cpu N] [--writer-cpu N]: opt-in real-time
+  // scheduling (MMCSS on Windows), CPU pinning and memory locking.
+  // --rate HZ [--mono]: write both files resampled, e.g. 16000 for ASR.
+  // --no-drift-correction: let mic.wav run on the microphone's own clock
+  // instead of following the speaker clock.
+  // --flac: record lossless FLAC at the device rates instead of WAV.
+  // --encoding mulaw|alaw|ima-adpcm: compressed 16-bit WAV, 2x or 4x
+  // smaller than PCM.
+  // --vad [--vad-gate]: detect speech in mic audio, optionally storing
+  // everything else as silence.
+  // --segment-seconds N, --segment-mb N: rotate both recordings into
+  // numbered segment files. --duration SECONDS: record for this long
+  // instead of 30 s.
+  // --live NAME (Linux): also publish both streams as they are captured to
+  // shared memory, as NAME-speaker and NAME-mic, for audio-capture-reader
+  // and other SharedMemoryReaders.
+  // --stream-speaker TARGET, --stream-mic TARGET (Linux): also stream a
+  // capture to "-" (stdout), "unix:PATH" or a FIFO path, e.g.
+  // `--stream-mic - --stream-format wav | ffplay -`. --stream-format
+  // raw|wav and --stream-policy block|drop-oldest|drop-newest apply to both.
+  // --combined: one aligned file, output/capture.wav, with the speaker at
+  // front left/right (front left with --mono) and the mic at front center,
+  // instead of two files.
+  RealtimeConfig realtime;
+  uint32_t outputRate = 0;
+  bool mono = false;
+  bool driftCorrection = true;
+  bool flac = false;
+  WavEncoding encoding = WavEncoding::Pcm;
+  bool voiceActivity = false;
+  VoiceActivityConfig voiceConfig;
+  SegmentOptions segments;
+  uint32_t duration = 30;
+  std::string liveName;
+  bool combined = false;
+#ifdef PLATFORM_LINUX
+  std::string speakerStream;
+  std::string micStream;
+  StreamSinkOptions streamOptions;
+#endif
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--realtime") == 0) {
+      realtime.enabled = true;
+    } else if (strcmp(argv[i], "--capture-cpu") == 0 && i + 1 < argc) {
+      realtime.captureCpus.push_back(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--writer-cpu") == 0 && i + 1 < argc) {
+      realtime.writerCpus.push_back(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      outputRate = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--mono") == 0) {
+      mono = true;
+    } else if (strcmp(argv[i], "--no-drift-correction") == 0) {
+      driftCorrection = false;
+    } else if (strcmp(argv[i], "--flac") == 0) {
+      flac = true;
+    } else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc &&
+               parseEncoding(argv[i + 1], encoding)) {
+      ++i;
+    } else if (strcmp(argv[i], "--segment-seconds") == 0 && i + 1 < argc) {
+      segments.maxSeconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--segment-mb") == 0 && i + 1 < argc) {
+      segments.maxBytes = static_cast<uint64_t>(atof(argv[++i]) * 1e6);
+    } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+      duration = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--combined") == 0) {
+      combined = true;
+#ifdef PLATFORM_LINUX
+    } else if (strcmp(argv[i], "--live") == 0 && i + 1 < argc) {
+      liveName = argv[++i];
+    } else if (strcmp(argv[i], "--stream-speaker") == 0 && i + 1 < argc) {
+      speakerStream = argv[++i];
+    } else if (strcmp(argv[i], "--stream-mic") == 0 && i + 1 < argc) {
+      micStream = argv[++i];
+    } else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc &&
+               (strcmp(argv[i + 1], "raw") == 0 ||
+                strcmp(argv[i + 1], "wav") == 0)) {
+      streamOptions.framing = strcmp(argv[++i], "wav") == 0
+                                  ? StreamFraming::Wav
+                                  : StreamFraming::Raw;
+    } else if (strcmp(argv[i], "--stream-policy") == 0 && i + 1 < argc &&
+               parseStreamPolicy(argv[i + 1], streamOptions.policy)) {
+      ++i;
+#endif
+    } else if (strcmp(argv[i], "--vad") == 0) {
+      voiceActivity = true;
+    } else if (strcmp(argv[i], "--vad-gate") == 0) {
+      voiceActivity = true;
+      voiceConfig.gate = true;
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--realtime] [--capture-cpu N] [--writer-cpu N]"
+                << " [--rate HZ] [--mono] [--no-drift-correction] [--flac]"
+                << " [--encoding mulaw|alaw|ima-adpcm] [--vad] [--vad-gate]"
+                << " [--segment-seconds N] [--segment-mb N] [--duration S]"
+                << " [--combined]"
+#ifdef PLATFORM_LINUX
+                << " [--live NAME] [--stream-speaker TARGET]"
+                << " [--stream-mic TARGET] [--stream-format raw|wav]"
+                << " [--stream-policy block|drop-oldest|drop-newest]"
+#endif
+                << std::endl;
+      return 1;
+    }
+  }
+
+#ifdef PLATFORM_LINUX
+  // stdout carries audio: everything else goes to stderr.
+  const bool audioOnStdout = speakerStream == "-" || micStream == "-";
+  if (audioOnStdout && speakerStream == micStream) {
+    std::cerr << "Only one stream can go to stdout" << std::endl;
+    return 1;
+  }
+  if (audioOnStdout)
+    Logger::instance().setOutput(stderr, stderr);
+  std::ostream &console = audioOnStdout ? std::cerr : std::cout;
+#else
+  std::ostream &console = std::cout;
+#endif
 
-  auto speakerCapture = std::make_unique<LoopbackCapture>("output/speaker.wav");
+  LOG_INFO << "========================================";
+#ifdef PLATFORM_WINDOWS
+  LOG_INFO << "  Audio Capture Application (Windows)";
+#else
+  LOG_INFO << "  Audio Capture Application (Linux, synthetic sources)";
+#endif
+  LOG_INFO << "========================================";
+  LOG_INFO;
 
-  auto micCapture = std::make_unique<MicCapture>("output/mic.wav");
+  if (realtime.enabled) {
+    Realtime::configure(realtime);
+    LOG_INFO;
+  }
 
-  std::cout << "Starting audio capture..." << std::endl;
-  std::cout << "Output files will be saved to:" << std::endl;
-  std::cout << "  - output/speaker.wav (system audio)" << std::endl;
-  std::cout << "  - output/mic.wav (microphone)" << std::endl;
-  std::cout << std::endl;
+  const std::string extension = flac ? ".flac" : ".wav";
+  if (combined && (flac || encoding != WavEncoding::Pcm ||
+                   segments.maxSeconds > 0.0 || segments.maxBytes > 0)) {
+    LOG_INFO << "The combined file is 16-bit PCM WAV in one piece: FLAC, "
+                "encodings and segments do not apply";
+  } else if (flac && (outputRate || mono || driftCorrection)) {
+    LOG_INFO << "FLAC is recorded at the device rates, without resampling or "
+                "drift correction";
+  }
 
-  std::cout << "=== Starting Speaker Capture ===" << std::endl;
+  // Both captures feed one file, aligned on the host clock.
+  std::shared_ptr<MultichannelWavWriter> combinedWriter;
+  size_t speakerGroup = 0;
+  size_t micGroup = 0;
+  if (combined) {
+    combinedWriter = std::make_shared<MultichannelWavWriter>(
+        "output/capture.wav", outputRate ? outputRate : 48000);
+    speakerGroup = combinedWriter->addGroup(
+        "speaker", mono ? 1 : 2,
+        mono ? WAV_SPEAKER_FRONT_LEFT
+             : WAV_SPEAKER_FRONT_LEFT | WAV_SPEAKER_FRONT_RIGHT);
+    micGroup = combinedWriter->addGroup("mic", 1, WAV_SPEAKER_FRONT_CENTER);
+  }
+
+#ifdef PLATFORM_WINDOWS
+  auto speakerCapture =
+      std::make_unique<LoopbackCapture>("output/speaker" + extension);
+  speakerCapture->setOutputRate(outputRate, mono);
+  speakerCapture->setEncoding(encoding);
+  if (flac)
+    speakerCapture->setFlacOutput(FlacWriterOptions());
+#else
+  // No loopback backend on Linux: stand in with a float stream shaped like
+  // a typical WASAPI mix format, converted to 16-bit like the real one.
+  SyntheticSourceConfig speakerConfig;
+  speakerConfig.format.sampleFormat = SampleFormat::Float32;
+  speakerConfig.frequency = 1000.0;
+  auto speakerCapture = std::make_unique<SourceCapture>(
+      "output/speaker" + extension,
+      std::make_unique<SyntheticSource>(speakerConfig));
+  WavWriterOptions speakerOptions;
+  speakerOptions.outputFormat = SampleFormat::Int16;
+  speakerOptions.sampleRate = outputRate;
+  speakerOptions.mono = mono;
+  speakerOptions.encoding = encoding;
+  speakerCapture->setWriterOptions(speakerOptions);
+  if (flac) {
+    FlacWriterOptions flacOptions;
+    flacOptions.outputFormat = SampleFormat::Int16;
+    speakerCapture->setFlacOutput(flacOptions);
+  }
+#endif
+
+  auto micCapture = std::make_unique<MicCapture>("output/mic" + extension);
+  WavWriterOptions micOptions;
+  micOptions.sampleRate = outputRate;
+  micOptions.mono = mono;
+  micOptions.encoding = encoding;
+  micCapture->setWriterOptions(micOptions);
+  if (flac)
+    micCapture->setFlacOutput(FlacWriterOptions());
+  // The speaker stream is the timeline both files share.
+  micCapture->setDriftCorrection(driftCorrection, &speakerCapture->clock());
+  if (voiceActivity)
+    micCapture->setVoiceActivity(voiceConfig);
+  const bool segmented =
+      !combined && (segments.maxSeconds > 0.0 || segments.maxBytes > 0);
+  if (combined) {
+    speakerCapture->setChannelGroup(combinedWriter, speakerGroup);
+    micCapture->setChannelGroup(combinedWriter, micGroup);
+  } else if (segmented) {
+    speakerCapture->setSegments(segments);
+    micCapture->setSegments(segments);
+  }
+
+  // Start small and let each writer grow its pool if the disk stalls.
+  BufferPoolConfig bufferConfig;
+  bufferConfig.blockCount = 16;
+  bufferConfig.autoTune = true;
+  speakerCapture->setBufferConfig(bufferConfig);
+  micCapture->setBufferConfig(bufferConfig);
+
+#ifdef PLATFORM_LINUX
+  // Both streams share one scheduler thread instead of a thread each.
+  CaptureScheduler scheduler(1);
+  if (!scheduler.start()) {
+    LOG_ERROR << "!!! FAILED to start capture scheduler !!!";
+    return 1;
+  }
+  speakerCapture->setScheduler(&scheduler);
+  micCapture->setScheduler(&scheduler);
+  if (!liveName.empty()) {
+    speakerCapture->setLiveStream(liveName + "-speaker");
+    micCapture->setLiveStream(liveName + "-mic");
+  }
+  if (!speakerStream.empty())
+    speakerCapture->setStream(speakerStream, streamOptions);
+  if (!micStream.empty())
+    micCapture->setStream(micStream, streamOptions);
+#endif
+
+  // Live per-stream counters and latency histograms, rewritten every second.
+  Utils::createDirectory("output");
+  MetricsReporterOptions metricsOptions;
+  metricsOptions.filePath = "output/stats.json";
+  MetricsReporter metricsReporter(metricsOptions);
+  metricsReporter.add("speaker", &speakerCapture->metrics());
+  metricsReporter.add("mic", &micCapture->metrics());
+  metricsReporter.start();
+
+  LOG_INFO << "Starting audio capture...";
+  LOG_INFO << "Output files will be saved to:";
+  const std::string numbering = segmented ? "-NNNN" : "";
+  if (combined) {
+    LOG_INFO << "  - output/capture.wav (system audio and microphone, "
+             << combinedWriter->channels() << " channels)";
+  } else {
+    LOG_INFO << "  - output/speaker" << numbering << extension
+             << " (system audio)";
+    LOG_INFO << "  - output/mic" << numbering << extension << " (microphone)";
+  }
+  LOG_INFO << "  - output/stats.json (capture metrics)";
+  if (!liveName.empty()) {
+    LOG_INFO << "Live streams: " << liveName << "-speaker, " << liveName
+             << "-mic (shared memory)";
+  }
+  LOG_INFO;
+
+  LOG_INFO << "=== Starting Speaker Capture ===";
   if (!speakerCapture->start()) {
-    std::cerr << std::endl;
-    std::cerr << "!!! FAILED to start speaker capture !!!" << std::endl;
+    LOG_ERROR;
+    LOG_ERROR << "!!! FAILED to start speaker capture !!!";
     return 1;
   }
-  std::cout << std::endl;
+  LOG_INFO;
 
-  std::cout << "=== Starting Microphone Capture ===" << std::endl;
+  LOG_INFO << "=== Starting Microphone Capture ===";
   if (!micCapture->start()) {
-    std::cerr << std::endl;
-    std::cerr << "!!! FAILED to start microphone capture !!!" << std::endl;
-    std::cout << "Stopping speaker capture..." << std::endl;
+    LOG_ERROR;
+    LOG_ERROR << "!!! FAILED to start microphone capture !!!";
+    LOG_INFO << "Stopping speaker capture...";
     speakerCapture->stop();
     return 1;
   }
-  std::cout << std::endl;
+  LOG_INFO;
 
-  std::cout << "=== Both captures running successfully ===" << std::endl;
-  std::cout << "Recording for 30 seconds..." << std::endl;
-  std::cout << std::endl;
+  LOG_INFO << "=== Both captures running successfully ===";
+  LOG_INFO << "Recording for " << duration << " seconds...";
+  LOG_INFO;
 
-  for (int i = 30; i > 0; --i) {
-    std::cout << "\rTime remaining: " << i << " seconds  " << std::flush;
+  // The countdown rewrites one console line, so it bypasses the logger; drain
+  // pending log lines first so they are not interleaved with it.
+  Logger::instance().flush();
+  for (uint32_t i = duration; i > 0; --i) {
+    console << "\rTime remaining: " << i << " seconds  " << std::flush;
     Utils::sleep(1000);
   }
+  console << std::endl;
 
-  std::cout << std::endl << std::endl;
-  std::cout << "=== Stopping Captures ===" << std::endl;
+  LOG_INFO;
+  LOG_INFO << "=== Stopping Captures ===";
   speakerCapture->stop();
   micCapture->stop();
+  metricsReporter.stop();
+  if (voiceActivity) {
+    const VoiceActivityDetector &voice = micCapture->voiceActivity();
+    LOG_INFO << "Speech: " << voice.speechSegments() << " segments, "
+             << double(voice.speechFrames()) /
+                    std::max<uint32_t>(voice.sampleRate(), 1)
+             << " s";
+  }
 
-  std::cout << std::endl;
-  std::cout << "========================================" << std::endl;
-  std::cout << "  Capture Complete!" << std::endl;
-  std::cout << "  Check the output folder for WAV files" << std::endl;
-  std::cout << "========================================" << std::endl;
+  LOG_INFO;
+  LOG_INFO << "========================================";
+  LOG_INFO << "  Capture Complete!";
+  LOG_INFO << "  Check the output folder for the recordings";
+  LOG_INFO << "========================================";
   return 0;
 }
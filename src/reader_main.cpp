@@ -0,0 +1,115 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "LevelMeter.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "SharedMemoryReader.h"
+#include "WavWriter.h"
+
+// Follows a live stream that audio-capture publishes with --live, from
+// another process: once a second, the level, how far behind capture the
+// newest audio arrived and any audio lost to falling behind.
+int main(int argc, char *argv[]) {
+  // NAME [--out FILE.wav] [--seconds N] [--oldest]
+  std::string name;
+  std::string outputFile;
+  double seconds = 0.0;
+  bool fromOldest = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      outputFile = argv[++i];
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--oldest") == 0) {
+      fromOldest = true;
+    } else if (name.empty() && argv[i][0] != '-') {
+      name = argv[i];
+    } else {
+      name.clear();
+      break;
+    }
+  }
+  if (name.empty()) {
+    std::cerr << "Usage: " << argv[0]
+              << " NAME [--out FILE.wav] [--seconds N] [--oldest]"
+              << std::endl;
+    return 1;
+  }
+
+  SharedMemoryReader reader(name);
+  LOG_INFO << "Waiting for live stream " << name << "...";
+  while (!reader.open(fromOldest))
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  LOG_INFO << "Attached to " << name << ": " << reader.sampleRate() << " Hz, "
+           << reader.channels() << " channels, "
+           << bytesPerSample(reader.format()) * 8 << "-bit, "
+           << reader.capacity() << "-byte ring, writer pid "
+           << reader.writerPid();
+
+  std::unique_ptr<WavWriter> writer;
+  if (!outputFile.empty()) {
+    writer.reset(new WavWriter(outputFile, reader.sampleRate(),
+                               reader.channels(), reader.format()));
+    if (!writer->initialize()) {
+      LOG_ERROR << "Could not create " << outputFile;
+      return 1;
+    }
+  }
+
+  LevelMeter meter(reader.format(), reader.channels());
+  LevelSums sums;
+  const uint16_t frameBytes = reader.frameBytes();
+  uint64_t intervalBytes = 0;
+  int64_t maxAgeNs = 0;
+  const int64_t startNs = metricsNowNs();
+  int64_t nextReportNs = startNs + 1000000000;
+  while (!reader.ended()) {
+    const uint8_t *data;
+    size_t size = reader.wait(&data, 100);
+    // Whole frames only; a partial one waits for the rest.
+    size = size / frameBytes * frameBytes;
+    if (size > 0) {
+      uint64_t offset;
+      BlockTimestamp time;
+      if (reader.latestTime(offset, time))
+        maxAgeNs = std::max(maxAgeNs, metricsNowNs() - time.hostTimeNs);
+      // In place: levels straight from the shared ring.
+      meter.measure(data, size / frameBytes, sums);
+      if (writer)
+        writer->write(data, static_cast<uint32_t>(size));
+      if (reader.consume(size))
+        intervalBytes += size;
+    }
+
+    int64_t now = metricsNowNs();
+    if (now >= nextReportNs) {
+      double rms = sums.rms();
+      LOG_INFO << "[" << name << "] " << intervalBytes / frameBytes
+               << " frames, level "
+               << (rms > 0.0 ? 20.0 * std::log10(rms) : -120.0)
+               << " dBFS, newest block " << maxAgeNs / 1000
+               << " us behind capture, " << reader.lostBytes()
+               << " bytes lost";
+      sums = LevelSums();
+      intervalBytes = 0;
+      maxAgeNs = 0;
+      nextReportNs = now + 1000000000;
+    }
+    if (seconds > 0.0 && now - startNs >= int64_t(seconds * 1e9))
+      break;
+  }
+
+  if (writer)
+    writer->finalize();
+  LOG_INFO << "Read " << reader.position() << " bytes of " << name << ", "
+           << reader.lostBytes() << " lost in " << reader.overruns()
+           << " overruns";
+  return 0;
+}
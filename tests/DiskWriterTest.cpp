@@ -0,0 +1,127 @@
+#include "AudioSink.h"
+#include "BlockSubscriber.h"
+#include "DiskWriter.h"
+#include "Metrics.h"
+#include "Test.h"
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Keeps what it is given, optionally taking its time like a slow disk.
+class RecordingSink : public AudioSink {
+public:
+  explicit RecordingSink(int delayUs = 0) : m_delayUs(delayUs) {}
+
+  bool initialize() override { return true; }
+  void write(const uint8_t *data, uint32_t size) override {
+    if (m_delayUs > 0)
+      std::this_thread::sleep_for(std::chrono::microseconds(m_delayUs));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_data.insert(m_data.end(), data, data + size);
+  }
+  bool finalize() override { return true; }
+
+  std::vector<uint8_t> data() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_data;
+  }
+
+private:
+  int m_delayUs;
+  std::mutex m_mutex;
+  std::vector<uint8_t> m_data;
+};
+
+BufferPoolConfig smallPool(size_t blocks, uint32_t blockSize) {
+  BufferPoolConfig config;
+  config.blockCount = blocks;
+  config.blockSize = blockSize;
+  config.minBlocks = 1;
+  config.maxBlocks = blocks;
+  config.lockPages = false;
+  return config;
+}
+
+std::vector<uint8_t> packet(size_t size, size_t index) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i)
+    data[i] = static_cast<uint8_t>(index * 31 + i);
+  return data;
+}
+
+} // namespace
+
+TEST(disk_writer, stop_drains_everything_pushed) {
+  // A slow sink leaves most packets queued when stop() is called.
+  RecordingSink sink(2000);
+  DiskWriter writer(&sink, smallPool(64, 1024));
+  CHECK(writer.start());
+  std::vector<uint8_t> expected;
+  for (size_t i = 0; i < 40; ++i) {
+    std::vector<uint8_t> data = packet(1000, i);
+    CHECK(writer.push(data.data(), static_cast<uint32_t>(data.size())));
+    expected.insert(expected.end(), data.begin(), data.end());
+  }
+  writer.stop();
+  CHECK(sink.data() == expected);
+  CHECK(writer.overruns() == 0);
+}
+
+TEST(disk_writer, full_pool_counts_overruns_and_drops) {
+  RecordingSink sink;
+  DiskWriter writer(&sink, smallPool(4, 1024));
+  // Not started: nothing is drained, so the pool fills.
+  std::vector<uint8_t> data = packet(1024, 0);
+  for (int i = 0; i < 4; ++i)
+    CHECK(writer.push(data.data(), 1024));
+  CHECK(!writer.push(data.data(), 1024));
+  CHECK(!writer.push(data.data(), 100));
+  CHECK(writer.overruns() == 2);
+  CHECK(writer.droppedBytes() == 1124);
+
+  // A packet needing more blocks than are free is dropped whole.
+  CHECK(writer.start());
+  writer.stop();
+  CHECK(sink.data().size() == 4 * 1024);
+  CHECK(!writer.push(data.data(), 5 * 1024));
+  CHECK(writer.overruns() == 3);
+}
+
+TEST(disk_writer, high_water_mark_counts_queued_blocks) {
+  RecordingSink sink;
+  DiskWriter writer(&sink, smallPool(16, 1024));
+  std::vector<uint8_t> data = packet(3000, 1);
+  // Three packets of three blocks each queue up before the writer runs.
+  for (int i = 0; i < 3; ++i)
+    CHECK(writer.push(data.data(), static_cast<uint32_t>(data.size())));
+  CHECK(writer.highWaterMark() == 0);
+  CHECK(writer.start());
+  writer.stop();
+  CHECK(writer.highWaterMark() == 9 * 1024);
+  CHECK(sink.data().size() == 9000);
+}
+
+TEST(disk_writer, subscriber_pool_shortfall_is_reported) {
+  RecordingSink sink;
+  BufferPoolConfig config = smallPool(4, 1024);
+  config.maxBlocks = 8;
+  DiskWriter writer(&sink, config);
+  StreamMetrics metrics;
+  writer.setMetrics(&metrics);
+
+  SubscriberOptions options;
+  options.maxQueuedBlocks = 3;
+  CHECK(writer.addSubscriber(std::make_shared<BlockSubscriber>(options)) == 0);
+  // One block left below maxBlocks: two of these three are missing.
+  CHECK(writer.addSubscriber(std::make_shared<BlockSubscriber>(options)) == 2);
+  CHECK(writer.pool().blockCount() == 8);
+  CHECK(writer.subscriberShortfall() == 2);
+
+  CHECK(writer.start());
+  writer.stop();
+  CHECK(metrics.toJsonFields().find("\"pool_shortfall_blocks\": 2") !=
+        std::string::npos);
+}
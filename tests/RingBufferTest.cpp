@@ -0,0 +1,123 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <thread>
+#include <vector>
+
+static std::vector<uint8_t> counting(size_t size, uint8_t first) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; ++i)
+    data[i] = static_cast<uint8_t>(first + i);
+  return data;
+}
+
+// Reads everything readable, across the wrap.
+static std::vector<uint8_t> readAll(SpscRingBuffer &ring) {
+  std::vector<uint8_t> out;
+  const uint8_t *data;
+  while (size_t size = ring.peek(&data)) {
+    out.insert(out.end(), data, data + size);
+    ring.consume(size);
+  }
+  return out;
+}
+
+TEST(ring_buffer, rounds_capacity_to_power_of_two) {
+  SpscRingBuffer ring(100);
+  CHECK(ring.capacity() == 128);
+}
+
+TEST(ring_buffer, overrun_rejects_whole_push_and_counts_it) {
+  SpscRingBuffer ring(64);
+  std::vector<uint8_t> first = counting(48, 0);
+  CHECK(ring.push(first.data(), first.size()));
+  std::vector<uint8_t> second = counting(32, 48);
+  CHECK(!ring.push(second.data(), second.size()));
+  CHECK(ring.overruns() == 1);
+  CHECK(ring.droppedBytes() == 32);
+  // Nothing of the rejected push is visible.
+  CHECK(ring.readAvailable() == 48);
+  CHECK(readAll(ring) == first);
+
+  // Room again: the next push lands and the counters stay put.
+  CHECK(ring.push(second.data(), second.size()));
+  CHECK(ring.push(second.data(), 16));
+  CHECK(!ring.push(second.data(), 17));
+  CHECK(ring.overruns() == 2);
+  CHECK(ring.droppedBytes() == 32 + 17);
+}
+
+TEST(ring_buffer, wraps_without_losing_order) {
+  SpscRingBuffer ring(64);
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> received;
+  uint8_t next = 0;
+  for (int round = 0; round < 50; ++round) {
+    std::vector<uint8_t> data = counting(37, next);
+    next = static_cast<uint8_t>(next + data.size());
+    CHECK(ring.push(data.data(), data.size()));
+    expected.insert(expected.end(), data.begin(), data.end());
+    std::vector<uint8_t> out = readAll(ring);
+    received.insert(received.end(), out.begin(), out.end());
+  }
+  CHECK(received == expected);
+  CHECK(ring.overruns() == 0);
+}
+
+TEST(ring_buffer, high_water_mark_is_tracked_by_consumer) {
+  SpscRingBuffer ring(256);
+  std::vector<uint8_t> data = counting(100, 0);
+  CHECK(ring.push(data.data(), data.size()));
+  CHECK(ring.push(data.data(), data.size()));
+  // Only the consumer updates it, when it looks.
+  CHECK(ring.highWaterMark() == 0);
+  const uint8_t *view;
+  ring.peek(&view);
+  CHECK(ring.highWaterMark() == 200);
+
+  readAll(ring);
+  CHECK(ring.push(data.data(), 50));
+  ring.peek(&view);
+  // A lower fill does not lower the mark.
+  CHECK(ring.highWaterMark() == 200);
+  readAll(ring);
+  CHECK(ring.push(data.data(), data.size()));
+  CHECK(ring.push(data.data(), data.size()));
+  CHECK(ring.push(data.data(), 50));
+  ring.peek(&view);
+  CHECK(ring.highWaterMark() == 250);
+}
+
+TEST(ring_buffer, threads_see_every_byte_in_order) {
+  constexpr size_t TOTAL = 4 << 20;
+  constexpr size_t CHUNK = 333;
+  SpscRingBuffer ring(4096);
+  std::thread producer([&] {
+    std::vector<uint8_t> chunk(CHUNK);
+    for (size_t sent = 0; sent < TOTAL;) {
+      size_t size = std::min(CHUNK, TOTAL - sent);
+      for (size_t i = 0; i < size; ++i)
+        chunk[i] = static_cast<uint8_t>((sent + i) * 7);
+      if (ring.push(chunk.data(), size))
+        sent += size;
+      else
+        std::this_thread::yield();
+    }
+  });
+  size_t received = 0;
+  size_t mismatches = 0;
+  while (received < TOTAL) {
+    const uint8_t *data;
+    size_t size = ring.peek(&data);
+    if (size == 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < size; ++i)
+      mismatches += data[i] != static_cast<uint8_t>((received + i) * 7);
+    ring.consume(size);
+    received += size;
+  }
+  producer.join();
+  CHECK(mismatches == 0);
+  CHECK(ring.highWaterMark() <= ring.capacity());
+}
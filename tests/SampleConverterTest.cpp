@@ -0,0 +1,48 @@
+#include "SampleConverter.h"
+#include "Test.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Call sizes that leave the dither phase anywhere, as a 44.1 kHz device
+// delivering 441-frame stereo packets does.
+static const size_t ODD_CALLS[] = {882, 1, 17, 883, 5, 31, 15, 1023};
+
+static std::vector<float> noise(size_t samples) {
+  std::vector<float> input(samples);
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-1.1f, 1.1f);
+  for (float &sample : input)
+    sample = dist(rng);
+  return input;
+}
+
+TEST(sample_converter, odd_sized_dithered_calls_match_scalar) {
+  size_t total = 0;
+  for (size_t size : ODD_CALLS)
+    total += size;
+  total *= 4;
+  std::vector<float> input = noise(total);
+  const SampleFormat formats[] = {SampleFormat::Int16, SampleFormat::Int24,
+                                  SampleFormat::Int32};
+  SimdLevel best = SampleConverter::detectSimdLevel();
+
+  for (SampleFormat format : formats) {
+    std::vector<uint8_t> reference(total * 4);
+    SampleConverter(format, true, SimdLevel::Scalar)
+        .convert(input.data(), total, reference.data());
+    for (int level = 0; level <= static_cast<int>(best); ++level) {
+      SampleConverter converter(format, true, static_cast<SimdLevel>(level));
+      std::vector<uint8_t> output(total * 4);
+      size_t done = 0;
+      size_t bytes = 0;
+      for (size_t call = 0; done < total; ++call) {
+        size_t size = ODD_CALLS[call % (sizeof(ODD_CALLS) / sizeof(size_t))];
+        bytes += converter.convert(input.data() + done, size,
+                                   output.data() + bytes);
+        done += size;
+      }
+      CHECK(memcmp(reference.data(), output.data(), bytes) == 0);
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#include "StreamSink.h"
+#include "Test.h"
+#include <filesystem>
+#include <vector>
+
+#ifdef PLATFORM_LINUX
+
+namespace {
+
+// Notes how each block arrived.
+class TimeRecordingSink : public AudioSink {
+public:
+  bool initialize() override { return true; }
+  void write(const uint8_t *, uint32_t size) override {
+    times.push_back(BlockTimestamp());
+    sizes.push_back(size);
+  }
+  void writeTimed(const uint8_t *, uint32_t size,
+                  const BlockTimestamp &time) override {
+    times.push_back(time);
+    sizes.push_back(size);
+  }
+  bool finalize() override { return true; }
+
+  std::vector<BlockTimestamp> times;
+  std::vector<uint32_t> sizes;
+};
+
+} // namespace
+
+TEST(stream_sink, timed_blocks_reach_inner_sink_with_timestamp) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "stream_sink_test.fifo")
+          .string();
+  std::filesystem::remove(path);
+  auto *inner = new TimeRecordingSink;
+  // No reader on the FIFO: the stream discards, the inner sink still gets
+  // everything.
+  StreamSink sink(path, 48000, 2, SampleFormat::Int16, StreamSinkOptions(),
+                  std::unique_ptr<AudioSink>(inner));
+  CHECK(sink.initialize());
+
+  const uint8_t packet[16] = {};
+  BlockTimestamp time;
+  time.position = 4800;
+  time.hostTimeNs = 123456789;
+  sink.writeTimed(packet, sizeof(packet), time);
+  sink.write(packet, sizeof(packet));
+
+  CHECK(inner->times.size() == 2);
+  CHECK(inner->times.size() == 2 && inner->times[0].valid() &&
+        inner->times[0].position == 4800 &&
+        inner->times[0].hostTimeNs == 123456789);
+  CHECK(inner->times.size() == 2 && !inner->times[1].valid());
+  CHECK(inner->sizes.size() == 2 && inner->sizes[0] == 16);
+  CHECK(sink.finalize());
+  std::filesystem::remove(path);
+}
+
+#endif
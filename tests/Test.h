@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Minimal self-registering test harness: TEST(suite, name) defines a case,
+// CHECK() records a failure and carries on. audio-capture-tests runs every
+// case, or the cases of the suites named on its command line.
+struct TestCase {
+    const char* suite;
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& testCases();
+void testFailed(const char* file, int line, const char* expression);
+
+struct TestRegistrar {
+    TestRegistrar(const char* suite, const char* name, void (*run)()) { testCases().push_back({suite, name, run}); }
+};
+
+#define TEST(suite, name)                                                        \
+    static void suite##_##name();                                                \
+    static TestRegistrar suite##_##name##_registrar(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(expression)                                      \
+    do {                                                       \
+        if (!(expression)) {                                   \
+            testFailed(__FILE__, __LINE__, #expression);       \
+        }                                                      \
+    } while (0)
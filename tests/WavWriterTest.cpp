@@ -0,0 +1,132 @@
+#include "Test.h"
+#include "WavReader.h"
+#include "WavWriter.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+// Three mono 24-bit frames: a 9-byte data chunk, odd for RIFF and not a
+// multiple of 8 for Wave64.
+static const uint8_t FRAMES[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+
+static std::vector<uint8_t> writeOddFile(const std::string &path,
+                                         WavContainer container,
+                                         WavWriteMode mode) {
+  WavWriterOptions options;
+  options.container = container;
+  options.mode = mode;
+  WavWriter writer(path, 48000, 1, SampleFormat::Int24, options);
+  CHECK(writer.initialize());
+  writer.write(FRAMES, sizeof(FRAMES));
+  CHECK(writer.finalize());
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+static uint64_t readLe(const uint8_t *p, int bytes) {
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; --i)
+    value = value << 8 | p[i];
+  return value;
+}
+
+static const WavWriteMode MODES[] = {WavWriteMode::Stdio, WavWriteMode::Batched,
+                                     WavWriteMode::Mapped};
+
+TEST(wav_writer, riff_pads_odd_data_chunk) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wav_writer_riff.wav").string();
+  for (WavWriteMode mode : MODES) {
+    std::vector<uint8_t> file =
+        writeOddFile(path, WavContainer::Rf64Auto, mode);
+    CHECK(file.size() % 2 == 0);
+    CHECK(file.size() >= 8 && readLe(file.data() + 4, 4) == file.size() - 8);
+    // The pad byte is zero and outside the data chunk.
+    CHECK(!file.empty() && file.back() == 0);
+    CHECK(file.size() > 10 &&
+          memcmp(file.data() + file.size() - 10, FRAMES, 9) == 0);
+
+    WavReader reader(path);
+    CHECK(reader.open());
+    CHECK(reader.dataSize() == 9);
+    CHECK(reader.frames() == 3);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(wav_writer, wave64_pads_data_chunk_to_8_bytes) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wav_writer_w64.w64").string();
+  for (WavWriteMode mode : MODES) {
+    std::vector<uint8_t> file = writeOddFile(path, WavContainer::Wave64, mode);
+    CHECK(file.size() % 8 == 0);
+    CHECK(file.size() >= 24 && readLe(file.data() + 16, 8) == file.size());
+    // The data chunk's own size still covers just the samples.
+    CHECK(file.size() >= 40 &&
+          readLe(file.data() + file.size() - 16 - 8, 8) == 24 + 9);
+    CHECK(file.size() > 16 &&
+          memcmp(file.data() + file.size() - 16, FRAMES, 9) == 0);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(wav_writer, promotes_to_rf64_past_threshold) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "wav_writer_rf64.wav").string();
+  // 1000 stereo int16 frames: 4000 data bytes, past a 1000-byte threshold.
+  std::vector<uint8_t> samples(4000);
+  for (size_t i = 0; i < samples.size(); ++i)
+    samples[i] = static_cast<uint8_t>(i * 7);
+  for (WavWriteMode mode : MODES) {
+    WavWriterOptions options;
+    options.mode = mode;
+    options.rf64Threshold = 1000;
+    WavWriter writer(path, 48000, 2, SampleFormat::Int16, options);
+    CHECK(writer.initialize());
+    writer.write(samples.data(), 2000);
+    writer.write(samples.data() + 2000, 2000);
+    CHECK(writer.finalize());
+    CHECK(writer.isRf64());
+
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), {});
+    CHECK(file.size() > 48);
+    if (file.size() <= 48)
+      continue;
+    CHECK(memcmp(file.data(), "RF64", 4) == 0);
+    CHECK(readLe(file.data() + 4, 4) == 0xFFFFFFFF);
+    CHECK(memcmp(file.data() + 8, "WAVE", 4) == 0);
+    // The JUNK chunk became ds64: riff size, data size, sample count.
+    CHECK(memcmp(file.data() + 12, "ds64", 4) == 0);
+    CHECK(readLe(file.data() + 16, 4) == 28);
+    CHECK(readLe(file.data() + 20, 8) == file.size() - 8);
+    CHECK(readLe(file.data() + 28, 8) == 4000);
+    CHECK(readLe(file.data() + 36, 8) == 1000);
+    // The data chunk's 32-bit size defers to ds64; the samples follow it.
+    const size_t data = file.size() - 4000 - 8;
+    CHECK(memcmp(file.data() + data, "data", 4) == 0);
+    CHECK(readLe(file.data() + data + 4, 4) == 0xFFFFFFFF);
+    CHECK(memcmp(file.data() + data + 8, samples.data(), 4000) == 0);
+
+    WavReader reader(path);
+    CHECK(reader.open());
+    CHECK(reader.dataSize() == 4000);
+    CHECK(reader.frames() == 1000);
+  }
+
+  // Under the threshold the file stays RIFF with its JUNK placeholder.
+  WavWriterOptions options;
+  options.rf64Threshold = 1000;
+  WavWriter writer(path, 48000, 2, SampleFormat::Int16, options);
+  CHECK(writer.initialize());
+  writer.write(samples.data(), 400);
+  CHECK(writer.finalize());
+  CHECK(!writer.isRf64());
+  std::ifstream in(path, std::ios::binary);
+  std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), {});
+  CHECK(file.size() > 16 && memcmp(file.data(), "RIFF", 4) == 0 &&
+        memcmp(file.data() + 12, "JUNK", 4) == 0);
+  std::filesystem::remove(path);
+}
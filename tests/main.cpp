@@ -0,0 +1,42 @@
+#include "Test.h"
+#include "Logger.h"
+#include <cstring>
+#include <iostream>
+
+static int g_failures = 0;
+
+std::vector<TestCase>& testCases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+void testFailed(const char* file, int line, const char* expression) {
+    ++g_failures;
+    std::cerr << file << ":" << line << ": CHECK(" << expression << ") failed" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // Warnings from the code under test go to stderr with the results.
+    Logger::instance().setOutput(stderr, stderr);
+
+    int run = 0;
+    int failedCases = 0;
+    for (const TestCase& test : testCases()) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            selected = selected || strcmp(argv[i], test.suite) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        int before = g_failures;
+        test.run();
+        Logger::instance().flush();
+        ++run;
+        bool passed = g_failures == before;
+        failedCases += passed ? 0 : 1;
+        std::cerr << (passed ? "[ OK ] " : "[FAIL] ") << test.suite << "." << test.name << std::endl;
+    }
+    std::cerr << run << " tests, " << failedCases << " failed" << std::endl;
+    return run == 0 || failedCases > 0 ? 1 : 0;
+}